@@ -0,0 +1,67 @@
+/**
+ *  Copyright Notice:
+ *  Copyright 2024 Intel. All rights reserved.
+ *  License: BSD 3-Clause License.
+ **/
+
+#ifndef __DEVICE_EMU_H__
+#define __DEVICE_EMU_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "ide_test.h"
+#include "helperlib.h"
+
+// Software emulation of the devices under test.
+//
+// The emulator models the configuration space of root ports, switch ports
+// and endpoints with the PCIe, IDE and DOE capabilities, a DOE mailbox on
+// the endpoints, the KCBAR region of the root ports and the KEYP table.
+// It is installed as the device backend (see set_device_backend) so that
+// the validator can run and be benchmarked without TEE-IO hardware.
+
+#define DEVICE_EMU_MAX_DEVICE_NUM   32
+#define DEVICE_EMU_SEL_IDE_STREAM_NUM  4
+// base address of the emulated KCBAR of the root ports
+#define DEVICE_EMU_KCBAR_BASE   0xfe000000ULL
+#define DEVICE_EMU_KCBAR_SIZE   0x1000
+
+/**
+ * Answer a DOE data object of the device.
+ * request and response include the DOE header.
+ * Return false if the device does not support the data object. DOE Error is set then.
+ */
+typedef bool (*device_emu_doe_responder_func)(
+  const char *bdf,
+  const uint8_t *request, size_t request_size,
+  uint8_t *response, size_t *response_size);
+
+/**
+ * Initialize the emulator.
+ * latency_us is the response time of the DOE mailbox.
+ */
+bool device_emu_init(uint32_t latency_us);
+void device_emu_close();
+
+/**
+ * Add a device. secondary_bus is the bus number below a root port or a switch port.
+ */
+bool device_emu_add_device(const char *bdf, IDE_PORT_TYPE port_type, uint8_t secondary_bus);
+
+/**
+ * Add the devices of a topology. The bus numbers are assigned in the same way
+ * as scan_devices_at_bus assumes: the secondary bus of a port is the bus of the next device.
+ */
+bool device_emu_add_topology(IDE_TEST_CONFIG *test_config, IDE_TEST_TOPOLOGY *top);
+
+/**
+ * Register the responder of the data objects other than DOE Discovery,
+ * e.g. a libspdm responder answering SPDM/IDE_KM/TDISP messages.
+ * None is registered by the validator. SPDM is advertised in DOE Discovery only once there is one.
+ */
+void device_emu_register_doe_responder(device_emu_doe_responder_func responder);
+
+const teeio_device_backend_t *device_emu_get_backend();
+
+#endif
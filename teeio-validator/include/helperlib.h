@@ -8,6 +8,7 @@
 #define __HELPER_LIB_H__
 
 #include <stdint.h>
+#include <sys/types.h>
 #include "pcie.h"
 #include "intel_keyp.h"
 #include "ide_test.h"
@@ -16,10 +17,54 @@
 // Define the macro to get the offset of a field in a struct
 #define OFFSET_OF(type, field) ((size_t) &(((type *)0)->field))
 
+#define PCIE_CAP_INDEX_CAP_ID_NUM     0x100
+#define PCIE_CAP_INDEX_EXT_CAP_ID_NUM 0x40
+#define PCIE_CAP_INDEX_MAX_DOE_NUM    32
+#define PCIE_CAP_INDEX_MAX_DVSEC_NUM  32
+
+typedef struct {
+  uint16_t offset;
+  uint16_t vendor_id;
+  uint16_t dvsec_id;
+} PCIE_DVSEC_INDEX;
+
+// Capability index of a device built from one snapshot of its configuration space.
+// Offset 0 means the capability is not present.
+typedef struct {
+  bool valid;
+  uint8_t cap_offset[PCIE_CAP_INDEX_CAP_ID_NUM];
+  // offset of the first instance of each extended capability
+  uint16_t ext_cap_offset[PCIE_CAP_INDEX_EXT_CAP_ID_NUM];
+  uint16_t doe_offset[PCIE_CAP_INDEX_MAX_DOE_NUM];
+  int doe_cnt;
+  PCIE_DVSEC_INDEX dvsec[PCIE_CAP_INDEX_MAX_DVSEC_NUM];
+  int dvsec_cnt;
+} PCIE_CAP_INDEX;
+
 void libspdm_sleep(uint64_t microseconds);
 
+// get the monotonic time in nanoseconds
+uint64_t get_monotonic_time_ns();
+
 bool is_power_of_two(uint8_t x);
 
+// Device backend. Configuration space, MMIO and ACPI table accesses go through it.
+typedef struct {
+  const char *name;
+  // return the fd of the configuration space or -1. The fd is closed by close_config_space()
+  int (*open_config_space)(const char *bdf);
+  void (*close_config_space)(int fd);
+  ssize_t (*config_read)(int fd, void *buffer, size_t size, uint32_t offset);
+  ssize_t (*config_write)(int fd, const void *buffer, size_t size, uint32_t offset);
+  uint8_t* (*map_mmio)(uint64_t addr, size_t size, int *mapped_fd);
+  void (*unmap_mmio)(int mapped_fd, uint8_t *mapped_addr, size_t size);
+  // return the size of the table or -1
+  int (*read_acpi_table)(const char *signature, uint8_t *buffer, uint32_t size);
+} teeio_device_backend_t;
+
+void set_device_backend(const teeio_device_backend_t *backend);
+const teeio_device_backend_t *get_device_backend();
+
 // PCIE & MMIO helper APIs
 uint32_t device_pci_read_32 (uint32_t offset, int fp);
 void device_pci_write_32 (uint32_t offset, uint32_t data, int fp);
@@ -27,6 +72,8 @@ void device_pci_write_32 (uint32_t offset, uint32_t data, int fp);
 uint16_t device_pci_read_16 (uint32_t offset, int fp);
 void device_pci_write_16 (uint32_t offset, uint16_t data, int fp);
 
+bool device_pci_read_block (uint32_t offset, void *buffer, uint32_t size, int fp);
+
 void mmio_write_reg32(void *const reg_ptr, const uint32_t reg_val);
 uint32_t mmio_read_reg32(void *reg_ptr);
 
@@ -77,6 +124,59 @@ void dump_hex_array(uint8_t* data, int size);
 bool set_deivce_info(int fp, char* device_name);
 bool unset_device_info(int fd);
 
+// pci register trace. records are rendered into the log by pci_trace_dump after the run.
+#define PCI_TRACE_DEFAULT_CAPACITY  (1 << 20)
+#define PCI_TRACE_MAX_DEVICE_NUM    64
+#define PCI_TRACE_INVALID_DEVICE_ID 0xFFFF
+
+typedef enum {
+  PCI_TRACE_READ32 = 0,
+  PCI_TRACE_WRITE32,
+  PCI_TRACE_READ16,
+  PCI_TRACE_WRITE16,
+  PCI_TRACE_DIRECTION_NUM
+} PCI_TRACE_DIRECTION;
+
+bool pci_trace_init(uint32_t capacity);
+void pci_trace_close();
+uint16_t pci_trace_register_device(const char* device_name);
+void pci_trace_record(uint16_t device_id, int fd, uint32_t offset, uint32_t value, PCI_TRACE_DIRECTION direction);
+void pci_trace_dump();
+
+// KeyRefresh benchmark. Refreshes are paced at a fixed interval and the latency
+// of each phase of every refresh is reported by keyrefresh_bench_report.
+typedef enum {
+  KEYREFRESH_PHASE_KEY_GEN = 0,   // key/iv generation, including CXL GET_KEY
+  KEYREFRESH_PHASE_KEY_PROG,      // KEY_PROG/KP_ACK round trips
+  KEYREFRESH_PHASE_RP_KEY_PROG,   // root port key/iv writes, prime and key set select
+  KEYREFRESH_PHASE_K_SET_GO,      // K_SET_GO/K_GOSTOP_ACK round trips
+  KEYREFRESH_PHASE_TOTAL,         // the whole refresh until the stream is secure again
+  KEYREFRESH_PHASE_NUM
+} KEYREFRESH_PHASE;
+
+typedef struct {
+  uint64_t *samples;      // KEYREFRESH_PHASE_NUM rows of capacity samples
+  int cnt;
+  int capacity;
+  uint64_t interval_ns;
+  uint64_t start_ns;
+  uint64_t next_ns;       // scheduled start of the next refresh
+} keyrefresh_bench_t;
+
+bool keyrefresh_bench_init(keyrefresh_bench_t *bench, int rounds, int interval_us);
+void keyrefresh_bench_wait(keyrefresh_bench_t *bench);
+void keyrefresh_bench_add(keyrefresh_bench_t *bench, const uint64_t phase_ns[KEYREFRESH_PHASE_NUM]);
+void keyrefresh_bench_report(keyrefresh_bench_t *bench, const char *name);
+void keyrefresh_bench_free(keyrefresh_bench_t *bench);
+
+// capability index of the device opened by open_configuration_space
+bool build_pcie_cap_index(int fd, PCIE_CAP_INDEX *index);
+PCIE_CAP_INDEX *get_device_cap_index(int fd);
+// the index shall be invalidated after the device is reset or its link is retrained
+void invalidate_device_cap_index(int fd);
+// invalidate the index of all the devices, e.g. when the device backend is switched
+void invalidate_all_device_cap_index();
+
 TEST_IDE_TYPE map_top_type_to_ide_type(IDE_TEST_TOPOLOGY_TYPE top_type);
 
 // file related helper APIs
@@ -86,11 +186,26 @@ bool validate_file_name(const char *file_name);
 bool get_uint32_array_from_string(uint32_t* array, uint32_t* array_size, const char* string);
 // get the max value from uint32_t array
 uint32_t get_max_from_uint32_array(uint32_t* array, uint32_t size);
+// sort uint64_t array in ascending order
+void sort_uint64_array(uint64_t* array, int size);
+// nearest-rank percentile of the sorted uint64_t array
+uint64_t get_percentile_of_sorted_uint64_array(const uint64_t* array, int size, int percentile);
 
 // dump key/iv stored in IDE-KM KEY_PROG message.
 // Refer to PCIe Spec 6.1 Figure 6-57
 void dump_key_iv_in_key_prog(const uint32_t *key, int key_dw_size, const uint32_t *iv, int iv_dw_size);
 
+// result store of a test suite. Its memory is freed at once by teeio_result_store_free.
+teeio_result_store_t *teeio_result_store_create();
+void teeio_result_store_free(teeio_result_store_t *store);
+void *teeio_result_store_alloc(teeio_result_store_t *store, size_t size);
+
+/**
+ * Render the message of an assertion into buffer.
+ * Return the length of the message as snprintf does.
+ */
+int teeio_render_assertion_message(const ide_run_test_case_assertion_result_t *assertion_result, char *buffer, size_t size);
+
 bool teeio_record_assertion_result(
   int case_class,
   int case_id,
@@ -121,4 +236,38 @@ bool teeio_record_group_result(
   const char *message_format,
   ...  );
 
+/**
+ * Result sink.
+ *
+ * When a sink is installed the results are streamed to it as they are recorded
+ * and the assertions are not kept in memory. config_result, group_result and
+ * case_result give the position of a record in the result tree.
+ */
+typedef struct {
+  const char *name;
+  void (*record_assertion)(const ide_run_test_config_result_t *config_result,
+                           const ide_run_test_group_result_t *group_result,
+                           const ide_run_test_case_result_t *case_result,
+                           int assertion_id, ide_common_test_case_assertion_type_t assertion_type,
+                           teeio_test_result_t result, const char *message);
+  void (*record_group)(const ide_run_test_config_result_t *config_result,
+                       const ide_run_test_group_result_t *group_result,
+                       teeio_test_group_func_t func, teeio_test_result_t result, const char *message);
+  void (*record_config_item)(const ide_run_test_config_result_t *config_result,
+                             const ide_run_test_group_result_t *group_result,
+                             const ide_run_test_case_result_t *case_result,
+                             int config_item_id, teeio_test_config_func_t func, teeio_test_result_t result);
+  // the case is done. Its totals and timing are final.
+  void (*record_case)(const ide_run_test_config_result_t *config_result,
+                      const ide_run_test_group_result_t *group_result,
+                      const ide_run_test_case_result_t *case_result);
+  void (*close)();
+} teeio_result_sink_t;
+
+void set_result_sink(const teeio_result_sink_t *sink);
+const teeio_result_sink_t *get_result_sink();
+
+// JSON-Lines sink. The file is synced to disk every checkpoint_interval records.
+const teeio_result_sink_t *jsonl_result_sink_open(const char *result_file, uint32_t checkpoint_interval);
+
 #endif
@@ -36,10 +36,17 @@
 #define MAX_TOPOLOGY_NUM 16
 #define MAX_CONFIGURATION_NUM 32
 #define MAX_TEST_SUITE_NUM 32
+#define MAX_PARALLEL_TOPOLOGY_NUM 16
+// root/upper/lower port, the switches in sw_conn1/sw_conn2 and the KCBARs of the root port
+#define MAX_TOPOLOGY_RESOURCE_NUM 32
 #define MAX_NAME_LENGTH 128
 #define MAX_CASE_NAME_LENGTH  32
 #define MAX_LINE_LENGTH 512
 
+// State of the devices under test and of the running test case is kept per thread,
+// because independent topologies may be tested in parallel (see parallel_topology).
+#define TEEIO_THREAD_LOCAL __thread
+
 #define MAX_SECTION_NAME_LENGTH 32
 #define MAX_ENTRY_NAME_LENGTH 32
 #define MAX_ENTRY_STRING_LENGTH 128
@@ -141,6 +148,9 @@ typedef struct
   uint8_t device;
   uint8_t function;
   uint8_t port_index;
+  // ceiling of DOE busy-spin window and polling interval in us. 0 means default.
+  uint32_t doe_spin_max_us;
+  uint32_t doe_backoff_max_us;
 } IDE_PORT;
 
 typedef struct
@@ -170,6 +180,15 @@ struct _IDE_SWITCH_INTERNAL_CONNECTION {
   int dps_port;
 };
 
+typedef enum {
+  PCAP_FILE_FORMAT_PCAPNG = 0,
+  PCAP_FILE_FORMAT_PCAP,
+  PCAP_FILE_FORMAT_NUM
+} PCAP_FILE_FORMAT;
+
+// records between two checkpoints of the result stream
+#define RESULT_STREAM_DEFAULT_CHECKPOINT 1000
+
 typedef struct
 {
   bool pci_log;
@@ -178,6 +197,18 @@ typedef struct
   bool doe_log;
   bool wo_tdisp;
   bool pcap_enable;
+  PCAP_FILE_FORMAT pcap_format;
+  bool doe_irq;
+  bool spdm_fresh_session;
+  bool spdm_probe_empty_slots;
+  uint32_t parallel_topology;
+  // run against the device emulator instead of the hardware
+  bool emulator;
+  uint32_t emulator_latency_us;
+  bool kcbar_verify;
+  // stream the results to RESULTFILE. It is synced every result_checkpoint records.
+  bool result_stream;
+  uint32_t result_checkpoint;
 } IDE_TEST_MAIN_CONFIG;
 
 typedef struct {
@@ -314,6 +345,8 @@ typedef struct {
   int cfg_space_fd;
   uint32_t ecap_offset;
   uint32_t doe_offset;
+  // DOE mailbox at doe_offset. See pci_doe_context_open.
+  void *doe_context;
   PCIE_IDE_CAP ide_cap;
 
   // kcbar related data
@@ -352,6 +385,17 @@ typedef enum {
   IDE_COMMON_TEST_CASE_ASSERTION_TYPE_SEPARATOR
 } ide_common_test_case_assertion_type_t;
 
+// results of a test suite are allocated from its result store (see helperlib.h)
+typedef struct _teeio_result_store_t teeio_result_store_t;
+typedef struct _teeio_message_format_t teeio_message_format_t;
+
+typedef union {
+  int64_t i64;
+  double d;
+  const char *str;
+  const void *ptr;
+} teeio_message_arg_t;
+
 typedef struct _ide_run_test_case_assertion_result_t ide_run_test_case_assertion_result_t;
 struct _ide_run_test_case_assertion_result_t{
   ide_run_test_case_assertion_result_t* next;
@@ -363,7 +407,11 @@ struct _ide_run_test_case_assertion_result_t{
   int assertion_id;
 
   teeio_test_result_t result;
-  char extra_data[MAX_LINE_LENGTH];
+
+  // The message is rendered from the format and the packed arguments
+  // by teeio_render_assertion_message. NULL if there is no message.
+  const teeio_message_format_t *message_format;
+  teeio_message_arg_t args[];
 };
 
 typedef enum {
@@ -374,6 +422,18 @@ typedef enum {
   TEEIO_TEST_CONFIG_FUNC_MAX
 } teeio_test_config_func_t;
 
+// phases of a test case. Their time is kept in ide_run_test_case_result_t.
+typedef enum {
+  TEEIO_TEST_CASE_PHASE_CONFIG_SUPPORT = 0,
+  TEEIO_TEST_CASE_PHASE_CONFIG_ENABLE,
+  TEEIO_TEST_CASE_PHASE_SETUP,
+  TEEIO_TEST_CASE_PHASE_RUN,
+  TEEIO_TEST_CASE_PHASE_CONFIG_CHECK,
+  TEEIO_TEST_CASE_PHASE_TEARDOWN,
+  TEEIO_TEST_CASE_PHASE_CONFIG_DISABLE,
+  TEEIO_TEST_CASE_PHASE_MAX
+} teeio_test_case_phase_t;
+
 typedef struct _ide_run_test_config_item_result_t ide_run_test_config_item_result_t;
 struct _ide_run_test_config_item_result_t {
   ide_run_test_config_item_result_t* next;
@@ -395,12 +455,19 @@ struct _ide_run_test_case_result_t {
   int total_passed;
   int total_failed;
 
+  // monotonic time spent in each phase. 0 if the phase is not run.
+  uint64_t phase_ns[TEEIO_TEST_CASE_PHASE_MAX];
+  uint64_t total_ns;
+
   ide_run_test_config_item_result_t *config_item_result;
+  ide_run_test_config_item_result_t *config_item_result_tail;
   ide_run_test_case_assertion_result_t *assertion_result;
+  ide_run_test_case_assertion_result_t *assertion_result_tail;
 };
 
 typedef struct {
   teeio_test_result_t result;
+  uint64_t elapsed_ns;
   char extra_data[MAX_LINE_LENGTH];
 } teeio_test_group_func_result_t;
 
@@ -420,8 +487,10 @@ struct _ide_run_test_group_result_t {
   int total_failed;
 
   teeio_test_group_func_result_t func_results[TEEIO_TEST_GROUP_FUNC_MAX];
+  uint64_t total_ns;
 
   ide_run_test_case_result_t* case_result;
+  ide_run_test_case_result_t* case_result_tail;
 };
 
 typedef struct _ide_run_test_config_result_t ide_run_test_config_result_t;
@@ -429,13 +498,33 @@ struct _ide_run_test_config_result_t {
   ide_run_test_config_result_t* next;
   char name[MAX_NAME_LENGTH];
   int config_id;
+  // name of the test suite which runs the config
+  const char *suite_name;
 
   int total_passed;
   int total_failed;
 
+  // time spent in the config callbacks, summed over the test cases
+  uint64_t func_ns[TEEIO_TEST_CONFIG_FUNC_MAX];
+  uint64_t total_ns;
+
   ide_run_test_group_result_t* group_result;
+  ide_run_test_group_result_t* group_result_tail;
 };
 
+// close the ports held by the group context of the topology and free it
+typedef void(*teeio_common_test_topology_close_func_t) (void *group_context);
+
+// The ports of a topology are opened once per suite. The first test group
+// scans the devices, opens the ports and keeps a copy of its group context
+// here. The following groups borrow the ports from the copy and only reset
+// them to a clean state in their teardown. The ports are closed when the
+// suite is done.
+typedef struct {
+  void *group_context;
+  teeio_common_test_topology_close_func_t close_func;
+} teeio_common_test_topology_context_t;
+
 typedef struct {
   uint32_t signature;
   IDE_TEST_CONFIG *test_config;
@@ -443,6 +532,11 @@ typedef struct {
   TEEIO_TEST_CATEGORY test_category;
 
   ide_run_test_config_result_t* result;
+  ide_run_test_config_result_t* result_tail;
+  // the results are allocated from it
+  teeio_result_store_t *result_store;
+  // ports shared by the test groups of the suite
+  teeio_common_test_topology_context_t topology;
 
 } ide_common_test_suite_context_t;
 
@@ -568,6 +662,10 @@ struct _ide_run_test_case {
   void *test_context;
   // indicates if the config_check is required in the test case
   bool config_check_required;
+  // the case does not change the state applied by the config enable function.
+  // The config is kept enabled for the next case in the group if the case passed
+  // its setup. If config_check_required is set too, the check shall pass as well.
+  bool config_readonly;
 
   ide_common_test_case_run_func_t run_func;
   ide_common_test_case_setup_func_t setup_func;
@@ -588,6 +686,7 @@ typedef struct {
   ide_common_test_case_run_func_t run;
   ide_common_test_case_teardown_func_t teardown;
   bool config_check_required;
+  bool config_readonly;
 } ide_test_case_funcs_t;
 
 typedef struct {
@@ -644,6 +743,9 @@ struct _ide_run_test_suite {
   ide_run_test_suite_t *next;
   char name[MAX_NAME_LENGTH];
   void *test_context;
+  IDE_TEST_TOPOLOGY *topology;
+  // suites in the same lane share hardware and are run sequentially
+  int lane;
 
   ide_run_test_group_t *test_group;
   ide_run_test_config_t *test_config;
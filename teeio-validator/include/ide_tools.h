@@ -15,6 +15,12 @@
 #define LS_IDE_NAME "lside"
 #define LS_IDE_VERSION "0.2.0"
 
+#define DOE_BENCH_NAME "doebench"
+#define DOE_BENCH_VERSION "0.1.0"
+
+#define RESULT_SUM_NAME "resultsum"
+#define RESULT_SUM_VERSION "0.1.0"
+
 #define NUM_SEL_IDE_ISSUE
 
 typedef enum
@@ -20,6 +20,11 @@
 */
 int open_configuration_space(char *bdf);
 
+/**
+ * close PCIE's configuration space opened by open_configuration_space
+*/
+void close_configuration_space(int fd);
+
 /**
  * get offset of cap in cap list
 */
@@ -82,6 +87,16 @@ bool open_dev_port(ide_common_test_port_context_t *port_context);
  */
 bool close_dev_port(ide_common_test_port_context_t *port_context, IDE_TEST_TOPOLOGY_TYPE top_type);
 
+/*
+ * Open DOE context of device port
+ */
+bool init_pci_doe(ide_common_test_port_context_t *port_context);
+
+/*
+ * Close DOE context of device port
+ */
+void close_pci_doe(ide_common_test_port_context_t *port_context);
+
 /*
  * set pcrc_en in ecap
  */
@@ -178,6 +193,11 @@ get_stream_cfg_reg_block(
     INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr,
     const uint16_t rp_stream_index);
 
+/**
+ * find the KCBAR address of a root port in KEYP table. 0 if it is not found.
+*/
+uint64_t find_keyp_kcbar_addr(uint16_t segment, uint8_t bus, uint8_t device, uint8_t function, INTEL_KEYP_PROTOCOL_TYPE keyp_protocol);
+
 /**
  * parse KEYP table
 */
@@ -8,6 +8,7 @@
 #define __IDE_LOG_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 
 typedef enum {
   TEEIO_DEBUG_ERROR = 0,
@@ -17,8 +18,17 @@ typedef enum {
   TEEIO_DEBUG_NUM
 } TEEIO_DEBUG_LEVEL;
 
+extern TEEIO_DEBUG_LEVEL g_debug_level;
+
 void teeio_debug_print(int debug_level, const char *format, ...);
 void teeio_print(const char *format, ...);
+
+// asynchronous logger. Log lines are written synchronously until teeio_log_init.
+bool teeio_log_init();
+void teeio_log_flush();
+void teeio_log_close();
+void teeio_log_write(const char *text);
+void teeio_log_set_tag(const char *tag);
 void teeio_assert(const char *file_name, int line_number,
                                  const char *description);
 
@@ -43,9 +53,12 @@ const char* get_ide_log_level_string(TEEIO_DEBUG_LEVEL debug_level);
         TEEIO_DEBUG_INTERNAL(expression); \
     } while (false)
 
+// the level is checked before the arguments are evaluated and formatted
 #define TEEIO_DEBUG_PRINT_INTERNAL(debug_level, ...) \
     do { \
-        teeio_debug_print(debug_level, ## __VA_ARGS__); \
+        if ((debug_level) <= g_debug_level) { \
+            teeio_debug_print(debug_level, ## __VA_ARGS__); \
+        } \
     } while (false)
 
 #define TEEIO_DEBUG_INTERNAL(expression) TEEIO_DEBUG_PRINT_INTERNAL expression
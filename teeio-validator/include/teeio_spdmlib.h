@@ -9,25 +9,98 @@
 
 // spdmlib header file
 
+// transfer statistics of a doe context
+typedef struct {
+    uint64_t requests;
+    uint64_t responses;
+    uint64_t request_bytes;
+    uint64_t response_bytes;
+    uint64_t errors;
+    uint64_t timeouts;
+    uint64_t aborts;
+} pci_doe_statistics_t;
+
+/**
+ * allocate doe context of the device
+*/
+void *pci_doe_context_open(const char *bdf, int fd, uint32_t spin_max_us, uint32_t backoff_max_us);
+
+/**
+ * free doe context
+*/
+void pci_doe_context_close(void *doe_context);
+
+/**
+ * fork a doe context which shares the mailboxes of doe_context.
+ * The forked context prefers another mailbox of the same protocol if there is one.
+ * SPDM and Secured SPDM stay on their mailbox if doe_context has a live spdm session.
+*/
+void *pci_doe_context_fork(void *doe_context);
+
+/**
+ * select doe mailbox of the doe context
+*/
+void pci_doe_context_set_mailbox(void *doe_context, uint32_t doe_offset);
+
 /**
  * initialize pcie doe
 */
-bool pcie_doe_init_request(uint8_t doe_discovery_version);
+bool pcie_doe_init_request(void *doe_context, uint8_t doe_discovery_version);
+
+/**
+ * check the protocols required by teeio-validator are supported by the discovered mailboxes
+*/
+bool pci_doe_check_protocols(void *doe_context);
+
+/**
+ * get the offset of doe mailbox which the protocol is routed to. 0 if it is not supported.
+*/
+uint32_t pci_doe_context_get_mailbox(void *doe_context, uint16_t vendor_id, uint8_t data_object_type);
+
+/**
+ * get the transfer statistics of the doe context
+*/
+void pci_doe_context_get_statistics(void *doe_context, pci_doe_statistics_t *statistics);
 
 /**
  * trigger doe abort
 */
-void trigger_doe_abort();
+void trigger_doe_abort(void *doe_context);
 
 /**
  * check if doe error is asserted
 */
-bool is_doe_error_asserted();
+bool is_doe_error_asserted(void *doe_context);
+
+/**
+ * enable doe interrupt of the device if it is supported
+*/
+bool pci_doe_enable_interrupt(void *doe_context);
+
+/**
+ * disable doe interrupt and fall back to polling
+*/
+void pci_doe_disable_interrupt(void *doe_context);
 
 /**
- * initialize spdm client
+ * bind doe context to spdm context
 */
-void *spdm_client_init(void);
+bool spdm_bind_doe_context(void *spdm_context, void *doe_context);
+
+/**
+ * count the spdm session set up or stopped through the doe context bound to spdm_context
+*/
+void spdm_track_doe_session(void *spdm_context, bool live);
+
+/**
+ * get the bdf of the device which spdm_context talks to
+*/
+const char *spdm_get_bdf(void *spdm_context);
+
+/**
+ * initialize spdm client which talks through doe_context
+*/
+void *spdm_client_init(void *doe_context);
 
 /**
  * setup spdm connection
@@ -39,6 +112,31 @@ bool spdm_connect (void *spdm_context, uint32_t *session_id);
 */
 bool spdm_stop(void *spdm_context, uint32_t session_id);
 
+/**
+ * acquire spdm session of the endpoint from the session pool
+*/
+bool spdm_session_acquire(const char *bdf, void *doe_context, void **spdm_context, uint32_t *session_id);
+
+/**
+ * set up the spdm session again if the first request in the reused session failed
+*/
+bool spdm_session_reacquire(const char *bdf, void *doe_context, void **spdm_context, uint32_t *session_id);
+
+/**
+ * release spdm session acquired from the session pool
+*/
+void spdm_session_release(void *spdm_context, uint32_t session_id);
+
+/**
+ * drop the pooled spdm session of the endpoint
+*/
+void spdm_session_pool_evict(const char *bdf, void *doe_context);
+
+/**
+ * free all the pooled spdm sessions
+*/
+void spdm_session_pool_close();
+
 libspdm_return_t device_doe_receive_message(
     void *spdm_context,
     size_t *response_size,
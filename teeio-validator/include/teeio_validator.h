@@ -28,5 +28,6 @@
 
 #define LOGFILE "./teeio_log"
 #define PCAPFILE "./teeio_pcap"
+#define RESULTFILE "./teeio_result"
 
 #endif
@@ -17,17 +17,14 @@
 #include "hal/library/debuglib.h"
 #include "teeio_debug.h"
 #include "ide_test.h"
+#include "teeio_spdmlib.h"
 #include "pcie_ide_lib.h"
 #include "cxl_ide_lib.h"
 #include "cxl_ide_internal.h"
 #include "library/cxl_ide_km_common_lib.h"
 
-extern uint32_t g_doe_extended_offset;
-extern uint32_t g_ide_extended_offset;
-extern uint32_t g_aer_extended_offset;
-extern int m_dev_fp;
-
-bool init_pci_doe(int fd);
+extern TEEIO_THREAD_LOCAL uint32_t g_ide_extended_offset;
+extern TEEIO_THREAD_LOCAL uint32_t g_aer_extended_offset;
 
 uint32_t m_pcie_bar_offset[] = {
   PCIE_BAR0_OFFSET,
@@ -125,40 +122,33 @@ bool cxl_init_root_port(cxl_ide_test_group_context_t *group_context)
   return true;
 }
 
-// walk thru configuration space to find out all CXL DVSEC
+// find out all CXL DVSEC in the capability index of the device
 bool cxl_find_dvsec_in_config_space(int fd, IDE_TEST_CXL_PCIE_DVSEC* dvsec, int* count)
 {
-  uint32_t walker = PCIE_EXT_CAP_START;
-  uint32_t cap_ext_header = 0;
   int dvsec_cnt = 0;
-  CXL_DVSEC_COMMON_HEADER header = {0};
+  PCIE_CAP_INDEX buffer;
+  PCIE_CAP_INDEX *index = get_device_cap_index(fd);
 
   TEEIO_ASSERT(dvsec != NULL);
   TEEIO_ASSERT(count != NULL);
 
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "cxl_find_dvsec_in_config_space\n"));
 
-  while (walker < PCIE_CONFIG_SPACE_SIZE && walker != 0)
+  if (index == NULL) {
+    build_pcie_cap_index(fd, &buffer);
+    index = &buffer;
+  }
+
+  for (int i = 0; i < index->dvsec_cnt; i++)
   {
-    cap_ext_header = device_pci_read_32(walker, fd);
-
-    if (((PCIE_CAP_ID *)&cap_ext_header)->id == PCI_DVSCE_EXT_CAPABILITY_ID)
-    {
-      header.ide_ecap.raw = device_pci_read_32(walker, fd);
-      header.header1.raw = device_pci_read_32(walker + 4, fd);
-      header.header2.raw = device_pci_read_16(walker + 8, fd);
-
-      if(header.header1.vendor_id == DVSEC_VENDOR_ID_CXL) {
-        // This is CXL DVSEC block
-        TEEIO_ASSERT(dvsec_cnt < *count);
-        dvsec->offset = walker;
-        dvsec->dvsec_id = header.header2.id;
-        dvsec += 1;
-        dvsec_cnt += 1;
-      }
+    if(index->dvsec[i].vendor_id == DVSEC_VENDOR_ID_CXL) {
+      // This is CXL DVSEC block
+      TEEIO_ASSERT(dvsec_cnt < *count);
+      dvsec->offset = index->dvsec[i].offset;
+      dvsec->dvsec_id = index->dvsec[i].dvsec_id;
+      dvsec += 1;
+      dvsec_cnt += 1;
     }
-
-    walker = ((PCIE_CAP_ID *)&cap_ext_header)->next_cap_offset;
   }
 
   *count = dvsec_cnt;
@@ -301,7 +291,7 @@ bool cxl_open_root_port(ide_common_test_port_context_t *port_context)
   return true;
 
 InitRootPortFail:
-  close(fd);
+  close_configuration_space(fd);
   unset_device_info(fd);
   return false;
 }
@@ -314,12 +304,7 @@ uint8_t* cxl_map_bar_addr(int cfg_space_fd, uint32_t bar, uint64_t offset_in_bar
   size_t map_size = CXL_CACHEMEM_REG_BLOCK_SIZE;
   off_t target = 0;
 
-  int mem_fd = open("/dev/mem", O_RDWR | O_SYNC);
-  if(mem_fd == -1) {
-      TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "Failed to open /dev/mem\n"));
-      return NULL;
-  }
-
+  int mem_fd = 0;
   uint8_t* mem_ptr = NULL;
 
   if(is_64_bit) {
@@ -330,11 +315,9 @@ uint8_t* cxl_map_bar_addr(int cfg_space_fd, uint32_t bar, uint64_t offset_in_bar
     target = bar_val & ~(map_size - 1);
   }
 
-  mem_ptr = (uint8_t *)mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, target + (uint32_t)offset_in_bar + CXL_IO_REG_BLOCK_SIZE);
-  if (mem_ptr == MAP_FAILED) {
+  mem_ptr = get_device_backend()->map_mmio(target + (uint32_t)offset_in_bar + CXL_IO_REG_BLOCK_SIZE, map_size, &mem_fd);
+  if (mem_ptr == NULL) {
       TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "Failed to mmap CXL.cachemem component reg block\n"));
-      close(mem_fd);
-      mem_ptr = NULL;
       mem_fd = 0;
   }
 
@@ -345,8 +328,7 @@ uint8_t* cxl_map_bar_addr(int cfg_space_fd, uint32_t bar, uint64_t offset_in_bar
 void cxl_unmap_memcache_reg_block(int mapped_fd, uint8_t* mapped_addr)
 {
   if(mapped_fd > 0 && mapped_addr != NULL) {
-    munmap(mapped_addr, CXL_CACHEMEM_REG_BLOCK_SIZE);
-    close(mapped_fd);
+    get_device_backend()->unmap_mmio(mapped_fd, mapped_addr, CXL_CACHEMEM_REG_BLOCK_SIZE);
   }
 }
 
@@ -506,7 +488,7 @@ bool cxl_close_root_port(cxl_ide_test_group_context_t *group_context)
   group_context->common.upper_port.mapped_kcbar_addr = 0;
 
   if(group_context->common.upper_port.cfg_space_fd > 0) {
-    close(group_context->common.upper_port.cfg_space_fd);
+    close_configuration_space(group_context->common.upper_port.cfg_space_fd);
     unset_device_info(group_context->common.upper_port.cfg_space_fd);
   }
   group_context->common.upper_port.cfg_space_fd = 0;
@@ -702,21 +684,15 @@ bool cxl_open_dev_port(ide_common_test_port_context_t *port_context)
   // dump CXL IDE Capability
   cxl_dump_ide_capability(cxl_data->memcache.cap_headers, cxl_data->memcache.cap_headers_cnt, cxl_data->memcache.mapped_memcache_reg_block);
 
-  // TODO
-  // m_dev_fp indicates the device ide card. It is used in doe_read_write.c.
-  // It will be removed later.
-  m_dev_fp = fd;
-
   // initialize pci doe
-  if(!init_pci_doe(fd)) {
+  if(!init_pci_doe(port_context)) {
     goto OpenDevFail;
   }
-  port_context->doe_offset = g_doe_extended_offset;
 
   return true;
 
 OpenDevFail:
-  close(fd);
+  close_configuration_space(fd);
   unset_device_info(fd);
   return false;
 }
@@ -734,15 +710,14 @@ bool cxl_close_dev_port(ide_common_test_port_context_t *port_context, IDE_TEST_T
   cxl_unmap_memcache_reg_block(cxl_data->memcache.mapped_fd, cxl_data->memcache.mapped_memcache_reg_block);
 
   if(port_context->cfg_space_fd > 0) {
-    close(port_context->cfg_space_fd);
+    close_configuration_space(port_context->cfg_space_fd);
     unset_device_info(port_context->cfg_space_fd);
   }
   port_context->cfg_space_fd = 0;
 
   memset(&port_context->cxl_data, 0, sizeof(CXL_PRIV_DATA));
 
-  m_dev_fp = 0;
-  g_doe_extended_offset = 0;
+  close_pci_doe(port_context);
   return true;
 }
 
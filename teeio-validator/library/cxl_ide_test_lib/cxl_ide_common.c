@@ -82,8 +82,8 @@ ide_test_case_name_t m_cxl_ide_test_case_names[] = {
 };
 
 ide_test_case_funcs_t m_cxl_ide_query_cases[MAX_CXL_QUERY_CASE_ID] = {
-  {cxl_ide_test_query_1_setup, cxl_ide_test_query_1_run, cxl_ide_test_query_1_teardown, false},
-  {cxl_ide_test_query_2_setup, cxl_ide_test_query_2_run, cxl_ide_test_query_2_teardown, false},
+  {cxl_ide_test_query_1_setup, cxl_ide_test_query_1_run, cxl_ide_test_query_1_teardown, false, true},
+  {cxl_ide_test_query_2_setup, cxl_ide_test_query_2_run, cxl_ide_test_query_2_teardown, false, true},
 };
 
 ide_test_case_funcs_t m_cxl_ide_key_prog_cases[MAX_CXL_KEYPROG_CASE_ID] = {
@@ -107,7 +107,7 @@ ide_test_case_funcs_t m_cxl_ide_kset_stop_cases[MAX_CXL_KSETSTOP_CASE_ID] = {
 };
 
 ide_test_case_funcs_t m_cxl_ide_get_key_cases[MAX_CXL_GETKEY_CASE_ID] = {
-  {cxl_ide_test_get_key_1_setup, cxl_ide_test_get_key_1_run, cxl_ide_test_get_key_1_teardown, false},
+  {cxl_ide_test_get_key_1_setup, cxl_ide_test_get_key_1_run, cxl_ide_test_get_key_1_teardown, false, true},
 };
 
 ide_test_case_funcs_t m_cxl_ide_test_full_cases[MAX_CXL_FULL_CASE_ID] = {
@@ -48,6 +48,20 @@ typedef struct {
 
 #pragma pack()
 
+// per-step timing of the key programming done by cxl_setup_ide_stream
+typedef struct {
+  uint64_t key_gen_ns;      // key/iv generation or GET_KEY of both directions
+  // KEY_PROG/KP_ACK round trips
+  uint64_t key_prog_ns[CXL_IDE_STREAM_DIRECTION_NUM];
+  // root port key/iv, key valid and start trigger writes
+  uint64_t rp_key_prog_ns;
+  // K_SET_GO/K_GOSTOP_ACK round trips
+  uint64_t k_set_go_ns[CXL_IDE_STREAM_DIRECTION_NUM];
+  uint64_t total_ns;
+} cxl_ide_km_key_prog_timing_t;
+
+const cxl_ide_km_key_prog_timing_t *cxl_ide_km_get_key_prog_timing();
+
 // setup cxl ide stream
 bool cxl_setup_ide_stream(void *doe_context, void *spdm_context,
                           uint32_t *session_id, uint8_t *kcbar_addr,
@@ -24,9 +24,13 @@
 #include "pcie_ide_lib.h"
 #include "cxl_ide_lib.h"
 #include "cxl_ide_test_common.h"
+#include "cxl_ide_test_internal.h"
 
 extern bool g_teeio_fixed_key;
 
+// timing of the last cxl_setup_ide_stream done by this thread
+static TEEIO_THREAD_LOCAL cxl_ide_km_key_prog_timing_t m_key_prog_timing = {0};
+
 void cxl_dump_key_iv_in_rp(const char* direction, uint8_t *key, int key_size, uint8_t *iv, int iv_size)
 {
   int i = 0;
@@ -258,7 +262,11 @@ bool cxl_setup_ide_stream(void *doe_context, void *spdm_context,
   uint32_t tx_iv[2] = {0};
   uint32_t rx_iv[2] = {0};
   CXL_QUERY_RESP_CAPS dev_caps = {0};
+  cxl_ide_km_key_prog_timing_t *timing = &m_key_prog_timing;
+  uint64_t setup_start_ns = get_monotonic_time_ns();
+  uint64_t start_ns;
 
+  memset(timing, 0, sizeof(cxl_ide_km_key_prog_timing_t));
   kcbar_ptr = (INTEL_KEYP_CXL_ROOT_COMPLEX_KCBAR *)kcbar_addr;
   dev_caps.raw = lower_port->cxl_data.query_resp.caps;
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "dev_caps: ide_key_generation_capable=%d, iv_generation_capable=%d\n",
@@ -299,6 +307,7 @@ bool cxl_setup_ide_stream(void *doe_context, void *spdm_context,
   uint8_t cxl_ide_km_iv_tx = 0;
 
   // generate cxl-ide key/iv for RX direction
+  start_ns = get_monotonic_time_ns();
   result = cxl_ide_generate_key(doe_context, spdm_context,
                                session_id, stream_id,
                                CXL_IDE_KM_KEY_SUB_STREAM_CXL, port_index,
@@ -318,14 +327,17 @@ bool cxl_setup_ide_stream(void *doe_context, void *spdm_context,
   if (!result) {
     return false;
   }
+  timing->key_gen_ns = get_monotonic_time_ns() - start_ns;
 
   // ide_km_key_prog in RX
+  start_ns = get_monotonic_time_ns();
   status = cxl_ide_km_key_prog(
       doe_context, spdm_context,
       session_id, stream_id,
       CXL_IDE_KM_KEY_DIRECTION_RX | cxl_ide_km_iv_rx | CXL_IDE_KM_KEY_SUB_STREAM_CXL,
       port_index, // port_index
       &rx_key_buffer, &kp_ack_status);
+  timing->key_prog_ns[CXL_IDE_STREAM_DIRECTION_RX] = get_monotonic_time_ns() - start_ns;
 
   if (LIBSPDM_STATUS_IS_ERROR(status))
   {
@@ -337,12 +349,14 @@ bool cxl_setup_ide_stream(void *doe_context, void *spdm_context,
   dump_key_iv_in_key_prog(rx_key_buffer.key, sizeof(rx_key_buffer.key)/sizeof(uint32_t), rx_key_buffer.iv, sizeof(rx_key_buffer.iv)/sizeof(uint32_t));
 
   // ide_km_key_prog in TX
+  start_ns = get_monotonic_time_ns();
   status = cxl_ide_km_key_prog(
       doe_context, spdm_context,
       session_id, stream_id,
       CXL_IDE_KM_KEY_DIRECTION_TX | cxl_ide_km_iv_tx | CXL_IDE_KM_KEY_SUB_STREAM_CXL,
       port_index,
       &tx_key_buffer, &kp_ack_status);
+  timing->key_prog_ns[CXL_IDE_STREAM_DIRECTION_TX] = get_monotonic_time_ns() - start_ns;
   if (LIBSPDM_STATUS_IS_ERROR(status))
   {
     TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "cxl_ide_km_key_prog TX failed with status=0x%08x\n", status));
@@ -354,6 +368,7 @@ bool cxl_setup_ide_stream(void *doe_context, void *spdm_context,
 
   // Program TX/RX pending keys into Link_Enc_Key_Tx and Link_Enc_Key_Rx registers
   // Program TX/RX IV values
+  start_ns = get_monotonic_time_ns();
   cxl_construct_rp_keys(tx_key_buffer.key, sizeof(tx_key_buffer.key), keys.bytes, sizeof(keys.bytes));
   cxl_construct_rp_iv(tx_key_buffer.iv, sizeof(tx_key_buffer.iv), tx_iv, sizeof(tx_iv));
   cxl_cfg_rp_link_enc_key_iv(kcbar_ptr, CXL_IDE_KM_KEY_DIRECTION_TX, 0, keys.bytes, sizeof(keys.bytes), (uint8_t *)tx_iv, sizeof(tx_iv));
@@ -367,6 +382,7 @@ bool cxl_setup_ide_stream(void *doe_context, void *spdm_context,
   // Set TxKeyValid and RxKeyValid bit
   cxl_cfg_rp_txrx_key_valid(kcbar_ptr, CXL_IDE_STREAM_DIRECTION_TX, true);
   cxl_cfg_rp_txrx_key_valid(kcbar_ptr, CXL_IDE_STREAM_DIRECTION_RX, true);
+  timing->rp_key_prog_ns = get_monotonic_time_ns() - start_ns;
 
   uint8_t ide_km_mode = CXL_IDE_KM_KEY_MODE_SKID;
   if(ide_mode == CXL_IDE_MODE_CONTAINMENT) {
@@ -374,10 +390,12 @@ bool cxl_setup_ide_stream(void *doe_context, void *spdm_context,
   }
 
   // KSetGo in RX
+  start_ns = get_monotonic_time_ns();
   status = cxl_ide_km_key_set_go(doe_context, spdm_context,
                                  session_id, stream_id,
                                  CXL_IDE_KM_KEY_DIRECTION_RX | ide_km_mode | CXL_IDE_KM_KEY_SUB_STREAM_CXL,
                                  port_index);
+  timing->k_set_go_ns[CXL_IDE_STREAM_DIRECTION_RX] = get_monotonic_time_ns() - start_ns;
   if (LIBSPDM_STATUS_IS_ERROR(status))
   {
     TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "cxl_ide_km_key_set_go RX failed with status=0x%08x\n", status));
@@ -387,18 +405,22 @@ bool cxl_setup_ide_stream(void *doe_context, void *spdm_context,
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "key_set_go RX\n"));
 
   // Skip set link_enc_enable if key_refresh is true
+  start_ns = get_monotonic_time_ns();
   if(!key_refresh) {
     cxl_cfg_rp_linkenc_enable(kcbar_ptr, true);
   }
 
   // Set StartTrigger bit
   cxl_cfg_rp_start_trigger(kcbar_ptr, true);
+  timing->rp_key_prog_ns += get_monotonic_time_ns() - start_ns;
 
   // KSetGo in TX
+  start_ns = get_monotonic_time_ns();
   status = cxl_ide_km_key_set_go(doe_context, spdm_context,
                                  session_id, stream_id,
                                  CXL_IDE_KM_KEY_DIRECTION_TX | ide_km_mode | CXL_IDE_KM_KEY_SUB_STREAM_CXL,
                                  port_index);
+  timing->k_set_go_ns[CXL_IDE_STREAM_DIRECTION_TX] = get_monotonic_time_ns() - start_ns;
   if (LIBSPDM_STATUS_IS_ERROR(status))
   {
     TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "cxl_ide_km_key_set_go TX failed with status=0x%08x\n", status));
@@ -410,9 +432,19 @@ bool cxl_setup_ide_stream(void *doe_context, void *spdm_context,
   // wait for 10 ms for device to get ide ready
   libspdm_sleep(10 * 1000);
 
+  timing->total_ns = get_monotonic_time_ns() - setup_start_ns;
+
   return true;
 }
 
+/**
+ * Timing of the last cxl_setup_ide_stream done in this thread.
+ */
+const cxl_ide_km_key_prog_timing_t *cxl_ide_km_get_key_prog_timing()
+{
+  return &m_key_prog_timing;
+}
+
 bool cxl_teardown_ide_stream(void *test_context)
 {
   bool ret = false;
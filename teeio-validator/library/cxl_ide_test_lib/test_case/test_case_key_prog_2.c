@@ -17,7 +17,7 @@
 #include "cxl_ide_test_common.h"
 #include "cxl_ide_test_internal.h"
 
-static int mCurrentRequestSize = 0;
+static TEEIO_THREAD_LOCAL int mCurrentRequestSize = 0;
 
 static void test_cxl_ide_key_prog2 (
   const void *doe_context,
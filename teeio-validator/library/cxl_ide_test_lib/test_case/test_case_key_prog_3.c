@@ -18,7 +18,7 @@
 #include "cxl_ide_test_internal.h"
 
 extern bool g_teeio_fixed_key;
-static uint8_t mPortIndex[0x100] = {0};
+static TEEIO_THREAD_LOCAL uint8_t mPortIndex[0x100] = {0};
 
 static int construct_test_port_index(uint8_t max_port_index)
 {
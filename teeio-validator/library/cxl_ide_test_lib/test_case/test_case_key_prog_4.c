@@ -17,7 +17,7 @@
 #include "cxl_ide_test_common.h"
 #include "cxl_ide_test_internal.h"
 
-static uint8_t mStreamId[0x100] = {0};
+static TEEIO_THREAD_LOCAL uint8_t mStreamId[0x100] = {0};
 
 static int construct_test_stream_id()
 {
@@ -17,7 +17,7 @@
 #include "cxl_ide_test_common.h"
 #include "cxl_ide_test_internal.h"
 
-static uint8_t mSubStream[0x100] = {0};
+static TEEIO_THREAD_LOCAL uint8_t mSubStream[0x100] = {0};
 
 char* dump_binary_to_str(uint8_t data, char* str, int str_size) {
   TEEIO_ASSERT(str_size >= 6);
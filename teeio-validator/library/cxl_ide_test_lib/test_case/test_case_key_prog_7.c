@@ -19,7 +19,7 @@
 #include "cxl_ide_test_common.h"
 #include "cxl_ide_test_internal.h"
 
-static CXL_QUERY_RESP_CAPS* m_dev_caps = NULL;
+static TEEIO_THREAD_LOCAL CXL_QUERY_RESP_CAPS* m_dev_caps = NULL;
 
 /**
  * Prepare the CXL IDE Keys with random values generated in host side
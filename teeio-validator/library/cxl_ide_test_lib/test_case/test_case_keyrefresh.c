@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <string.h>
 
 #include "assert.h"
 #include "hal/base.h"
@@ -22,6 +23,9 @@
 #include "cxl_ide_test_common.h"
 #include "cxl_ide_test_internal.h"
 
+extern int g_test_rounds;
+extern int g_keyrefresh_interval_us;
+
 bool cxl_ide_test_keyrefresh_setup(void *test_context)
 {
   ide_common_test_case_context_t *case_context = (ide_common_test_case_context_t *)test_context;
@@ -55,6 +59,59 @@ bool cxl_ide_test_keyrefresh_setup(void *test_context)
                               false);
 }
 
+// refresh the keys g_test_rounds times without the tester and report the latency of the refreshes
+static bool cxl_ide_keyrefresh_benchmark(cxl_ide_test_group_context_t *group_context, IDE_TEST_CONFIGURATION *configuration)
+{
+  spdm_doe_context_t* spdm_doe = &group_context->spdm_doe;
+  ide_common_test_port_context_t* upper_port = &group_context->common.upper_port;
+  ide_common_test_port_context_t* lower_port = &group_context->common.lower_port;
+  const cxl_ide_km_key_prog_timing_t *timing;
+  uint64_t phase_ns[KEYREFRESH_PHASE_NUM];
+  keyrefresh_bench_t bench;
+  uint64_t start_ns;
+  bool res = true;
+
+  if(!keyrefresh_bench_init(&bench, g_test_rounds, g_keyrefresh_interval_us)) {
+    return false;
+  }
+
+  for(int rounds = 0; rounds < g_test_rounds; rounds++) {
+    keyrefresh_bench_wait(&bench);
+
+    start_ns = get_monotonic_time_ns();
+    // Query the port index
+    res = cxl_ide_query_port_index(group_context);
+    if(res) {
+      res = cxl_setup_ide_stream(spdm_doe->doe_context, spdm_doe->spdm_context,
+                                 &spdm_doe->session_id, upper_port->mapped_kcbar_addr,
+                                 group_context->stream_id, lower_port->port->port_index,
+                                 upper_port, lower_port, false,
+                                 configuration->bit_map, configuration->priv_data.cxl_ide.ide_mode,
+                                 true);
+    }
+    if(!res) {
+      TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KeyRefresh failed in round %d.\n", rounds));
+      break;
+    }
+
+    timing = cxl_ide_km_get_key_prog_timing();
+    memset(phase_ns, 0, sizeof(phase_ns));
+    phase_ns[KEYREFRESH_PHASE_KEY_GEN] = timing->key_gen_ns;
+    for(int direction = 0; direction < CXL_IDE_STREAM_DIRECTION_NUM; direction++) {
+      phase_ns[KEYREFRESH_PHASE_KEY_PROG] += timing->key_prog_ns[direction];
+      phase_ns[KEYREFRESH_PHASE_K_SET_GO] += timing->k_set_go_ns[direction];
+    }
+    phase_ns[KEYREFRESH_PHASE_RP_KEY_PROG] = timing->rp_key_prog_ns;
+    phase_ns[KEYREFRESH_PHASE_TOTAL] = get_monotonic_time_ns() - start_ns;
+    keyrefresh_bench_add(&bench, phase_ns);
+  }
+
+  keyrefresh_bench_report(&bench, "CXL-IDE");
+  keyrefresh_bench_free(&bench);
+
+  return res;
+}
+
 void cxl_ide_test_keyrefresh_run(void *test_context)
 {
   ide_common_test_case_context_t *case_context = (ide_common_test_case_context_t *)test_context;
@@ -83,6 +140,11 @@ void cxl_ide_test_keyrefresh_run(void *test_context)
   int cmd = 0;
   bool res = true;
 
+  if(g_keyrefresh_interval_us >= 0) {
+    res = cxl_ide_keyrefresh_benchmark(group_context, configuration);
+    goto Done;
+  }
+
   while(true){
     TEEIO_PRINT(("\n"));
     TEEIO_PRINT(("Print host registers.\n"));
@@ -118,6 +180,7 @@ void cxl_ide_test_keyrefresh_run(void *test_context)
     }
   }
 
+Done:
   teeio_record_assertion_result(case_class, case_id, 1, IDE_COMMON_TEST_CASE_ASSERTION_TYPE_TEST,
                                 res ? TEEIO_TEST_RESULT_PASS : TEEIO_TEST_RESULT_FAILED,
                                 res ? "CXL-IDE KeyRefresh succeeded." : "CXL-IDE KeyRefresh failed.");
@@ -18,7 +18,7 @@
 #include "cxl_ide_test_internal.h"
 
 // store the dev_caps for all the ports of the device
-static CXL_QUERY_RESP_CAPS m_dev_caps[0x100] = {0};
+static TEEIO_THREAD_LOCAL CXL_QUERY_RESP_CAPS m_dev_caps[0x100] = {0};
 
 extern const char* m_cxl_ide_mode_names[];
 
@@ -17,7 +17,7 @@
 #include "cxl_ide_test_common.h"
 #include "cxl_ide_test_internal.h"
 
-static uint8_t mMaxPortIndex = 0;
+static TEEIO_THREAD_LOCAL uint8_t mMaxPortIndex = 0;
 
 bool cxl_ide_test_query_2_setup(void *test_context)
 {
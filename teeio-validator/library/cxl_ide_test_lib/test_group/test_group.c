@@ -24,6 +24,10 @@
 
 extern const char* m_cxl_ide_mode_names[];
 
+bool cxl_reset_ecap_registers(ide_common_test_port_context_t *port_context);
+bool cxl_reset_kcbar_registers(ide_common_test_port_context_t *port_context);
+void cxl_clear_rootport_key_ivs(ide_common_test_port_context_t* port_context);
+
 // CXL Spec 3.1 Section 8.2.4.22
 // CXL IDE Capability Structure
 bool cxl_check_device_ide_reg_block(uint32_t* ide_reg_block, uint32_t ide_reg_block_count)
@@ -168,6 +172,66 @@ static bool check_and_enable_ide_mode(cxl_ide_test_group_context_t *group_contex
   return true;
 }
 
+// close the ports kept in the topology context of the suite
+static void close_topology(void *group_context)
+{
+  cxl_ide_test_group_context_t *context = (cxl_ide_test_group_context_t *)group_context;
+
+  cxl_close_dev_port(&context->common.lower_port, context->common.top->type);
+  cxl_close_root_port(context);
+
+  free(context);
+}
+
+/**
+ * Borrow the ports opened by a previous test group of the suite.
+ * false is returned if the ports of the topology are not opened yet.
+ */
+static bool borrow_topology(cxl_ide_test_group_context_t *context)
+{
+  cxl_ide_test_group_context_t *opened = (cxl_ide_test_group_context_t *)context->common.suite_context->topology.group_context;
+
+  if(opened == NULL) {
+    return false;
+  }
+
+  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Borrow the opened ports %s(%s) and %s(%s)\n",
+               opened->common.upper_port.port->port_name, opened->common.upper_port.port->bdf,
+               opened->common.lower_port.port->port_name, opened->common.lower_port.port->bdf));
+
+  context->common.root_port = opened->common.root_port;
+  context->common.upper_port = opened->common.upper_port;
+  context->common.lower_port = opened->common.lower_port;
+
+  return true;
+}
+
+// keep the ports just opened by the test group in the topology context of the suite
+static void keep_topology(cxl_ide_test_group_context_t *context)
+{
+  teeio_common_test_topology_context_t *topology = &context->common.suite_context->topology;
+  TEEIO_ASSERT(topology->group_context == NULL);
+
+  cxl_ide_test_group_context_t *opened = (cxl_ide_test_group_context_t *)malloc(sizeof(cxl_ide_test_group_context_t));
+  TEEIO_ASSERT(opened != NULL);
+  *opened = *context;
+  // the spdm session is acquired and released by each group
+  memset(&opened->spdm_doe, 0, sizeof(spdm_doe_context_t));
+
+  topology->group_context = opened;
+  topology->close_func = close_topology;
+}
+
+// reset the registers of the borrowed ports so that the next test group starts from a clean state
+static void reset_topology(cxl_ide_test_group_context_t *context)
+{
+  cxl_reset_ecap_registers(&context->common.lower_port);
+
+  cxl_reset_ecap_registers(&context->common.upper_port);
+  cxl_reset_kcbar_registers(&context->common.upper_port);
+  cxl_clear_rootport_key_ivs(&context->common.upper_port);
+}
+
 /**
  * This function works to setup link_ide
  *
@@ -185,26 +249,31 @@ static bool common_test_group_setup(void *test_context)
 
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "test_group_setup start\n"));
 
-  // first scan devices
-  if(!cxl_scan_devices(test_context)) {
-    teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Scan device failed.");
-    return false;
-  }
+  // the ports are opened once per suite
+  if(!borrow_topology(context)) {
+    // first scan devices
+    if(!cxl_scan_devices(test_context)) {
+      teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Scan device failed.");
+      return false;
+    }
 
-  // initialize lower_port
-  ret = cxl_init_dev_port(context);
-  if(!ret) {
-    teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize device port failed.");
-    return false;
-  }
+    // initialize lower_port
+    ret = cxl_init_dev_port(context);
+    if(!ret) {
+      teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize device port failed.");
+      return false;
+    }
 
-  IDE_TEST_TOPOLOGY *top = context->common.top;
-  TEEIO_ASSERT(top->connection == IDE_TEST_CONNECT_DIRECT || top->connection == IDE_TEST_CONNECT_SWITCH);
+    IDE_TEST_TOPOLOGY *top = context->common.top;
+    TEEIO_ASSERT(top->connection == IDE_TEST_CONNECT_DIRECT || top->connection == IDE_TEST_CONNECT_SWITCH);
 
-  ret = cxl_init_root_port(context);
-  if (!ret) {
-    teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize root port failed.");
-    return false;
+    ret = cxl_init_root_port(context);
+    if (!ret) {
+      teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize root port failed.");
+      return false;
+    }
+
+    keep_topology(context);
   }
 
   // set KeyRefreshControl and Truncation transmit control registers
@@ -219,15 +288,10 @@ static bool common_test_group_setup(void *test_context)
     return false;
   }
 
-  // init spdm_context
-  void *spdm_context = spdm_client_init();
-  if(spdm_connect == NULL) {
-    teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize spdm failed.");
-    return false;
-  }
-
+  // acquire spdm_context and spdm_session
+  void *spdm_context = NULL;
   uint32_t session_id = 0;
-  ret = spdm_connect(spdm_context, &session_id);
+  ret = spdm_session_acquire(context->common.lower_port.port->bdf, context->common.lower_port.doe_context, &spdm_context, &session_id);
   if (!ret) {
     TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "spdm_connect failed.\n"));
     teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Spdm connect failed.");
@@ -236,12 +300,22 @@ static bool common_test_group_setup(void *test_context)
 
   context->spdm_doe.spdm_context = spdm_context;
   context->spdm_doe.session_id = session_id;
+  context->spdm_doe.doe_context = context->common.lower_port.doe_context;
 
   // cxl query is called in group_setup
   // For test case of CXL_MEM_IDE_TEST_CASE_QUERY, cxl query is not called because
   // it is to test CXL Query itself  
   if(context->common.case_class != CXL_MEM_IDE_TEST_CASE_QUERY) {
-    if(!cxl_ide_query(context)) {
+    bool queried = cxl_ide_query(context);
+    // a stale pooled session fails the first request in it. Set it up again then.
+    if(!queried && spdm_session_reacquire(context->common.lower_port.port->bdf, context->common.lower_port.doe_context, &spdm_context, &session_id)) {
+      context->spdm_doe.spdm_context = spdm_context;
+      context->spdm_doe.session_id = session_id;
+      queried = cxl_ide_query(context);
+    }
+    context->spdm_doe.spdm_context = spdm_context;
+    context->spdm_doe.session_id = session_id;
+    if(!queried) {
       teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "CXL Query failed.");
       return false;
     }
@@ -272,10 +346,9 @@ static bool common_test_group_teardown(void *test_context)
   cxl_ide_test_group_context_t *context = (cxl_ide_test_group_context_t *)test_context;
   TEEIO_ASSERT(context->common.signature == GROUP_CONTEXT_SIGNATURE);
 
-  // close spdm_session and free spdm_context
+  // release spdm_session and spdm_context
   if(context->spdm_doe.spdm_context != NULL) {
-    spdm_stop(context->spdm_doe.spdm_context, context->spdm_doe.session_id);
-    free(context->spdm_doe.spdm_context);
+    spdm_session_release(context->spdm_doe.spdm_context, context->spdm_doe.session_id);
     context->spdm_doe.spdm_context = NULL;
     context->spdm_doe.session_id = 0;
   }
@@ -283,9 +356,8 @@ static bool common_test_group_teardown(void *test_context)
   IDE_TEST_TOPOLOGY *top = context->common.top;
   TEEIO_ASSERT(top->connection == IDE_TEST_CONNECT_DIRECT || top->connection == IDE_TEST_CONNECT_SWITCH);
 
-  // close ports
-  cxl_close_dev_port(&context->common.lower_port, top->type);
-  cxl_close_root_port(context);
+  // the ports are closed when the suite is done
+  reset_topology(context);
 
   teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_TEARDOWN, TEEIO_TEST_RESULT_PASS, "");
 
@@ -44,11 +44,11 @@ ide_test_case_name_t m_cxl_tsp_test_case_names[] = {
 };
 
 ide_test_case_funcs_t m_cxl_tsp_get_version_cases[MAX_CXL_TSP_GET_VERSION_CASE_ID] = {
-  {cxl_tsp_test_get_version_setup, cxl_tsp_test_get_version_run, cxl_tsp_test_get_version_teardown, false}
+  {cxl_tsp_test_get_version_setup, cxl_tsp_test_get_version_run, cxl_tsp_test_get_version_teardown, false, true}
 };
 
 ide_test_case_funcs_t m_cxl_tsp_get_caps_cases[MAX_CXL_TSP_GET_CAPS_CASE_ID] = {
-  {cxl_tsp_test_get_caps_setup, cxl_tsp_test_get_caps_run, cxl_tsp_test_get_caps_teardown, false}
+  {cxl_tsp_test_get_caps_setup, cxl_tsp_test_get_caps_run, cxl_tsp_test_get_caps_teardown, false, true}
 };
 
 ide_test_case_funcs_t m_cxl_tsp_set_configuration_cases[MAX_CXL_TSP_SET_CFG_CASE_ID] = {
@@ -56,11 +56,11 @@ ide_test_case_funcs_t m_cxl_tsp_set_configuration_cases[MAX_CXL_TSP_SET_CFG_CASE
 };
 
 ide_test_case_funcs_t m_cxl_tsp_get_configuration_cases[MAX_CXL_TSP_GET_CFG_CASE_ID] = {
-  {cxl_tsp_test_get_configuration_setup, cxl_tsp_test_get_configuration_run, cxl_tsp_test_get_configuration_teardown, false}
+  {cxl_tsp_test_get_configuration_setup, cxl_tsp_test_get_configuration_run, cxl_tsp_test_get_configuration_teardown, false, true}
 };
 
 ide_test_case_funcs_t m_cxl_tsp_get_configuration_report_cases[MAX_CXL_TSP_GET_CFG_REPORT_CASE_ID] = {
-  {cxl_tsp_test_get_configuration_report_setup, cxl_tsp_test_get_configuration_report_run, cxl_tsp_test_get_configuration_report_teardown, false}
+  {cxl_tsp_test_get_configuration_report_setup, cxl_tsp_test_get_configuration_report_run, cxl_tsp_test_get_configuration_report_teardown, false, true}
 };
 
 ide_test_case_funcs_t m_cxl_tsp_lock_configuration_cases[MAX_CXL_TSP_LOCK_CFG_CASE_ID] = {
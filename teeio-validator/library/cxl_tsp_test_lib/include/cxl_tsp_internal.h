@@ -12,6 +12,7 @@
 #include "library/spdm_requester_lib.h"
 #include "library/spdm_transport_pcidoe_lib.h"
 #include "library/cxl_tsp_requester_lib.h"
+#include "ide_test.h"
 
 #pragma pack(1)
 typedef struct {
@@ -31,5 +32,12 @@ typedef struct {
 
 #pragma pack()
 
+/**
+ * Get the device capabilities negotiated in the spdm session of the group.
+ * GET_VERSION and GET_CAPABILITIES are sent by the first caller in the session
+ * and the result is shared by the following test cases of the group.
+ */
+bool cxl_tsp_test_get_session_state(cxl_tsp_test_group_context_t *group_context,
+                                    libcxltsp_device_capabilities_t *device_capabilities);
 
 #endif
\ No newline at end of file
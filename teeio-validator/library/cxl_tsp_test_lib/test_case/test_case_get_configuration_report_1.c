@@ -13,7 +13,7 @@
 #include "helperlib.h"
 #include "cxl_tsp_internal.h"
 
-static libcxltsp_device_capabilities_t m_device_capabilities = {0};
+static TEEIO_THREAD_LOCAL libcxltsp_device_capabilities_t m_device_capabilities = {0};
 
 static void test_cxl_tsp_get_configuration_report(
   const void *pci_doe_context,
@@ -128,8 +128,6 @@ static void test_cxl_tsp_get_configuration_report(
 
 bool cxl_tsp_test_get_configuration_report_setup(void *test_context)
 {
-  libspdm_return_t status;
-
   ide_common_test_case_context_t *case_context = (ide_common_test_case_context_t *)test_context;
   TEEIO_ASSERT(case_context);
   TEEIO_ASSERT(case_context->signature == CASE_CONTEXT_SIGNATURE);
@@ -138,19 +136,9 @@ bool cxl_tsp_test_get_configuration_report_setup(void *test_context)
   TEEIO_ASSERT(group_context);
   teeio_common_test_group_context_t *common = &group_context->common;
   TEEIO_ASSERT(common->signature == GROUP_CONTEXT_SIGNATURE);
-  spdm_doe_context_t *spdm_doe = &group_context->spdm_doe;
-  TEEIO_ASSERT(spdm_doe);
-
-  status = cxl_tsp_get_version(spdm_doe->doe_context, spdm_doe->spdm_context, &spdm_doe->session_id);
-  if(LIBSPDM_STATUS_IS_ERROR(status)) {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "%s: cxl_tsp_get_version failed with  status=0x%x\n", __func__, status));
-    return false;
-  }
 
-  libspdm_zero_mem(&m_device_capabilities, sizeof(m_device_capabilities));
-  status = cxl_tsp_get_capabilities(spdm_doe->doe_context, spdm_doe->spdm_context, &spdm_doe->session_id, &m_device_capabilities);
-  if(LIBSPDM_STATUS_IS_ERROR(status)) {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "%s: cxl_tsp_get_capabilities failed with  status=0x%x\n", __func__, status));
+  // version and capabilities are negotiated once per session
+  if(!cxl_tsp_test_get_session_state(group_context, &m_device_capabilities)) {
     return false;
   }
 
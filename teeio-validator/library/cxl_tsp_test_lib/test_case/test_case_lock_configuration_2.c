@@ -12,7 +12,7 @@
 #include "helperlib.h"
 #include "cxl_tsp_internal.h"
 
-static libcxltsp_device_capabilities_t m_device_capabilities = {0};
+static TEEIO_THREAD_LOCAL libcxltsp_device_capabilities_t m_device_capabilities = {0};
 
 static void test_cxl_tsp_lock_configuration_already_locked (
   const void *pci_doe_context,
@@ -101,16 +101,8 @@ bool cxl_tsp_test_lock_configuration_2_setup(void *test_context)
   spdm_doe_context_t *spdm_doe = &group_context->spdm_doe;
   TEEIO_ASSERT(spdm_doe);
 
-  status = cxl_tsp_get_version(spdm_doe->doe_context, spdm_doe->spdm_context, &spdm_doe->session_id);
-  if(LIBSPDM_STATUS_IS_ERROR(status)) {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "%s: cxl_tsp_get_version failed with status=0x%x\n", __func__, status));
-    return false;
-  }
-
-  libspdm_zero_mem(&m_device_capabilities, sizeof(m_device_capabilities));
-  status = cxl_tsp_get_capabilities(spdm_doe->doe_context, spdm_doe->spdm_context, &spdm_doe->session_id, &m_device_capabilities);
-  if(LIBSPDM_STATUS_IS_ERROR(status)) {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "%s: cxl_tsp_get_capabilities failed with status=0x%x\n", __func__, status));
+  // version and capabilities are negotiated once per session
+  if(!cxl_tsp_test_get_session_state(group_context, &m_device_capabilities)) {
     return false;
   }
 
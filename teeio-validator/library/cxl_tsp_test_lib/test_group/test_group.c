@@ -21,6 +21,52 @@
 #include "helperlib.h"
 #include "teeio_debug.h"
 #include "teeio_spdmlib.h"
+#include "cxl_tsp_internal.h"
+
+// TSP state negotiated in a spdm session
+typedef struct {
+  void *spdm_context;
+  uint32_t session_id;
+  bool negotiated;
+  libcxltsp_device_capabilities_t device_capabilities;
+} cxl_tsp_session_state_t;
+
+static TEEIO_THREAD_LOCAL cxl_tsp_session_state_t m_session_state = {0};
+
+bool cxl_tsp_test_get_session_state(cxl_tsp_test_group_context_t *group_context,
+                                    libcxltsp_device_capabilities_t *device_capabilities)
+{
+  libspdm_return_t status;
+  spdm_doe_context_t *spdm_doe = &group_context->spdm_doe;
+
+  if(m_session_state.negotiated &&
+     m_session_state.spdm_context == spdm_doe->spdm_context &&
+     m_session_state.session_id == spdm_doe->session_id) {
+    *device_capabilities = m_session_state.device_capabilities;
+    return true;
+  }
+
+  libspdm_zero_mem(&m_session_state, sizeof(m_session_state));
+
+  status = cxl_tsp_get_version(spdm_doe->doe_context, spdm_doe->spdm_context, &spdm_doe->session_id);
+  if(LIBSPDM_STATUS_IS_ERROR(status)) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "%s: cxl_tsp_get_version failed with status=0x%x\n", __func__, status));
+    return false;
+  }
+
+  status = cxl_tsp_get_capabilities(spdm_doe->doe_context, spdm_doe->spdm_context, &spdm_doe->session_id, &m_session_state.device_capabilities);
+  if(LIBSPDM_STATUS_IS_ERROR(status)) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "%s: cxl_tsp_get_capabilities failed with status=0x%x\n", __func__, status));
+    return false;
+  }
+
+  m_session_state.spdm_context = spdm_doe->spdm_context;
+  m_session_state.session_id = spdm_doe->session_id;
+  m_session_state.negotiated = true;
+  *device_capabilities = m_session_state.device_capabilities;
+
+  return true;
+}
 
 /**
  * This function works to setup link_ide
@@ -61,12 +107,10 @@ static bool common_test_group_setup(void *test_context)
     return false;
   }
 
-  // init spdm_context
-  void *spdm_context = spdm_client_init();
-  TEEIO_ASSERT(spdm_context != NULL);
-
+  // acquire spdm_context and spdm_session
+  void *spdm_context = NULL;
   uint32_t session_id = 0;
-  ret = spdm_connect(spdm_context, &session_id);
+  ret = spdm_session_acquire(context->common.lower_port.port->bdf, context->common.lower_port.doe_context, &spdm_context, &session_id);
   if (!ret) {
     TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "spdm_connect failed.\n"));
     teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Spdm connect failed.");
@@ -75,6 +119,7 @@ static bool common_test_group_setup(void *test_context)
 
   context->spdm_doe.spdm_context = spdm_context;
   context->spdm_doe.session_id = session_id;
+  context->spdm_doe.doe_context = context->common.lower_port.doe_context;
 
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "test_group_setup done\n"));
 
@@ -88,10 +133,12 @@ static bool common_test_group_teardown(void *test_context)
   cxl_ide_test_group_context_t *context = (cxl_ide_test_group_context_t *)test_context;
   TEEIO_ASSERT(context->common.signature == GROUP_CONTEXT_SIGNATURE);
 
-  // close spdm_session and free spdm_context
+  // the negotiated state goes with the session
+  libspdm_zero_mem(&m_session_state, sizeof(m_session_state));
+
+  // release spdm_session and spdm_context
   if(context->spdm_doe.spdm_context != NULL) {
-    spdm_stop(context->spdm_doe.spdm_context, context->spdm_doe.session_id);
-    free(context->spdm_doe.spdm_context);
+    spdm_session_release(context->spdm_doe.spdm_context, context->spdm_doe.session_id);
     context->spdm_doe.spdm_context = NULL;
     context->spdm_doe.session_id = 0;
   }
@@ -53,10 +53,5 @@ void libspdm_debug_print(size_t error_level, const char *format, ...)
 
     va_end(marker);
 
-    printf("%s", buffer);
-
-    if(m_logfile) {
-        fprintf(m_logfile, "%s", buffer);
-        fflush(m_logfile);
-    }
+    teeio_log_write(buffer);
 }
@@ -3,6 +3,7 @@
  *  Copyright 2023-2024 Intel. All rights reserved.
  *  License: BSD 3-Clause License.
  */
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -11,6 +12,9 @@
 #include <time.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include "teeio_debug.h"
 #include "helperlib.h"
 
@@ -27,7 +31,58 @@ const char* m_ide_log_level[] = {
 };
 
 #define TIME_STAMP_LENGTH 64
-char m_timestamp[TIME_STAMP_LENGTH];
+
+// wall-clock prefix of this thread. It is formatted again only when the millisecond changes.
+typedef struct {
+  time_t second;
+  long millisecond;
+  char date_time[TIME_STAMP_LENGTH/2];
+} TEEIO_LOG_TIMESTAMP_CACHE;
+
+TEEIO_THREAD_LOCAL char m_timestamp[TIME_STAMP_LENGTH];
+static TEEIO_THREAD_LOCAL TEEIO_LOG_TIMESTAMP_CACHE m_timestamp_cache = {.second = -1, .millisecond = -1};
+
+/**
+ * Asynchronous logger.
+ *
+ * After teeio_log_init the log lines are formatted into the slots of a ring and
+ * written to stdout and the log file by a writer thread. Producers reserve a slot
+ * with a compare-and-swap of the head and publish it by storing its sequence
+ * number (bounded MPSC queue), so a log line costs no lock and no syscall.
+ * The writer drains the ring and flushes the outputs at least every
+ * TEEIO_LOG_FLUSH_INTERVAL_US. The ring is also drained on TEEIO_ASSERT and on
+ * fatal signals. If the ring is full the producer yields until the writer has
+ * made room, so no log line is lost.
+ *
+ * Before teeio_log_init and after teeio_log_close lines are written synchronously.
+ */
+#define TEEIO_LOG_RING_SIZE 4096
+#define TEEIO_LOG_RECORD_LENGTH (IDE_MAX_LOG_MESSAGE_LENGTH + TIME_STAMP_LENGTH)
+#define TEEIO_LOG_FLUSH_INTERVAL_US (10 * 1000)
+
+typedef struct {
+  uint64_t seq;
+  uint32_t length;
+  char text[TEEIO_LOG_RECORD_LENGTH];
+} TEEIO_LOG_RECORD;
+
+static TEEIO_LOG_RECORD *m_log_ring = NULL;
+static uint64_t m_log_head = 0;
+static uint64_t m_log_tail = 0;
+static bool m_log_async = false;
+// producers between reserve_log_record and publish_log_record
+static uint32_t m_log_producers = 0;
+static bool m_log_writer_running = false;
+static pthread_t m_log_writer;
+// serializes the consumers: the writer thread and the flush on assert
+static pthread_mutex_t m_log_drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// "[lane N]" if the thread runs a lane of parallel test suites, so their interleaved lines can be told apart.
+// It fits in the TIME_STAMP_LENGTH headroom of a record together with the timestamp and level.
+#define TEEIO_LOG_TAG_LENGTH 16
+static TEEIO_THREAD_LOCAL char m_log_tag[TEEIO_LOG_TAG_LENGTH] = "";
+
+static const int m_log_fatal_signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
 
 TEEIO_DEBUG_LEVEL get_ide_log_level_from_string(const char* debug_level)
 {
@@ -54,64 +109,321 @@ const char* get_ide_log_level_string(TEEIO_DEBUG_LEVEL debug_level)
 
 char * current_time()
 {
-    char buf[TIME_STAMP_LENGTH/2];
-    struct timeval currentTime;
-    gettimeofday(&currentTime, NULL);
-
-    // Extract milliseconds
-    long milliseconds = currentTime.tv_usec / 1000;
+    TEEIO_LOG_TIMESTAMP_CACHE *cache = &m_timestamp_cache;
+    struct timespec now;
+    long milliseconds;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    milliseconds = now.tv_nsec / 1000000;
+    if(now.tv_sec == cache->second && milliseconds == cache->millisecond) {
+        return m_timestamp;
+    }
 
-    // Convert to local time
-    time_t rawtime = currentTime.tv_sec;
-    struct tm *localTime = localtime(&rawtime);
+    if(now.tv_sec != cache->second) {
+        // Convert to local time
+        struct tm localTime;
+        localtime_r(&now.tv_sec, &localTime);
+        strftime(cache->date_time, TIME_STAMP_LENGTH/2, "%Y-%m-%d %H:%M:%S", &localTime);
+        cache->second = now.tv_sec;
+    }
+    cache->millisecond = milliseconds;
 
-    strftime(buf, TIME_STAMP_LENGTH/2, "%Y-%m-%d %H:%M:%S", localTime);
-    snprintf(m_timestamp, TIME_STAMP_LENGTH, "%s.%03ld", buf, milliseconds);
+    snprintf(m_timestamp, TIME_STAMP_LENGTH, "%s.%03ld", cache->date_time, milliseconds);
     return m_timestamp;
 }
 
-void teeio_debug_print(int debug_level, const char *format, ...)
+static void write_log_text(const char *text, uint32_t length)
 {
-    char buffer[IDE_MAX_LOG_MESSAGE_LENGTH] = {0};
-    va_list marker;
+    fwrite(text, 1, length, stdout);
+    if(m_logfile) {
+        fwrite(text, 1, length, m_logfile);
+    }
+}
 
-    if (debug_level > g_debug_level) {
+/**
+ * Write the published records to stdout and the log file.
+ * Return false if the drain mutex is not taken because wait is false.
+ */
+static bool drain_log_ring(bool wait)
+{
+    TEEIO_LOG_RECORD *record;
+    bool written = false;
+
+    if(wait) {
+        pthread_mutex_lock(&m_log_drain_mutex);
+    } else if(pthread_mutex_trylock(&m_log_drain_mutex) != 0) {
+        return false;
+    }
+
+    while(m_log_ring != NULL) {
+        record = m_log_ring + (m_log_tail & (TEEIO_LOG_RING_SIZE - 1));
+        if(__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != m_log_tail + 1) {
+            break;
+        }
+        write_log_text(record->text, record->length);
+        __atomic_store_n(&record->seq, m_log_tail + TEEIO_LOG_RING_SIZE, __ATOMIC_RELEASE);
+        m_log_tail++;
+        written = true;
+    }
+
+    if(written) {
+        fflush(stdout);
+        if(m_logfile) {
+            fflush(m_logfile);
+        }
+    }
+
+    pthread_mutex_unlock(&m_log_drain_mutex);
+    return true;
+}
+
+static void *log_writer_thread(void *arg)
+{
+    struct timespec interval = {0, TEEIO_LOG_FLUSH_INTERVAL_US * 1000};
+
+    while(__atomic_load_n(&m_log_writer_running, __ATOMIC_ACQUIRE)) {
+        drain_log_ring(true);
+        nanosleep(&interval, NULL);
+    }
+
+    return NULL;
+}
+
+static void log_fatal_signal_handler(int sig)
+{
+    // best effort. The ring is skipped if the crashing thread is draining it.
+    drain_log_ring(false);
+    raise(sig);
+}
+
+/**
+ * Reserve a slot in the ring. NULL if the logger is synchronous.
+ * The caller is counted as a producer until the record is published, so that
+ * teeio_log_close does not free the ring under it.
+ */
+static TEEIO_LOG_RECORD *reserve_log_record(uint64_t *seq)
+{
+    TEEIO_LOG_RECORD *record;
+    uint64_t pos;
+    int64_t diff;
+
+    // pairs with teeio_log_close, which clears m_log_async and then waits for the producers
+    __atomic_add_fetch(&m_log_producers, 1, __ATOMIC_SEQ_CST);
+    if(!__atomic_load_n(&m_log_async, __ATOMIC_SEQ_CST)) {
+        __atomic_sub_fetch(&m_log_producers, 1, __ATOMIC_RELEASE);
+        return NULL;
+    }
+
+    pos = __atomic_load_n(&m_log_head, __ATOMIC_RELAXED);
+    while(true) {
+        record = m_log_ring + (pos & (TEEIO_LOG_RING_SIZE - 1));
+        diff = (int64_t)(__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) - pos);
+        if(diff == 0) {
+            if(__atomic_compare_exchange_n(&m_log_head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *seq = pos;
+                return record;
+            }
+        } else if(diff < 0) {
+            // the ring is full. Wait for the writer to make room, or log synchronously once it is stopped.
+            if(!__atomic_load_n(&m_log_async, __ATOMIC_SEQ_CST)) {
+                __atomic_sub_fetch(&m_log_producers, 1, __ATOMIC_RELEASE);
+                return NULL;
+            }
+            sched_yield();
+            pos = __atomic_load_n(&m_log_head, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&m_log_head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void publish_log_record(TEEIO_LOG_RECORD *record, uint64_t seq, int length)
+{
+    if(length < 0) {
+        length = 0;
+    } else if(length >= TEEIO_LOG_RECORD_LENGTH) {
+        length = TEEIO_LOG_RECORD_LENGTH - 1;
+    }
+    record->length = (uint32_t)length;
+    __atomic_store_n(&record->seq, seq + 1, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&m_log_producers, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Start the writer thread. Log lines are queued from now on.
+ */
+bool teeio_log_init()
+{
+    struct sigaction action;
+
+    if(m_log_ring != NULL) {
+        return true;
+    }
+
+    m_log_ring = (TEEIO_LOG_RECORD *)malloc(TEEIO_LOG_RING_SIZE * sizeof(TEEIO_LOG_RECORD));
+    if(m_log_ring == NULL) {
+        return false;
+    }
+    for(uint64_t i = 0; i < TEEIO_LOG_RING_SIZE; i++) {
+        m_log_ring[i].seq = i;
+    }
+    m_log_head = 0;
+    m_log_tail = 0;
+
+    m_log_writer_running = true;
+    if(pthread_create(&m_log_writer, NULL, log_writer_thread, NULL) != 0) {
+        m_log_writer_running = false;
+        free(m_log_ring);
+        m_log_ring = NULL;
+        return false;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = log_fatal_signal_handler;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    for(int i = 0; i < sizeof(m_log_fatal_signals)/sizeof(int); i++) {
+        sigaction(m_log_fatal_signals[i], &action, NULL);
+    }
+
+    __atomic_store_n(&m_log_async, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * Write out the queued log lines.
+ */
+void teeio_log_flush()
+{
+    drain_log_ring(true);
+}
+
+/**
+ * Drain the ring, stop the writer thread and fall back to synchronous logging.
+ */
+void teeio_log_close()
+{
+    if(m_log_ring == NULL) {
         return;
     }
 
-    va_start(marker, format);
+    __atomic_store_n(&m_log_async, false, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&m_log_writer_running, false, __ATOMIC_RELEASE);
+    pthread_join(m_log_writer, NULL);
 
-    vsnprintf(buffer, sizeof(buffer), format, marker);
+    // new producers log synchronously now. Wait for the ones holding a record to publish it.
+    while(__atomic_load_n(&m_log_producers, __ATOMIC_SEQ_CST) != 0) {
+        sched_yield();
+    }
+    drain_log_ring(true);
 
-    va_end(marker);
+    for(int i = 0; i < sizeof(m_log_fatal_signals)/sizeof(int); i++) {
+        signal(m_log_fatal_signals[i], SIG_DFL);
+    }
+
+    pthread_mutex_lock(&m_log_drain_mutex);
+    free(m_log_ring);
+    m_log_ring = NULL;
+    pthread_mutex_unlock(&m_log_drain_mutex);
+}
+
+/**
+ * Tag the log lines of the calling thread with [tag]. NULL or "" removes the tag.
+ */
+void teeio_log_set_tag(const char *tag)
+{
+    if(tag == NULL || tag[0] == 0) {
+        m_log_tag[0] = 0;
+    } else {
+        snprintf(m_log_tag, sizeof(m_log_tag), "[%s]", tag);
+    }
+}
+
+/**
+ * Queue the pre-formatted text as it is. It is used by the libspdm debug log.
+ */
+void teeio_log_write(const char *text)
+{
+    TEEIO_LOG_RECORD *record;
+    uint64_t seq;
+
+    record = reserve_log_record(&seq);
+    if(record == NULL) {
+        write_log_text(text, strlen(text));
+        fflush(stdout);
+        if(m_logfile) {
+            fflush(m_logfile);
+        }
+        return;
+    }
+
+    strncpy(record->text, text, TEEIO_LOG_RECORD_LENGTH - 1);
+    publish_log_record(record, seq, strnlen(record->text, TEEIO_LOG_RECORD_LENGTH - 1));
+}
+
+static void teeio_log_vprint(const char *level, const char *format, va_list marker)
+{
+    char buffer[IDE_MAX_LOG_MESSAGE_LENGTH];
+    TEEIO_LOG_RECORD *record;
+    uint64_t seq;
+    int length;
 
     char* timestamp = current_time();
 
-    printf("[%s][%s] %s", timestamp, get_ide_log_level_string(debug_level), buffer);
+    record = reserve_log_record(&seq);
+    if(record == NULL) {
+        vsnprintf(buffer, sizeof(buffer), format, marker);
+        if(level != NULL) {
+            printf("[%s][%s]%s %s", timestamp, level, m_log_tag, buffer);
+        } else {
+            printf("[%s]%s %s", timestamp, m_log_tag, buffer);
+        }
+        if(m_logfile) {
+            if(level != NULL) {
+                fprintf(m_logfile, "[%s][%s]%s %s", timestamp, level, m_log_tag, buffer);
+            } else {
+                fprintf(m_logfile, "[%s]%s %s", timestamp, m_log_tag, buffer);
+            }
+            fflush(m_logfile);
+        }
+        return;
+    }
 
-    if(m_logfile) {
-        fprintf(m_logfile, "[%s][%s] %s", timestamp, get_ide_log_level_string(debug_level), buffer);
-        fflush(m_logfile);
+    if(level != NULL) {
+        length = snprintf(record->text, TEEIO_LOG_RECORD_LENGTH, "[%s][%s]%s ", timestamp, level, m_log_tag);
+    } else {
+        length = snprintf(record->text, TEEIO_LOG_RECORD_LENGTH, "[%s]%s ", timestamp, m_log_tag);
+    }
+    // the message is limited to IDE_MAX_LOG_MESSAGE_LENGTH as in synchronous mode
+    int message_length = vsnprintf(record->text + length, IDE_MAX_LOG_MESSAGE_LENGTH, format, marker);
+    if(message_length < 0) {
+        message_length = 0;
+    } else if(message_length >= IDE_MAX_LOG_MESSAGE_LENGTH) {
+        message_length = IDE_MAX_LOG_MESSAGE_LENGTH - 1;
     }
+    publish_log_record(record, seq, length + message_length);
 }
 
-void teeio_print(const char *format, ...)
+void teeio_debug_print(int debug_level, const char *format, ...)
 {
-    char buffer[IDE_MAX_LOG_MESSAGE_LENGTH] = {0};
     va_list marker;
 
+    if (debug_level > g_debug_level) {
+        return;
+    }
+
     va_start(marker, format);
+    teeio_log_vprint(get_ide_log_level_string(debug_level), format, marker);
+    va_end(marker);
+}
 
-    vsnprintf(buffer, sizeof(buffer), format, marker);
+void teeio_print(const char *format, ...)
+{
+    va_list marker;
 
+    va_start(marker, format);
+    teeio_log_vprint(NULL, format, marker);
     va_end(marker);
-
-    char* timestamp = current_time();
-    printf("[%s] %s", timestamp, buffer);
-    if(m_logfile) {
-        fprintf(m_logfile, "[%s] %s", timestamp, buffer);
-        fflush(m_logfile);
-    }
 }
 
 
@@ -126,6 +438,9 @@ void teeio_print(const char *format, ...)
 
 void debug_lib_assert(const char* which_assert, const char *file_name, int line_number, const char *description)
 {
+    // the queued lines lead to the assert, write them out first
+    teeio_log_flush();
+
     printf("%s: %s(%d): %s\n", which_assert, file_name, (int32_t)(uint32_t)line_number,
            description);
 
@@ -0,0 +1,150 @@
+/**
+ *  Copyright Notice:
+ *  Copyright 2024 Intel. All rights reserved.
+ *  License: BSD 3-Clause License.
+ **/
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "teeio_debug.h"
+#include "helperlib.h"
+
+/**
+ * Device backend.
+ *
+ * Configuration space, MMIO and ACPI table accesses of the validator go
+ * through the device backend. The default backend accesses the hardware
+ * through sysfs and /dev/mem. An emulated backend (see device_emu.h) can be
+ * installed before any device is opened so that the validator runs without
+ * TEE-IO hardware.
+ */
+
+static int sysfs_open_config_space(const char *bdf)
+{
+  char buf[MAX_FILE_NAME];
+  sprintf(buf, "/sys/bus/pci/devices/%s/config", bdf);
+
+  int fd = open(buf, O_RDWR);
+  if (fd == -1)
+  {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "open %s error!\n", buf));
+    return -1;
+  }
+  else
+  {
+    TEEIO_DEBUG((TEEIO_DEBUG_INFO, "successful open device with fd: %d\n", fd));
+  }
+  uint32_t size = lseek(fd, 0x0, SEEK_END);
+  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "cfg space size = %x\n", size));
+
+  if (size > 0x1000)
+  {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "cfg space size is not valid!(bdf: %s)\n", bdf));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static ssize_t sysfs_config_read(int fd, void *buffer, size_t size, uint32_t offset)
+{
+  return pread(fd, buffer, size, offset);
+}
+
+static ssize_t sysfs_config_write(int fd, const void *buffer, size_t size, uint32_t offset)
+{
+  return pwrite(fd, buffer, size, offset);
+}
+
+static uint8_t* sysfs_map_mmio(uint64_t addr, size_t size, int *mapped_fd)
+{
+  int mem_fd = open("/dev/mem", O_RDWR | O_SYNC);
+  if(mem_fd == -1) {
+    TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "Failed to open /dev/mem\n"));
+    return NULL;
+  }
+
+  uint8_t *mem_ptr = (uint8_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, addr);
+  if (mem_ptr == MAP_FAILED) {
+    TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "Failed to mmap 0x%llx\n", (unsigned long long)addr));
+    close(mem_fd);
+    return NULL;
+  }
+
+  *mapped_fd = mem_fd;
+  return mem_ptr;
+}
+
+static void sysfs_unmap_mmio(int mapped_fd, uint8_t *mapped_addr, size_t size)
+{
+  munmap(mapped_addr, size);
+  close(mapped_fd);
+}
+
+static int sysfs_read_acpi_table(const char *signature, uint8_t *buffer, uint32_t size)
+{
+  char path[MAX_FILE_NAME];
+  snprintf(path, sizeof(path), "/sys/firmware/acpi/tables/%s", signature);
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+  {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Error opening %s. (%s)\n", signature, path));
+    return -1;
+  }
+
+  uint32_t table_size = lseek(fd, 0x0, SEEK_END);
+  if (table_size > size)
+  {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "%s is too large. (0x%x)\n", signature, table_size));
+    close(fd);
+    return -1;
+  }
+
+  lseek(fd, 0, SEEK_SET);
+  ssize_t bytes_read = read(fd, buffer, table_size);
+  close(fd);
+
+  return bytes_read == table_size ? (int)table_size : -1;
+}
+
+static void sysfs_close_config_space(int fd)
+{
+  close(fd);
+}
+
+static const teeio_device_backend_t m_sysfs_device_backend = {
+  .name = "sysfs",
+  .open_config_space = sysfs_open_config_space,
+  .close_config_space = sysfs_close_config_space,
+  .config_read = sysfs_config_read,
+  .config_write = sysfs_config_write,
+  .map_mmio = sysfs_map_mmio,
+  .unmap_mmio = sysfs_unmap_mmio,
+  .read_acpi_table = sysfs_read_acpi_table
+};
+
+static const teeio_device_backend_t *m_device_backend = &m_sysfs_device_backend;
+
+/**
+ * Install the device backend. NULL restores the sysfs backend.
+ * It shall be called before any device is opened.
+ */
+void set_device_backend(const teeio_device_backend_t *backend)
+{
+  m_device_backend = backend == NULL ? &m_sysfs_device_backend : backend;
+  // the capabilities are read through the backend
+  invalidate_all_device_cap_index();
+  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "device backend: %s\n", m_device_backend->name));
+}
+
+const teeio_device_backend_t *get_device_backend()
+{
+  return m_device_backend;
+}
@@ -0,0 +1,687 @@
+/**
+ *  Copyright Notice:
+ *  Copyright 2024 Intel. All rights reserved.
+ *  License: BSD 3-Clause License.
+ **/
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "teeio_debug.h"
+#include "helperlib.h"
+#include "device_emu.h"
+
+extern const char *IDE_PORT_TYPE_NAMES[];
+
+/**
+ * Device emulator.
+ *
+ * Each emulated device owns a 4K configuration space which is plain storage
+ * except for below registers:
+ *  - DOE Control/Status/Write Data Mailbox/Read Data Mailbox of the endpoints.
+ *    A request written into the mailbox is answered on DOE Go. DOE Discovery
+ *    is answered by the emulator, other data objects are handed over to the
+ *    responder registered by device_emu_register_doe_responder. No responder
+ *    is built in, so without one only DOE Discovery is advertised and the
+ *    SPDM based test groups fail to connect. The response becomes ready
+ *    latency_us later and DOE Busy is reported until then.
+ *  - Selective IDE Stream Status reports Secure when the stream is enabled.
+ *  - Capability headers, IDE Capability and DOE Capability are read-only.
+ *
+ * An emulated configuration space is opened as a /dev/null fd. It is released
+ * by close_config_space so that the fd number can be reused. KCBAR of the root ports is backed by
+ * memory which persists between map and unmap, like the hardware registers.
+ */
+
+#define DEVICE_EMU_VENDOR_ID  0x8086
+#define DEVICE_EMU_DEVICE_ID  0x0de0
+
+#define DEVICE_EMU_PCIE_CAP_OFFSET  0x40
+#define DEVICE_EMU_IDE_ECAP_OFFSET  0x100
+#define DEVICE_EMU_DOE_ECAP_OFFSET  0x200
+// Selective IDE Stream Register Blocks follow IDE Capability/Control. Each of them has 1 Address Association Register Block.
+#define DEVICE_EMU_SEL_IDE_STREAM_OFFSET  (DEVICE_EMU_IDE_ECAP_OFFSET + sizeof(PCIE_IDE_ECAP))
+#define DEVICE_EMU_SEL_IDE_STREAM_SIZE  (sizeof(PCIE_SEL_IDE_STREAM_REG_BLOCK) + sizeof(PCIE_SEL_IDE_ADDR_ASSOC_REG_BLOCK))
+
+#define DEVICE_EMU_DOE_CAPABILITIES_OFFSET  0x04
+#define DEVICE_EMU_DOE_CONTROL_OFFSET       0x08
+#define   DEVICE_EMU_DOE_CONTROL_ABORT        0x00000001
+#define   DEVICE_EMU_DOE_CONTROL_GO           0x80000000
+#define DEVICE_EMU_DOE_STATUS_OFFSET        0x0C
+#define   DEVICE_EMU_DOE_STATUS_BUSY          0x00000001
+#define   DEVICE_EMU_DOE_STATUS_ERROR         0x00000004
+#define   DEVICE_EMU_DOE_STATUS_READY         0x80000000
+#define DEVICE_EMU_DOE_WRITE_MAILBOX_OFFSET 0x10
+#define DEVICE_EMU_DOE_READ_MAILBOX_OFFSET  0x14
+#define DEVICE_EMU_DOE_REGS_SIZE            0x18
+
+// max size of a data object in dwords
+#define DEVICE_EMU_DOE_MAX_DW  4096
+#define DEVICE_EMU_DOE_LENGTH_MASK  0x3ffff
+
+#define DEVICE_EMU_MAX_FD_NUM  1024
+
+// PCIe Express Capabilities Register - Device/Port Type
+#define DEVICE_EMU_PCIE_TYPE_ENDPOINT  0x0
+#define DEVICE_EMU_PCIE_TYPE_ROOT_PORT  0x4
+#define DEVICE_EMU_PCIE_TYPE_DOWNSTREAM_PORT  0x6
+
+typedef struct {
+  uint16_t vendor_id;
+  uint8_t data_object_type;
+} device_emu_doe_protocol_t;
+
+static const device_emu_doe_protocol_t m_emu_doe_protocols[] = {
+  {0x0001, 0x00},   // DOE Discovery
+  {0x0001, 0x01},   // SPDM
+  {0x0001, 0x02}    // Secured SPDM
+};
+
+#define DEVICE_EMU_DOE_PROTOCOL_NUM (sizeof(m_emu_doe_protocols) / sizeof(device_emu_doe_protocol_t))
+
+typedef struct {
+  uint32_t control;
+  bool error;
+  uint32_t request[DEVICE_EMU_DOE_MAX_DW];
+  uint32_t request_dw;
+  uint32_t response[DEVICE_EMU_DOE_MAX_DW];
+  uint32_t response_dw;
+  uint32_t read_index;
+  uint64_t ready_ns;
+} device_emu_doe_mailbox_t;
+
+typedef struct {
+  char bdf[BDF_LENGTH];
+  IDE_PORT_TYPE port_type;
+  bool has_doe;
+  uint8_t config_space[PCIE_CONFIG_SPACE_SIZE];
+  device_emu_doe_mailbox_t doe;
+} device_emu_device_t;
+
+static device_emu_device_t *m_emu_devices[DEVICE_EMU_MAX_DEVICE_NUM] = {0};
+static int m_emu_device_cnt = 0;
+// fd => index + 1 of m_emu_devices[]. 0 means the fd is not an emulated configuration space.
+static uint8_t m_emu_fd_to_device[DEVICE_EMU_MAX_FD_NUM] = {0};
+// KCBAR of PCIE/CXL.IO followed by KCBAR of CXL.memcache, one per device
+static uint8_t *m_emu_kcbar = NULL;
+static uint64_t m_emu_latency_ns = 0;
+static device_emu_doe_responder_func m_emu_doe_responder = NULL;
+static pthread_mutex_t m_emu_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t *config_dw(device_emu_device_t *device, uint32_t offset)
+{
+  return (uint32_t *)(device->config_space + offset);
+}
+
+static uint8_t get_pcie_port_type(IDE_PORT_TYPE port_type)
+{
+  if(port_type == IDE_PORT_TYPE_ROOTPORT) {
+    return DEVICE_EMU_PCIE_TYPE_ROOT_PORT;
+  } else if(port_type == IDE_PORT_TYPE_SWITCH) {
+    return DEVICE_EMU_PCIE_TYPE_DOWNSTREAM_PORT;
+  }
+  return DEVICE_EMU_PCIE_TYPE_ENDPOINT;
+}
+
+static void init_config_space(device_emu_device_t *device, uint8_t primary_bus, uint8_t secondary_bus)
+{
+  bool is_bridge = device->port_type != IDE_PORT_TYPE_ENDPOINT;
+  PCIE_CAP_ID ecap = {.raw = 0};
+  PCIE_IDE_CAP ide_cap = {.raw = 0};
+  PCIE_SEL_IDE_STREAM_CAP sel_ide_stream_cap = {.raw = 0};
+  PCIE_CAP pcie_cap = {.raw = 0};
+  uint32_t offset;
+
+  *config_dw(device, 0x00) = DEVICE_EMU_VENDOR_ID | (DEVICE_EMU_DEVICE_ID << 16);
+  // Capabilities List, Bus Master and Memory Space Enable
+  *config_dw(device, 0x04) = 0x00100006;
+  // Class Code: PCI-to-PCI bridge or processing accelerator
+  *config_dw(device, 0x08) = is_bridge ? 0x06040000 : 0x12000000;
+  *config_dw(device, 0x0c) = (is_bridge ? 0x01 : 0x00) << 16;
+  if(is_bridge) {
+    *config_dw(device, 0x18) = primary_bus | (secondary_bus << 8) | (secondary_bus << 16);
+  }
+  device->config_space[0x34] = DEVICE_EMU_PCIE_CAP_OFFSET;
+
+  // PCI Express Capability
+  pcie_cap.cap_version = 2;
+  pcie_cap.dev_port_type = get_pcie_port_type(device->port_type);
+  *config_dw(device, DEVICE_EMU_PCIE_CAP_OFFSET) = PCIE_CAPABILITY_ID | (pcie_cap.raw << 16);
+
+  // IDE Extended Capability
+  ecap.id = PCI_IDE_EXT_CAPABILITY_ID;
+  ecap.version = 1;
+  ecap.next_cap_offset = device->has_doe ? DEVICE_EMU_DOE_ECAP_OFFSET : 0;
+  *config_dw(device, DEVICE_EMU_IDE_ECAP_OFFSET) = ecap.raw;
+  ide_cap.sel_ide_supported = 1;
+  ide_cap.ide_km_protocol_supported = 1;
+  ide_cap.num_sel_ide = DEVICE_EMU_SEL_IDE_STREAM_NUM - 1;
+  *config_dw(device, DEVICE_EMU_IDE_ECAP_OFFSET + 4) = ide_cap.raw;
+
+  sel_ide_stream_cap.num_addr_assoc_reg_blocks = 1;
+  for(int i = 0; i < DEVICE_EMU_SEL_IDE_STREAM_NUM; i++) {
+    offset = DEVICE_EMU_SEL_IDE_STREAM_OFFSET + i * DEVICE_EMU_SEL_IDE_STREAM_SIZE;
+    *config_dw(device, offset) = sel_ide_stream_cap.raw;
+  }
+
+  // DOE Extended Capability
+  if(device->has_doe) {
+    ecap.id = PCI_DOE_EXT_CAPABILITY_ID;
+    ecap.version = PCIE_DOE_ECAP_VERSION2;
+    ecap.next_cap_offset = 0;
+    *config_dw(device, DEVICE_EMU_DOE_ECAP_OFFSET) = ecap.raw;
+  }
+}
+
+bool device_emu_init(uint32_t latency_us)
+{
+  if(m_emu_kcbar == NULL) {
+    m_emu_kcbar = (uint8_t *)calloc(2 * DEVICE_EMU_MAX_DEVICE_NUM, DEVICE_EMU_KCBAR_SIZE);
+    if(m_emu_kcbar == NULL) {
+      TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to allocate emulated KCBAR.\n"));
+      return false;
+    }
+  }
+
+  m_emu_latency_ns = (uint64_t)latency_us * 1000;
+  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "device emulator: DOE latency %dus\n", latency_us));
+
+  return true;
+}
+
+void device_emu_close()
+{
+  pthread_mutex_lock(&m_emu_mutex);
+  for(int i = 0; i < m_emu_device_cnt; i++) {
+    free(m_emu_devices[i]);
+    m_emu_devices[i] = NULL;
+  }
+  m_emu_device_cnt = 0;
+  memset(m_emu_fd_to_device, 0, sizeof(m_emu_fd_to_device));
+  pthread_mutex_unlock(&m_emu_mutex);
+
+  if(m_emu_kcbar != NULL) {
+    free(m_emu_kcbar);
+    m_emu_kcbar = NULL;
+  }
+}
+
+static int find_emu_device(const char *bdf)
+{
+  for(int i = 0; i < m_emu_device_cnt; i++) {
+    if(strcmp(m_emu_devices[i]->bdf, bdf) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool device_emu_add_device(const char *bdf, IDE_PORT_TYPE port_type, uint8_t secondary_bus)
+{
+  char bdf_str[BDF_LENGTH] = {0};
+  uint16_t segment;
+  uint8_t bus, device, function;
+  device_emu_device_t *emu_device = NULL;
+  bool res = false;
+
+  strncpy(bdf_str, bdf, BDF_LENGTH - 1);
+  if(!parse_bdf_string((uint8_t *)bdf_str, &segment, &bus, &device, &function)) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "device emulator: invalid bdf %s\n", bdf));
+    return false;
+  }
+
+  pthread_mutex_lock(&m_emu_mutex);
+  if(find_emu_device(bdf) >= 0) {
+    // the device is shared by topologies
+    res = true;
+    goto Done;
+  }
+
+  if(m_emu_device_cnt == DEVICE_EMU_MAX_DEVICE_NUM) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "device emulator: too many devices. (%s)\n", bdf));
+    goto Done;
+  }
+
+  emu_device = (device_emu_device_t *)calloc(1, sizeof(device_emu_device_t));
+  if(emu_device == NULL) {
+    goto Done;
+  }
+
+  strncpy(emu_device->bdf, bdf, BDF_LENGTH - 1);
+  emu_device->port_type = port_type;
+  emu_device->has_doe = port_type == IDE_PORT_TYPE_ENDPOINT;
+  init_config_space(emu_device, bus, secondary_bus);
+
+  m_emu_devices[m_emu_device_cnt++] = emu_device;
+  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "device emulator: add %s (%s)\n", bdf, IDE_PORT_TYPE_NAMES[port_type]));
+  res = true;
+
+Done:
+  pthread_mutex_unlock(&m_emu_mutex);
+  return res;
+}
+
+static bool add_topology_port(IDE_PORT *port, IDE_PORT_TYPE port_type, uint16_t segment, uint8_t *bus)
+{
+  char bdf[BDF_LENGTH] = {0};
+  uint8_t secondary_bus = port_type == IDE_PORT_TYPE_ENDPOINT ? 0 : *bus + 1;
+
+  TEEIO_ASSERT(port != NULL);
+  snprintf(bdf, BDF_LENGTH, "%04x:%02x:%02x.%x", segment, *bus, port->device, port->function & 0xf);
+  if(!device_emu_add_device(bdf, port_type, secondary_bus)) {
+    return false;
+  }
+
+  *bus = secondary_bus;
+  return true;
+}
+
+bool device_emu_add_topology(IDE_TEST_CONFIG *test_config, IDE_TEST_TOPOLOGY *top)
+{
+  uint8_t bus = top->bus;
+  IDE_SWITCH_INTERNAL_CONNECTION *conn = top->sw_conn1;
+
+  if(!add_topology_port(get_port_by_id(test_config, top->root_port), IDE_PORT_TYPE_ROOTPORT, top->segment, &bus)) {
+    return false;
+  }
+
+  while(conn != NULL) {
+    IDE_SWITCH *sw = get_switch_by_id(test_config, conn->switch_id);
+    TEEIO_ASSERT(sw);
+    if(!add_topology_port(get_port_from_switch_by_id(sw, conn->ups_port), IDE_PORT_TYPE_SWITCH, top->segment, &bus) ||
+       !add_topology_port(get_port_from_switch_by_id(sw, conn->dps_port), IDE_PORT_TYPE_SWITCH, top->segment, &bus)) {
+      return false;
+    }
+    conn = conn->next;
+  }
+
+  return add_topology_port(get_port_by_id(test_config, top->lower_port), IDE_PORT_TYPE_ENDPOINT, top->segment, &bus);
+}
+
+void device_emu_register_doe_responder(device_emu_doe_responder_func responder)
+{
+  m_emu_doe_responder = responder;
+}
+
+static device_emu_device_t *get_emu_device_by_fd(int fd)
+{
+  if(fd <= 0 || fd >= DEVICE_EMU_MAX_FD_NUM || m_emu_fd_to_device[fd] == 0) {
+    return NULL;
+  }
+  return m_emu_devices[m_emu_fd_to_device[fd] - 1];
+}
+
+static void answer_doe_discovery(device_emu_doe_mailbox_t *doe)
+{
+  uint8_t index = doe->request[2] & 0xff;
+  // SPDM and Secured SPDM are handed over to the responder
+  uint8_t protocol_num = m_emu_doe_responder == NULL ? 1 : DEVICE_EMU_DOE_PROTOCOL_NUM;
+
+  if(doe->request_dw != 3 || index >= protocol_num) {
+    doe->error = true;
+    return;
+  }
+
+  doe->response[0] = doe->request[0];
+  doe->response[1] = 3;
+  doe->response[2] = m_emu_doe_protocols[index].vendor_id |
+                     (m_emu_doe_protocols[index].data_object_type << 16) |
+                     ((index + 1 < protocol_num ? index + 1 : 0) << 24);
+  doe->response_dw = 3;
+}
+
+static void answer_doe_request(device_emu_device_t *device)
+{
+  device_emu_doe_mailbox_t *doe = &device->doe;
+  size_t response_size = sizeof(doe->response);
+  uint32_t length;
+
+  doe->response_dw = 0;
+  doe->read_index = 0;
+
+  if(doe->request_dw < 2) {
+    doe->error = true;
+    goto Done;
+  }
+  length = doe->request[1] & DEVICE_EMU_DOE_LENGTH_MASK;
+  if(length != doe->request_dw) {
+    TEEIO_DEBUG((TEEIO_DEBUG_WARN, "device emulator: %s DOE length mismatch. (%d, %d)\n", device->bdf, length, doe->request_dw));
+    doe->error = true;
+    goto Done;
+  }
+
+  if(doe->request[0] == (uint32_t)(m_emu_doe_protocols[0].vendor_id | (m_emu_doe_protocols[0].data_object_type << 16))) {
+    answer_doe_discovery(doe);
+    goto Done;
+  }
+
+  if(m_emu_doe_responder == NULL ||
+     !m_emu_doe_responder(device->bdf, (uint8_t *)doe->request, doe->request_dw * sizeof(uint32_t),
+                          (uint8_t *)doe->response, &response_size) ||
+     response_size > sizeof(doe->response)) {
+    doe->error = true;
+    goto Done;
+  }
+  doe->response_dw = (uint32_t)((response_size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+
+Done:
+  doe->request_dw = 0;
+  doe->ready_ns = get_monotonic_time_ns() + m_emu_latency_ns;
+}
+
+// refresh DOE Status and Read Data Mailbox from the state of the mailbox
+static void update_doe_registers(device_emu_device_t *device)
+{
+  device_emu_doe_mailbox_t *doe = &device->doe;
+  uint32_t status = 0;
+  uint32_t read_mailbox = 0;
+
+  if(doe->error) {
+    status |= DEVICE_EMU_DOE_STATUS_ERROR;
+  } else if(doe->response_dw != 0) {
+    if(get_monotonic_time_ns() < doe->ready_ns) {
+      status |= DEVICE_EMU_DOE_STATUS_BUSY;
+    } else {
+      status |= DEVICE_EMU_DOE_STATUS_READY;
+      read_mailbox = doe->response[doe->read_index];
+    }
+  }
+
+  *config_dw(device, DEVICE_EMU_DOE_ECAP_OFFSET + DEVICE_EMU_DOE_CONTROL_OFFSET) = doe->control;
+  *config_dw(device, DEVICE_EMU_DOE_ECAP_OFFSET + DEVICE_EMU_DOE_STATUS_OFFSET) = status;
+  *config_dw(device, DEVICE_EMU_DOE_ECAP_OFFSET + DEVICE_EMU_DOE_READ_MAILBOX_OFFSET) = read_mailbox;
+}
+
+static void write_doe_register(device_emu_device_t *device, uint32_t reg, uint32_t value)
+{
+  device_emu_doe_mailbox_t *doe = &device->doe;
+
+  switch(reg) {
+    case DEVICE_EMU_DOE_CONTROL_OFFSET:
+      if(value & DEVICE_EMU_DOE_CONTROL_ABORT) {
+        doe->error = false;
+        doe->request_dw = 0;
+        doe->response_dw = 0;
+        doe->read_index = 0;
+      } else if(value & DEVICE_EMU_DOE_CONTROL_GO) {
+        answer_doe_request(device);
+      }
+      doe->control = value & ~(DEVICE_EMU_DOE_CONTROL_ABORT | DEVICE_EMU_DOE_CONTROL_GO);
+      break;
+
+    case DEVICE_EMU_DOE_WRITE_MAILBOX_OFFSET:
+      if(doe->request_dw == DEVICE_EMU_DOE_MAX_DW) {
+        doe->error = true;
+      } else {
+        doe->request[doe->request_dw++] = value;
+      }
+      break;
+
+    case DEVICE_EMU_DOE_READ_MAILBOX_OFFSET:
+      // any write pops the current dword of the response
+      if(doe->response_dw != 0 && ++doe->read_index >= doe->response_dw) {
+        doe->response_dw = 0;
+        doe->read_index = 0;
+      }
+      break;
+
+    default:
+      // DOE Capabilities is read-only. DOE Interrupt Status is not emulated.
+      break;
+  }
+}
+
+static bool is_read_only_register(uint32_t offset)
+{
+  uint32_t sel_stream_offset;
+
+  if(offset < 0x10 || offset == DEVICE_EMU_PCIE_CAP_OFFSET ||
+     offset == DEVICE_EMU_IDE_ECAP_OFFSET || offset == DEVICE_EMU_IDE_ECAP_OFFSET + 4) {
+    return true;
+  }
+
+  if(offset >= DEVICE_EMU_SEL_IDE_STREAM_OFFSET &&
+     offset < DEVICE_EMU_SEL_IDE_STREAM_OFFSET + DEVICE_EMU_SEL_IDE_STREAM_NUM * DEVICE_EMU_SEL_IDE_STREAM_SIZE) {
+    sel_stream_offset = (offset - DEVICE_EMU_SEL_IDE_STREAM_OFFSET) % DEVICE_EMU_SEL_IDE_STREAM_SIZE;
+    // Selective IDE Stream Capability and Status
+    return sel_stream_offset == 0 || sel_stream_offset == 8;
+  }
+
+  return false;
+}
+
+// Selective IDE Stream Status follows the enabled bit of its Control
+static void update_sel_ide_stream_status(device_emu_device_t *device, uint32_t offset)
+{
+  uint32_t sel_stream_offset;
+  PCIE_SEL_IDE_STREAM_CTRL ctrl;
+  PCIE_SEL_IDE_STREAM_STATUS status = {.raw = 0};
+
+  if(offset < DEVICE_EMU_SEL_IDE_STREAM_OFFSET ||
+     offset >= DEVICE_EMU_SEL_IDE_STREAM_OFFSET + DEVICE_EMU_SEL_IDE_STREAM_NUM * DEVICE_EMU_SEL_IDE_STREAM_SIZE) {
+    return;
+  }
+
+  sel_stream_offset = (offset - DEVICE_EMU_SEL_IDE_STREAM_OFFSET) % DEVICE_EMU_SEL_IDE_STREAM_SIZE;
+  if(sel_stream_offset != 4) {
+    return;
+  }
+
+  ctrl.raw = *config_dw(device, offset);
+  status.state = ctrl.enabled ? IDE_STREAM_STATUS_SECURE : IDE_STREAM_STATUS_INSECURE;
+  *config_dw(device, offset + 4) = status.raw;
+}
+
+static int emu_open_config_space(const char *bdf)
+{
+  int fd = -1;
+  int index;
+
+  pthread_mutex_lock(&m_emu_mutex);
+  index = find_emu_device(bdf);
+  if(index < 0) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "device emulator: %s is not emulated.\n", bdf));
+    goto Done;
+  }
+
+  fd = open("/dev/null", O_RDWR);
+  if(fd == -1) {
+    goto Done;
+  }
+  if(fd >= DEVICE_EMU_MAX_FD_NUM) {
+    close(fd);
+    fd = -1;
+    goto Done;
+  }
+
+  m_emu_fd_to_device[fd] = index + 1;
+  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "successful open emulated device %s with fd: %d\n", bdf, fd));
+
+Done:
+  pthread_mutex_unlock(&m_emu_mutex);
+  return fd;
+}
+
+static void emu_close_config_space(int fd)
+{
+  pthread_mutex_lock(&m_emu_mutex);
+  if(fd > 0 && fd < DEVICE_EMU_MAX_FD_NUM) {
+    m_emu_fd_to_device[fd] = 0;
+  }
+  pthread_mutex_unlock(&m_emu_mutex);
+
+  close(fd);
+}
+
+static ssize_t emu_config_read(int fd, void *buffer, size_t size, uint32_t offset)
+{
+  device_emu_device_t *device;
+  ssize_t read_size = -1;
+
+  pthread_mutex_lock(&m_emu_mutex);
+  device = get_emu_device_by_fd(fd);
+  if(device == NULL || offset >= PCIE_CONFIG_SPACE_SIZE) {
+    goto Done;
+  }
+
+  if(device->has_doe) {
+    update_doe_registers(device);
+  }
+
+  read_size = offset + size > PCIE_CONFIG_SPACE_SIZE ? PCIE_CONFIG_SPACE_SIZE - offset : size;
+  memcpy(buffer, device->config_space + offset, read_size);
+
+Done:
+  pthread_mutex_unlock(&m_emu_mutex);
+  return read_size;
+}
+
+static ssize_t emu_config_write(int fd, const void *buffer, size_t size, uint32_t offset)
+{
+  device_emu_device_t *device;
+  ssize_t write_size = -1;
+  uint32_t value = 0;
+
+  pthread_mutex_lock(&m_emu_mutex);
+  device = get_emu_device_by_fd(fd);
+  if(device == NULL || offset + size > PCIE_CONFIG_SPACE_SIZE) {
+    goto Done;
+  }
+  write_size = size;
+
+  if(device->has_doe && offset >= DEVICE_EMU_DOE_ECAP_OFFSET &&
+     offset < DEVICE_EMU_DOE_ECAP_OFFSET + DEVICE_EMU_DOE_REGS_SIZE) {
+    // DOE registers are accessed in dwords
+    if(size == sizeof(uint32_t) && (offset & 0x3) == 0) {
+      memcpy(&value, buffer, sizeof(value));
+      write_doe_register(device, offset - DEVICE_EMU_DOE_ECAP_OFFSET, value);
+    }
+    goto Done;
+  }
+
+  if(is_read_only_register(offset & ~0x3)) {
+    goto Done;
+  }
+
+  memcpy(device->config_space + offset, buffer, size);
+  update_sel_ide_stream_status(device, offset & ~0x3);
+
+Done:
+  pthread_mutex_unlock(&m_emu_mutex);
+  return write_size;
+}
+
+static uint8_t* emu_map_mmio(uint64_t addr, size_t size, int *mapped_fd)
+{
+  uint64_t kcbar_end = DEVICE_EMU_KCBAR_BASE + 2 * DEVICE_EMU_MAX_DEVICE_NUM * DEVICE_EMU_KCBAR_SIZE;
+  uint8_t *mem_ptr;
+
+  int fd = open("/dev/null", O_RDWR);
+  if(fd == -1) {
+    return NULL;
+  }
+
+  if(m_emu_kcbar != NULL && addr >= DEVICE_EMU_KCBAR_BASE && addr + size <= kcbar_end) {
+    mem_ptr = m_emu_kcbar + (addr - DEVICE_EMU_KCBAR_BASE);
+  } else {
+    // other MMIO, e.g. CXL.cachemem component registers, is not kept after unmap
+    mem_ptr = (uint8_t *)calloc(1, size);
+    if(mem_ptr == NULL) {
+      close(fd);
+      return NULL;
+    }
+  }
+
+  *mapped_fd = fd;
+  return mem_ptr;
+}
+
+static void emu_unmap_mmio(int mapped_fd, uint8_t *mapped_addr, size_t size)
+{
+  uint8_t *kcbar_end = m_emu_kcbar + 2 * DEVICE_EMU_MAX_DEVICE_NUM * DEVICE_EMU_KCBAR_SIZE;
+
+  if(m_emu_kcbar == NULL || mapped_addr < m_emu_kcbar || mapped_addr >= kcbar_end) {
+    free(mapped_addr);
+  }
+  close(mapped_fd);
+}
+
+static uint32_t add_keyp_kcu(uint8_t *buffer, device_emu_device_t *device, INTEL_KEYP_PROTOCOL_TYPE protocol, uint64_t kcbar_addr)
+{
+  INTEL_KEYP_KEY_CONFIGURATION_UNIT *kcu = (INTEL_KEYP_KEY_CONFIGURATION_UNIT *)buffer;
+  INTEL_KEYP_ROOT_PORT_INFORMATION *krpi = (INTEL_KEYP_ROOT_PORT_INFORMATION *)(kcu + 1);
+  uint16_t segment;
+  uint8_t bus, dev, func;
+
+  parse_bdf_string((uint8_t *)device->bdf, &segment, &bus, &dev, &func);
+
+  kcu->Length = sizeof(INTEL_KEYP_KEY_CONFIGURATION_UNIT) + sizeof(INTEL_KEYP_ROOT_PORT_INFORMATION);
+  kcu->ProtocolType = protocol;
+  kcu->Version = 1;
+  kcu->RootPortCount = 1;
+  kcu->RegisterBaseAddr = kcbar_addr;
+  krpi->SegmentNumber = segment;
+  krpi->Bus = bus;
+  krpi->Bits.Device = dev;
+  krpi->Bits.Function = func;
+
+  return kcu->Length;
+}
+
+// KEYP has a Key Configuration Unit of each protocol for each root port
+static int emu_read_acpi_table(const char *signature, uint8_t *buffer, uint32_t size)
+{
+  const uint32_t kcu_size = sizeof(INTEL_KEYP_KEY_CONFIGURATION_UNIT) + sizeof(INTEL_KEYP_ROOT_PORT_INFORMATION);
+  INTEL_KEYP_ACPI *keyp = (INTEL_KEYP_ACPI *)buffer;
+  uint32_t offset = sizeof(INTEL_KEYP_ACPI);
+
+  if(strcmp(signature, "KEYP") != 0 || size < offset) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "device emulator: ACPI table %s is not emulated.\n", signature));
+    return -1;
+  }
+
+  memset(buffer, 0, size);
+  pthread_mutex_lock(&m_emu_mutex);
+  for(int i = 0; i < m_emu_device_cnt; i++) {
+    if(m_emu_devices[i]->port_type != IDE_PORT_TYPE_ROOTPORT) {
+      continue;
+    }
+    if(offset + 2 * kcu_size > size) {
+      break;
+    }
+    offset += add_keyp_kcu(buffer + offset, m_emu_devices[i], INTEL_KEYP_PROTOCOL_TYPE_PCIE_CXLIO,
+                           DEVICE_EMU_KCBAR_BASE + i * DEVICE_EMU_KCBAR_SIZE);
+    offset += add_keyp_kcu(buffer + offset, m_emu_devices[i], INTEL_KEYP_PROTOCOL_TYPE_CXL_MEMCACHE,
+                           DEVICE_EMU_KCBAR_BASE + (DEVICE_EMU_MAX_DEVICE_NUM + i) * DEVICE_EMU_KCBAR_SIZE);
+  }
+  pthread_mutex_unlock(&m_emu_mutex);
+
+  memcpy(keyp->signature, "KEYP", sizeof(keyp->signature));
+  keyp->length = offset;
+  keyp->revision = 1;
+  keyp->check_sum = (uint8_t)(0 - calculate_checksum(buffer, offset));
+
+  return (int)offset;
+}
+
+static const teeio_device_backend_t m_emu_device_backend = {
+  .name = "emulator",
+  .open_config_space = emu_open_config_space,
+  .close_config_space = emu_close_config_space,
+  .config_read = emu_config_read,
+  .config_write = emu_config_write,
+  .map_mmio = emu_map_mmio,
+  .unmap_mmio = emu_unmap_mmio,
+  .read_acpi_table = emu_read_acpi_table
+};
+
+const teeio_device_backend_t *device_emu_get_backend()
+{
+  return &m_emu_device_backend;
+}
@@ -11,11 +11,14 @@
 #include "pcie.h"
 #include "intel_keyp.h"
 #include "ide_test.h"
+#include "helperlib.h"
 
 typedef struct
 {
     int fd;
     char device_name[MAX_NAME_LENGTH];
+    uint16_t trace_id;
+    PCIE_CAP_INDEX cap_index;
 } IDE_TEST_DEVICES_INFO;
 
 IDE_TEST_DEVICES_INFO *get_device_info_by_fd(int fp);
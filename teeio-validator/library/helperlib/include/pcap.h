@@ -7,12 +7,25 @@
 #ifndef __SPDM_PCAP_H__
 #define __SPDM_PCAP_H__
 
-bool open_pcap_packet_file(const char *pcap_file_name, uint32_t transport_layer);
+#include "ide_test.h"
+
+// direction of a packet. The values are those of the pcapng epb_flags direction bits.
+typedef enum {
+    PCAP_PACKET_DIRECTION_UNKNOWN = 0,
+    PCAP_PACKET_DIRECTION_INBOUND = 1,
+    PCAP_PACKET_DIRECTION_OUTBOUND = 2
+} PCAP_PACKET_DIRECTION;
+
+bool open_pcap_packet_file(const char *pcap_file_name, uint32_t transport_layer, PCAP_FILE_FORMAT format);
 
 void close_pcap_packet_file(void);
 
 void append_pcap_packet_data(const void *header, size_t header_size,
                              const void *data, size_t size);
 
+void append_pcap_packet_data_ex(const char *device, PCAP_PACKET_DIRECTION direction,
+                                const void *header, size_t header_size,
+                                const void *data, size_t size);
+
 
 #endif
@@ -0,0 +1,119 @@
+/**
+ *  Copyright Notice:
+ *  Copyright 2024 Intel. All rights reserved.
+ *  License: BSD 3-Clause License.
+ **/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "teeio_debug.h"
+#include "helperlib.h"
+
+/**
+ * KeyRefresh benchmark.
+ *
+ * The KeyRefresh cases run a fixed number of refreshes without waiting for
+ * the tester. Each refresh is started at start + n * interval so that the
+ * refresh rate does not drift with the latency of the refreshes. If a refresh
+ * takes longer than the interval the next one is started right away.
+ * The latency of each phase of every refresh is kept and the throughput and
+ * the tail latency are reported after the last refresh.
+ */
+
+static const char* m_keyrefresh_phase_str[KEYREFRESH_PHASE_NUM] = {
+  "KEY_GEN",
+  "KEY_PROG",
+  "RP_KEY_PROG",
+  "K_SET_GO",
+  "TOTAL"
+};
+
+bool keyrefresh_bench_init(keyrefresh_bench_t *bench, int rounds, int interval_us)
+{
+  TEEIO_ASSERT(bench);
+  TEEIO_ASSERT(rounds > 0);
+
+  memset(bench, 0, sizeof(keyrefresh_bench_t));
+
+  bench->samples = (uint64_t *)calloc((size_t)rounds * KEYREFRESH_PHASE_NUM, sizeof(uint64_t));
+  if(bench->samples == NULL) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to allocate keyrefresh samples (%d rounds).\n", rounds));
+    return false;
+  }
+
+  bench->capacity = rounds;
+  bench->interval_ns = interval_us > 0 ? (uint64_t)interval_us * 1000 : 0;
+  bench->start_ns = get_monotonic_time_ns();
+  bench->next_ns = bench->start_ns;
+
+  return true;
+}
+
+/**
+ * Wait until the scheduled start of the next refresh.
+ */
+void keyrefresh_bench_wait(keyrefresh_bench_t *bench)
+{
+  uint64_t now_ns = get_monotonic_time_ns();
+
+  if(bench->next_ns > now_ns) {
+    libspdm_sleep((bench->next_ns - now_ns) / 1000);
+  }
+  bench->next_ns += bench->interval_ns;
+}
+
+void keyrefresh_bench_add(keyrefresh_bench_t *bench, const uint64_t phase_ns[KEYREFRESH_PHASE_NUM])
+{
+  if(bench->cnt == bench->capacity) {
+    return;
+  }
+
+  for(int phase = 0; phase < KEYREFRESH_PHASE_NUM; phase++) {
+    bench->samples[phase * bench->capacity + bench->cnt] = phase_ns[phase];
+  }
+  bench->cnt++;
+}
+
+/**
+ * Print the throughput and min/p50/p95/p99/max of each phase.
+ * The samples are sorted in place.
+ */
+void keyrefresh_bench_report(keyrefresh_bench_t *bench, const char *name)
+{
+  uint64_t elapsed_ns = get_monotonic_time_ns() - bench->start_ns;
+  uint64_t *samples;
+  int cnt = bench->cnt;
+
+  TEEIO_PRINT(("\n"));
+  TEEIO_PRINT(("%s KeyRefresh benchmark: %d refreshes in %llums, %.1f refreshes/s (interval %lluus)\n",
+              name, cnt, (unsigned long long)(elapsed_ns / 1000000),
+              elapsed_ns == 0 ? 0.0 : (double)cnt * 1000000000.0 / (double)elapsed_ns,
+              (unsigned long long)(bench->interval_ns / 1000)));
+  if(cnt == 0) {
+    return;
+  }
+
+  TEEIO_PRINT(("  %-12s %10s %10s %10s %10s %10s\n", "Phase(us)", "min", "p50", "p95", "p99", "max"));
+  for(int phase = 0; phase < KEYREFRESH_PHASE_NUM; phase++) {
+    samples = bench->samples + phase * bench->capacity;
+    sort_uint64_array(samples, cnt);
+    TEEIO_PRINT(("  %-12s %10llu %10llu %10llu %10llu %10llu\n", m_keyrefresh_phase_str[phase],
+                (unsigned long long)(samples[0] / 1000),
+                (unsigned long long)(get_percentile_of_sorted_uint64_array(samples, cnt, 50) / 1000),
+                (unsigned long long)(get_percentile_of_sorted_uint64_array(samples, cnt, 95) / 1000),
+                (unsigned long long)(get_percentile_of_sorted_uint64_array(samples, cnt, 99) / 1000),
+                (unsigned long long)(samples[cnt - 1] / 1000)));
+  }
+}
+
+void keyrefresh_bench_free(keyrefresh_bench_t *bench)
+{
+  if(bench->samples != NULL) {
+    free(bench->samples);
+    bench->samples = NULL;
+  }
+  bench->capacity = 0;
+  bench->cnt = 0;
+}
@@ -4,21 +4,251 @@
  *  License: BSD 3-Clause License. For full text see link: https://github.com/DMTF/spdm-emu/blob/main/LICENSE.md
  **/
 
+#define _DEFAULT_SOURCE
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <stdbool.h>
+#include <pthread.h>
 #include <industry_standard/pcap.h>
 #include <industry_standard/link_type_ex.h>
+#include "ide_test.h"
 #include "pcap.h"
 #include "command.h"
 #include "teeio_debug.h"
 
 #define PCAP_PACKET_MAX_SIZE 0x00010000
 
+/**
+ * Packet capture.
+ *
+ * The packets are appended to a write buffer and written to the file by a
+ * flusher thread, so capturing a DOE message costs a memcpy. The flusher swaps
+ * the two buffers every PCAP_FLUSH_INTERVAL_US, or as soon as the active buffer
+ * cannot take the next packet, and writes out the full one.
+ *
+ * In pcapng format every device has its own interface (named by its BDF),
+ * timestamps have nanosecond resolution and each packet carries its direction
+ * in epb_flags. The classic pcap format keeps one interface and carries
+ * microsecond timestamps.
+ */
+#define PCAP_WRITE_BUFFER_SIZE (4 * 1024 * 1024)
+#define PCAP_FLUSH_INTERVAL_US (500 * 1000)
+#define PCAP_MAX_INTERFACE_NUM 64
+#define PCAP_MAX_INTERFACE_NAME_LENGTH 64
+#define PCAP_UNKNOWN_INTERFACE_NAME "unknown"
+
+#define PCAPNG_BLOCK_TYPE_SHB 0x0A0D0D0A
+#define PCAPNG_BLOCK_TYPE_IDB 0x00000001
+#define PCAPNG_BLOCK_TYPE_EPB 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_OPT_ENDOFOPT 0
+#define PCAPNG_OPT_IF_NAME 2
+#define PCAPNG_OPT_IF_TSRESOL 9
+#define PCAPNG_OPT_EPB_FLAGS 2
+// if_tsresol of 10^-9 s
+#define PCAPNG_TSRESOL_NS 9
+
+#define PCAPNG_PAD4(x) (((x) + 3) & ~(size_t)3)
+
+#pragma pack(1)
+typedef struct {
+    uint32_t block_type;
+    uint32_t block_total_length;
+    uint32_t byte_order_magic;
+    uint16_t major_version;
+    uint16_t minor_version;
+    int64_t section_length;
+} pcapng_section_header_block_t;
+
+typedef struct {
+    uint32_t block_type;
+    uint32_t block_total_length;
+    uint16_t link_type;
+    uint16_t reserved;
+    uint32_t snap_len;
+} pcapng_interface_description_block_t;
+
+typedef struct {
+    uint32_t block_type;
+    uint32_t block_total_length;
+    uint32_t interface_id;
+    uint32_t timestamp_high;
+    uint32_t timestamp_low;
+    uint32_t captured_packet_length;
+    uint32_t original_packet_length;
+} pcapng_enhanced_packet_block_t;
+
+typedef struct {
+    uint16_t option_code;
+    uint16_t option_length;
+} pcapng_option_header_t;
+#pragma pack()
+
 static FILE *m_pcap_file;
+static PCAP_FILE_FORMAT m_pcap_format;
+static uint32_t m_pcap_link_type;
+
+static char m_pcap_interfaces[PCAP_MAX_INTERFACE_NUM][PCAP_MAX_INTERFACE_NAME_LENGTH];
+static uint32_t m_pcap_interface_cnt;
+
+static uint8_t *m_pcap_buffers[2];
+static int m_pcap_active_buffer;
+static size_t m_pcap_buffer_used;
+static bool m_pcap_flusher_running;
+static pthread_t m_pcap_flusher;
+// keeps the packets of parallel test suites from interleaving
+static pthread_mutex_t m_pcap_file_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t m_pcap_flush_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t m_pcap_swapped_cond = PTHREAD_COND_INITIALIZER;
 
-bool open_pcap_packet_file(const char *pcap_file_name, uint32_t transport_layer)
+static void *pcap_flusher_thread(void *arg)
+{
+    struct timespec deadline;
+    uint8_t *buffer;
+    size_t size;
+
+    pthread_mutex_lock(&m_pcap_file_mutex);
+    while (true) {
+        if (m_pcap_buffer_used == 0) {
+            if (!m_pcap_flusher_running) {
+                break;
+            }
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += PCAP_FLUSH_INTERVAL_US * 1000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&m_pcap_flush_cond, &m_pcap_file_mutex, &deadline);
+            continue;
+        }
+
+        // swap the buffers and write out the full one without holding the lock
+        buffer = m_pcap_buffers[m_pcap_active_buffer];
+        size = m_pcap_buffer_used;
+        m_pcap_active_buffer ^= 1;
+        m_pcap_buffer_used = 0;
+        pthread_cond_broadcast(&m_pcap_swapped_cond);
+        pthread_mutex_unlock(&m_pcap_file_mutex);
+
+        if (fwrite(buffer, 1, size, m_pcap_file) != size) {
+            TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "!!!Write pcap file error!!!\n"));
+        }
+        fflush(m_pcap_file);
+
+        pthread_mutex_lock(&m_pcap_file_mutex);
+    }
+    pthread_mutex_unlock(&m_pcap_file_mutex);
+
+    return NULL;
+}
+
+/**
+ * Reserve size bytes in the active buffer. m_pcap_file_mutex is held by the caller.
+ */
+static uint8_t *reserve_pcap_buffer(size_t size)
+{
+    uint8_t *ptr;
+
+    if (size > PCAP_WRITE_BUFFER_SIZE) {
+        return NULL;
+    }
+
+    while (m_pcap_buffer_used + size > PCAP_WRITE_BUFFER_SIZE) {
+        pthread_cond_signal(&m_pcap_flush_cond);
+        pthread_cond_wait(&m_pcap_swapped_cond, &m_pcap_file_mutex);
+    }
+
+    ptr = m_pcap_buffers[m_pcap_active_buffer] + m_pcap_buffer_used;
+    m_pcap_buffer_used += size;
+    return ptr;
+}
+
+static uint8_t *append_pcapng_option(uint8_t *ptr, uint16_t code, const void *value, uint16_t length)
+{
+    pcapng_option_header_t *option = (pcapng_option_header_t *)ptr;
+
+    option->option_code = code;
+    option->option_length = length;
+    ptr += sizeof(pcapng_option_header_t);
+    if (length != 0) {
+        memcpy(ptr, value, length);
+        memset(ptr + length, 0, PCAPNG_PAD4(length) - length);
+    }
+    return ptr + PCAPNG_PAD4(length);
+}
+
+static void append_pcapng_section_header(void)
+{
+    pcapng_section_header_block_t *shb;
+    uint32_t total_length = sizeof(pcapng_section_header_block_t) + sizeof(uint32_t);
+
+    shb = (pcapng_section_header_block_t *)reserve_pcap_buffer(total_length);
+    shb->block_type = PCAPNG_BLOCK_TYPE_SHB;
+    shb->block_total_length = total_length;
+    shb->byte_order_magic = PCAPNG_BYTE_ORDER_MAGIC;
+    shb->major_version = 1;
+    shb->minor_version = 0;
+    // section length is not specified
+    shb->section_length = -1;
+    memcpy(shb + 1, &total_length, sizeof(uint32_t));
+}
+
+/**
+ * Get the interface of the device. An interface description block is written the
+ * first time a device is seen. m_pcap_file_mutex is held by the caller.
+ */
+static uint32_t get_pcapng_interface(const char *device)
+{
+    pcapng_interface_description_block_t *idb;
+    uint8_t tsresol = PCAPNG_TSRESOL_NS;
+    uint32_t total_length;
+    uint16_t name_length;
+    uint32_t i;
+    uint8_t *ptr;
+
+    if (device == NULL) {
+        device = PCAP_UNKNOWN_INTERFACE_NAME;
+    }
+
+    for (i = 0; i < m_pcap_interface_cnt; i++) {
+        if (strncmp(m_pcap_interfaces[i], device, PCAP_MAX_INTERFACE_NAME_LENGTH - 1) == 0) {
+            return i;
+        }
+    }
+
+    if (m_pcap_interface_cnt == PCAP_MAX_INTERFACE_NUM) {
+        // the packets of the other devices share the last interface
+        return PCAP_MAX_INTERFACE_NUM - 1;
+    }
+
+    strncpy(m_pcap_interfaces[m_pcap_interface_cnt], device, PCAP_MAX_INTERFACE_NAME_LENGTH - 1);
+    name_length = (uint16_t)strlen(m_pcap_interfaces[m_pcap_interface_cnt]);
+
+    total_length = sizeof(pcapng_interface_description_block_t) +
+                   sizeof(pcapng_option_header_t) + PCAPNG_PAD4(name_length) +
+                   sizeof(pcapng_option_header_t) + PCAPNG_PAD4(sizeof(tsresol)) +
+                   sizeof(pcapng_option_header_t) +
+                   sizeof(uint32_t);
+
+    idb = (pcapng_interface_description_block_t *)reserve_pcap_buffer(total_length);
+    idb->block_type = PCAPNG_BLOCK_TYPE_IDB;
+    idb->block_total_length = total_length;
+    idb->link_type = (uint16_t)m_pcap_link_type;
+    idb->reserved = 0;
+    idb->snap_len = PCAP_PACKET_MAX_SIZE;
+
+    ptr = (uint8_t *)(idb + 1);
+    ptr = append_pcapng_option(ptr, PCAPNG_OPT_IF_NAME, m_pcap_interfaces[m_pcap_interface_cnt], name_length);
+    ptr = append_pcapng_option(ptr, PCAPNG_OPT_IF_TSRESOL, &tsresol, sizeof(tsresol));
+    ptr = append_pcapng_option(ptr, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+    memcpy(ptr, &total_length, sizeof(uint32_t));
+
+    return m_pcap_interface_cnt++;
+}
+
+bool open_pcap_packet_file(const char *pcap_file_name, uint32_t transport_layer, PCAP_FILE_FORMAT format)
 {
     pcap_global_header_t pcap_global_header;
 
@@ -26,91 +256,163 @@ bool open_pcap_packet_file(const char *pcap_file_name, uint32_t transport_layer)
         return false;
     }
 
-    pcap_global_header.magic_number = PCAP_GLOBAL_HEADER_MAGIC;
-    pcap_global_header.version_major = PCAP_GLOBAL_HEADER_VERSION_MAJOR;
-    pcap_global_header.version_minor = PCAP_GLOBAL_HEADER_VERSION_MINOR;
-    pcap_global_header.this_zone = 0;
-    pcap_global_header.sig_figs = 0;
-    pcap_global_header.snap_len = PCAP_PACKET_MAX_SIZE;
     if (transport_layer == SOCKET_TRANSPORT_TYPE_MCTP) {
-        pcap_global_header.network = LINKTYPE_MCTP;
+        m_pcap_link_type = LINKTYPE_MCTP;
     } else if (transport_layer == SOCKET_TRANSPORT_TYPE_PCI_DOE) {
-        pcap_global_header.network = LINKTYPE_PCI_DOE;
+        m_pcap_link_type = LINKTYPE_PCI_DOE;
     } else {
         return false;
     }
+    m_pcap_format = format;
+    m_pcap_interface_cnt = 0;
 
     if ((m_pcap_file = fopen(pcap_file_name, "wb")) == NULL) {
         TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "!!!Unable to open pcap file %s!!!\n", pcap_file_name));
         return false;
     }
 
-    if ((fwrite(&pcap_global_header, 1, sizeof(pcap_global_header),
-                m_pcap_file)) != sizeof(pcap_global_header)) {
-        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "!!!Write pcap file error!!!\n"));
+    m_pcap_buffers[0] = (uint8_t *)malloc(PCAP_WRITE_BUFFER_SIZE);
+    m_pcap_buffers[1] = (uint8_t *)malloc(PCAP_WRITE_BUFFER_SIZE);
+    if (m_pcap_buffers[0] == NULL || m_pcap_buffers[1] == NULL) {
+        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "!!!Unable to allocate pcap write buffer!!!\n"));
+        close_pcap_packet_file();
+        return false;
+    }
+    m_pcap_active_buffer = 0;
+    m_pcap_buffer_used = 0;
+
+    if (format == PCAP_FILE_FORMAT_PCAPNG) {
+        append_pcapng_section_header();
+    } else {
+        pcap_global_header.magic_number = PCAP_GLOBAL_HEADER_MAGIC;
+        pcap_global_header.version_major = PCAP_GLOBAL_HEADER_VERSION_MAJOR;
+        pcap_global_header.version_minor = PCAP_GLOBAL_HEADER_VERSION_MINOR;
+        pcap_global_header.this_zone = 0;
+        pcap_global_header.sig_figs = 0;
+        pcap_global_header.snap_len = PCAP_PACKET_MAX_SIZE;
+        pcap_global_header.network = m_pcap_link_type;
+        memcpy(reserve_pcap_buffer(sizeof(pcap_global_header)), &pcap_global_header, sizeof(pcap_global_header));
+    }
+
+    m_pcap_flusher_running = true;
+    if (pthread_create(&m_pcap_flusher, NULL, pcap_flusher_thread, NULL) != 0) {
+        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "!!!Unable to create pcap flusher thread!!!\n"));
+        m_pcap_flusher_running = false;
         close_pcap_packet_file();
         return false;
     }
 
-    fflush(m_pcap_file);
     return true;
 }
 
 void close_pcap_packet_file(void)
 {
+    pthread_mutex_lock(&m_pcap_file_mutex);
+    bool running = m_pcap_flusher_running;
+    m_pcap_flusher_running = false;
+    pthread_cond_signal(&m_pcap_flush_cond);
+    pthread_mutex_unlock(&m_pcap_file_mutex);
+
+    // the flusher writes out the buffered packets before it quits
+    if (running) {
+        pthread_join(m_pcap_flusher, NULL);
+    }
+
+    pthread_mutex_lock(&m_pcap_file_mutex);
     if (m_pcap_file != NULL) {
         fclose(m_pcap_file);
         m_pcap_file = NULL;
     }
+    for (int i = 0; i < 2; i++) {
+        free(m_pcap_buffers[i]);
+        m_pcap_buffers[i] = NULL;
+    }
+    m_pcap_buffer_used = 0;
+    pthread_mutex_unlock(&m_pcap_file_mutex);
 }
 
-void append_pcap_packet_data(const void *header, size_t header_size,
-                             const void *data, size_t size)
+static void do_append_pcap_packet_data(const char *device, PCAP_PACKET_DIRECTION direction,
+                                       const void *header, size_t header_size,
+                                       const void *data, size_t size)
 {
-    pcap_packet_header_t pcap_packet_header;
+    pcap_packet_header_t *pcap_packet_header;
+    pcapng_enhanced_packet_block_t *epb;
     size_t total_size;
+    size_t incl_len;
+    uint32_t block_total_length;
+    uint32_t interface_id;
+    uint32_t flags;
+    struct timespec now;
+    uint64_t timestamp;
+    uint8_t *ptr;
 
-    total_size = header_size + size;
-
-    if (m_pcap_file != NULL) {
-        time_t rawtime;
-        time(&rawtime);
+    if (m_pcap_file == NULL || m_pcap_buffers[0] == NULL) {
+        return;
+    }
 
-        pcap_packet_header.ts_sec = (uint32_t)rawtime;
-        pcap_packet_header.ts_usec = 0;
+    clock_gettime(CLOCK_REALTIME, &now);
+    total_size = header_size + size;
+    incl_len = (total_size > PCAP_PACKET_MAX_SIZE) ? PCAP_PACKET_MAX_SIZE : total_size;
 
-        pcap_packet_header.incl_len =
-            (uint32_t)((total_size > PCAP_PACKET_MAX_SIZE) ?
-                       PCAP_PACKET_MAX_SIZE :
-                       total_size);
-        pcap_packet_header.orig_len = (uint32_t)total_size;
+    if (m_pcap_format == PCAP_FILE_FORMAT_PCAPNG) {
+        interface_id = get_pcapng_interface(device);
+        block_total_length = (uint32_t)(sizeof(pcapng_enhanced_packet_block_t) + PCAPNG_PAD4(incl_len) +
+                                        sizeof(pcapng_option_header_t) + sizeof(uint32_t) +
+                                        sizeof(pcapng_option_header_t) +
+                                        sizeof(uint32_t));
+        timestamp = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
 
-        if ((fwrite(&pcap_packet_header, 1, sizeof(pcap_packet_header),
-                    m_pcap_file)) != sizeof(pcap_packet_header)) {
-            TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "!!!Write pcap file error!!!\n"));
-            close_pcap_packet_file();
-            return;
-        }
+        epb = (pcapng_enhanced_packet_block_t *)reserve_pcap_buffer(block_total_length);
+        epb->block_type = PCAPNG_BLOCK_TYPE_EPB;
+        epb->block_total_length = block_total_length;
+        epb->interface_id = interface_id;
+        epb->timestamp_high = (uint32_t)(timestamp >> 32);
+        epb->timestamp_low = (uint32_t)timestamp;
+        epb->captured_packet_length = (uint32_t)incl_len;
+        epb->original_packet_length = (uint32_t)total_size;
+        ptr = (uint8_t *)(epb + 1);
+    } else {
+        pcap_packet_header = (pcap_packet_header_t *)reserve_pcap_buffer(sizeof(pcap_packet_header_t) + incl_len);
+        pcap_packet_header->ts_sec = (uint32_t)now.tv_sec;
+        pcap_packet_header->ts_usec = (uint32_t)(now.tv_nsec / 1000);
+        pcap_packet_header->incl_len = (uint32_t)incl_len;
+        pcap_packet_header->orig_len = (uint32_t)total_size;
+        ptr = (uint8_t *)(pcap_packet_header + 1);
+    }
 
-        if (total_size > PCAP_PACKET_MAX_SIZE) {
-            total_size = PCAP_PACKET_MAX_SIZE;
-        }
+    if (header_size > incl_len) {
+        header_size = incl_len;
+    }
+    if (header_size != 0) {
+        memcpy(ptr, header, header_size);
+    }
+    memcpy(ptr + header_size, data, incl_len - header_size);
 
-        if (header_size != 0) {
-            if ((fwrite(header, 1, header_size, m_pcap_file)) !=
-                header_size) {
-                TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "!!!Write pcap file error!!!\n"));
-                close_pcap_packet_file();
-                return;
-            }
-        }
+    if (m_pcap_format == PCAP_FILE_FORMAT_PCAPNG) {
+        ptr += incl_len;
+        memset(ptr, 0, PCAPNG_PAD4(incl_len) - incl_len);
+        ptr += PCAPNG_PAD4(incl_len) - incl_len;
+        flags = (uint32_t)direction;
+        ptr = append_pcapng_option(ptr, PCAPNG_OPT_EPB_FLAGS, &flags, sizeof(flags));
+        ptr = append_pcapng_option(ptr, PCAPNG_OPT_ENDOFOPT, NULL, 0);
+        memcpy(ptr, &block_total_length, sizeof(uint32_t));
+    }
+}
 
-        if ((fwrite(data, 1, size, m_pcap_file)) != size) {
-            TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "!!!Write pcap file error!!!\n"));
-            close_pcap_packet_file();
-            return;
-        }
+void append_pcap_packet_data(const void *header, size_t header_size,
+                             const void *data, size_t size)
+{
+    append_pcap_packet_data_ex(NULL, PCAP_PACKET_DIRECTION_UNKNOWN, header, header_size, data, size);
+}
 
-        fflush(m_pcap_file);
-    }
+/**
+ * Capture a packet of the device (BDF) in the direction.
+ */
+void append_pcap_packet_data_ex(const char *device, PCAP_PACKET_DIRECTION direction,
+                                const void *header, size_t header_size,
+                                const void *data, size_t size)
+{
+    pthread_mutex_lock(&m_pcap_file_mutex);
+    do_append_pcap_packet_data(device, direction, header, header_size, data, size);
+    pthread_mutex_unlock(&m_pcap_file_mutex);
 }
@@ -0,0 +1,217 @@
+/**
+ *  Copyright Notice:
+ *  Copyright 2024 Intel. All rights reserved.
+ *  License: BSD 3-Clause License.
+ **/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "teeio_debug.h"
+#include "helperlib.h"
+
+/**
+ * PCI register trace.
+ *
+ * When pci_log is enabled the config space accessors record every access
+ * into a binary ring buffer instead of formatting a log line. Writers
+ * reserve a slot with an atomic increment of the head, fill it and then
+ * publish it by storing its sequence number. The trace is rendered into
+ * the log by pci_trace_dump after the run, so tracing costs a few stores
+ * per access and no longer distorts the timing of the run being traced.
+ *
+ * If the ring wraps, the oldest records are overwritten and the number of
+ * lost records is reported by pci_trace_dump. A slot is read like a seqlock:
+ * its sequence number is checked again after the copy, and a record which
+ * was overwritten during the copy is dropped.
+ */
+
+typedef struct {
+  uint64_t seq;           // sequence + 1 of the record. 0 means the slot is not published.
+  uint64_t timestamp_ns;
+  int32_t fd;
+  uint32_t offset;
+  uint32_t value;
+  uint16_t device_id;
+  uint8_t direction;      // PCI_TRACE_DIRECTION
+  uint8_t reserved;
+} PCI_TRACE_RECORD;
+
+typedef struct {
+  const char* name;
+  const char* format;
+} PCI_TRACE_DIRECTION_FORMAT;
+
+static const PCI_TRACE_DIRECTION_FORMAT m_pci_trace_formats[PCI_TRACE_DIRECTION_NUM] = {
+  {"PCI_READ32 ", "%s : 0x%04x => 0x%08x (%s) +%lluns\n"},
+  {"PCI_WRITE32", "%s : 0x%04x <= 0x%08x (%s) +%lluns\n"},
+  {"PCI_READ16 ", "%s : 0x%04x => 0x%04x (%s) +%lluns\n"},
+  {"PCI_WRITE16", "%s : 0x%04x <= 0x%04x (%s) +%lluns\n"}
+};
+
+static PCI_TRACE_RECORD *m_pci_trace_ring = NULL;
+static uint64_t m_pci_trace_mask = 0;
+static uint64_t m_pci_trace_head = 0;
+static uint64_t m_pci_trace_tail = 0;
+static uint64_t m_pci_trace_start_ns = 0;
+// serializes the consumers. Test suites may run in parallel and dump the trace when their groups finish.
+static pthread_mutex_t m_pci_trace_dump_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t m_pci_trace_device_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// device names are kept after the device is closed so that the trace can be decoded post-run
+static char m_pci_trace_device_names[PCI_TRACE_MAX_DEVICE_NUM][MAX_NAME_LENGTH] = {0};
+static int m_pci_trace_device_cnt = 0;
+
+/**
+ * Allocate the ring buffer. capacity is rounded up to power of 2.
+ */
+bool pci_trace_init(uint32_t capacity)
+{
+  uint64_t size = 1;
+
+  if(m_pci_trace_ring != NULL) {
+    return true;
+  }
+
+  if(capacity == 0) {
+    capacity = PCI_TRACE_DEFAULT_CAPACITY;
+  }
+  while(size < capacity) {
+    size <<= 1;
+  }
+
+  m_pci_trace_ring = (PCI_TRACE_RECORD *)calloc(size, sizeof(PCI_TRACE_RECORD));
+  if(m_pci_trace_ring == NULL) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to allocate pci trace buffer (%d records).\n", (uint32_t)size));
+    return false;
+  }
+
+  m_pci_trace_mask = size - 1;
+  m_pci_trace_head = 0;
+  m_pci_trace_tail = 0;
+  m_pci_trace_start_ns = get_monotonic_time_ns();
+
+  return true;
+}
+
+void pci_trace_close()
+{
+  if(m_pci_trace_ring != NULL) {
+    free(m_pci_trace_ring);
+    m_pci_trace_ring = NULL;
+  }
+  m_pci_trace_mask = 0;
+}
+
+/**
+ * Register a device name to the trace.
+ * Return the device id which is used in pci_trace_record.
+ */
+uint16_t pci_trace_register_device(const char* device_name)
+{
+  uint16_t device_id = PCI_TRACE_INVALID_DEVICE_ID;
+  int cnt;
+
+  pthread_mutex_lock(&m_pci_trace_device_mutex);
+  cnt = __atomic_load_n(&m_pci_trace_device_cnt, __ATOMIC_ACQUIRE);
+
+  for(int i = 0; i < cnt; i++) {
+    if(strcmp(m_pci_trace_device_names[i], device_name) == 0) {
+      device_id = i;
+      goto Done;
+    }
+  }
+
+  if(cnt == PCI_TRACE_MAX_DEVICE_NUM) {
+    goto Done;
+  }
+
+  strncpy(m_pci_trace_device_names[cnt], device_name, MAX_NAME_LENGTH - 1);
+  __atomic_store_n(&m_pci_trace_device_cnt, cnt + 1, __ATOMIC_RELEASE);
+  device_id = cnt;
+
+Done:
+  pthread_mutex_unlock(&m_pci_trace_device_mutex);
+  return device_id;
+}
+
+void pci_trace_record(uint16_t device_id, int fd, uint32_t offset, uint32_t value, PCI_TRACE_DIRECTION direction)
+{
+  PCI_TRACE_RECORD *record;
+  uint64_t seq;
+
+  if(m_pci_trace_ring == NULL) {
+    return;
+  }
+
+  seq = __atomic_fetch_add(&m_pci_trace_head, 1, __ATOMIC_RELAXED);
+  record = m_pci_trace_ring + (seq & m_pci_trace_mask);
+
+  __atomic_store_n(&record->seq, 0, __ATOMIC_RELAXED);
+  // the slot is unpublished before any of its fields is changed
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  record->timestamp_ns = get_monotonic_time_ns();
+  record->fd = fd;
+  record->offset = offset;
+  record->value = value;
+  record->device_id = device_id;
+  record->direction = (uint8_t)direction;
+  __atomic_store_n(&record->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Decode the records in the ring buffer and render them into the log.
+ * The rendered records are consumed.
+ */
+void pci_trace_dump()
+{
+  uint64_t head;
+  uint64_t seq;
+  uint64_t lost = 0;
+  PCI_TRACE_RECORD record;
+  const char* device_name;
+
+  if(m_pci_trace_ring == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&m_pci_trace_dump_mutex);
+  head = __atomic_load_n(&m_pci_trace_head, __ATOMIC_ACQUIRE);
+  if(head - m_pci_trace_tail > m_pci_trace_mask + 1) {
+    lost = head - m_pci_trace_tail - (m_pci_trace_mask + 1);
+    m_pci_trace_tail = head - (m_pci_trace_mask + 1);
+  }
+
+  for(seq = m_pci_trace_tail; seq < head; seq++) {
+    PCI_TRACE_RECORD *slot = m_pci_trace_ring + (seq & m_pci_trace_mask);
+    if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != seq + 1) {
+      // the record is not published yet or is overwritten
+      continue;
+    }
+    memcpy(&record, slot, sizeof(record));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq + 1) {
+      // overwritten by a writer while it was copied
+      lost++;
+      continue;
+    }
+    if(record.direction >= PCI_TRACE_DIRECTION_NUM) {
+      continue;
+    }
+
+    device_name = record.device_id < m_pci_trace_device_cnt ? m_pci_trace_device_names[record.device_id] : "unknown";
+    TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, m_pci_trace_formats[record.direction].format,
+                 m_pci_trace_formats[record.direction].name,
+                 record.offset, record.value, device_name,
+                 (unsigned long long)(record.timestamp_ns - m_pci_trace_start_ns)));
+  }
+
+  if(lost != 0) {
+    TEEIO_DEBUG((TEEIO_DEBUG_WARN, "pci trace buffer overflowed. %llu records lost.\n", (unsigned long long)lost));
+  }
+
+  m_pci_trace_tail = head;
+  pthread_mutex_unlock(&m_pci_trace_dump_mutex);
+}
@@ -4,6 +4,8 @@
  *  License: BSD 3-Clause License.
  **/
 
+#define _DEFAULT_SOURCE
+
 #include <stdint.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -11,6 +13,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "pcie.h"
 #include "teeio_debug.h"
 #include "helperlib.h"
@@ -21,6 +24,12 @@ extern bool g_pci_log;
 #define MAX_SUPPORT_DEVICE_NUM  32
 IDE_TEST_DEVICES_INFO devices[MAX_SUPPORT_DEVICE_NUM] = {0};
 
+// fd => index + 1 of devices[]. 0 means the fd is not registered.
+#define MAX_SUPPORT_FD_NUM  1024
+static uint8_t m_fd_to_device[MAX_SUPPORT_FD_NUM] = {0};
+// devices are registered by the threads running test suites in parallel
+static pthread_mutex_t m_devices_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * the correct bdf string looks like: 0001:2a:00.0
 */
@@ -108,13 +117,19 @@ bool unset_device_info(int fd)
         return false;
     }
 
+    pthread_mutex_lock(&m_devices_mutex);
     for(int i = 0; i < MAX_SUPPORT_DEVICE_NUM; i++) {
         if(devices[i].fd == fd) {
+            if(fd < MAX_SUPPORT_FD_NUM) {
+                m_fd_to_device[fd] = 0;
+            }
             devices[i].fd = 0;
             memset(devices[i].device_name, 0, sizeof(devices[i].device_name));
-            return true;
+            devices[i].cap_index.valid = false;
+            break;
         }
     }
+    pthread_mutex_unlock(&m_devices_mutex);
 
     return true;
 }
@@ -126,19 +141,36 @@ bool set_deivce_info(int fd, char* device_name)
         return false;
     }
 
+    IDE_TEST_DEVICES_INFO *device = NULL;
+
+    pthread_mutex_lock(&m_devices_mutex);
     for(int i = 0; i < MAX_SUPPORT_DEVICE_NUM; i++) {
         if(devices[i].fd == fd) {
             TEEIO_ASSERT(strcmp(devices[i].device_name, device_name) == 0);
+            // the device is opened again. Its capabilities may have changed since.
+            devices[i].cap_index.valid = false;
+            pthread_mutex_unlock(&m_devices_mutex);
             return true;
         } else if(devices[i].fd == 0) {
             // This is an empty slot
             devices[i].fd = fd;
             strncpy(devices[i].device_name, device_name, strlen(device_name));
-            return true;
+            devices[i].trace_id = pci_trace_register_device(device_name);
+            if(fd < MAX_SUPPORT_FD_NUM) {
+                m_fd_to_device[fd] = i + 1;
+            }
+            device = devices + i;
+            break;
         }
     }
+    pthread_mutex_unlock(&m_devices_mutex);
+
+    if(device == NULL) {
+        return false;
+    }
 
-    return false;
+    build_pcie_cap_index(fd, &device->cap_index);
+    return true;
 }
 
 IDE_TEST_DEVICES_INFO *get_device_info_by_fd(int fd)
@@ -148,6 +180,10 @@ IDE_TEST_DEVICES_INFO *get_device_info_by_fd(int fd)
         return NULL;
     }
 
+    if(fd < MAX_SUPPORT_FD_NUM) {
+        return m_fd_to_device[fd] == 0 ? NULL : devices + m_fd_to_device[fd] - 1;
+    }
+
     for(int i = 0; i < MAX_SUPPORT_DEVICE_NUM; i++) {
         if(devices[i].fd == fd) {
             return devices + i;
@@ -157,19 +193,118 @@ IDE_TEST_DEVICES_INFO *get_device_info_by_fd(int fd)
     return NULL;
 }
 
+/**
+ * Build the capability index of a device from one snapshot of its configuration space.
+ */
+bool build_pcie_cap_index(int fd, PCIE_CAP_INDEX *index)
+{
+    uint32_t cfg_space[PCIE_CONFIG_SPACE_SIZE / sizeof(uint32_t)];
+    uint32_t walker;
+    PCIE_CAP_LIST cap_header;
+    PCIE_CAP_ID ext_cap_header;
+    // a capability takes at least one dword, so a longer list has a loop
+    int ttl;
+
+    TEEIO_ASSERT(index != NULL);
+
+    memset(index, 0, sizeof(PCIE_CAP_INDEX));
+    device_pci_read_block(0, cfg_space, sizeof(cfg_space), fd);
+
+    // capabilities start from CAPABILITY_POINTER in Type 0/1 header
+    walker = cfg_space[0x34 / sizeof(uint32_t)] & 0xFF;
+    ttl = PCIE_EXT_CAP_START / sizeof(uint32_t);
+    while (walker < PCIE_EXT_CAP_START && walker != 0 && ttl-- > 0) {
+        memcpy(&cap_header, (uint8_t *)cfg_space + walker, sizeof(cap_header));
+        if (index->cap_offset[cap_header.id] == 0) {
+            index->cap_offset[cap_header.id] = walker;
+        }
+        walker = cap_header.next_cap_offset;
+    }
+
+    // extended capabilities
+    walker = PCIE_EXT_CAP_START;
+    ttl = (PCIE_CONFIG_SPACE_SIZE - PCIE_EXT_CAP_START) / sizeof(uint32_t);
+    while (walker < PCIE_CONFIG_SPACE_SIZE - 3 * sizeof(uint32_t) && walker >= PCIE_EXT_CAP_START && ttl-- > 0) {
+        ext_cap_header.raw = cfg_space[walker / sizeof(uint32_t)];
+        if (ext_cap_header.raw == 0 || ext_cap_header.raw == 0xFFFFFFFF) {
+            break;
+        }
+
+        if (ext_cap_header.id < PCIE_CAP_INDEX_EXT_CAP_ID_NUM && index->ext_cap_offset[ext_cap_header.id] == 0) {
+            index->ext_cap_offset[ext_cap_header.id] = walker;
+        }
+
+        // the counts come from the device, so the extra instances are dropped instead of asserted
+        if (ext_cap_header.id == PCI_DOE_EXT_CAPABILITY_ID) {
+            if (index->doe_cnt < PCIE_CAP_INDEX_MAX_DOE_NUM) {
+                index->doe_offset[index->doe_cnt++] = walker;
+            } else {
+                TEEIO_DEBUG((TEEIO_DEBUG_WARN, "More than %d DOE capabilities. DOE@0x%03x is ignored.\n", PCIE_CAP_INDEX_MAX_DOE_NUM, walker));
+            }
+        } else if (ext_cap_header.id == PCI_DVSCE_EXT_CAPABILITY_ID && index->dvsec_cnt >= PCIE_CAP_INDEX_MAX_DVSEC_NUM) {
+            TEEIO_DEBUG((TEEIO_DEBUG_WARN, "More than %d DVSECs. DVSEC@0x%03x is ignored.\n", PCIE_CAP_INDEX_MAX_DVSEC_NUM, walker));
+        } else if (ext_cap_header.id == PCI_DVSCE_EXT_CAPABILITY_ID) {
+            // DVSEC Header 1 (vendor id at [15:0]) and DVSEC Header 2 (dvsec id at [15:0])
+            index->dvsec[index->dvsec_cnt].offset = walker;
+            index->dvsec[index->dvsec_cnt].vendor_id = cfg_space[walker / sizeof(uint32_t) + 1] & 0xFFFF;
+            index->dvsec[index->dvsec_cnt].dvsec_id = cfg_space[walker / sizeof(uint32_t) + 2] & 0xFFFF;
+            index->dvsec_cnt++;
+        }
+
+        walker = ext_cap_header.next_cap_offset;
+    }
+
+    index->valid = true;
+    return true;
+}
+
+/**
+ * Get the capability index of a device registered by set_deivce_info.
+ * The index is rebuilt if it is invalidated. NULL if the device is not registered.
+ */
+PCIE_CAP_INDEX *get_device_cap_index(int fd)
+{
+    IDE_TEST_DEVICES_INFO *device = get_device_info_by_fd(fd);
+    if(device == NULL) {
+        return NULL;
+    }
+
+    if(!device->cap_index.valid) {
+        build_pcie_cap_index(fd, &device->cap_index);
+    }
+
+    return &device->cap_index;
+}
+
+void invalidate_device_cap_index(int fd)
+{
+    IDE_TEST_DEVICES_INFO *device = get_device_info_by_fd(fd);
+    if(device != NULL) {
+        device->cap_index.valid = false;
+    }
+}
+
+void invalidate_all_device_cap_index()
+{
+    pthread_mutex_lock(&m_devices_mutex);
+    for(int i = 0; i < MAX_SUPPORT_DEVICE_NUM; i++) {
+        devices[i].cap_index.valid = false;
+    }
+    pthread_mutex_unlock(&m_devices_mutex);
+}
+
 uint32_t device_pci_read_32(uint32_t off_to_the_cfg_start, int fd){
     uint32_t data;
     IDE_TEST_DEVICES_INFO *device = NULL;
 
     TEEIO_ASSERT (fd > 0);
 
-    lseek(fd,off_to_the_cfg_start,SEEK_SET);
-    read(fd, &data, 4);
+    get_device_backend()->config_read(fd, &data, 4, off_to_the_cfg_start);
 
     if(g_pci_log) {
         device = get_device_info_by_fd(fd);
         if(device) {
-          TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "PCI_READ32  : 0x%04x => 0x%08x (%s)\n", off_to_the_cfg_start, data, device->device_name));
+          pci_trace_record(device->trace_id, fd, off_to_the_cfg_start, data, PCI_TRACE_READ32);
         }
     }
 
@@ -181,13 +316,12 @@ void device_pci_write_32(uint32_t off_to_the_cfg_start, uint32_t value, int fd){
 
     TEEIO_ASSERT (fd > 0);
 
-    lseek(fd,off_to_the_cfg_start,SEEK_SET);
-    write(fd, &value, 4);
+    get_device_backend()->config_write(fd, &value, 4, off_to_the_cfg_start);
 
     if(g_pci_log) {
         device = get_device_info_by_fd(fd);
         if(device) {
-          TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "PCI_WRITE32 : 0x%04x <= 0x%08x (%s)\n", off_to_the_cfg_start, value, device->device_name));
+          pci_trace_record(device->trace_id, fd, off_to_the_cfg_start, value, PCI_TRACE_WRITE32);
         }
     }
 }
@@ -198,13 +332,12 @@ uint16_t device_pci_read_16(uint32_t off_to_the_cfg_start, int fd){
 
     TEEIO_ASSERT (fd > 0);
 
-    lseek(fd,off_to_the_cfg_start,SEEK_SET);
-    read(fd, &data, 2);
+    get_device_backend()->config_read(fd, &data, 2, off_to_the_cfg_start);
 
     if(g_pci_log) {
         device = get_device_info_by_fd(fd);
         if(device) {
-          TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "PCI_READ16  : 0x%04x => 0x%04x (%s)\n", off_to_the_cfg_start, data, device->device_name));
+          pci_trace_record(device->trace_id, fd, off_to_the_cfg_start, data, PCI_TRACE_READ16);
         }
     }
 
@@ -216,17 +349,48 @@ void device_pci_write_16(uint32_t off_to_the_cfg_start, uint16_t value, int fd){
 
     TEEIO_ASSERT (fd > 0);
 
-    lseek(fd,off_to_the_cfg_start,SEEK_SET);
-    write(fd, &value, 2);
+    get_device_backend()->config_write(fd, &value, 2, off_to_the_cfg_start);
 
     if(g_pci_log) {
         device = get_device_info_by_fd(fd);
         if(device) {
-          TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "PCI_WRITE16 : 0x%04x <= 0x%04x (%s)\n", off_to_the_cfg_start, value, device->device_name));
+          pci_trace_record(device->trace_id, fd, off_to_the_cfg_start, value, PCI_TRACE_WRITE16);
         }
     }
 }
 
+/**
+ * Read a block of configuration space in one call, e.g. an IDE stream's
+ * register block or the whole extended configuration space.
+ * The bytes beyond the end of the configuration space are zero filled.
+ */
+bool device_pci_read_block(uint32_t off_to_the_cfg_start, void *buffer, uint32_t size, int fd){
+    IDE_TEST_DEVICES_INFO *device = NULL;
+    ssize_t read_size;
+
+    TEEIO_ASSERT (fd > 0);
+    TEEIO_ASSERT (buffer != NULL);
+
+    read_size = get_device_backend()->config_read(fd, buffer, size, off_to_the_cfg_start);
+    if(read_size < 0) {
+        read_size = 0;
+    }
+    if(read_size < size) {
+        memset((uint8_t *)buffer + read_size, 0, size - read_size);
+    }
+
+    if(g_pci_log) {
+        device = get_device_info_by_fd(fd);
+        if(device) {
+          for(uint32_t i = 0; i + 4 <= read_size; i += 4) {
+            pci_trace_record(device->trace_id, fd, off_to_the_cfg_start + i, *(uint32_t *)((uint8_t *)buffer + i), PCI_TRACE_READ32);
+          }
+        }
+    }
+
+    return read_size == size;
+}
+
 void mmio_write_reg64(
     void *const reg_ptr,
     const uint64_t reg_val)
@@ -0,0 +1,300 @@
+/**
+ *  Copyright Notice:
+ *  Copyright 2024 Intel. All rights reserved.
+ *  License: BSD 3-Clause License.
+ **/
+
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "teeio_debug.h"
+#include "helperlib.h"
+
+/**
+ * Result sink.
+ *
+ * The test results are streamed to the installed sink as they are recorded,
+ * so that a long run keeps its memory flat and its partial results survive
+ * a crash. The JSON-Lines sink appends one record per line:
+ *
+ *   {"type":"assertion","suite":..,"config_id":..,"config":..,"group":..,"class":..,"case":..,
+ *    "id":"1.2.3","kind":"test","result":"pass","message":..}
+ *   {"type":"group", .. "func":"setup","result":..,"message":..}
+ *   {"type":"config_item", .. "case":..,"item":2,"func":"enable","result":..}
+ *   {"type":"case", .. "result":..,"passed":..,"failed":..,"total_us":..}
+ *   {"type":"checkpoint","records":..}
+ *
+ * A checkpoint record is written and the file is synced to disk every
+ * checkpoint_interval records. tools/resultsum rebuilds the pass/fail tree
+ * from the stream.
+ */
+
+// large enough for the names and a message with every character escaped
+#define JSONL_RECORD_MAX_LENGTH (MAX_LINE_LENGTH * 16)
+#define MAX_TIME_STAMP_LENGTH 32
+
+static const teeio_result_sink_t *m_result_sink = NULL;
+
+static const char *m_result_str[] = {
+  "skipped", "pass", "fail"
+};
+
+static const char *m_group_func_str[] = {
+  "setup", "teardown"
+};
+
+static const char *m_config_func_str[] = {
+  "support", "enable", "disable", "check"
+};
+
+/**
+ * Install the result sink. NULL stops streaming.
+ * It shall be called before the test suites are run.
+ */
+void set_result_sink(const teeio_result_sink_t *sink)
+{
+  m_result_sink = sink;
+  if(sink != NULL) {
+    TEEIO_DEBUG((TEEIO_DEBUG_INFO, "result sink: %s\n", sink->name));
+  }
+}
+
+const teeio_result_sink_t *get_result_sink()
+{
+  return m_result_sink;
+}
+
+typedef struct {
+  char data[JSONL_RECORD_MAX_LENGTH];
+  size_t pos;
+} jsonl_record_t;
+
+static FILE *m_jsonl_file = NULL;
+static pthread_mutex_t m_jsonl_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t m_jsonl_checkpoint_interval = 0;
+static uint32_t m_jsonl_pending_records = 0;
+static uint64_t m_jsonl_records = 0;
+
+static void jsonl_append(jsonl_record_t *record, const char *format, ...)
+{
+  va_list marker;
+
+  if(record->pos >= sizeof(record->data)) {
+    return;
+  }
+
+  va_start(marker, format);
+  int len = vsnprintf(record->data + record->pos, sizeof(record->data) - record->pos, format, marker);
+  va_end(marker);
+
+  if(len > 0) {
+    record->pos += len;
+  }
+}
+
+// append "key":"value" with value escaped
+static void jsonl_append_string(jsonl_record_t *record, const char *key, const char *value)
+{
+  jsonl_append(record, "%s\"%s\":\"", record->pos > 1 ? "," : "", key);
+
+  for(const char *p = value != NULL ? value : ""; *p; p++) {
+    unsigned char c = (unsigned char)*p;
+    if(c == '"' || c == '\\') {
+      jsonl_append(record, "\\%c", c);
+    } else if(c == '\n') {
+      jsonl_append(record, "\\n");
+    } else if(c < 0x20) {
+      jsonl_append(record, "\\u%04x", c);
+    } else if(record->pos < sizeof(record->data) - 1) {
+      record->data[record->pos++] = c;
+      record->data[record->pos] = '\0';
+    }
+  }
+
+  jsonl_append(record, "\"");
+}
+
+static void jsonl_append_number(jsonl_record_t *record, const char *key, unsigned long long value)
+{
+  jsonl_append(record, "%s\"%s\":%llu", record->pos > 1 ? "," : "", key, value);
+}
+
+static void jsonl_begin(jsonl_record_t *record, const char *type,
+                        const ide_run_test_config_result_t *config_result,
+                        const ide_run_test_group_result_t *group_result,
+                        const ide_run_test_case_result_t *case_result)
+{
+  record->pos = 0;
+  record->data[0] = '\0';
+
+  jsonl_append(record, "{");
+  jsonl_append_string(record, "type", type);
+  if(config_result != NULL) {
+    jsonl_append_string(record, "suite", config_result->suite_name);
+    jsonl_append_number(record, "config_id", config_result->config_id);
+    jsonl_append_string(record, "config", config_result->name);
+  }
+  if(group_result != NULL) {
+    jsonl_append_string(record, "group", group_result->name);
+  }
+  if(case_result != NULL) {
+    jsonl_append_string(record, "class", case_result->class);
+    jsonl_append_string(record, "case", case_result->name);
+  }
+}
+
+// caller shall hold m_jsonl_lock
+static void jsonl_checkpoint()
+{
+  fprintf(m_jsonl_file, "{\"type\":\"checkpoint\",\"records\":%llu}\n", (unsigned long long)m_jsonl_records);
+  fflush(m_jsonl_file);
+  fsync(fileno(m_jsonl_file));
+  m_jsonl_pending_records = 0;
+}
+
+static void jsonl_write(jsonl_record_t *record, bool flush)
+{
+  jsonl_append(record, "}");
+
+  pthread_mutex_lock(&m_jsonl_lock);
+  if(m_jsonl_file != NULL) {
+    fputs(record->data, m_jsonl_file);
+    fputc('\n', m_jsonl_file);
+    m_jsonl_records++;
+
+    if(m_jsonl_checkpoint_interval != 0 && ++m_jsonl_pending_records >= m_jsonl_checkpoint_interval) {
+      jsonl_checkpoint();
+    } else if(flush) {
+      fflush(m_jsonl_file);
+    }
+  }
+  pthread_mutex_unlock(&m_jsonl_lock);
+}
+
+static void jsonl_record_assertion(const ide_run_test_config_result_t *config_result,
+                                   const ide_run_test_group_result_t *group_result,
+                                   const ide_run_test_case_result_t *case_result,
+                                   int assertion_id, ide_common_test_case_assertion_type_t assertion_type,
+                                   teeio_test_result_t result, const char *message)
+{
+  jsonl_record_t record;
+  char id[32];
+
+  jsonl_begin(&record, "assertion", config_result, group_result, case_result);
+  snprintf(id, sizeof(id), "%d.%d.%d", case_result->class_id + 1, case_result->case_id, assertion_id);
+  jsonl_append_string(&record, "id", id);
+  jsonl_append_string(&record, "kind", assertion_type == IDE_COMMON_TEST_CASE_ASSERTION_TYPE_SEPARATOR ? "separator" : "test");
+  jsonl_append_string(&record, "result", m_result_str[result]);
+  jsonl_append_string(&record, "message", message);
+  jsonl_write(&record, false);
+}
+
+static void jsonl_record_group(const ide_run_test_config_result_t *config_result,
+                               const ide_run_test_group_result_t *group_result,
+                               teeio_test_group_func_t func, teeio_test_result_t result, const char *message)
+{
+  jsonl_record_t record;
+
+  jsonl_begin(&record, "group", config_result, group_result, NULL);
+  jsonl_append_string(&record, "func", m_group_func_str[func]);
+  jsonl_append_string(&record, "result", m_result_str[result]);
+  jsonl_append_string(&record, "message", message);
+  jsonl_write(&record, false);
+}
+
+static void jsonl_record_config_item(const ide_run_test_config_result_t *config_result,
+                                     const ide_run_test_group_result_t *group_result,
+                                     const ide_run_test_case_result_t *case_result,
+                                     int config_item_id, teeio_test_config_func_t func, teeio_test_result_t result)
+{
+  jsonl_record_t record;
+
+  jsonl_begin(&record, "config_item", config_result, group_result, case_result);
+  jsonl_append_number(&record, "item", config_item_id);
+  jsonl_append_string(&record, "func", m_config_func_str[func]);
+  jsonl_append_string(&record, "result", m_result_str[result]);
+  jsonl_write(&record, false);
+}
+
+static void jsonl_record_case(const ide_run_test_config_result_t *config_result,
+                              const ide_run_test_group_result_t *group_result,
+                              const ide_run_test_case_result_t *case_result)
+{
+  jsonl_record_t record;
+  teeio_test_result_t result = TEEIO_TEST_RESULT_NOT_TESTED;
+
+  if(case_result->total_failed > 0) {
+    result = TEEIO_TEST_RESULT_FAILED;
+  } else if(case_result->total_passed > 0) {
+    result = TEEIO_TEST_RESULT_PASS;
+  }
+
+  jsonl_begin(&record, "case", config_result, group_result, case_result);
+  jsonl_append_string(&record, "result", m_result_str[result]);
+  jsonl_append_number(&record, "passed", case_result->total_passed);
+  jsonl_append_number(&record, "failed", case_result->total_failed);
+  jsonl_append_number(&record, "total_us", case_result->total_ns / 1000);
+  // a finished case is flushed so that it survives a crash of the following cases
+  jsonl_write(&record, true);
+}
+
+static void jsonl_close()
+{
+  pthread_mutex_lock(&m_jsonl_lock);
+  if(m_jsonl_file != NULL) {
+    jsonl_checkpoint();
+    fclose(m_jsonl_file);
+    m_jsonl_file = NULL;
+  }
+  pthread_mutex_unlock(&m_jsonl_lock);
+}
+
+static const teeio_result_sink_t m_jsonl_result_sink = {
+  .name = "jsonl",
+  .record_assertion = jsonl_record_assertion,
+  .record_group = jsonl_record_group,
+  .record_config_item = jsonl_record_config_item,
+  .record_case = jsonl_record_case,
+  .close = jsonl_close
+};
+
+/**
+ * Open the JSON-Lines sink. The records are written to <result_file>_<time stamp>.jsonl.
+ */
+const teeio_result_sink_t *jsonl_result_sink_open(const char *result_file, uint32_t checkpoint_interval)
+{
+  char full_result_file[MAX_FILE_NAME] = {0};
+  char current_time_stamp[MAX_TIME_STAMP_LENGTH] = {0};
+  struct timeval currentTime;
+
+  if(m_jsonl_file != NULL) {
+    TEEIO_DEBUG((TEEIO_DEBUG_WARN, "result file exists. Close it before opening a new one.\n"));
+    jsonl_close();
+  }
+
+  gettimeofday(&currentTime, NULL);
+  time_t rawtime = currentTime.tv_sec;
+  strftime(current_time_stamp, MAX_TIME_STAMP_LENGTH, "%Y-%m-%d_%H-%M-%S", localtime(&rawtime));
+
+  snprintf(full_result_file, MAX_FILE_NAME, "%s_%s.jsonl", result_file, current_time_stamp);
+  m_jsonl_file = fopen(full_result_file, "w");
+  if(m_jsonl_file == NULL) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to open result file [%s]\n", full_result_file));
+    return NULL;
+  }
+
+  m_jsonl_checkpoint_interval = checkpoint_interval;
+  m_jsonl_pending_records = 0;
+  m_jsonl_records = 0;
+
+  TEEIO_PRINT(("Results are streamed to %s\n", full_result_file));
+
+  return &m_jsonl_result_sink;
+}
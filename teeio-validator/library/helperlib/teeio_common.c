@@ -6,6 +6,7 @@
 
 #include <stdint.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -18,9 +19,360 @@
 #include "helperlib.h"
 #include "helper_internal.h"
 
-extern ide_run_test_group_result_t* g_current_group_result;
-extern ide_run_test_config_result_t* g_current_config_result;
-extern ide_run_test_case_result_t* g_current_case_result;
+extern TEEIO_THREAD_LOCAL ide_run_test_group_result_t* g_current_group_result;
+extern TEEIO_THREAD_LOCAL ide_run_test_config_result_t* g_current_config_result;
+extern TEEIO_THREAD_LOCAL ide_run_test_case_result_t* g_current_case_result;
+extern TEEIO_THREAD_LOCAL teeio_result_store_t* g_current_result_store;
+
+/**
+ * Result store.
+ *
+ * The results of a test suite are allocated from an arena which is freed at once.
+ * An assertion keeps the interned message format and its packed arguments. The
+ * message is rendered only when the results are printed or exported.
+ */
+
+#define TEEIO_RESULT_ARENA_CHUNK_SIZE 0x10000
+#define TEEIO_RESULT_ARENA_ALIGN      16
+#define TEEIO_MESSAGE_FORMAT_BUCKET_NUM 256
+#define TEEIO_MESSAGE_MAX_ARG_NUM     16
+#define TEEIO_MESSAGE_MAX_SPEC_LEN    32
+
+typedef enum {
+  TEEIO_MESSAGE_ARG_INT = 0,
+  TEEIO_MESSAGE_ARG_LONG,
+  TEEIO_MESSAGE_ARG_LONG_LONG,
+  TEEIO_MESSAGE_ARG_SIZE,
+  TEEIO_MESSAGE_ARG_INTMAX,
+  TEEIO_MESSAGE_ARG_PTRDIFF,
+  TEEIO_MESSAGE_ARG_DOUBLE,
+  TEEIO_MESSAGE_ARG_STRING,
+  TEEIO_MESSAGE_ARG_POINTER
+} teeio_message_arg_type_t;
+
+struct _teeio_message_format_t {
+  teeio_message_format_t *next;
+  uint32_t hash;
+  // false if the format has a conversion the store cannot pack, e.g. '*' width.
+  // The message is rendered when it is recorded then.
+  bool packable;
+  int arg_num;
+  uint8_t arg_types[TEEIO_MESSAGE_MAX_ARG_NUM];
+  const char *format;
+};
+
+typedef struct _teeio_result_arena_chunk_t teeio_result_arena_chunk_t;
+struct _teeio_result_arena_chunk_t {
+  teeio_result_arena_chunk_t *next;
+  size_t size;
+  size_t used;
+};
+
+struct _teeio_result_store_t {
+  teeio_result_arena_chunk_t *chunk;
+  teeio_message_format_t *formats[TEEIO_MESSAGE_FORMAT_BUCKET_NUM];
+};
+
+// format of the messages rendered when they are recorded
+static teeio_message_format_t m_rendered_message_format = {
+  .packable = true,
+  .arg_num = 1,
+  .arg_types = {TEEIO_MESSAGE_ARG_STRING},
+  .format = "%s"
+};
+
+#define TEEIO_RESULT_ARENA_CHUNK_HEADER_SIZE \
+  ((sizeof(teeio_result_arena_chunk_t) + TEEIO_RESULT_ARENA_ALIGN - 1) & ~(size_t)(TEEIO_RESULT_ARENA_ALIGN - 1))
+
+teeio_result_store_t *teeio_result_store_create()
+{
+  teeio_result_store_t *store = (teeio_result_store_t *)calloc(1, sizeof(teeio_result_store_t));
+  if(store == NULL) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to allocate the result store.\n"));
+  }
+  return store;
+}
+
+void teeio_result_store_free(teeio_result_store_t *store)
+{
+  if(store == NULL) {
+    return;
+  }
+
+  teeio_result_arena_chunk_t *chunk = store->chunk;
+  while(chunk) {
+    teeio_result_arena_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  free(store);
+}
+
+/**
+ * Allocate zeroed memory from the arena of the store.
+ * It is freed by teeio_result_store_free.
+ */
+void *teeio_result_store_alloc(teeio_result_store_t *store, size_t size)
+{
+  TEEIO_ASSERT(store);
+
+  size = (size + TEEIO_RESULT_ARENA_ALIGN - 1) & ~(size_t)(TEEIO_RESULT_ARENA_ALIGN - 1);
+
+  teeio_result_arena_chunk_t *chunk = store->chunk;
+  if(chunk == NULL || chunk->size - chunk->used < size) {
+    size_t chunk_size = TEEIO_RESULT_ARENA_CHUNK_HEADER_SIZE + size;
+    if(chunk_size < TEEIO_RESULT_ARENA_CHUNK_SIZE) {
+      chunk_size = TEEIO_RESULT_ARENA_CHUNK_SIZE;
+    }
+    chunk = (teeio_result_arena_chunk_t *)calloc(1, chunk_size);
+    if(chunk == NULL) {
+      TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to allocate the result arena.\n"));
+      return NULL;
+    }
+    chunk->size = chunk_size;
+    chunk->used = TEEIO_RESULT_ARENA_CHUNK_HEADER_SIZE;
+    chunk->next = store->chunk;
+    store->chunk = chunk;
+  }
+
+  void *ptr = (uint8_t *)chunk + chunk->used;
+  chunk->used += size;
+
+  return ptr;
+}
+
+static char *teeio_result_store_strdup(teeio_result_store_t *store, const char *str)
+{
+  size_t len = strlen(str);
+  char *copy = (char *)teeio_result_store_alloc(store, len + 1);
+  if(copy != NULL) {
+    memcpy(copy, str, len);
+  }
+  return copy;
+}
+
+static uint32_t teeio_message_format_hash(const char *format)
+{
+  uint32_t hash = 2166136261u;
+  while(*format) {
+    hash ^= (uint8_t)*format++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * Parse the conversion specification at *format which follows the '%'.
+ * Return false if the conversion is not supported by the store.
+ * *format points to the conversion specifier when it returns.
+ */
+static bool teeio_message_parse_spec(const char **format, int *arg_type, bool *has_arg)
+{
+  const char *p = *format;
+  int length = 0; // 0: none, 'l', 'L' (ll), 'z', 'j', 't', 'D' (long double)
+
+  while(*p && strchr("-+ #0", *p)) {
+    p++;
+  }
+  while(isdigit((unsigned char)*p)) {
+    p++;
+  }
+  if(*p == '.') {
+    p++;
+    while(isdigit((unsigned char)*p)) {
+      p++;
+    }
+  }
+  if(*p == '*') {
+    return false;
+  }
+
+  if(*p == 'h') {
+    p += (p[1] == 'h') ? 2 : 1;
+  } else if(*p == 'l') {
+    length = (p[1] == 'l') ? 'L' : 'l';
+    p += (p[1] == 'l') ? 2 : 1;
+  } else if(*p == 'z' || *p == 'j' || *p == 't') {
+    length = *p++;
+  } else if(*p == 'L') {
+    length = 'D';
+    p++;
+  }
+
+  *format = p;
+  *has_arg = true;
+
+  switch(*p) {
+  case '%':
+    *has_arg = false;
+    return true;
+  case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+    *arg_type = length == 'l' ? TEEIO_MESSAGE_ARG_LONG :
+                length == 'L' ? TEEIO_MESSAGE_ARG_LONG_LONG :
+                length == 'z' ? TEEIO_MESSAGE_ARG_SIZE :
+                length == 'j' ? TEEIO_MESSAGE_ARG_INTMAX :
+                length == 't' ? TEEIO_MESSAGE_ARG_PTRDIFF : TEEIO_MESSAGE_ARG_INT;
+    return length != 'D';
+  case 'c':
+    *arg_type = TEEIO_MESSAGE_ARG_INT;
+    return length == 0;
+  case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+    *arg_type = TEEIO_MESSAGE_ARG_DOUBLE;
+    return length == 0 || length == 'l';
+  case 's':
+    *arg_type = TEEIO_MESSAGE_ARG_STRING;
+    return length == 0;
+  case 'p':
+    *arg_type = TEEIO_MESSAGE_ARG_POINTER;
+    return length == 0;
+  default:
+    return false;
+  }
+}
+
+static void teeio_message_parse_format(teeio_message_format_t *message_format)
+{
+  const char *p = message_format->format;
+  int arg_type = 0;
+  bool has_arg;
+
+  message_format->packable = true;
+  for(; *p; p++) {
+    if(*p != '%') {
+      continue;
+    }
+    p++;
+    if(!teeio_message_parse_spec(&p, &arg_type, &has_arg) ||
+       (has_arg && message_format->arg_num == TEEIO_MESSAGE_MAX_ARG_NUM)) {
+      message_format->packable = false;
+      return;
+    }
+    if(has_arg) {
+      message_format->arg_types[message_format->arg_num++] = (uint8_t)arg_type;
+    }
+  }
+}
+
+/**
+ * Get the message format from the store. The format is copied into the store
+ * the first time, because some cases pass a message in a stack buffer as the format.
+ */
+static teeio_message_format_t *teeio_result_store_get_format(teeio_result_store_t *store, const char *format)
+{
+  uint32_t hash = teeio_message_format_hash(format);
+  teeio_message_format_t **bucket = &store->formats[hash % TEEIO_MESSAGE_FORMAT_BUCKET_NUM];
+
+  for(teeio_message_format_t *itr = *bucket; itr != NULL; itr = itr->next) {
+    if(itr->hash == hash && strcmp(itr->format, format) == 0) {
+      return itr;
+    }
+  }
+
+  teeio_message_format_t *message_format = (teeio_message_format_t *)teeio_result_store_alloc(store, sizeof(teeio_message_format_t));
+  if(message_format == NULL) {
+    return NULL;
+  }
+  message_format->format = teeio_result_store_strdup(store, format);
+  if(message_format->format == NULL) {
+    return NULL;
+  }
+  message_format->hash = hash;
+  teeio_message_parse_format(message_format);
+
+  message_format->next = *bucket;
+  *bucket = message_format;
+
+  return message_format;
+}
+
+/**
+ * Render the message of an assertion into buffer.
+ * Return the length of the message as snprintf does.
+ */
+int teeio_render_assertion_message(const ide_run_test_case_assertion_result_t *assertion_result, char *buffer, size_t size)
+{
+  const teeio_message_format_t *message_format = assertion_result->message_format;
+  char spec[TEEIO_MESSAGE_MAX_SPEC_LEN];
+  size_t pos = 0;
+  int len, arg_index = 0;
+  int arg_type = 0;
+  bool has_arg;
+
+  TEEIO_ASSERT(size > 0);
+  buffer[0] = '\0';
+  if(message_format == NULL) {
+    return 0;
+  }
+
+  const char *p = message_format->format;
+  while(*p) {
+    const char *start = p;
+    if(*p != '%') {
+      while(*p && *p != '%') {
+        p++;
+      }
+      len = (int)(p - start);
+      if(pos < size) {
+        snprintf(buffer + pos, size - pos, "%.*s", len, start);
+      }
+      pos += len;
+      continue;
+    }
+
+    p++;
+    teeio_message_parse_spec(&p, &arg_type, &has_arg);
+    p++;
+    len = (int)(p - start);
+    if(len >= (int)sizeof(spec)) {
+      len = sizeof(spec) - 1;
+    }
+    memcpy(spec, start, len);
+    spec[len] = '\0';
+
+    char *dst = pos < size ? buffer + pos : NULL;
+    size_t dst_size = pos < size ? size - pos : 0;
+    const teeio_message_arg_t *arg = &assertion_result->args[arg_index];
+    if(!has_arg) {
+      len = snprintf(dst, dst_size, "%%");
+    } else {
+      arg_index++;
+      switch(message_format->arg_types[arg_index - 1]) {
+      case TEEIO_MESSAGE_ARG_INT:
+        len = snprintf(dst, dst_size, spec, (int)arg->i64);
+        break;
+      case TEEIO_MESSAGE_ARG_LONG:
+        len = snprintf(dst, dst_size, spec, (long)arg->i64);
+        break;
+      case TEEIO_MESSAGE_ARG_LONG_LONG:
+        len = snprintf(dst, dst_size, spec, (long long)arg->i64);
+        break;
+      case TEEIO_MESSAGE_ARG_SIZE:
+        len = snprintf(dst, dst_size, spec, (size_t)arg->i64);
+        break;
+      case TEEIO_MESSAGE_ARG_INTMAX:
+        len = snprintf(dst, dst_size, spec, (intmax_t)arg->i64);
+        break;
+      case TEEIO_MESSAGE_ARG_PTRDIFF:
+        len = snprintf(dst, dst_size, spec, (ptrdiff_t)arg->i64);
+        break;
+      case TEEIO_MESSAGE_ARG_DOUBLE:
+        len = snprintf(dst, dst_size, spec, arg->d);
+        break;
+      case TEEIO_MESSAGE_ARG_STRING:
+        len = snprintf(dst, dst_size, spec, arg->str != NULL ? arg->str : "(null)");
+        break;
+      default:
+        len = snprintf(dst, dst_size, spec, arg->ptr);
+        break;
+      }
+    }
+    if(len > 0) {
+      pos += len;
+    }
+  }
+
+  return (int)pos;
+}
 
 /**
  * Check the test result of a case.
@@ -42,22 +394,10 @@ teeio_test_result_t teeio_test_case_result(
   }
 
   teeio_test_result_t result = TEEIO_TEST_RESULT_NOT_TESTED;
-  int pass = 0, failed = 0;
-  ide_run_test_case_assertion_result_t* assertion = case_result->assertion_result;
-  while(assertion) {
-    if(assertion->type == IDE_COMMON_TEST_CASE_ASSERTION_TYPE_TEST) {
-      if(assertion->result == TEEIO_TEST_RESULT_PASS) {
-        pass++;
-      } else if(assertion->result == TEEIO_TEST_RESULT_FAILED) {
-        failed++;
-      }
-    }
-    assertion = assertion->next;
-  }
 
-  if(failed > 0) {
+  if(case_result->total_failed > 0) {
     result = TEEIO_TEST_RESULT_FAILED;
-  } else if(pass > 0 && failed == 0) {
+  } else if(case_result->total_passed > 0) {
     result = TEEIO_TEST_RESULT_PASS;
   }
 
@@ -74,8 +414,11 @@ bool teeio_record_assertion_result(
   ...)
 {
   va_list marker;
+  teeio_message_format_t *format = NULL;
+  char *rendered_message = NULL;
+  int i;
 
-  if(g_current_case_result == NULL) {
+  if(g_current_case_result == NULL || g_current_result_store == NULL) {
     TEEIO_ASSERT(false);
     return false;
   }
@@ -86,15 +429,81 @@ bool teeio_record_assertion_result(
     return false;
   }
 
-  ide_run_test_case_assertion_result_t* ar = (ide_run_test_case_assertion_result_t *)malloc(sizeof(ide_run_test_case_assertion_result_t));
-  memset(ar, 0, sizeof(ide_run_test_case_assertion_result_t));
+  const teeio_result_sink_t *result_sink = get_result_sink();
+  if(result_sink != NULL) {
+    // stream it instead of keeping it in memory
+    char message[MAX_LINE_LENGTH] = {0};
+    if (message_format != NULL) {
+      va_start(marker, message_format);
+      vsnprintf(message, sizeof(message), message_format, marker);
+      va_end(marker);
+    }
+    result_sink->record_assertion(g_current_config_result, g_current_group_result, case_result,
+                                  assertion_id, assertion_type, result, message);
+    goto UpdateTotals;
+  }
 
   if (message_format != NULL) {
+    format = teeio_result_store_get_format(g_current_result_store, message_format);
+    if(format != NULL && !format->packable) {
+      // render it now and keep the text
+      char buffer[MAX_LINE_LENGTH];
       va_start(marker, message_format);
+      vsnprintf(buffer, sizeof(buffer), message_format, marker);
+      va_end(marker);
+      rendered_message = teeio_result_store_strdup(g_current_result_store, buffer);
+      format = rendered_message != NULL ? &m_rendered_message_format : NULL;
+    }
+  }
 
-      vsnprintf(ar->extra_data, sizeof(ar->extra_data), message_format, marker);
+  int arg_num = format != NULL ? format->arg_num : 0;
+  ide_run_test_case_assertion_result_t* ar = (ide_run_test_case_assertion_result_t *)teeio_result_store_alloc(
+          g_current_result_store, sizeof(ide_run_test_case_assertion_result_t) + arg_num * sizeof(teeio_message_arg_t));
+  if(ar == NULL) {
+    return false;
+  }
 
-      va_end(marker);
+  ar->message_format = format;
+  if(rendered_message != NULL) {
+    ar->args[0].str = rendered_message;
+  } else if(arg_num > 0) {
+    // pack the arguments. The strings are copied because they are often in stack buffers.
+    va_start(marker, message_format);
+    for(i = 0; i < arg_num; i++) {
+      switch(format->arg_types[i]) {
+      case TEEIO_MESSAGE_ARG_INT:
+        ar->args[i].i64 = va_arg(marker, int);
+        break;
+      case TEEIO_MESSAGE_ARG_LONG:
+        ar->args[i].i64 = va_arg(marker, long);
+        break;
+      case TEEIO_MESSAGE_ARG_LONG_LONG:
+        ar->args[i].i64 = va_arg(marker, long long);
+        break;
+      case TEEIO_MESSAGE_ARG_SIZE:
+        ar->args[i].i64 = (int64_t)va_arg(marker, size_t);
+        break;
+      case TEEIO_MESSAGE_ARG_INTMAX:
+        ar->args[i].i64 = va_arg(marker, intmax_t);
+        break;
+      case TEEIO_MESSAGE_ARG_PTRDIFF:
+        ar->args[i].i64 = va_arg(marker, ptrdiff_t);
+        break;
+      case TEEIO_MESSAGE_ARG_DOUBLE:
+        ar->args[i].d = va_arg(marker, double);
+        break;
+      case TEEIO_MESSAGE_ARG_STRING:
+        {
+          const char *str = va_arg(marker, const char *);
+          ar->args[i].str = str != NULL ? teeio_result_store_strdup(g_current_result_store, str) : NULL;
+        }
+        break;
+      default:
+        ar->args[i].ptr = va_arg(marker, void *);
+        break;
+      }
+    }
+    va_end(marker);
   }
 
   ar->class_id = case_class;
@@ -104,16 +513,14 @@ bool teeio_record_assertion_result(
   ar->result = result;
 
   // Append it to case_result
-  ide_run_test_case_assertion_result_t *itr = case_result->assertion_result;
-  if(itr == NULL) {
+  if(case_result->assertion_result_tail == NULL) {
     case_result->assertion_result = ar;
   } else {
-    while(itr->next) {
-      itr = itr->next;
-    }
-    itr->next = ar;
+    case_result->assertion_result_tail->next = ar;
   }
+  case_result->assertion_result_tail = ar;
 
+UpdateTotals:
   // increase the total passed/failed
   if(result == TEEIO_TEST_RESULT_PASS) {
     g_current_config_result->total_passed++;
@@ -134,33 +541,46 @@ bool teeio_record_config_item_result(
   teeio_test_result_t result
   )
 {
-  if(g_current_case_result == NULL) {
+  if(g_current_case_result == NULL || g_current_result_store == NULL) {
     return false;
   }
 
-  ide_run_test_config_item_result_t* config_item_result = g_current_case_result->config_item_result;
-  while(config_item_result) {
-    if(config_item_result->config_item_id == config_item_id) {
-      break;
+  // the case result is not kept while the results are streamed
+  const teeio_result_sink_t *result_sink = get_result_sink();
+  if(result_sink != NULL) {
+    if(g_current_config_result != NULL) {
+      result_sink->record_config_item(g_current_config_result, g_current_group_result, g_current_case_result,
+                                      config_item_id, func, result);
+    }
+    return true;
+  }
+
+  // the items of a case are few, and the last one is mostly the one recorded
+  ide_run_test_config_item_result_t* config_item_result = g_current_case_result->config_item_result_tail;
+  if(config_item_result != NULL && config_item_result->config_item_id != config_item_id) {
+    config_item_result = g_current_case_result->config_item_result;
+    while(config_item_result) {
+      if(config_item_result->config_item_id == config_item_id) {
+        break;
+      }
+      config_item_result = config_item_result->next;
     }
-    config_item_result = config_item_result->next;
   }
 
   if(config_item_result == NULL) {
-    config_item_result = (ide_run_test_config_item_result_t *)malloc(sizeof(ide_run_test_config_item_result_t));
-    memset(config_item_result, 0, sizeof(ide_run_test_config_item_result_t));
+    config_item_result = (ide_run_test_config_item_result_t *)teeio_result_store_alloc(g_current_result_store, sizeof(ide_run_test_config_item_result_t));
+    if(config_item_result == NULL) {
+      return false;
+    }
     config_item_result->config_item_id = config_item_id;
 
     // Append it to g_current_case_result->config_item_result
-    ide_run_test_config_item_result_t *itr = g_current_case_result->config_item_result;
-    if(itr == NULL) {
+    if(g_current_case_result->config_item_result_tail == NULL) {
       g_current_case_result->config_item_result = config_item_result;
     } else {
-      while(itr->next) {
-        itr = itr->next;
-      }
-      itr->next = config_item_result;
+      g_current_case_result->config_item_result_tail->next = config_item_result;
     }
+    g_current_case_result->config_item_result_tail = config_item_result;
   }
 
   config_item_result->results[func] = result;
@@ -189,5 +609,10 @@ bool teeio_record_group_result(
     va_end(marker);
   }
 
+  const teeio_result_sink_t *result_sink = get_result_sink();
+  if(result_sink != NULL && g_current_config_result != NULL) {
+    result_sink->record_group(g_current_config_result, g_current_group_result, func, result, func_result->extra_data);
+  }
+
   return true;
 }
@@ -4,6 +4,8 @@
  *  License: BSD 3-Clause License.
  **/
 
+#define _DEFAULT_SOURCE
+
 #include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -461,7 +463,7 @@ void log_file_close(){
     }
 }
 
-bool pcap_file_init(const char* pcap_file, uint32_t transport_layer)
+bool pcap_file_init(const char* pcap_file, uint32_t transport_layer, PCAP_FILE_FORMAT format)
 {
   bool ret;
 
@@ -476,8 +478,9 @@ bool pcap_file_init(const char* pcap_file, uint32_t transport_layer)
 
   strftime(current_time_stamp, MAX_TIME_STAMP_LENGTH, "%Y-%m-%d_%H-%M-%S", localTime);
 
-  snprintf(full_pcap_file, MAX_FILE_NAME, "%s_%s.pcap", pcap_file, current_time_stamp);
-  ret = open_pcap_packet_file(full_pcap_file, transport_layer);
+  snprintf(full_pcap_file, MAX_FILE_NAME, "%s_%s.%s", pcap_file, current_time_stamp,
+           format == PCAP_FILE_FORMAT_PCAP ? "pcap" : "pcapng");
+  ret = open_pcap_packet_file(full_pcap_file, transport_layer, format);
   if(!ret){
     TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to open pcap file [%s]\n", full_pcap_file));
     return false;
@@ -491,6 +494,36 @@ void pcap_file_close()
   close_pcap_packet_file();
 }
 
+// get the monotonic time in nanoseconds
+uint64_t get_monotonic_time_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_uint64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// sort uint64_t array in ascending order
+void sort_uint64_array(uint64_t* array, int size)
+{
+  qsort(array, size, sizeof(uint64_t), compare_uint64);
+}
+
+// nearest-rank percentile of the sorted uint64_t array
+uint64_t get_percentile_of_sorted_uint64_array(const uint64_t* array, int size, int percentile)
+{
+  TEEIO_ASSERT(size > 0);
+
+  int rank = (size * percentile + 99) / 100;
+  return array[rank > 0 ? rank - 1 : 0];
+}
+
 // get the max value from uint32_t array
 uint32_t get_max_from_uint32_array(uint32_t* array, uint32_t size)
 {
@@ -11,14 +11,22 @@
 
 uint32_t get_ide_reg_block_offset(int fd, TEST_IDE_TYPE ide_type, uint8_t ide_id, uint32_t ide_ecap_offset);
 
-bool init_pci_doe(int fd);
-
 void enable_ide_stream_in_kcbar(
     INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr,
     const uint8_t rp_stream_index,
     bool enable
 );
 
+// Accessors of the KCBAR registers. The control registers of a KCBAR mapped
+// by map_kcbar_addr are shadowed per KCBAR; see intel_rp_pcie.c.
+uint32_t kcbar_read_reg32(INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr, void *reg_ptr);
+
+void kcbar_write_reg32(INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr, void *reg_ptr, uint32_t value);
+
+void kcbar_write_self_clearing_reg32(INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr, void *reg_ptr, uint32_t value, uint32_t self_clearing_mask);
+
+INTEL_KEYP_PCIE_STREAM_CAP kcbar_get_capabilities(INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr);
+
 void dump_kcbar(
     INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr,
     const uint8_t rp_stream_index
@@ -12,14 +12,263 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <sys/mman.h>
 #include "pcie_ide_internal.h"
 #include "pcie_ide_lib.h"
 
-int m_rp_fp = 0;
+TEEIO_THREAD_LOCAL int m_rp_fp = 0;
+
+extern bool g_kcbar_verify;
 
 #define KCBAR_MEMORY_SIZE 1024
+#define KCBAR_SHADOW_DW_NUM (KCBAR_MEMORY_SIZE / sizeof(uint32_t))
+#define MAX_KCBAR_DESC_NUM 16
+
+// Shadow copy of the control registers of a KCBAR. Root ports of the same key
+// configuration unit map the same KCBAR, so the shadow is keyed by its physical
+// address and shared by the mappings.
+typedef struct {
+    uint64_t kcbar_addr;
+    uint32_t ref_cnt;
+    uint32_t regs[KCBAR_SHADOW_DW_NUM];
+    bool valid[KCBAR_SHADOW_DW_NUM];
+} INTEL_KEYP_KCBAR_SHADOW;
+
+// KCBAR descriptor of a mapping.
+// The key/iv slot layout is computed from the capabilities once when the KCBAR
+// is mapped. The control registers are shadowed so that their read-modify-write
+// does not read the uncached MMIO. Status registers are never shadowed.
+typedef struct {
+    INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar;
+    // the same KCBAR may be mapped at the same address again
+    uint32_t ref_cnt;
+    INTEL_KEYP_PCIE_STREAM_CAP capabilities;
+    // slots[0] of the root port side direction
+    INTEL_KEYP_KEY_SLOT *tx_key_slots;
+    INTEL_KEYP_IV_SLOT *tx_iv_slots;
+    INTEL_KEYP_KEY_SLOT *rx_key_slots;
+    INTEL_KEYP_IV_SLOT *rx_iv_slots;
+    INTEL_KEYP_KCBAR_SHADOW *shadow;
+} INTEL_KEYP_KCBAR_DESC;
+
+static INTEL_KEYP_KCBAR_DESC *m_kcbar_descs[MAX_KCBAR_DESC_NUM] = {0};
+static INTEL_KEYP_KCBAR_SHADOW *m_kcbar_shadows[MAX_KCBAR_DESC_NUM] = {0};
+static pthread_mutex_t m_kcbar_descs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void init_kcbar_desc(INTEL_KEYP_KCBAR_DESC *desc, INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar_ptr)
+{
+    desc->kcbar = kcbar_ptr;
+    desc->capabilities.raw = mmio_read_reg32(&kcbar_ptr->capabilities);
+    // Tx key_slots[0] follows the stream config register blocks
+    desc->tx_key_slots = (INTEL_KEYP_KEY_SLOT *)(&kcbar_ptr->stream_config_reg_block + desc->capabilities.num_stream_supported + 1);
+    desc->tx_iv_slots = (INTEL_KEYP_IV_SLOT *)(desc->tx_key_slots + desc->capabilities.num_tx_key_slots + 1);
+    desc->rx_key_slots = (INTEL_KEYP_KEY_SLOT *)(desc->tx_iv_slots + desc->capabilities.num_tx_key_slots + 1);
+    desc->rx_iv_slots = (INTEL_KEYP_IV_SLOT *)(desc->rx_key_slots + desc->capabilities.num_rx_key_slots + 1);
+}
+
+// m_kcbar_descs_mutex is held by the caller
+static INTEL_KEYP_KCBAR_SHADOW *get_kcbar_shadow(uint64_t kcbar_addr)
+{
+    INTEL_KEYP_KCBAR_SHADOW *shadow;
+    int free_index = -1;
+
+    for (int i = 0; i < MAX_KCBAR_DESC_NUM; i++) {
+        if (m_kcbar_shadows[i] == NULL) {
+            free_index = free_index < 0 ? i : free_index;
+        } else if (m_kcbar_shadows[i]->kcbar_addr == kcbar_addr) {
+            m_kcbar_shadows[i]->ref_cnt++;
+            return m_kcbar_shadows[i];
+        }
+    }
+    if (free_index < 0) {
+        return NULL;
+    }
+
+    shadow = (INTEL_KEYP_KCBAR_SHADOW *)calloc(1, sizeof(INTEL_KEYP_KCBAR_SHADOW));
+    if (shadow == NULL) {
+        return NULL;
+    }
+    shadow->kcbar_addr = kcbar_addr;
+    shadow->ref_cnt = 1;
+    m_kcbar_shadows[free_index] = shadow;
+
+    return shadow;
+}
+
+// m_kcbar_descs_mutex is held by the caller
+static void put_kcbar_shadow(INTEL_KEYP_KCBAR_SHADOW *shadow)
+{
+    if (--shadow->ref_cnt != 0) {
+        return;
+    }
+    for (int i = 0; i < MAX_KCBAR_DESC_NUM; i++) {
+        if (m_kcbar_shadows[i] == shadow) {
+            m_kcbar_shadows[i] = NULL;
+        }
+    }
+    free(shadow);
+}
+
+static void register_kcbar_desc(INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar_ptr, uint64_t kcbar_addr)
+{
+    INTEL_KEYP_KCBAR_DESC *desc = NULL;
+    int free_index = -1;
+
+    pthread_mutex_lock(&m_kcbar_descs_mutex);
+    for (int i = 0; i < MAX_KCBAR_DESC_NUM; i++) {
+        if (m_kcbar_descs[i] == NULL) {
+            free_index = free_index < 0 ? i : free_index;
+        } else if (m_kcbar_descs[i]->kcbar == kcbar_ptr) {
+            m_kcbar_descs[i]->ref_cnt++;
+            goto Done;
+        }
+    }
+
+    if (free_index >= 0) {
+        desc = (INTEL_KEYP_KCBAR_DESC *)calloc(1, sizeof(INTEL_KEYP_KCBAR_DESC));
+    }
+    if (desc != NULL) {
+        desc->shadow = get_kcbar_shadow(kcbar_addr);
+        if (desc->shadow == NULL) {
+            free(desc);
+            desc = NULL;
+        }
+    }
+    if (desc == NULL) {
+        TEEIO_DEBUG((TEEIO_DEBUG_WARN, "Too many KCBARs are mapped. KCBAR %p is not cached.\n", (void *)kcbar_ptr));
+        goto Done;
+    }
+
+    init_kcbar_desc(desc, kcbar_ptr);
+    desc->ref_cnt = 1;
+    m_kcbar_descs[free_index] = desc;
+
+Done:
+    pthread_mutex_unlock(&m_kcbar_descs_mutex);
+}
+
+static void unregister_kcbar_desc(INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar_ptr)
+{
+    pthread_mutex_lock(&m_kcbar_descs_mutex);
+    for (int i = 0; i < MAX_KCBAR_DESC_NUM; i++) {
+        if (m_kcbar_descs[i] != NULL && m_kcbar_descs[i]->kcbar == kcbar_ptr && --m_kcbar_descs[i]->ref_cnt == 0) {
+            put_kcbar_shadow(m_kcbar_descs[i]->shadow);
+            free(m_kcbar_descs[i]);
+            m_kcbar_descs[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&m_kcbar_descs_mutex);
+}
+
+// A KCBAR is used by one thread at a time. The lock only protects the table.
+static INTEL_KEYP_KCBAR_DESC *get_kcbar_desc(INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar_ptr)
+{
+    INTEL_KEYP_KCBAR_DESC *desc = NULL;
+
+    pthread_mutex_lock(&m_kcbar_descs_mutex);
+    for (int i = 0; i < MAX_KCBAR_DESC_NUM; i++) {
+        if (m_kcbar_descs[i] != NULL && m_kcbar_descs[i]->kcbar == kcbar_ptr) {
+            desc = m_kcbar_descs[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_kcbar_descs_mutex);
+
+    return desc;
+}
+
+static int get_kcbar_shadow_index(INTEL_KEYP_KCBAR_DESC *desc, void *reg_ptr)
+{
+    size_t offset = (uint8_t *)reg_ptr - (uint8_t *)desc->kcbar;
+    if (offset >= KCBAR_MEMORY_SIZE || (offset & 0x3) != 0) {
+        return -1;
+    }
+    return (int)(offset / sizeof(uint32_t));
+}
+
+/**
+ * Read a KCBAR control register.
+ * The shadow copy is returned if the register has been read or written before.
+ * With kcbar_verify the register is read back and compared with the shadow copy.
+ */
+uint32_t kcbar_read_reg32(INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr, void *reg_ptr)
+{
+    INTEL_KEYP_KCBAR_DESC *desc = get_kcbar_desc(kcbar_ptr);
+    int index = desc == NULL ? -1 : get_kcbar_shadow_index(desc, reg_ptr);
+    INTEL_KEYP_KCBAR_SHADOW *shadow;
+    uint32_t data;
+
+    if (index < 0) {
+        return mmio_read_reg32(reg_ptr);
+    }
+
+    shadow = desc->shadow;
+    if (shadow->valid[index] && !g_kcbar_verify) {
+        return shadow->regs[index];
+    }
+
+    data = mmio_read_reg32(reg_ptr);
+    if (shadow->valid[index] && shadow->regs[index] != data) {
+        TEEIO_DEBUG((TEEIO_DEBUG_WARN, "KCBAR+0x%03x readback mismatch: shadow=0x%08x, mmio=0x%08x\n",
+                     index * (int)sizeof(uint32_t), shadow->regs[index], data));
+    }
+    shadow->regs[index] = data;
+    shadow->valid[index] = true;
+
+    return data;
+}
+
+void kcbar_write_reg32(INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr, void *reg_ptr, uint32_t value)
+{
+    INTEL_KEYP_KCBAR_DESC *desc = get_kcbar_desc(kcbar_ptr);
+    int index = desc == NULL ? -1 : get_kcbar_shadow_index(desc, reg_ptr);
+
+    mmio_write_reg32(reg_ptr, value);
+    if (index < 0) {
+        return;
+    }
+
+    desc->shadow->regs[index] = value;
+    desc->shadow->valid[index] = true;
+    if (g_kcbar_verify) {
+        kcbar_read_reg32(kcbar_ptr, reg_ptr);
+    }
+}
+
+/**
+ * Write a KCBAR control register which has self-clearing bits, e.g. the prime
+ * bits of Tx/Rx control. The shadow copy keeps the bits in self_clearing_mask
+ * cleared so that a later read-modify-write does not set them again.
+ * It is not read back because the hardware may not have cleared the bits yet.
+ */
+void kcbar_write_self_clearing_reg32(INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr, void *reg_ptr, uint32_t value, uint32_t self_clearing_mask)
+{
+    INTEL_KEYP_KCBAR_DESC *desc = get_kcbar_desc(kcbar_ptr);
+    int index = desc == NULL ? -1 : get_kcbar_shadow_index(desc, reg_ptr);
+
+    mmio_write_reg32(reg_ptr, value);
+    if (index < 0) {
+        return;
+    }
+
+    desc->shadow->regs[index] = value & ~self_clearing_mask;
+    desc->shadow->valid[index] = true;
+}
+
+INTEL_KEYP_PCIE_STREAM_CAP kcbar_get_capabilities(INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr)
+{
+    INTEL_KEYP_KCBAR_DESC *desc = get_kcbar_desc(kcbar_ptr);
+    INTEL_KEYP_PCIE_STREAM_CAP capabilities;
+
+    if (desc != NULL) {
+        return desc->capabilities;
+    }
+
+    capabilities.raw = mmio_read_reg32(&kcbar_ptr->capabilities);
+    return capabilities;
+}
 
 INTEL_KEYP_STREAM_CONFIG_REG_BLOCK *get_stream_cfg_reg_block(
     INTEL_KEYP_ROOT_COMPLEX_KCBAR *const kcbar_ptr,
@@ -35,24 +284,28 @@ void kcbar_set_key_slot(
     INTEL_KEYP_KEY_SLOT *const key_val_ptr,
     INTEL_KEYP_IV_SLOT *const iv_val_ptr)
 {
-    // INTEL_KEYP_IV_SLOT default_iv_val = {0};
+    INTEL_KEYP_KCBAR_DESC *desc = get_kcbar_desc(kcbar_ptr);
+    INTEL_KEYP_KCBAR_DESC local_desc;
     INTEL_KEYP_KEY_SLOT *key_slot_ptr = NULL;
     INTEL_KEYP_IV_SLOT *iv_slot_ptr = NULL;
-    INTEL_KEYP_PCIE_STREAM_CAP kcbar_capabilities = {.raw = mmio_read_reg32(&kcbar_ptr->capabilities)};
-    INTEL_KEYP_STREAM_CONFIG_REG_BLOCK *stream_config_reg_block = &kcbar_ptr->stream_config_reg_block;
 
-    // Jump to Tx key_slots[0]
-    key_slot_ptr = (INTEL_KEYP_KEY_SLOT *)(stream_config_reg_block + kcbar_capabilities.num_stream_supported + 1);
-    // Jump to Tx iv_slots[0]
-    iv_slot_ptr = (INTEL_KEYP_IV_SLOT *)(key_slot_ptr + kcbar_capabilities.num_tx_key_slots + 1);
+    if (desc == NULL)
+    {
+        // the KCBAR is not mapped by map_kcbar_addr
+        init_kcbar_desc(&local_desc, kcbar_ptr);
+        desc = &local_desc;
+    }
 
     // Input is device side direction, rootport side should use the opposite direction (i.e., RX <-> TX)
     if (direction == PCIE_IDE_STREAM_TX)
     {
-        // Jump to rx key_slots[0]
-        key_slot_ptr = (INTEL_KEYP_KEY_SLOT *)(iv_slot_ptr + kcbar_capabilities.num_tx_key_slots + 1);
-        // Jump to rx iv_slots[0]
-        iv_slot_ptr = (INTEL_KEYP_IV_SLOT *)(key_slot_ptr + kcbar_capabilities.num_rx_key_slots + 1);
+        key_slot_ptr = desc->rx_key_slots;
+        iv_slot_ptr = desc->rx_iv_slots;
+    }
+    else
+    {
+        key_slot_ptr = desc->tx_key_slots;
+        iv_slot_ptr = desc->tx_iv_slots;
     }
 
     // Jump to correct key slot
@@ -98,7 +351,7 @@ void cfg_rootport_ide_keys(
     }
 
     // Replace the SLOT_ID for the specified SUB_STREAM
-    INTEL_KEYP_STREAM_KEYSET_SLOT_ID stream_keyset_slot_id = {.raw = mmio_read_reg32(keyset_slot_id_ptr)};
+    INTEL_KEYP_STREAM_KEYSET_SLOT_ID stream_keyset_slot_id = {.raw = kcbar_read_reg32(kcbar_ptr, keyset_slot_id_ptr)};
     if (sub_stream == PCIE_IDE_SUB_STREAM_PR)
     {
         stream_keyset_slot_id.pr = slot_id;
@@ -116,7 +369,7 @@ void cfg_rootport_ide_keys(
         TEEIO_ASSERT(false);
     }
 
-    mmio_write_reg32(keyset_slot_id_ptr, stream_keyset_slot_id.raw);
+    kcbar_write_reg32(kcbar_ptr, keyset_slot_id_ptr, stream_keyset_slot_id.raw);
     return;
 }
 
@@ -128,7 +381,7 @@ bool is_rp_ide_stream_enabled_in_kcbar(
     INTEL_KEYP_STREAM_CONFIG_REG_BLOCK *stream_cfg_reg_block = get_stream_cfg_reg_block(kcbar_ptr, rp_stream_index);
 
     INTEL_KEYP_STREAM_CONTROL *stream_ctrl_ptr = &stream_cfg_reg_block->control;
-    INTEL_KEYP_STREAM_CONTROL stream_ctrl = {.raw = mmio_read_reg32(stream_ctrl_ptr)};
+    INTEL_KEYP_STREAM_CONTROL stream_ctrl = {.raw = kcbar_read_reg32(kcbar_ptr, stream_ctrl_ptr)};
     return stream_ctrl.en == 1;
 }
 
@@ -140,7 +393,7 @@ void set_rc_tx_ide_key_set(
     INTEL_KEYP_STREAM_CONFIG_REG_BLOCK *stream_cfg_reg_block = get_stream_cfg_reg_block(kcbar_ptr, rp_stream_index);
     INTEL_KEYP_STREAM_TXRX_CONTROL *ctrl_reg_ptr = &stream_cfg_reg_block->tx_ctrl;
 
-    INTEL_KEYP_STREAM_TXRX_CONTROL stream_txrx_control = {.raw = mmio_read_reg32(ctrl_reg_ptr)};
+    INTEL_KEYP_STREAM_TXRX_CONTROL stream_txrx_control = {.raw = kcbar_read_reg32(kcbar_ptr, ctrl_reg_ptr)};
     if (key_set_select == PCIE_IDE_STREAM_KS0)
     {
         stream_txrx_control.stream_tx_control.key_set_select = 0b01;
@@ -153,7 +406,7 @@ void set_rc_tx_ide_key_set(
     {
         TEEIO_ASSERT(false);
     }
-    mmio_write_reg32(ctrl_reg_ptr, stream_txrx_control.raw);
+    kcbar_write_reg32(kcbar_ptr, ctrl_reg_ptr, stream_txrx_control.raw);
 }
 
 void prime_rc_ide_keys(
@@ -168,7 +421,7 @@ void prime_rc_ide_keys(
 
     TEEIO_ASSERT(key_set_select < PCIE_IDE_STREAM_KS_NUM);
 
-    INTEL_KEYP_STREAM_TXRX_CONTROL stream_txrx_control = {.raw = mmio_read_reg32(ctrl_reg_ptr)};
+    INTEL_KEYP_STREAM_TXRX_CONTROL stream_txrx_control = {.raw = kcbar_read_reg32(kcbar_ptr, ctrl_reg_ptr)};
     if (key_set_select == PCIE_IDE_STREAM_KS0)
     {
         stream_txrx_control.common.prime_key_set_0 = 1;
@@ -177,7 +430,11 @@ void prime_rc_ide_keys(
     {
         stream_txrx_control.common.prime_key_set_1 = 1;
     }
-    mmio_write_reg32(ctrl_reg_ptr, stream_txrx_control.raw);
+    // the prime bits are cleared by the hardware
+    INTEL_KEYP_STREAM_TXRX_CONTROL prime_bits = {.raw = 0};
+    prime_bits.common.prime_key_set_0 = 1;
+    prime_bits.common.prime_key_set_1 = 1;
+    kcbar_write_self_clearing_reg32(kcbar_ptr, ctrl_reg_ptr, stream_txrx_control.raw, prime_bits.raw);
 
     // check if ready_key_set_x is 1 after prime
     uint32_t data32 = mmio_read_reg32(status_reg_ptr);
@@ -196,19 +453,13 @@ uint8_t* map_kcbar_addr(uint64_t addr, int* mapped_fd)
         return NULL;
     }
 
-    int mem_fd = open("/dev/mem", O_RDWR | O_SYNC);
-    if(mem_fd == -1) {
-        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "Failed to open /dev/mem\n"));
-        return NULL;
-    }
-    uint8_t * mem_ptr = (uint8_t *)mmap(NULL, KCBAR_MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, addr);
-    if (mem_ptr == MAP_FAILED) {
+    uint8_t *mem_ptr = get_device_backend()->map_mmio(addr, KCBAR_MEMORY_SIZE, mapped_fd);
+    if (mem_ptr == NULL) {
         TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "Failed to mmap kcbar\n"));
-        close(mem_fd);
         return NULL;
     }
 
-    *mapped_fd = mem_fd;
+    register_kcbar_desc((INTEL_KEYP_ROOT_COMPLEX_KCBAR *)mem_ptr, addr);
 
     return mem_ptr;
 }
@@ -216,8 +467,8 @@ uint8_t* map_kcbar_addr(uint64_t addr, int* mapped_fd)
 bool unmap_kcbar_addr(int kcbar_mem_fd, uint8_t* mapped_kcbar_addr)
 {
     if(kcbar_mem_fd > 0 && mapped_kcbar_addr != NULL){
-        munmap(mapped_kcbar_addr, KCBAR_MEMORY_SIZE);
-        close(kcbar_mem_fd);
+        unregister_kcbar_desc((INTEL_KEYP_ROOT_COMPLEX_KCBAR *)mapped_kcbar_addr);
+        get_device_backend()->unmap_mmio(kcbar_mem_fd, mapped_kcbar_addr, KCBAR_MEMORY_SIZE);
         return true;
     }
 
@@ -225,10 +476,11 @@ bool unmap_kcbar_addr(int kcbar_mem_fd, uint8_t* mapped_kcbar_addr)
 }
 
 
-// Parse the KEYP table and map the kcbar address
-bool parse_keyp_table(ide_common_test_port_context_t *port_context, INTEL_KEYP_PROTOCOL_TYPE keyp_protocol)
+// Find the KCBAR of the root port segment:bus:device.function in the KEYP table.
+// Return 0 if the root port is not described by a key configuration unit of keyp_protocol.
+uint64_t find_keyp_kcbar_addr(uint16_t segment, uint8_t bus, uint8_t device, uint8_t function, INTEL_KEYP_PROTOCOL_TYPE keyp_protocol)
 {
-  const char *keyp_table = "/sys/firmware/acpi/tables/KEYP";
+  const char *keyp_table = "KEYP";
   const char KEYP_SIGNATURE[] = {'K', 'E', 'Y', 'P'};
   uint8_t buffer[4096] = {0};
   uint32_t i = 0;
@@ -239,41 +491,26 @@ bool parse_keyp_table(ide_common_test_port_context_t *port_context, INTEL_KEYP_P
   uint32_t size = 0;
   uint64_t kcbar_addr = 0;
 
-  if (port_context == NULL || port_context->port->port_type != IDE_PORT_TYPE_ROOTPORT)
+  int table_size = get_device_backend()->read_acpi_table(keyp_table, buffer, sizeof(buffer));
+  if (table_size < (int)sizeof(INTEL_KEYP_ACPI))
   {
-    TEEIO_ASSERT(false);
-    return false;
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Error reading %s.\n", keyp_table));
+    return 0;
   }
-
-  port_context->kcbar_fd = -1;
-  port_context->mapped_kcbar_addr = 0;
-
-  int fd = open(keyp_table, O_RDONLY);
-  if (fd == -1)
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Error opening KEYP. (%s)\n", keyp_table));
-    return false;
-  }
-
-  size = lseek(fd, 0x0, SEEK_END);
-  TEEIO_ASSERT(size <= 4096);
-
-  lseek(fd, 0, SEEK_SET);
-  size_t bytes_read = read(fd, buffer, size);
-  TEEIO_ASSERT(bytes_read == size);
+  size = (uint32_t)table_size;
 
   INTEL_KEYP_ACPI *keyp = (INTEL_KEYP_ACPI *)buffer;
   if (memcmp(keyp->signature, KEYP_SIGNATURE, sizeof(keyp->signature)) != 0)
   {
     TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Invalid KEYP signature.\n"));
-    return false;
+    return 0;
   }
 
   uint8_t sum = calculate_checksum(buffer, size);
   if (sum != 0)
   {
     TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Invalid Checksum.\n"));
-    return false;
+    return 0;
   }
 
   offset = sizeof(INTEL_KEYP_ACPI);
@@ -290,10 +527,10 @@ bool parse_keyp_table(ide_common_test_port_context_t *port_context, INTEL_KEYP_P
     for (i = 0; i < kcu->RootPortCount; i++)
     {
       krpi = (INTEL_KEYP_ROOT_PORT_INFORMATION *)(buffer + offset + sizeof(INTEL_KEYP_KEY_CONFIGURATION_UNIT) + i * sizeof(INTEL_KEYP_ROOT_PORT_INFORMATION));
-      if (krpi->SegmentNumber == port_context->port->segment &&
-          krpi->Bus == port_context->port->bus &&
-          krpi->Bits.Device == port_context->port->device &&
-          krpi->Bits.Function == port_context->port->function)
+      if (krpi->SegmentNumber == segment &&
+          krpi->Bus == bus &&
+          krpi->Bits.Device == device &&
+          krpi->Bits.Function == function)
       {
         found = true;
         break;
@@ -309,7 +546,26 @@ bool parse_keyp_table(ide_common_test_port_context_t *port_context, INTEL_KEYP_P
     offset += kcu->Length;
   }
 
-  if (!found || kcbar_addr == 0)
+  return kcbar_addr;
+}
+
+// Parse the KEYP table and map the kcbar address
+bool parse_keyp_table(ide_common_test_port_context_t *port_context, INTEL_KEYP_PROTOCOL_TYPE keyp_protocol)
+{
+  uint64_t kcbar_addr = 0;
+
+  if (port_context == NULL || port_context->port->port_type != IDE_PORT_TYPE_ROOTPORT)
+  {
+    TEEIO_ASSERT(false);
+    return false;
+  }
+
+  port_context->kcbar_fd = -1;
+  port_context->mapped_kcbar_addr = 0;
+
+  kcbar_addr = find_keyp_kcbar_addr(port_context->port->segment, port_context->port->bus,
+                                    port_context->port->device, port_context->port->function, keyp_protocol);
+  if (kcbar_addr == 0)
   {
     return false;
   }
@@ -333,16 +589,16 @@ bool initialize_kcbar_registers(
 {
   INTEL_KEYP_STREAM_CONFIG_REG_BLOCK *stream_config_reg_block = (&kcbar->stream_config_reg_block) + rp_stream_index;
 
-  mmio_write_reg32(&stream_config_reg_block->tx_ctrl, 0);
-  mmio_write_reg32(&stream_config_reg_block->rx_ctrl, 0);
-  mmio_write_reg32(&stream_config_reg_block->tx_key_set_0, 0);
-  mmio_write_reg32(&stream_config_reg_block->tx_key_set_1, 0);
-  mmio_write_reg32(&stream_config_reg_block->rx_key_set_0, 0);
-  mmio_write_reg32(&stream_config_reg_block->rx_key_set_1, 0);
+  kcbar_write_reg32(kcbar, &stream_config_reg_block->tx_ctrl, 0);
+  kcbar_write_reg32(kcbar, &stream_config_reg_block->rx_ctrl, 0);
+  kcbar_write_reg32(kcbar, &stream_config_reg_block->tx_key_set_0, 0);
+  kcbar_write_reg32(kcbar, &stream_config_reg_block->tx_key_set_1, 0);
+  kcbar_write_reg32(kcbar, &stream_config_reg_block->rx_key_set_0, 0);
+  kcbar_write_reg32(kcbar, &stream_config_reg_block->rx_key_set_1, 0);
 
   INTEL_KEYP_STREAM_CONTROL stream_control = {.raw = 0};
   stream_control.stream_id = stream_id;
-  mmio_write_reg32(&stream_config_reg_block->control, stream_control.raw);
+  kcbar_write_reg32(kcbar, &stream_config_reg_block->control, stream_control.raw);
 
   return true;
 }
@@ -357,10 +613,10 @@ void enable_ide_stream_in_kcbar(
 
     // enable ide stream in kcbar
     INTEL_KEYP_STREAM_CONTROL *stream_ctrl_ptr = &stream_cfg_reg_block->control;
-    INTEL_KEYP_STREAM_CONTROL stream_ctrl = {.raw = mmio_read_reg32(stream_ctrl_ptr)};
+    INTEL_KEYP_STREAM_CONTROL stream_ctrl = {.raw = kcbar_read_reg32(kcbar_ptr, stream_ctrl_ptr)};
     stream_ctrl.en = enable ? 1 : 0;
 
-    mmio_write_reg32(stream_ctrl_ptr, stream_ctrl.raw);
+    kcbar_write_reg32(kcbar_ptr, stream_ctrl_ptr, stream_ctrl.raw);
 }
 
 void dump_kcbar(
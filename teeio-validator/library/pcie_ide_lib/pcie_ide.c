@@ -37,12 +37,8 @@
 
 #define LINK_IDE_REGISTER_BLOCK_SIZE (sizeof(PCIE_LNK_IDE_STREAM_CTRL) + sizeof(PCIE_LINK_IDE_STREAM_STATUS))
 
-extern uint32_t g_doe_extended_offset;
-
-uint32_t g_doe_extended_offset = 0;
-uint32_t g_ide_extended_offset = 0;
-uint32_t g_aer_extended_offset = 0;
-int m_dev_fp = 0;
+TEEIO_THREAD_LOCAL uint32_t g_ide_extended_offset = 0;
+TEEIO_THREAD_LOCAL uint32_t g_aer_extended_offset = 0;
 
 const char *m_ide_type_name[] = {
   "SelectiveIDE",
@@ -77,43 +73,35 @@ int open_configuration_space(char *bdf)
     return -1;
   }
 
-  char buf[MAX_FILE_NAME];
-  sprintf(buf, "/sys/bus/pci/devices/%s/config", bdf);
+  return get_device_backend()->open_config_space(bdf);
+}
 
-  int fd = open(buf, O_RDWR);
-  if (fd == -1)
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "open %s error!\n", buf));
-    return -1;
-  }
-  else
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_INFO, "successful open device with fd: %d\n", fd));
+void close_configuration_space(int fd)
+{
+  // the fd may be reused by another device, or the same device reopened after a reset
+  if (fd > 0) {
+    invalidate_device_cap_index(fd);
   }
-  uint32_t size = lseek(fd, 0x0, SEEK_END);
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "cfg space size = %x\n", size));
+  get_device_backend()->close_config_space(fd);
+}
+
 
-  if (size > 0x1000)
+// Capability index of the device. If the device is not registered by set_deivce_info,
+// the index is built into the given buffer.
+static PCIE_CAP_INDEX *get_cap_index(int fd, PCIE_CAP_INDEX *buffer)
+{
+  PCIE_CAP_INDEX *index = get_device_cap_index(fd);
+  if (index == NULL)
   {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "cfg space size is not valid!(bdf: %s)\n", bdf));
-    close(fd);
-    return -1;
+    build_pcie_cap_index(fd, buffer);
+    index = buffer;
   }
-
-  return fd;
+  return index;
 }
 
-
 uint32_t get_cap_offset(int fd, uint32_t cap_id)
 {
-  uint32_t walker = 0;
-  uint32_t cap_header = 0;
-  uint32_t offset = 0;
-
-  // get capability start from Type 0/1 header
-  uint16_t data16;
-  data16 = device_pci_read_16(0x34, fd);
-  walker = data16 & 0xFF; // CAPABILITY_POINTER
+  PCIE_CAP_INDEX buffer;
 
   if (cap_id != PCIE_CAPABILITY_ID)
   {
@@ -121,29 +109,13 @@ uint32_t get_cap_offset(int fd, uint32_t cap_id)
     return 0;
   }
 
-  while (walker < PCIE_EXT_CAP_START && walker != 0)
-  {
-    cap_header = device_pci_read_32(walker, fd);
-
-    if (((PCIE_CAP_LIST *)&cap_header)->id == cap_id)
-    {
-      offset = walker;
-      break;
-    }
-
-    walker = ((PCIE_CAP_LIST *)&cap_header)->next_cap_offset;
-  }
-
-  return offset;
+  return get_cap_index(fd, &buffer)->cap_offset[cap_id];
 }
 
 
 uint32_t get_extended_cap_offset(int fd, uint32_t ext_id)
 {
-  uint32_t ext_cap_start = 0x100; // defined by PCIe Specification
-  uint32_t walker = ext_cap_start;
-  uint32_t cap_ext_header = 0;
-  uint32_t offset = 0;
+  PCIE_CAP_INDEX buffer;
 
   if (ext_id != PCI_DOE_EXT_CAPABILITY_ID &&
       ext_id != PCI_IDE_EXT_CAPABILITY_ID &&
@@ -154,49 +126,27 @@ uint32_t get_extended_cap_offset(int fd, uint32_t ext_id)
     return 0;
   }
 
-  while (walker < 0x1000 && walker != 0)
-  {
-    cap_ext_header = device_pci_read_32(walker, fd);
-
-    if (((PCIE_CAP_ID *)&cap_ext_header)->id == ext_id)
-    {
-      offset = walker;
-      break;
-    }
-
-    walker = ((PCIE_CAP_ID *)&cap_ext_header)->next_cap_offset;
-  }
-
-  return offset;
+  return get_cap_index(fd, &buffer)->ext_cap_offset[ext_id];
 }
 
-// There may be multi DOE Extened Caps in ecap. This function walks thru the
-// extended caps and find out all the DOE Extended caps offset.
+// There may be multi DOE Extened Caps in ecap. This function returns all the
+// DOE Extended caps offset.
 bool get_doe_extended_cap_offset(int fd, uint32_t* doe_offsets, int* size)
 {
-  uint32_t ext_cap_start = 0x100; // defined by PCIe Specification
-  uint32_t walker = ext_cap_start;
-  uint32_t cap_ext_header = 0;
+  PCIE_CAP_INDEX buffer;
+  PCIE_CAP_INDEX *index = get_cap_index(fd, &buffer);
   int cnt = 0;
 
   TEEIO_ASSERT(size != NULL);
 
-  while (walker < 0x1000 && walker != 0)
+  for (cnt = 0; cnt < index->doe_cnt; cnt++)
   {
-    cap_ext_header = device_pci_read_32(walker, fd);
+    TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Find DOE Extended Cap at offset - 0x%04x\n", index->doe_offset[cnt]));
 
-    if (((PCIE_CAP_ID *)&cap_ext_header)->id == PCI_DOE_EXT_CAPABILITY_ID)
-    {
-      TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Find DOE Extended Cap at offset - 0x%04x\n", walker));
-
-      if(doe_offsets != NULL) {
-        TEEIO_ASSERT(cnt < *size);
-        doe_offsets[cnt] = walker;
-      }
-      cnt += 1;
+    if(doe_offsets != NULL) {
+      TEEIO_ASSERT(cnt < *size);
+      doe_offsets[cnt] = index->doe_offset[cnt];
     }
-
-    walker = ((PCIE_CAP_ID *)&cap_ext_header)->next_cap_offset;
   }
 
   *size = cnt;
@@ -224,7 +174,7 @@ bool close_root_port(pcie_ide_test_group_context_t *group_context)
   group_context->common.upper_port.mapped_kcbar_addr = 0;
 
   if(group_context->common.upper_port.cfg_space_fd > 0) {
-    close(group_context->common.upper_port.cfg_space_fd);
+    close_configuration_space(group_context->common.upper_port.cfg_space_fd);
     unset_device_info(group_context->common.upper_port.cfg_space_fd);
   }
   group_context->common.upper_port.cfg_space_fd = 0;
@@ -287,7 +237,7 @@ bool open_root_port(ide_common_test_port_context_t *port_context)
 
   // store the stream_cap in kcbar and pci_ide_cap in ecap(@configuration space)
   INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar = (INTEL_KEYP_ROOT_COMPLEX_KCBAR *)port_context->mapped_kcbar_addr;
-  port_context->stream_cap.raw = mmio_read_reg32(&kcbar->capabilities);
+  port_context->stream_cap.raw = kcbar_get_capabilities(kcbar).raw;
 
   uint32_t offset = ecap_offset + 4;
   port_context->ide_cap.raw = device_pci_read_32(offset, fd);
@@ -295,7 +245,7 @@ bool open_root_port(ide_common_test_port_context_t *port_context)
   return true;
 
 InitRootPortFail:
-  close(fd);
+  close_configuration_space(fd);
   unset_device_info(fd);
   return false;
 }
@@ -320,7 +270,7 @@ bool pcie_ide_alloc_slot_ids(ide_common_test_port_context_t* port_context, uint8
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Walk thru Rootport KCBar stream_x to collect the used key/iv slots.\n"));
 
   INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar = (INTEL_KEYP_ROOT_COMPLEX_KCBAR *)port_context->mapped_kcbar_addr;
-  INTEL_KEYP_PCIE_STREAM_CAP stream_cap = { .raw = mmio_read_reg32(&kcbar->capabilities)};
+  INTEL_KEYP_PCIE_STREAM_CAP stream_cap = kcbar_get_capabilities(kcbar);
   int num_stream_supported = stream_cap.num_stream_supported + 1;
   int num_key_iv_slots = stream_cap.num_tx_key_slots + 1;
 
@@ -611,7 +561,7 @@ bool check_use_prefetchable(char* bdf)
 
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Device bar0 is 0x%08x, use_prefetchable = %d\n", bar0, use_prefetchable));
 
-  close(fd);
+  close_configuration_space(fd);
 
   return use_prefetchable;
 }
@@ -660,7 +610,7 @@ bool populate_addr_assoc_reg_block(
     addr_assoc_reg_block->addr_assoc2.raw = addr_assoc2.raw;
     addr_assoc_reg_block->addr_assoc3.raw = addr_assoc3.raw;
 
-    close(cfg_space_fd);
+    close_configuration_space(cfg_space_fd);
 
     return true;
 }
@@ -825,13 +775,19 @@ bool init_root_port(pcie_ide_test_group_context_t *group_context)
   return true;
 
 InitHostFail:
-  close(port_context->cfg_space_fd);
+  close_configuration_space(port_context->cfg_space_fd);
   unset_device_info(port_context->cfg_space_fd);
   return false;
 }
 
-bool init_pci_doe(int fd)
+/**
+ * Open the DOE context of the device and select the DOE mailbox which supports
+ * the data object types used by teeio-validator.
+ */
+bool init_pci_doe(ide_common_test_port_context_t *port_context)
 {
+  int fd = port_context->cfg_space_fd;
+  IDE_PORT *port = port_context->port;
   uint32_t doe_extended_offsets[MAX_PCI_DOE_CNT] = {0};
   int doe_cnt = MAX_PCI_DOE_CNT;
   if(!get_doe_extended_cap_offset(fd, doe_extended_offsets, &doe_cnt)) {
@@ -839,34 +795,65 @@ bool init_pci_doe(int fd)
     return false;
   }
 
+  void *doe_context = pci_doe_context_open(port->bdf, fd, port->doe_spin_max_us, port->doe_backoff_max_us);
+  if(doe_context == NULL) {
+    return false;
+  }
+
+  // Before init PCI DOE, we need to abort any ongoing doe operation and check the Error bit.
+  // All the mailboxes are aborted first so that they share one abort timeout.
+  for(int i = 0; i < doe_cnt; i++) {
+    pci_doe_context_set_mailbox(doe_context, doe_extended_offsets[i]);
+    trigger_doe_abort(doe_context);
+  }
+  libspdm_sleep(1000 * 1000);
+
   PCIE_CAP_ID ecap_id = {.raw = 0};
-  uint8_t doe_discovery_version = 0;
   for(int i = 0; i < doe_cnt; i++) {
-    g_doe_extended_offset = doe_extended_offsets[i];
-    ecap_id.raw = device_pci_read_32(g_doe_extended_offset, fd);
+    uint8_t doe_discovery_version = 0;
+    uint32_t doe_offset = doe_extended_offsets[i];
+    pci_doe_context_set_mailbox(doe_context, doe_offset);
+    ecap_id.raw = device_pci_read_32(doe_offset, fd);
     if(ecap_id.version >= PCIE_DOE_ECAP_VERSION2) {
       // PCIE Spec 6.1 Section 6.30.1.1
       doe_discovery_version = PCIE_DOE_DISCOVERY_VERSION2;
     }
-    TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Try to init pci_doe (doe_offset=0x%04x, ecap_id=0x%08x)\n", g_doe_extended_offset, ecap_id.raw));
+    TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Try to init pci_doe (doe_offset=0x%04x, ecap_id=0x%08x)\n", doe_offset, ecap_id.raw));
 
-    // Before init PCI DOE, we need to abort any ongoing doe operation and check the Error bit.
-    trigger_doe_abort();
-    libspdm_sleep(1000 * 1000);
-    if (is_doe_error_asserted()) {
+    if (is_doe_error_asserted(doe_context)) {
       TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "PCI DOE Error bit is set and cannot be cleared.\n"));
       continue;
     }
 
-    if(pcie_doe_init_request(doe_discovery_version)) {
-      TEEIO_DEBUG((TEEIO_DEBUG_INFO, "doe_offset=0x%04x is the one to be used in teeio-validator.\n", g_doe_extended_offset));
-      return true;
+    if(!pcie_doe_init_request(doe_context, doe_discovery_version)) {
+      TEEIO_DEBUG((TEEIO_DEBUG_WARN, "doe_offset=0x%04x is skipped.\n", doe_offset));
     }
   }
 
+  if(pci_doe_check_protocols(doe_context)) {
+    uint32_t doe_offset = pci_doe_context_get_mailbox(doe_context, PCI_DOE_VENDOR_ID_PCISIG, PCI_DOE_DATA_OBJECT_TYPE_SPDM);
+    TEEIO_DEBUG((TEEIO_DEBUG_INFO, "doe_offset=0x%04x is the one to be used in teeio-validator.\n", doe_offset));
+    pci_doe_context_set_mailbox(doe_context, doe_offset);
+    port_context->doe_context = doe_context;
+    port_context->doe_offset = doe_offset;
+    pci_doe_enable_interrupt(doe_context);
+    return true;
+  }
+
+  pci_doe_context_close(doe_context);
   return false;
 }
 
+/**
+ * Close the DOE context opened by init_pci_doe.
+ */
+void close_pci_doe(ide_common_test_port_context_t *port_context)
+{
+  pci_doe_context_close(port_context->doe_context);
+  port_context->doe_context = NULL;
+  port_context->doe_offset = 0;
+}
+
 bool close_dev_port(ide_common_test_port_context_t *port_context, IDE_TEST_TOPOLOGY_TYPE top_type)
 {
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "close_dev_port %s(%s)\n", port_context->port->port_name, port_context->port->bdf));
@@ -880,13 +867,12 @@ bool close_dev_port(ide_common_test_port_context_t *port_context, IDE_TEST_TOPOL
   reset_ide_registers(port_context, top_type, 0, 0, false);
 
   if(port_context->cfg_space_fd > 0) {
-    close(port_context->cfg_space_fd);
+    close_configuration_space(port_context->cfg_space_fd);
     unset_device_info(port_context->cfg_space_fd);
   }
   port_context->cfg_space_fd = 0;
 
-  m_dev_fp = 0;
-  g_doe_extended_offset = 0;
+  close_pci_doe(port_context);
   return true;
 }
 
@@ -921,16 +907,10 @@ bool open_dev_port(ide_common_test_port_context_t *port_context)
   }
   port_context->ecap_offset = ecap_offset;
 
-  // TODO
-  // m_dev_fp indicates the device ide card. It is used in doe_read_write.c.
-  // It will be removed later.
-  m_dev_fp = fd;
-
   // initialize pci doe
-  if(!init_pci_doe(fd)) {
+  if(!init_pci_doe(port_context)) {
     goto OpenDevFail;
   }
-  port_context->doe_offset = g_doe_extended_offset;
 
   uint32_t offset = ecap_offset + 4;
   port_context->ide_cap.raw = device_pci_read_32(offset, fd);
@@ -938,7 +918,7 @@ bool open_dev_port(ide_common_test_port_context_t *port_context)
   return true;
 
 OpenDevFail:
-  close(fd);
+  close_configuration_space(fd);
   unset_device_info(fd);
   return false;
 }
@@ -992,7 +972,7 @@ bool init_dev_port(pcie_ide_test_group_context_t *group_context)
   return true;
 
 InitDevFailed:
-  close(port_context->cfg_space_fd);
+  close_configuration_space(port_context->cfg_space_fd);
   unset_device_info(port_context->cfg_space_fd);
   return false;
 }
@@ -1214,7 +1194,7 @@ void prime_rp_ide_key_set(
 
     TEEIO_ASSERT(key_set_select < PCIE_IDE_STREAM_KS_NUM);
 
-    INTEL_KEYP_STREAM_TXRX_CONTROL stream_txrx_control = {.raw = mmio_read_reg32(ctrl_reg_ptr)};
+    INTEL_KEYP_STREAM_TXRX_CONTROL stream_txrx_control = {.raw = kcbar_read_reg32(kcbar_ptr, ctrl_reg_ptr)};
     TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Before prime_rp_ide_key_set direction=%s ks=%s: %s=0x%08x\n",
       direct_names[direction],
       ks_names[key_set_select],
@@ -1231,8 +1211,13 @@ void prime_rp_ide_key_set(
         stream_txrx_control.common.prime_key_set_0 = 0;
         stream_txrx_control.common.prime_key_set_1 = 1;
     }
-    mmio_write_reg32(ctrl_reg_ptr, stream_txrx_control.raw);
+    // the prime bits are cleared by the hardware
+    INTEL_KEYP_STREAM_TXRX_CONTROL prime_bits = {.raw = 0};
+    prime_bits.common.prime_key_set_0 = 1;
+    prime_bits.common.prime_key_set_1 = 1;
+    kcbar_write_self_clearing_reg32(kcbar_ptr, ctrl_reg_ptr, stream_txrx_control.raw, prime_bits.raw);
 
+    // read the register itself to see whether the hardware has cleared the prime bits
     stream_txrx_control.raw = mmio_read_reg32(ctrl_reg_ptr);
     TEEIO_DEBUG((TEEIO_DEBUG_INFO, "After prime_rp_ide_key_set direction=%s ks=%s: %s=0x%08x\n",
       direct_names[direction],
@@ -1258,7 +1243,7 @@ void set_rp_ide_key_set_select(
     INTEL_KEYP_STREAM_CONFIG_REG_BLOCK *stream_cfg_reg_block = get_stream_cfg_reg_block(kcbar_ptr, rp_stream_index);
     INTEL_KEYP_STREAM_TXRX_CONTROL *ctrl_reg_ptr = &stream_cfg_reg_block->tx_ctrl;
 
-    INTEL_KEYP_STREAM_TXRX_CONTROL stream_txrx_control = {.raw = mmio_read_reg32(ctrl_reg_ptr)};
+    INTEL_KEYP_STREAM_TXRX_CONTROL stream_txrx_control = {.raw = kcbar_read_reg32(kcbar_ptr, ctrl_reg_ptr)};
     if (key_set_select == PCIE_IDE_STREAM_KS0)
     {
         stream_txrx_control.stream_tx_control.key_set_select = 0b01;
@@ -1271,7 +1256,7 @@ void set_rp_ide_key_set_select(
     {
         TEEIO_ASSERT(false);
     }
-    mmio_write_reg32(ctrl_reg_ptr, stream_txrx_control.raw);
+    kcbar_write_reg32(kcbar_ptr, ctrl_reg_ptr, stream_txrx_control.raw);
 }
 
 bool enable_ide_stream_in_ecap(int cfg_space_fd, uint32_t ecap_offset, TEST_IDE_TYPE ide_type, uint8_t ide_id, bool enable){
@@ -1343,14 +1328,21 @@ void dump_ecap(
 )
 {
     uint32_t offset = ide_ecap_offset;
+    // IDE Extended Cap Header, IDE Capability Register and IDE Control Register
+    uint32_t ecap_regs[3];
+    // Selective IDE Stream Capability/Control/Status, RID and Address Association Registers
+    uint32_t stream_regs[8];
+    int i = 0;
+
     TEEIO_PRINT(("IDE Extended Cap:\n"));
 
+    device_pci_read_block(ide_ecap_offset, ecap_regs, sizeof(ecap_regs), fd);
+
     // refer to PCIE_IDE_ECAP
-    PCIE_CAP_ID cap_id = {.raw = device_pci_read_32(offset, fd)};
+    PCIE_CAP_ID cap_id = {.raw = ecap_regs[0]};
     TEEIO_PRINT(("    cap_id        : %08x\n", cap_id.raw));
 
-    offset += 4;
-    PCIE_IDE_CAP ide_cap = {.raw = device_pci_read_32(offset, fd)};
+    PCIE_IDE_CAP ide_cap = {.raw = ecap_regs[1]};
     TEEIO_PRINT(("    ide_cap       : %08x\n", ide_cap.raw));
     TEEIO_PRINT(("                  : lnk_ide=%x, sel_ide=%x, ft=%x, aggr=%x, pcrc=%x, alog=%x, sel_ide_cfg_req=%x\n",
                                                             ide_cap.lnk_ide_supported, ide_cap.sel_ide_supported,
@@ -1360,47 +1352,42 @@ void dump_ecap(
     TEEIO_PRINT(("                  : num_lnk_ide=%x, num_sel_ide=%x\n",
                                                             ide_cap.num_lnk_ide, ide_cap.num_sel_ide));
 
-    offset += 4;
-    PCIE_IDE_CTRL ide_ctrl = {.raw = device_pci_read_32(offset, fd)};
+    PCIE_IDE_CTRL ide_ctrl = {.raw = ecap_regs[2]};
     TEEIO_PRINT(("    ide_ctrl      : %08x (ft_supported=%x)\n", ide_ctrl.raw, ide_ctrl.ft_supported));
 
     offset = get_ide_reg_block_offset(fd, ide_type, ide_id, ide_ecap_offset);
 
+    // Link IDE Stream Register Block only has the Control and Status Registers
+    device_pci_read_block(offset, stream_regs, ide_type == TEST_IDE_TYPE_SEL_IDE ? sizeof(stream_regs) : 2 * sizeof(uint32_t), fd);
+
     if(ide_type == TEST_IDE_TYPE_SEL_IDE) {
-        PCIE_SEL_IDE_STREAM_CAP stream_cap = {.raw = device_pci_read_32(offset, fd)};
+        PCIE_SEL_IDE_STREAM_CAP stream_cap = {.raw = stream_regs[i++]};
         TEEIO_PRINT(("    stream_cap    : %08x (num_addr_assoc_reg_blocks=%d)\n", stream_cap.raw, stream_cap.num_addr_assoc_reg_blocks));
-        offset += 4;
     }
 
-    PCIE_SEL_IDE_STREAM_CTRL stream_ctrl = {.raw = device_pci_read_32(offset, fd)};
+    PCIE_SEL_IDE_STREAM_CTRL stream_ctrl = {.raw = stream_regs[i++]};
     TEEIO_PRINT(("    stream_ctrl   : %08x\n", stream_ctrl.raw));
     TEEIO_PRINT(("                  : enabled=%x, pcrc_en=%x, cfg_sel_ide=%x, stream_id=%x\n",
                                                           stream_ctrl.enabled, stream_ctrl.pcrc_en, stream_ctrl.cfg_sel_ide, stream_ctrl.stream_id));
 
-    offset += 4;
-    PCIE_SEL_IDE_STREAM_STATUS stream_status = {.raw = device_pci_read_32(offset, fd)};
+    PCIE_SEL_IDE_STREAM_STATUS stream_status = {.raw = stream_regs[i++]};
     TEEIO_PRINT(("    stream_status : %08x (state=%x, recv_intg_check_fail_msg=%x)\n",
                                                           stream_status.raw, stream_status.state, stream_status.recv_intg_check_fail_msg));
 
     if(ide_type == TEST_IDE_TYPE_SEL_IDE) {
-        offset += 4;
-        PCIE_SEL_IDE_RID_ASSOC_1 rid_assoc1 = {.raw = device_pci_read_32(offset, fd)};
+        PCIE_SEL_IDE_RID_ASSOC_1 rid_assoc1 = {.raw = stream_regs[i++]};
         TEEIO_PRINT(("    rid_assoc1    : %08x\n", rid_assoc1.raw));
 
-        offset += 4;
-        PCIE_SEL_IDE_RID_ASSOC_2 rid_assoc2 = {.raw = device_pci_read_32(offset, fd)};
+        PCIE_SEL_IDE_RID_ASSOC_2 rid_assoc2 = {.raw = stream_regs[i++]};
         TEEIO_PRINT(("    rid_assoc2    : %08x\n", rid_assoc2.raw));
 
-        offset += 4;
-        PCIE_SEL_IDE_ADDR_ASSOC_1 addr_assoc1 = {.raw = device_pci_read_32(offset, fd)};
+        PCIE_SEL_IDE_ADDR_ASSOC_1 addr_assoc1 = {.raw = stream_regs[i++]};
         TEEIO_PRINT(("    addr_assoc1   : %08x\n", addr_assoc1.raw));
 
-        offset += 4;
-        PCIE_SEL_IDE_ADDR_ASSOC_2 addr_assoc2 = {.raw = device_pci_read_32(offset, fd)};
+        PCIE_SEL_IDE_ADDR_ASSOC_2 addr_assoc2 = {.raw = stream_regs[i++]};
         TEEIO_PRINT(("    addr_assoc2   : %08x\n", addr_assoc2.raw));
 
-        offset += 4;
-        PCIE_SEL_IDE_ADDR_ASSOC_3 addr_assoc3 = {.raw = device_pci_read_32(offset, fd)};
+        PCIE_SEL_IDE_ADDR_ASSOC_3 addr_assoc3 = {.raw = stream_regs[i++]};
         TEEIO_PRINT(("    addr_assoc3   : %08x\n", addr_assoc3.raw));
     }
 }
@@ -19,6 +19,7 @@
 #include "helperlib.h"
 #include "pcie_ide_internal.h"
 int open_configuration_space(char *bdf);
+void close_configuration_space(int fd);
 
 typedef union {
   struct {
@@ -86,7 +87,7 @@ bool scan_rp_switch_internal_port_at_bus(IDE_PORT* port, uint16_t segment, uint8
 
 ScanSwitchInternalPortDone:
   if(fd > 0) {
-    close(fd);
+    close_configuration_space(fd);
   }
 
 return res;
@@ -138,7 +139,7 @@ bool scan_endpoint_at_bus(uint16_t segment, uint8_t bus, IDE_PORT* port)
 
 ScanEndpointDone:
   if(fd > 0) {
-    close(fd);
+    close_configuration_space(fd);
   }
 
   TEEIO_ASSERT(res);
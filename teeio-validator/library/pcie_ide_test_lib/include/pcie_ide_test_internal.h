@@ -39,6 +39,22 @@ typedef struct
 
 void dump_key_iv(pci_ide_km_aes_256_gcm_key_buffer_t* key_buffer);
 
+// per-step timing of the key programming of a key set
+typedef struct {
+  uint64_t key_gen_ns;
+  // KEY_PROG/KP_ACK round trips
+  uint64_t key_prog_ns[PCIE_IDE_STREAM_DIRECTION_NUM][PCIE_IDE_SUB_STREAM_NUM];
+  // root port key/iv slot writes. They overlap the next KEY_PROG.
+  uint64_t rp_key_prog_ns[PCIE_IDE_STREAM_DIRECTION_NUM][PCIE_IDE_SUB_STREAM_NUM];
+  // root port key_set_select before K_SET_GO in TX
+  uint64_t rp_key_select_ns;
+  // K_SET_GO/K_GOSTOP_ACK round trips
+  uint64_t k_set_go_ns[PCIE_IDE_STREAM_DIRECTION_NUM][PCIE_IDE_SUB_STREAM_NUM];
+  uint64_t total_ns;
+} ide_km_key_prog_timing_t;
+
+const ide_km_key_prog_timing_t *ide_km_get_key_prog_timing();
+
 bool ide_km_key_prog(
     const void *pci_doe_context,
     void *spdm_context,
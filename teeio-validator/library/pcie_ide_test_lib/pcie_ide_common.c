@@ -148,8 +148,8 @@ ide_test_case_name_t m_test_case_names[] = {
 };
 
 ide_test_case_funcs_t m_pcie_ide_query_cases[MAX_QUERY_CASE_ID] = {
-  { pcie_ide_test_query_1_setup, pcie_ide_test_query_1_run, pcie_ide_test_query_1_teardown, false },
-  { pcie_ide_test_query_2_setup, pcie_ide_test_query_2_run, pcie_ide_test_query_2_teardown, false }
+  { pcie_ide_test_query_1_setup, pcie_ide_test_query_1_run, pcie_ide_test_query_1_teardown, false, true },
+  { pcie_ide_test_query_2_setup, pcie_ide_test_query_2_run, pcie_ide_test_query_2_teardown, false, true }
 };
 
 ide_test_case_funcs_t m_pcie_ide_key_prog_cases[MAX_KEYPROG_CASE_ID] = {
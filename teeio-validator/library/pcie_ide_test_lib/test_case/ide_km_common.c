@@ -8,6 +8,7 @@
 #include <ctype.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include "assert.h"
 #include "hal/base.h"
@@ -22,6 +23,7 @@
 #include "teeio_debug.h"
 #include "pcie_ide_lib.h"
 #include "pcie_ide_test_lib.h"
+#include "pcie_ide_test_internal.h"
 
 extern bool g_teeio_fixed_key;
 
@@ -34,6 +36,9 @@ const char *direction_names[] = {
 const char *substream_names[] = {
     "PR", "NPR", "CPL"};
 
+// timing of the last key programming done by this thread
+static TEEIO_THREAD_LOCAL ide_km_key_prog_timing_t m_key_prog_timing = {0};
+
 /**
  * Dump key_iv in rootport registers
  * Refer to Root Complex IDE Key Configuration Unit Software Programing Guide Revision 1.01
@@ -57,40 +62,10 @@ void pcie_dump_key_iv_in_rp(const char* direction, uint8_t *key, int key_size, u
   }
 }
 
-// program keys to device card and root port
-bool ide_km_key_prog(
-    const void *pci_doe_context,
-    void *spdm_context,
-    const uint32_t *session_id,
-    uint8_t ks,
-    uint8_t direction,
-    uint8_t substream,
-    uint8_t port_index,
-    uint8_t stream_id,
-    uint8_t *kcbar_addr,
-    ide_key_set_t *k_set,
-    uint8_t rp_stream_index)
+static bool ide_km_gen_key(uint8_t direction, pci_ide_km_aes_256_gcm_key_buffer_t *key_buffer)
 {
-    bool result;
-    pci_ide_km_aes_256_gcm_key_buffer_t key_buffer;
-    uint8_t kp_ack_status;
-    uint8_t slot_id;
-    libspdm_return_t status;
-    INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar_ptr = 0;
-    INTEL_KEYP_KEY_SLOT keys = {0};
-    INTEL_KEYP_IV_SLOT iv = {0};
     uint8_t fixed_key_byte = 0;
 
-    uint8_t k_sets[] = {PCI_IDE_KM_KEY_SET_K0, PCI_IDE_KM_KEY_SET_K1};
-    uint8_t directions[] = {PCI_IDE_KM_KEY_DIRECTION_RX, PCI_IDE_KM_KEY_DIRECTION_TX};
-    uint8_t substreams[] = {PCI_IDE_KM_KEY_SUB_STREAM_PR, PCI_IDE_KM_KEY_SUB_STREAM_NPR, PCI_IDE_KM_KEY_SUB_STREAM_CPL};
-
-    iv.bytes[0] = PCIE_IDE_IV_INIT_VALUE;
-
-    TEEIO_ASSERT(ks < PCIE_IDE_STREAM_KS_NUM);
-    TEEIO_ASSERT(direction < PCIE_IDE_STREAM_DIRECTION_NUM);
-    TEEIO_ASSERT(substream < PCIE_IDE_SUB_STREAM_NUM);
-
     if(direction == PCIE_IDE_STREAM_RX) {
       fixed_key_byte = TEEIO_TEST_FIXED_RX_KEY_BYTE_VALUE;
     } else {
@@ -98,22 +73,43 @@ bool ide_km_key_prog(
     }
 
     if(!g_teeio_fixed_key) {
-      result = libspdm_get_random_number(sizeof(key_buffer.key), (void *)key_buffer.key);
-      if(!result) {
+      if(!libspdm_get_random_number(sizeof(key_buffer->key), (void *)key_buffer->key)) {
         return false;
       }
     } else {
-      memset(key_buffer.key, fixed_key_byte, sizeof(key_buffer.key));
+      memset(key_buffer->key, fixed_key_byte, sizeof(key_buffer->key));
     }
 
-    key_buffer.iv[0] = 0;
-    key_buffer.iv[1] = PCIE_IDE_IV_INIT_VALUE;
+    key_buffer->iv[0] = 0;
+    key_buffer->iv[1] = PCIE_IDE_IV_INIT_VALUE;
+
+    return true;
+}
+
+// program key to device card with KEY_PROG
+static bool ide_km_dev_key_prog(
+    const void *pci_doe_context,
+    void *spdm_context,
+    const uint32_t *session_id,
+    uint8_t ks,
+    uint8_t direction,
+    uint8_t substream,
+    uint8_t port_index,
+    uint8_t stream_id,
+    pci_ide_km_aes_256_gcm_key_buffer_t *key_buffer)
+{
+    uint8_t kp_ack_status;
+    libspdm_return_t status;
+
+    uint8_t k_sets[] = {PCI_IDE_KM_KEY_SET_K0, PCI_IDE_KM_KEY_SET_K1};
+    uint8_t directions[] = {PCI_IDE_KM_KEY_DIRECTION_RX, PCI_IDE_KM_KEY_DIRECTION_TX};
+    uint8_t substreams[] = {PCI_IDE_KM_KEY_SUB_STREAM_PR, PCI_IDE_KM_KEY_SUB_STREAM_NPR, PCI_IDE_KM_KEY_SUB_STREAM_CPL};
 
     status = pci_ide_km_key_prog(pci_doe_context, spdm_context, session_id,
                                  stream_id,
                                  k_sets[ks] | directions[direction] | substreams[substream],
                                  port_index,
-                                 &key_buffer,
+                                 key_buffer,
                                  &kp_ack_status);
     if(LIBSPDM_STATUS_IS_ERROR(status)) {
       TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "pci_ide_km_key_prog failed with status=0x%x\n", status));
@@ -121,25 +117,289 @@ bool ide_km_key_prog(
     }
 
     TEEIO_DEBUG((TEEIO_DEBUG_INFO, "dev key_prog %s|%s|%s - sts=%02x\n", k_set_names[ks], direction_names[direction], substream_names[substream], kp_ack_status));
-    dump_key_iv_in_key_prog(key_buffer.key, sizeof(key_buffer.key)/sizeof(uint32_t), key_buffer.iv, sizeof(key_buffer.iv)/sizeof(uint32_t));
+    dump_key_iv_in_key_prog(key_buffer->key, sizeof(key_buffer->key)/sizeof(uint32_t), key_buffer->iv, sizeof(key_buffer->iv)/sizeof(uint32_t));
 
     if(kp_ack_status != PCI_IDE_KM_KP_ACK_STATUS_SUCCESS) {
       TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "pci_ide_km_key_prog failed with kp_ack_status=0x%x\n", kp_ack_status));
       return false;
     }
 
-    kcbar_ptr = (INTEL_KEYP_ROOT_COMPLEX_KCBAR *)kcbar_addr;
+    return true;
+}
 
-    // program key in root port kcbar registers
-    pcie_construct_rp_keys(key_buffer.key, sizeof(key_buffer.key), keys.bytes, sizeof(keys.bytes));
+// program key in root port kcbar registers
+static void ide_km_rp_key_prog(
+    uint8_t ks,
+    uint8_t direction,
+    uint8_t substream,
+    uint8_t *kcbar_addr,
+    ide_key_set_t *k_set,
+    uint8_t rp_stream_index,
+    pci_ide_km_aes_256_gcm_key_buffer_t *key_buffer)
+{
+    INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar_ptr = (INTEL_KEYP_ROOT_COMPLEX_KCBAR *)kcbar_addr;
+    INTEL_KEYP_KEY_SLOT keys = {0};
+    INTEL_KEYP_IV_SLOT iv = {0};
+    uint8_t slot_id;
+
+    iv.bytes[0] = PCIE_IDE_IV_INIT_VALUE;
+
+    pcie_construct_rp_keys(key_buffer->key, sizeof(key_buffer->key), keys.bytes, sizeof(keys.bytes));
     slot_id = k_set->slot_id[direction][substream];
     cfg_rootport_ide_keys(kcbar_ptr, rp_stream_index, direction, ks, substream, slot_id, &keys, &iv);
     TEEIO_DEBUG((TEEIO_DEBUG_INFO, "rp key_prog %s|%s|%s - @key/iv slot[%02x]\n", k_set_names[ks], direction_names[direction], substream_names[substream], slot_id));
     pcie_dump_key_iv_in_rp(direction == PCIE_IDE_STREAM_RX ? "TX" : "RX", (uint8_t *)keys.bytes, sizeof(keys.bytes), (uint8_t *)iv.bytes, sizeof(iv.bytes));
+}
+
+// program keys to device card and root port
+bool ide_km_key_prog(
+    const void *pci_doe_context,
+    void *spdm_context,
+    const uint32_t *session_id,
+    uint8_t ks,
+    uint8_t direction,
+    uint8_t substream,
+    uint8_t port_index,
+    uint8_t stream_id,
+    uint8_t *kcbar_addr,
+    ide_key_set_t *k_set,
+    uint8_t rp_stream_index)
+{
+    pci_ide_km_aes_256_gcm_key_buffer_t key_buffer;
+
+    TEEIO_ASSERT(ks < PCIE_IDE_STREAM_KS_NUM);
+    TEEIO_ASSERT(direction < PCIE_IDE_STREAM_DIRECTION_NUM);
+    TEEIO_ASSERT(substream < PCIE_IDE_SUB_STREAM_NUM);
+
+    if(!ide_km_gen_key(direction, &key_buffer)) {
+      return false;
+    }
+
+    if(!ide_km_dev_key_prog(pci_doe_context, spdm_context, session_id, ks, direction, substream,
+                            port_index, stream_id, &key_buffer)) {
+      return false;
+    }
+
+    ide_km_rp_key_prog(ks, direction, substream, kcbar_addr, k_set, rp_stream_index, &key_buffer);
 
     return true;
 }
 
+/**
+ * Pipelined key programming of a key set.
+ *
+ * The keys of all the (direction, substream) steps are generated up front. The
+ * KEY_PROG round trips are sent by the calling thread while the root port writer
+ * programs the key slots of the steps which the device has acked, so the KCBAR
+ * writes of step n overlap the KEY_PROG of step n+1. The root port key set of a
+ * direction is primed once its 3 substreams are programmed.
+ *
+ * The root port writer is started once per test thread and kept until the thread
+ * exits, so thread creation is not part of the key programming latency.
+ */
+#define IDE_KM_KEY_PROG_STEP_NUM (PCIE_IDE_STREAM_DIRECTION_NUM * PCIE_IDE_SUB_STREAM_NUM)
+
+typedef struct {
+  uint8_t ks;
+  uint8_t *kcbar_addr;
+  ide_key_set_t *k_set;
+  uint8_t rp_stream_index;
+  pci_ide_km_aes_256_gcm_key_buffer_t key_buffers[IDE_KM_KEY_PROG_STEP_NUM];
+  ide_km_key_prog_timing_t *timing;
+
+  int acked;      // steps acked by the device
+  bool failed;
+} ide_km_key_prog_pipeline_t;
+
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  // pipeline to be programmed. It is cleared by the writer once the pipeline is done.
+  ide_km_key_prog_pipeline_t *pipeline;
+  bool quit;
+} ide_km_rp_key_prog_worker_t;
+
+static pthread_key_t m_rp_key_prog_worker_key;
+static pthread_once_t m_rp_key_prog_worker_once = PTHREAD_ONCE_INIT;
+
+static void ide_km_rp_key_prog_pipeline(ide_km_rp_key_prog_worker_t *worker, ide_km_key_prog_pipeline_t *pipeline)
+{
+  uint64_t start_ns;
+
+  for(int step = 0; step < IDE_KM_KEY_PROG_STEP_NUM; step++) {
+    uint8_t direction = step / PCIE_IDE_SUB_STREAM_NUM;
+    uint8_t substream = step % PCIE_IDE_SUB_STREAM_NUM;
+
+    pthread_mutex_lock(&worker->mutex);
+    while(pipeline->acked <= step && !pipeline->failed) {
+      pthread_cond_wait(&worker->cond, &worker->mutex);
+    }
+    bool failed = pipeline->acked <= step;
+    pthread_mutex_unlock(&worker->mutex);
+    if(failed) {
+      break;
+    }
+
+    start_ns = get_monotonic_time_ns();
+    ide_km_rp_key_prog(pipeline->ks, direction, substream, pipeline->kcbar_addr,
+                       pipeline->k_set, pipeline->rp_stream_index, pipeline->key_buffers + step);
+    if(substream == PCIE_IDE_SUB_STREAM_NUM - 1) {
+      prime_rp_ide_key_set((INTEL_KEYP_ROOT_COMPLEX_KCBAR *)pipeline->kcbar_addr,
+                           pipeline->rp_stream_index, direction, pipeline->ks);
+    }
+    pipeline->timing->rp_key_prog_ns[direction][substream] = get_monotonic_time_ns() - start_ns;
+  }
+}
+
+static void *ide_km_rp_key_prog_worker(void *arg)
+{
+  ide_km_rp_key_prog_worker_t *worker = (ide_km_rp_key_prog_worker_t *)arg;
+  ide_km_key_prog_pipeline_t *pipeline;
+
+  pthread_mutex_lock(&worker->mutex);
+  while(true) {
+    while(worker->pipeline == NULL && !worker->quit) {
+      pthread_cond_wait(&worker->cond, &worker->mutex);
+    }
+    pipeline = worker->pipeline;
+    if(pipeline == NULL) {
+      break;
+    }
+    pthread_mutex_unlock(&worker->mutex);
+
+    ide_km_rp_key_prog_pipeline(worker, pipeline);
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->pipeline = NULL;
+    pthread_cond_broadcast(&worker->cond);
+  }
+  pthread_mutex_unlock(&worker->mutex);
+
+  return NULL;
+}
+
+// stop the root port writer of a test thread when the thread exits
+static void ide_km_rp_key_prog_worker_close(void *arg)
+{
+  ide_km_rp_key_prog_worker_t *worker = (ide_km_rp_key_prog_worker_t *)arg;
+
+  pthread_mutex_lock(&worker->mutex);
+  worker->quit = true;
+  pthread_cond_broadcast(&worker->cond);
+  pthread_mutex_unlock(&worker->mutex);
+  pthread_join(worker->thread, NULL);
+
+  pthread_cond_destroy(&worker->cond);
+  pthread_mutex_destroy(&worker->mutex);
+  free(worker);
+}
+
+static void ide_km_rp_key_prog_worker_key_init()
+{
+  pthread_key_create(&m_rp_key_prog_worker_key, ide_km_rp_key_prog_worker_close);
+}
+
+// root port writer of the calling thread. It is started on first use.
+static ide_km_rp_key_prog_worker_t *get_rp_key_prog_worker()
+{
+  ide_km_rp_key_prog_worker_t *worker;
+
+  pthread_once(&m_rp_key_prog_worker_once, ide_km_rp_key_prog_worker_key_init);
+  worker = (ide_km_rp_key_prog_worker_t *)pthread_getspecific(m_rp_key_prog_worker_key);
+  if(worker != NULL) {
+    return worker;
+  }
+
+  worker = (ide_km_rp_key_prog_worker_t *)calloc(1, sizeof(ide_km_rp_key_prog_worker_t));
+  if(worker == NULL) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to allocate the root port key programming thread.\n"));
+    return NULL;
+  }
+  pthread_mutex_init(&worker->mutex, NULL);
+  pthread_cond_init(&worker->cond, NULL);
+  if(pthread_create(&worker->thread, NULL, ide_km_rp_key_prog_worker, worker) != 0) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to create the root port key programming thread.\n"));
+    pthread_cond_destroy(&worker->cond);
+    pthread_mutex_destroy(&worker->mutex);
+    free(worker);
+    return NULL;
+  }
+  pthread_setspecific(m_rp_key_prog_worker_key, worker);
+
+  return worker;
+}
+
+static bool ide_km_key_prog_pipelined(
+    ide_km_rp_key_prog_worker_t *worker,
+    void *doe_context, void *spdm_context, const uint32_t *session_id,
+    uint8_t ks, uint8_t port_index, uint8_t stream_id,
+    uint8_t *kcbar_addr, ide_key_set_t *k_set, uint8_t rp_stream_index,
+    ide_km_key_prog_timing_t *timing)
+{
+  ide_km_key_prog_pipeline_t pipeline = {0};
+  uint64_t start_ns;
+  bool result = true;
+  int step;
+
+  TEEIO_ASSERT(ks < PCIE_IDE_STREAM_KS_NUM);
+
+  pipeline.ks = ks;
+  pipeline.kcbar_addr = kcbar_addr;
+  pipeline.k_set = k_set;
+  pipeline.rp_stream_index = rp_stream_index;
+  pipeline.timing = timing;
+
+  start_ns = get_monotonic_time_ns();
+  for(step = 0; step < IDE_KM_KEY_PROG_STEP_NUM; step++) {
+    if(!ide_km_gen_key(step / PCIE_IDE_SUB_STREAM_NUM, pipeline.key_buffers + step)) {
+      result = false;
+      goto Done;
+    }
+  }
+  timing->key_gen_ns = get_monotonic_time_ns() - start_ns;
+
+  pthread_mutex_lock(&worker->mutex);
+  worker->pipeline = &pipeline;
+  pthread_cond_broadcast(&worker->cond);
+  pthread_mutex_unlock(&worker->mutex);
+
+  for(step = 0; step < IDE_KM_KEY_PROG_STEP_NUM; step++) {
+    uint8_t direction = step / PCIE_IDE_SUB_STREAM_NUM;
+    uint8_t substream = step % PCIE_IDE_SUB_STREAM_NUM;
+
+    start_ns = get_monotonic_time_ns();
+    result = ide_km_dev_key_prog(doe_context, spdm_context, session_id, ks, direction, substream,
+                                 port_index, stream_id, pipeline.key_buffers + step);
+    timing->key_prog_ns[direction][substream] = get_monotonic_time_ns() - start_ns;
+
+    pthread_mutex_lock(&worker->mutex);
+    if(result) {
+      pipeline.acked++;
+    } else {
+      pipeline.failed = true;
+    }
+    pthread_cond_broadcast(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+
+    if(!result) {
+      break;
+    }
+  }
+
+  // wait for the root port writer to finish the pipeline
+  pthread_mutex_lock(&worker->mutex);
+  while(worker->pipeline != NULL) {
+    pthread_cond_wait(&worker->cond, &worker->mutex);
+  }
+  pthread_mutex_unlock(&worker->mutex);
+
+Done:
+  libspdm_zero_mem(pipeline.key_buffers, sizeof(pipeline.key_buffers));
+
+  return result;
+}
+
 libspdm_return_t ide_km_key_set_go(const void *pci_doe_context,
                                    void *spdm_context, const uint32_t *session_id,
                                    uint8_t stream_id, uint8_t key_sub_stream,
@@ -200,6 +460,102 @@ libspdm_return_t ide_km_key_set_go(const void *pci_doe_context,
     return LIBSPDM_STATUS_SUCCESS;
 }
 
+// K_SET_GO of all the substreams of key set @ks. RX goes first, then the root port switches to @ks and TX goes.
+static bool ide_km_key_set_go_all(
+    void *doe_context, void *spdm_context, const uint32_t *session_id,
+    uint8_t ks, uint8_t port_index, uint8_t stream_id,
+    uint8_t *kcbar_addr, uint8_t rp_stream_index,
+    ide_km_key_prog_timing_t *timing)
+{
+  uint8_t directions[] = {PCI_IDE_KM_KEY_DIRECTION_RX, PCI_IDE_KM_KEY_DIRECTION_TX};
+  uint8_t substreams[] = {PCI_IDE_KM_KEY_SUB_STREAM_PR, PCI_IDE_KM_KEY_SUB_STREAM_NPR, PCI_IDE_KM_KEY_SUB_STREAM_CPL};
+  libspdm_return_t status;
+  uint64_t start_ns;
+
+  for(int direction = 0; direction < PCIE_IDE_STREAM_DIRECTION_NUM; direction++) {
+    if(direction == PCIE_IDE_STREAM_TX) {
+      // set key_set_select in host ide
+      start_ns = get_monotonic_time_ns();
+      set_rp_ide_key_set_select((INTEL_KEYP_ROOT_COMPLEX_KCBAR *)kcbar_addr, rp_stream_index, ks);
+      timing->rp_key_select_ns = get_monotonic_time_ns() - start_ns;
+    }
+
+    for(int substream = 0; substream < PCIE_IDE_SUB_STREAM_NUM; substream++) {
+      TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|%s|%s\n", k_set_names[ks], direction_names[direction], substream_names[substream]));
+      start_ns = get_monotonic_time_ns();
+      status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
+                                 ks | directions[direction] | substreams[substream], port_index);
+      timing->k_set_go_ns[direction][substream] = get_monotonic_time_ns() - start_ns;
+      if (LIBSPDM_STATUS_IS_ERROR(status))
+      {
+        TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|%s|%s failed with 0x%x\n", k_set_names[ks], direction_names[direction], substream_names[substream], status));
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static void dump_key_prog_timing(const ide_km_key_prog_timing_t *timing, uint8_t ks)
+{
+  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Key programming of %s took %lluus (key generation %lluus)\n", k_set_names[ks],
+               (unsigned long long)(timing->total_ns / 1000), (unsigned long long)(timing->key_gen_ns / 1000)));
+  for(int direction = 0; direction < PCIE_IDE_STREAM_DIRECTION_NUM; direction++) {
+    for(int substream = 0; substream < PCIE_IDE_SUB_STREAM_NUM; substream++) {
+      TEEIO_DEBUG((TEEIO_DEBUG_INFO, "  %s|%s: key_prog %lluus, rp key_prog %lluus, k_set_go %lluus\n",
+                   direction_names[direction], substream_names[substream],
+                   (unsigned long long)(timing->key_prog_ns[direction][substream] / 1000),
+                   (unsigned long long)(timing->rp_key_prog_ns[direction][substream] / 1000),
+                   (unsigned long long)(timing->k_set_go_ns[direction][substream] / 1000)));
+    }
+  }
+}
+
+// program key set @ks to device card and root port and, unless skip_ksetgo, switch them to @ks
+static bool ide_km_program_key_set(
+    void *doe_context, void *spdm_context, const uint32_t *session_id,
+    uint8_t ks, uint8_t port_index, uint8_t stream_id,
+    uint8_t *kcbar_addr, ide_key_set_t *k_set, uint8_t rp_stream_index,
+    bool skip_ksetgo)
+{
+  ide_km_key_prog_timing_t *timing = &m_key_prog_timing;
+  ide_km_rp_key_prog_worker_t *worker;
+  uint64_t start_ns;
+  bool result;
+
+  memset(timing, 0, sizeof(ide_km_key_prog_timing_t));
+
+  // the root port writer is started before the timing begins
+  worker = get_rp_key_prog_worker();
+  if(worker == NULL) {
+    return false;
+  }
+
+  start_ns = get_monotonic_time_ns();
+  result = ide_km_key_prog_pipelined(worker, doe_context, spdm_context, session_id, ks, port_index, stream_id,
+                                     kcbar_addr, k_set, rp_stream_index, timing);
+  if(result && !skip_ksetgo) {
+    result = ide_km_key_set_go_all(doe_context, spdm_context, session_id, ks, port_index, stream_id,
+                                   kcbar_addr, rp_stream_index, timing);
+  }
+
+  timing->total_ns = get_monotonic_time_ns() - start_ns;
+  if(result) {
+    dump_key_prog_timing(timing, ks);
+  }
+
+  return result;
+}
+
+/**
+ * Timing of the last key programming done by setup_ide_stream or ide_key_switch_to in this thread.
+ */
+const ide_km_key_prog_timing_t *ide_km_get_key_prog_timing()
+{
+  return &m_key_prog_timing;
+}
+
 // setup ide stream
 bool setup_ide_stream(void* doe_context, void* spdm_context,
                     uint32_t* session_id, uint8_t* kcbar_addr,
@@ -243,158 +599,16 @@ bool setup_ide_stream(void* doe_context, void* spdm_context,
     return false;
   }
 
-  // ide_km_key_prog
-  result = ide_km_key_prog(
-      doe_context, spdm_context,
-      session_id, ks, PCIE_IDE_STREAM_RX, PCIE_IDE_SUB_STREAM_PR,
-      port_index, // port_index
-      stream_id,
-      kcbar_addr,
-      k_set,
-      rp_stream_index);
+  result = ide_km_program_key_set(doe_context, spdm_context, session_id, ks, port_index, stream_id,
+                                  kcbar_addr, k_set, rp_stream_index, skip_ksetgo);
   if(!result) {
     return false;
   }
 
-  result = ide_km_key_prog(
-      doe_context, spdm_context,
-      session_id, ks, PCIE_IDE_STREAM_RX, PCIE_IDE_SUB_STREAM_NPR,
-      port_index,
-      stream_id,
-      kcbar_addr,
-      k_set,
-      rp_stream_index);
-  if(!result) {
-    return false;
-  }
-
-  result = ide_km_key_prog(
-      doe_context, spdm_context,
-      session_id, ks, PCIE_IDE_STREAM_RX, PCIE_IDE_SUB_STREAM_CPL,
-      port_index,
-      stream_id,
-      kcbar_addr,
-      k_set,
-      rp_stream_index);
-  if(!result) {
-    return false;
-  }
-
-  prime_rp_ide_key_set(
-      (INTEL_KEYP_ROOT_COMPLEX_KCBAR *)kcbar_addr,
-      rp_stream_index,
-      PCIE_IDE_STREAM_RX,
-      ks);
-
-  result = ide_km_key_prog(
-      doe_context, spdm_context,
-      session_id, ks, PCIE_IDE_STREAM_TX, PCIE_IDE_SUB_STREAM_PR,
-      port_index,
-      stream_id,
-      kcbar_addr,
-      k_set,
-      rp_stream_index);
-  if(!result) {
-    return false;
-  }
-
-  result = ide_km_key_prog(
-      doe_context, spdm_context,
-      session_id, ks, PCIE_IDE_STREAM_TX, PCIE_IDE_SUB_STREAM_NPR,
-      port_index,
-      stream_id,
-      kcbar_addr,
-      k_set,
-      rp_stream_index);
-  if(!result) {
-    return false;
-  }
-
-  result = ide_km_key_prog(
-      doe_context, spdm_context,
-      session_id, ks, PCIE_IDE_STREAM_TX, PCIE_IDE_SUB_STREAM_CPL,
-      port_index,
-      stream_id,
-      kcbar_addr,
-      k_set,
-      rp_stream_index);
-  if(!result) {
-    return false;
-  }
-
-  prime_rp_ide_key_set(
-      (INTEL_KEYP_ROOT_COMPLEX_KCBAR *)kcbar_addr,
-      rp_stream_index,
-      PCIE_IDE_STREAM_TX,
-      ks);
-  
   if(skip_ksetgo) {
     return true;
   }
 
-  // Now KSetGo
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|RX|PR\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_RX | PCI_IDE_KM_KEY_SUB_STREAM_PR, port_index);
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|RX|PR failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|RX|NPR\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_RX | PCI_IDE_KM_KEY_SUB_STREAM_NPR, port_index);
-
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|RX|NPR failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|RX|CPL\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_RX | PCI_IDE_KM_KEY_SUB_STREAM_CPL, port_index);
-
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|RX|CPL failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
-  // set key_set_select in host ide
-  INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar = (INTEL_KEYP_ROOT_COMPLEX_KCBAR *)kcbar_addr;
-  set_rp_ide_key_set_select(kcbar, rp_stream_index, ks);
-
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|TX|PR\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_TX | PCI_IDE_KM_KEY_SUB_STREAM_PR, port_index);
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|TX|PR failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|TX|NPR\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_TX | PCI_IDE_KM_KEY_SUB_STREAM_NPR, port_index);
-
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|TX|NPR failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|TX|CPL\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_TX | PCI_IDE_KM_KEY_SUB_STREAM_CPL, port_index);
-
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|TX|CPL failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
   // enable dev ide
   TEST_IDE_TYPE ide_type = TEST_IDE_TYPE_SEL_IDE;
   if (top_type == IDE_TEST_TOPOLOGY_TYPE_LINK_IDE)
@@ -476,119 +690,16 @@ bool ide_key_switch_to(void* doe_context, void* spdm_context,
     }
   }
 
-  bool result = ide_km_key_prog(doe_context, spdm_context, session_id,
-                                ks, PCIE_IDE_STREAM_RX, PCIE_IDE_SUB_STREAM_PR,
-                                port_index, stream_id, kcbar_addr, k_set, rp_stream_index);
-  if(!result) {
-    return false;
-  }
-
-  result = ide_km_key_prog(doe_context, spdm_context, session_id,
-                            ks, PCIE_IDE_STREAM_RX, PCIE_IDE_SUB_STREAM_NPR,
-                            port_index, stream_id, kcbar_addr, k_set, rp_stream_index);
-  if(!result) {
-    return false;
-  }
-
-  result = ide_km_key_prog(doe_context, spdm_context, session_id,
-                            ks, PCIE_IDE_STREAM_RX, PCIE_IDE_SUB_STREAM_CPL,
-                            port_index, stream_id, kcbar_addr, k_set, rp_stream_index);
-  if(!result) {
-    return false;
-  }
-
-  prime_rp_ide_key_set((INTEL_KEYP_ROOT_COMPLEX_KCBAR *)kcbar_addr, rp_stream_index, PCIE_IDE_STREAM_RX, ks);
-
-  result = ide_km_key_prog(doe_context, spdm_context,session_id,
-                           ks, PCIE_IDE_STREAM_TX, PCIE_IDE_SUB_STREAM_PR,
-                           port_index, stream_id, kcbar_addr, k_set, rp_stream_index);
-  if(!result) {
-    return false;
-  }
-
-  result = ide_km_key_prog(doe_context, spdm_context, session_id,
-                        ks, PCIE_IDE_STREAM_TX, PCIE_IDE_SUB_STREAM_NPR,
-                        port_index, stream_id, kcbar_addr, k_set, rp_stream_index);
-  if(!result) {
-    return false;
-  }
-
-  result = ide_km_key_prog(doe_context, spdm_context, session_id,
-                            ks, PCIE_IDE_STREAM_TX, PCIE_IDE_SUB_STREAM_CPL,
-                            port_index, stream_id, kcbar_addr, k_set, rp_stream_index);
+  bool result = ide_km_program_key_set(doe_context, spdm_context, session_id, ks, port_index, stream_id,
+                                       kcbar_addr, k_set, rp_stream_index, skip_ksetgo);
   if(!result) {
     return false;
   }
 
-  prime_rp_ide_key_set((INTEL_KEYP_ROOT_COMPLEX_KCBAR *)kcbar_addr, rp_stream_index, PCIE_IDE_STREAM_TX, ks);
-
   if(skip_ksetgo) {
     return true;
   }
 
-  // Now KSetGo
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|RX|PR\n", k_set_names[ks]));
-  libspdm_return_t status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_RX | PCI_IDE_KM_KEY_SUB_STREAM_PR, port_index);
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|RX|PR failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|RX|NPR\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_RX | PCI_IDE_KM_KEY_SUB_STREAM_NPR, port_index);
-
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|RX|NPR failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|RX|CPL\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_RX | PCI_IDE_KM_KEY_SUB_STREAM_CPL, port_index);
-
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|RX|CPL failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
-  // set key_set_select in host ide
-  INTEL_KEYP_ROOT_COMPLEX_KCBAR *kcbar = (INTEL_KEYP_ROOT_COMPLEX_KCBAR *)kcbar_addr;
-  set_rp_ide_key_set_select(kcbar, rp_stream_index, ks);
-
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|TX|PR\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_TX | PCI_IDE_KM_KEY_SUB_STREAM_PR, port_index);
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|TX|PR failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|TX|NPR\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_TX | PCI_IDE_KM_KEY_SUB_STREAM_NPR, port_index);
-
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|TX|NPR failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
-  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "KSetGo %s|TX|CPL\n", k_set_names[ks]));
-  status = ide_km_key_set_go(doe_context, spdm_context, session_id, stream_id,
-                             ks | PCI_IDE_KM_KEY_DIRECTION_TX | PCI_IDE_KM_KEY_SUB_STREAM_CPL, port_index);
-
-  if (LIBSPDM_STATUS_IS_ERROR(status))
-  {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KSetGo %s|TX|CPL failed with 0x%x\n", k_set_names[ks], status));
-    return false;
-  }
-
   // wait for 10 ms for device to get ide ready
   libspdm_sleep(10 * 1000);
 
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <string.h>
 
 #include "assert.h"
 #include "hal/base.h"
@@ -24,8 +25,9 @@
 
 extern int g_test_interval;
 extern int g_test_rounds;
+extern int g_keyrefresh_interval_us;
 
-static uint8_t mKeySet = 0;
+static TEEIO_THREAD_LOCAL uint8_t mKeySet = 0;
 
 bool pcie_ide_keyrefresh_setup_common(void *test_context)
 {
@@ -48,6 +50,59 @@ bool pcie_ide_keyrefresh_setup_common(void *test_context)
                           group_context->common.top->type, upper_port, lower_port, false);
 }
 
+// switch to the other key set g_test_rounds times without the tester and report the latency of the refreshes
+static bool pcie_ide_keyrefresh_benchmark(pcie_ide_test_group_context_t *group_context)
+{
+  ide_common_test_port_context_t* upper_port = &group_context->common.upper_port;
+  ide_common_test_port_context_t* lower_port = &group_context->common.lower_port;
+  const ide_km_key_prog_timing_t *timing;
+  uint64_t phase_ns[KEYREFRESH_PHASE_NUM];
+  keyrefresh_bench_t bench;
+  uint64_t start_ns;
+  bool res = true;
+
+  if(!keyrefresh_bench_init(&bench, g_test_rounds, g_keyrefresh_interval_us)) {
+    return false;
+  }
+
+  for(int rounds = 0; rounds < g_test_rounds; rounds++) {
+    keyrefresh_bench_wait(&bench);
+
+    uint8_t ks = mKeySet == PCI_IDE_KM_KEY_SET_K0 ? PCI_IDE_KM_KEY_SET_K1 : PCI_IDE_KM_KEY_SET_K0;
+    start_ns = get_monotonic_time_ns();
+    res = ide_key_switch_to(group_context->spdm_doe.doe_context, group_context->spdm_doe.spdm_context,
+                            &group_context->spdm_doe.session_id,
+                            upper_port->mapped_kcbar_addr, group_context->stream_id,
+                            &group_context->k_set, group_context->rp_stream_index,
+                            lower_port->port->port_index,
+                            group_context->common.top->type, upper_port, lower_port, ks, false);
+    if(!res) {
+      TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "KeyRefresh to KeySet %d failed in round %d.\n", ks, rounds));
+      break;
+    }
+    mKeySet = ks;
+
+    timing = ide_km_get_key_prog_timing();
+    memset(phase_ns, 0, sizeof(phase_ns));
+    phase_ns[KEYREFRESH_PHASE_KEY_GEN] = timing->key_gen_ns;
+    for(int direction = 0; direction < PCIE_IDE_STREAM_DIRECTION_NUM; direction++) {
+      for(int substream = 0; substream < PCIE_IDE_SUB_STREAM_NUM; substream++) {
+        phase_ns[KEYREFRESH_PHASE_KEY_PROG] += timing->key_prog_ns[direction][substream];
+        phase_ns[KEYREFRESH_PHASE_RP_KEY_PROG] += timing->rp_key_prog_ns[direction][substream];
+        phase_ns[KEYREFRESH_PHASE_K_SET_GO] += timing->k_set_go_ns[direction][substream];
+      }
+    }
+    phase_ns[KEYREFRESH_PHASE_RP_KEY_PROG] += timing->rp_key_select_ns;
+    phase_ns[KEYREFRESH_PHASE_TOTAL] = get_monotonic_time_ns() - start_ns;
+    keyrefresh_bench_add(&bench, phase_ns);
+  }
+
+  keyrefresh_bench_report(&bench, "PCIE-IDE");
+  keyrefresh_bench_free(&bench);
+
+  return res;
+}
+
 void pcie_ide_keyrefresh_run_common(void *test_context)
 {
   ide_common_test_case_context_t *case_context = (ide_common_test_case_context_t *)test_context;
@@ -85,6 +140,11 @@ void pcie_ide_keyrefresh_run_common(void *test_context)
   bool res = true;
   int rounds = 0;
 
+  if(g_keyrefresh_interval_us >= 0) {
+    res = pcie_ide_keyrefresh_benchmark(group_context);
+    goto Done;
+  }
+
   while(true){
     TEEIO_PRINT(("\n"));
     TEEIO_PRINT(("Current KeySet=%d. Check the registers below.\n", mKeySet));
@@ -136,6 +196,7 @@ void pcie_ide_keyrefresh_run_common(void *test_context)
     }
   }
 
+Done:
   teeio_record_assertion_result(case_class, case_id, 1, IDE_COMMON_TEST_CASE_ASSERTION_TYPE_TEST,
                                 res ? TEEIO_TEST_RESULT_PASS : TEEIO_TEST_RESULT_FAILED,
                                 res ? "PCIE-IDE KeyRefresh succeeded." : "PCIE-IDE KeyRefresh failed.");
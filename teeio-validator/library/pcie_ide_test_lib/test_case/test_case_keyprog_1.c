@@ -22,7 +22,7 @@
 #include "pcie_ide_test_lib.h"
 #include "pcie_ide_test_internal.h"
 
-uint8_t m_keyprog_max_port = 0;
+TEEIO_THREAD_LOCAL uint8_t m_keyprog_max_port = 0;
 
 bool test_keyprog_setup_common(void *test_context)
 {
@@ -22,7 +22,7 @@
 #include "pcie_ide_test_lib.h"
 #include "pcie_ide_test_internal.h"
 
-extern uint8_t m_keyprog_max_port;
+extern TEEIO_THREAD_LOCAL uint8_t m_keyprog_max_port;
 
 // KeyProg Case 2.3
 bool test_ide_km_key_prog_case3(const void *pci_doe_context,
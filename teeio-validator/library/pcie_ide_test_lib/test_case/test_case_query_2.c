@@ -18,7 +18,7 @@
 #include "teeio_debug.h"
 #include "pcie_ide_test_internal.h"
 
-static uint8_t mMaxPortIndex = 0;
+static TEEIO_THREAD_LOCAL uint8_t mMaxPortIndex = 0;
 
 bool
 pcie_ide_test_query(const void *pci_doe_context,
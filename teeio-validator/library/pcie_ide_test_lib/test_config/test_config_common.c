@@ -122,7 +122,7 @@ bool set_ft_supported_in_switch(char* port_bdf)
     ret = true;
 
 SetFailed:
-    close(fd);
+    close_configuration_space(fd);
     unset_device_info(fd);
 
     return ret;
@@ -249,7 +249,7 @@ bool check_ft_supported_in_switch_port(char* bdf)
     TEEIO_DEBUG((TEEIO_DEBUG_INFO, "ide_cap.ft_supported=%d\n", ide_cap.ft_supported));
 
 CheckFailed:
-    close(fd);
+    close_configuration_space(fd);
     unset_device_info(fd);
 
     return supported;
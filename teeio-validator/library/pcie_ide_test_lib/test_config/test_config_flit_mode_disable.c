@@ -184,6 +184,10 @@ bool test_config_flit_mode_disable_common (void *test_context, bool is_enable)
     return false;
   }
 
+  // link is retrained. capability index shall be rebuilt.
+  invalidate_device_cap_index(group_context->common.upper_port.cfg_space_fd);
+  invalidate_device_cap_index(group_context->common.lower_port.cfg_space_fd);
+
   result = reset_ide_registers(&group_context->common.lower_port,
                                group_context->common.top->type,
                                group_context->stream_id,
@@ -49,6 +49,96 @@ bool scan_devices(void *test_context)
   return ret;
 }
 
+// close the ports kept in the topology context of the suite
+static void close_topology(void *group_context)
+{
+  pcie_ide_test_group_context_t *context = (pcie_ide_test_group_context_t *)group_context;
+  IDE_TEST_TOPOLOGY *top = context->common.top;
+
+  close_dev_port(&context->common.lower_port, top->type);
+  if(top->connection == IDE_TEST_CONNECT_DIRECT || top->connection == IDE_TEST_CONNECT_SWITCH) {
+    close_root_port(context);
+  }
+
+  free(context);
+}
+
+/**
+ * Borrow the ports opened by a previous test group of the suite.
+ * false is returned if the ports of the topology are not opened yet.
+ */
+bool pcie_ide_borrow_topology(void *test_context)
+{
+  pcie_ide_test_group_context_t *context = (pcie_ide_test_group_context_t *)test_context;
+  pcie_ide_test_group_context_t *opened = (pcie_ide_test_group_context_t *)context->common.suite_context->topology.group_context;
+
+  if(opened == NULL) {
+    return false;
+  }
+
+  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Borrow the opened ports %s(%s) and %s(%s)\n",
+               opened->common.upper_port.port->port_name, opened->common.upper_port.port->bdf,
+               opened->common.lower_port.port->port_name, opened->common.lower_port.port->bdf));
+
+  context->common.root_port = opened->common.root_port;
+  context->common.upper_port = opened->common.upper_port;
+  context->common.lower_port = opened->common.lower_port;
+  context->stream_id = opened->stream_id;
+  context->rp_stream_index = opened->rp_stream_index;
+  context->k_set = opened->k_set;
+
+  return true;
+}
+
+/**
+ * Keep the ports just opened by the test group in the topology context of the suite.
+ * They are closed when the suite is done.
+ */
+void pcie_ide_keep_topology(void *test_context)
+{
+  pcie_ide_test_group_context_t *context = (pcie_ide_test_group_context_t *)test_context;
+  teeio_common_test_topology_context_t *topology = &context->common.suite_context->topology;
+  TEEIO_ASSERT(topology->group_context == NULL);
+
+  pcie_ide_test_group_context_t *opened = (pcie_ide_test_group_context_t *)malloc(sizeof(pcie_ide_test_group_context_t));
+  TEEIO_ASSERT(opened != NULL);
+  *opened = *context;
+  // the spdm session is acquired and released by each group
+  memset(&opened->spdm_doe, 0, sizeof(spdm_doe_context_t));
+
+  topology->group_context = opened;
+  topology->close_func = close_topology;
+}
+
+// clean the assoc_reg_blocks in the same way as close_dev_port/close_root_port
+static void clean_assoc_reg_blocks(ide_common_test_port_context_t *port_context)
+{
+  port_context->addr_assoc_reg_block.addr_assoc1.raw = 0;
+  port_context->addr_assoc_reg_block.addr_assoc2.raw = 0;
+  port_context->rid_assoc_reg_block.rid_assoc1.raw = 0;
+  port_context->rid_assoc_reg_block.rid_assoc2.raw = 0;
+}
+
+/**
+ * Reset the IDE registers of the borrowed ports so that the next test group
+ * starts from a clean state. The ports are left open.
+ */
+void pcie_ide_reset_topology(void *test_context)
+{
+  pcie_ide_test_group_context_t *context = (pcie_ide_test_group_context_t *)test_context;
+  IDE_TEST_TOPOLOGY *top = context->common.top;
+
+  ide_common_test_port_context_t *port_context = &context->common.lower_port;
+  clean_assoc_reg_blocks(port_context);
+  reset_ide_registers(port_context, top->type, 0, 0, false);
+
+  if(top->connection == IDE_TEST_CONNECT_DIRECT || top->connection == IDE_TEST_CONNECT_SWITCH) {
+    port_context = &context->common.upper_port;
+    clean_assoc_reg_blocks(port_context);
+    reset_ide_registers(port_context, top->type, 0, context->rp_stream_index, true);
+  }
+}
+
 // use ide_km to query the port_index matching with BDF of lower port
 bool ide_query_port_index(void *test_context)
 {
@@ -128,50 +218,60 @@ static bool common_test_group_setup(void *test_context)
   pcie_ide_test_group_context_t *context = (pcie_ide_test_group_context_t *)test_context;
   TEEIO_ASSERT(context->common.signature == GROUP_CONTEXT_SIGNATURE);
 
-  // first scan devices
-  if(!scan_devices(test_context)) {
-    teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Scan device failed.");
-    return false;
-  }
+  // the ports are opened once per suite
+  if(!pcie_ide_borrow_topology(test_context)) {
+    // first scan devices
+    if(!scan_devices(test_context)) {
+      teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Scan device failed.");
+      return false;
+    }
 
-  // initialize lower_port
-  ret = init_dev_port(context);
-  if(!ret) {
-    teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize device port failed.");
-    return false;
-  }
+    // initialize lower_port
+    ret = init_dev_port(context);
+    if(!ret) {
+      teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize device port failed.");
+      return false;
+    }
 
-  IDE_TEST_TOPOLOGY *top = context->common.top;
-  if(top->connection == IDE_TEST_CONNECT_DIRECT || top->connection == IDE_TEST_CONNECT_SWITCH) {
-    ret = init_root_port(context);
-  } else if(top->connection == IDE_TEST_CONNECT_P2P ){
-    NOT_IMPLEMENTED("Open both root_port and upper_port for peer2peer connection.");
-  } else {
-    ret = false;
-  }
+    IDE_TEST_TOPOLOGY *top = context->common.top;
+    if(top->connection == IDE_TEST_CONNECT_DIRECT || top->connection == IDE_TEST_CONNECT_SWITCH) {
+      ret = init_root_port(context);
+    } else if(top->connection == IDE_TEST_CONNECT_P2P ){
+      NOT_IMPLEMENTED("Open both root_port and upper_port for peer2peer connection.");
+    } else {
+      ret = false;
+    }
 
-  if (!ret) {
-    teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize root port failed.");
-    return false;
-  }
+    if (!ret) {
+      teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize root port failed.");
+      return false;
+    }
 
-  // init spdm_context
-  void *spdm_context = spdm_client_init();
-  if(spdm_context == NULL) {
-    teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize spdm failed.");
-    return false;
+    pcie_ide_keep_topology(test_context);
   }
 
+  // acquire spdm_context and spdm_session
+  void *spdm_context = NULL;
   uint32_t session_id = 0;
-  if(!spdm_connect(spdm_context, &session_id)) {
+  if(!spdm_session_acquire(context->common.lower_port.port->bdf, context->common.lower_port.doe_context, &spdm_context, &session_id)) {
     teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Spdm connect failed.");
     return false;
   }
 
   context->spdm_doe.spdm_context = spdm_context;
   context->spdm_doe.session_id = session_id;
-
-  if (!ide_query_port_index(test_context)) {
+  context->spdm_doe.doe_context = context->common.lower_port.doe_context;
+
+  bool found = ide_query_port_index(test_context);
+  // a stale pooled session fails the first request in it. Set it up again then.
+  if (!found && spdm_session_reacquire(context->common.lower_port.port->bdf, context->common.lower_port.doe_context, &spdm_context, &session_id)) {
+    context->spdm_doe.spdm_context = spdm_context;
+    context->spdm_doe.session_id = session_id;
+    found = ide_query_port_index(test_context);
+  }
+  context->spdm_doe.spdm_context = spdm_context;
+  context->spdm_doe.session_id = session_id;
+  if (!found) {
     teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Query port_index for lower_port failed.");
     return false;
   }
@@ -186,25 +286,22 @@ static bool common_test_group_teardown(void *test_context)
   pcie_ide_test_group_context_t *context = (pcie_ide_test_group_context_t *)test_context;
   TEEIO_ASSERT(context->common.signature == GROUP_CONTEXT_SIGNATURE);
 
-  // close spdm_session and free spdm_context
+  // release spdm_session and spdm_context
   if(context->spdm_doe.spdm_context != NULL) {
-    spdm_stop(context->spdm_doe.spdm_context, context->spdm_doe.session_id);
-    free(context->spdm_doe.spdm_context);
+    spdm_session_release(context->spdm_doe.spdm_context, context->spdm_doe.session_id);
     context->spdm_doe.spdm_context = NULL;
     context->spdm_doe.session_id = 0;
   }
 
   IDE_TEST_TOPOLOGY *top = context->common.top;
-  // close ports
-  close_dev_port(&context->common.lower_port, top->type);
-
-  if(top->connection == IDE_TEST_CONNECT_DIRECT || top->connection == IDE_TEST_CONNECT_SWITCH) {
-    close_root_port(context);
-  } else if(top->connection == IDE_TEST_CONNECT_P2P ){
+  if(top->connection == IDE_TEST_CONNECT_P2P ){
     // close both root_port and upper_port
     NOT_IMPLEMENTED("Close both root_port and upper_port for peer2peer connection.");
   }
 
+  // the ports are closed when the suite is done
+  pcie_ide_reset_topology(test_context);
+
   teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_TEARDOWN, TEEIO_TEST_RESULT_PASS, "");
 
   return true;
@@ -100,6 +100,7 @@ static bool gen_teeio_spdm_test_case_from_responder_test_case(
   while(ptr_responder->case_id != COMMON_TEST_ID_END) {
     ide_test_case_funcs_t* ptr_teeio = teeio_tc_funcs + i;
     ptr_teeio->config_check_required = false;
+    ptr_teeio->config_readonly = true;
     ptr_teeio->run = ptr_responder->case_func;
     ptr_teeio->setup = ptr_responder->case_setup_func;
     ptr_teeio->teardown = ptr_responder->case_teardown_func;
@@ -16,9 +16,6 @@
 #include "teeio_spdmlib.h"
 #include "helperlib.h"
 
-extern int m_dev_fp;
-extern uint32_t g_doe_extended_offset;
-
  bool spdm_scan_devices(void *test_context)
 {
   bool ret = false;
@@ -68,13 +65,12 @@ bool spdm_close_dev_port(ide_common_test_port_context_t *port_context)
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "close_dev_port %s(%s)\n", port_context->port->port_name, port_context->port->bdf));
 
   if(port_context->cfg_space_fd > 0) {
-    close(port_context->cfg_space_fd);
+    close_configuration_space(port_context->cfg_space_fd);
     unset_device_info(port_context->cfg_space_fd);
   }
   port_context->cfg_space_fd = 0;
 
-  m_dev_fp = 0;
-  g_doe_extended_offset = 0;
+  close_pci_doe(port_context);
   return true;
 }
 
@@ -103,7 +99,7 @@ bool spdm_close_root_port(spdm_test_group_context_t *group_context)
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "close_root_port %s(%s)\n", port_context->port->port_name, port_context->port->bdf));
 
   if(group_context->common.upper_port.cfg_space_fd > 0) {
-    close(group_context->common.upper_port.cfg_space_fd);
+    close_configuration_space(group_context->common.upper_port.cfg_space_fd);
     unset_device_info(group_context->common.upper_port.cfg_space_fd);
   }
   group_context->common.upper_port.cfg_space_fd = 0;
@@ -111,7 +107,7 @@ bool spdm_close_root_port(spdm_test_group_context_t *group_context)
   return true;
 }
 
-void *spdm_init_client(void)
+void *spdm_init_client(void *doe_context)
 {
   void *spdm_context;
   void *scratch_buffer;
@@ -124,6 +120,10 @@ void *spdm_init_client(void)
     return NULL;
   }
   libspdm_init_context(spdm_context);
+  if (!spdm_bind_doe_context(spdm_context, doe_context)) {
+    free(spdm_context);
+    return NULL;
+  }
 
   libspdm_register_device_io_func(spdm_context, device_doe_send_message, device_doe_receive_message);
 
@@ -186,14 +186,18 @@ bool spdm_test_group_setup(void *test_context)
     return false;
   }
 
+  // responder tests set up their own connection which invalidates the pooled session
+  spdm_session_pool_evict(context->common.lower_port.port->bdf, context->common.lower_port.doe_context);
+
   // init spdm_context
-  void *spdm_context = spdm_init_client();
+  void *spdm_context = spdm_init_client(context->common.lower_port.doe_context);
   if(spdm_context == NULL) {
     teeio_record_group_result(TEEIO_TEST_GROUP_FUNC_SETUP, TEEIO_TEST_RESULT_FAILED, "Initialize spdm failed.");
     return false;
   }
 
   context->spdm_doe.spdm_context = spdm_context;
+  context->spdm_doe.doe_context = context->common.lower_port.doe_context;
 
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "test_group_setup done\n"));
 
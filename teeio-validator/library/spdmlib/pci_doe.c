@@ -4,6 +4,13 @@
  *  License: BSD 3-Clause License.
  **/
 
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
 #include "teeio_validator.h"
 #include "teeio_spdmlib.h"
 #include "pcap.h"
@@ -26,13 +33,124 @@
 #define PCI_EXPRESS_REG_DOE_WRITE_DATA_MAILBOX_OFFSET 0x10
 #define PCI_EXPRESS_REG_DOE_READ_DATA_MAILBOX_OFFSET 0x14
 
-#define PCI_EXPRESS_DOE_MAILBOX_TIMEOUT 300000000   // 30 second, enough for debug device to respond
+#define PCI_EXPRESS_DOE_MAILBOX_TIMEOUT 30000000   // 30 second in us, enough for debug device to respond
 /* PCI Express - end */
 
-extern int m_dev_fp;
-extern uint32_t g_doe_extended_offset;
+// Initial busy-spin window before any response time of the device is learned.
+#define PCI_DOE_SPIN_DEFAULT_US 50
+// Default ceiling of the learned busy-spin window.
+#define PCI_DOE_SPIN_MAX_DEFAULT_US 1000
+// Polling interval starts at PCI_DOE_POLL_BACKOFF_MIN_US and doubles up to the backoff ceiling.
+#define PCI_DOE_POLL_BACKOFF_MIN_US 10
+#define PCI_DOE_POLL_BACKOFF_MAX_DEFAULT_US (30 * 1000)
+// Re-check DOE Status at least this often when waiting on the interrupt, in case an edge is lost.
+#define PCI_DOE_IRQ_WAIT_SLICE_MS 10
+
+// latency_histogram[i] counts the responses which take [2^i, 2^(i+1)) us.
+#define PCI_DOE_LATENCY_BUCKETS 24
+// The spin window is learned once there are enough samples.
+#define PCI_DOE_LATENCY_MIN_SAMPLES 8
+// The histogram is halved when it has this many samples so that it follows the device.
+#define PCI_DOE_LATENCY_MAX_SAMPLES 1024
+// The spin window covers this percentage of the observed responses.
+#define PCI_DOE_LATENCY_PERCENTILE 90
+
+#define MAX_PCI_DOE_WAIT_STRATEGY_NUM 16
+
+// DOE instances of a device and data object protocols of a DOE instance
+#define MAX_PCI_DOE_MAILBOX_NUM 8
+#define MAX_PCI_DOE_PROTOCOL_NUM 32
+#define MAX_PCI_DOE_ROUTE_NUM 16
+
+#define PCI_DOE_CONTEXT_SIGNATURE SIGNATURE_32('D', 'O', 'E', 'C')
+
 extern bool g_doe_log;
-void *m_pci_doe_context;
+extern bool g_doe_irq;
+
+typedef struct _pci_doe_wait_strategy_t pci_doe_wait_strategy_t;
+typedef struct _pci_doe_context_t pci_doe_context_t;
+
+/**
+ * Wait until (DOE Status & mask) == expected. Return false if DOE Error is set or timeout.
+ */
+typedef bool (*pci_doe_wait_func_t)(pci_doe_context_t *doe_context, uint32_t mask, uint32_t expected, uint64_t timeout_us);
+
+struct _pci_doe_wait_strategy_t {
+    char bdf[BDF_LENGTH];
+    pci_doe_wait_func_t wait;
+    // uio fd which delivers the DOE interrupt. -1 if the interrupt is not used.
+    int irq_fd;
+    // DOE contexts which have the interrupt enabled. irq_fd is closed with the last one.
+    uint32_t irq_ref_cnt;
+    uint32_t spin_max_us;
+    uint32_t backoff_max_us;
+    uint32_t latency_histogram[PCI_DOE_LATENCY_BUCKETS];
+    uint32_t latency_samples;
+};
+
+typedef struct {
+    uint32_t offset;
+    uint32_t protocol_cnt;
+    pci_doe_data_object_protocol_t protocols[MAX_PCI_DOE_PROTOCOL_NUM];
+    // held from DOE Go until the response is read, so one request is outstanding per mailbox
+    pthread_mutex_t lock;
+} pci_doe_mailbox_t;
+
+// DOE instances discovered on a device. They are shared by the forked DOE contexts.
+typedef struct {
+    uint32_t ref_cnt;
+    uint32_t mailbox_cnt;
+    pci_doe_mailbox_t mailboxes[MAX_PCI_DOE_MAILBOX_NUM];
+    // used if there is no free entry in m_doe_wait_strategies
+    pci_doe_wait_strategy_t *private_wait_strategy;
+} pci_doe_mailboxes_t;
+
+typedef struct {
+    uint16_t vendor_id;
+    uint8_t data_object_type;
+    uint8_t mailbox;
+} pci_doe_route_t;
+
+/**
+ * DOE mailboxes of a device. It is passed to libspdm as the app context data of
+ * spdm_context and as the pci_doe_context of the DOE requester functions, so
+ * that several DOE mailboxes can be driven in one process.
+ *
+ * A request is sent to the mailbox which the routes select for its data object
+ * protocol. The mailbox at doe_offset is used if no route matches, i.e. during discovery.
+ */
+struct _pci_doe_context_t {
+    uint32_t signature;
+    char bdf[BDF_LENGTH];
+    int fd;
+    uint32_t doe_offset;
+    pci_doe_mailboxes_t *mailboxes;
+    uint32_t route_cnt;
+    pci_doe_route_t routes[MAX_PCI_DOE_ROUTE_NUM];
+    // mailbox of the outstanding request. NULL if there is none or the mailbox is not discovered yet.
+    pci_doe_mailbox_t *active_mailbox;
+    // doe_offset to restore once the outstanding request is done
+    uint32_t default_doe_offset;
+    pci_doe_wait_strategy_t *wait_strategy;
+    // the context holds a reference of wait_strategy->irq_fd
+    bool irq_enabled;
+    // SPDM sessions set up through the context. The device knows them on their mailbox only.
+    uint32_t session_cnt;
+    // time when DOE Go is set for the outstanding request
+    uint64_t go_time_ns;
+    bool send_receive_buffer_acquired;
+    uint8_t send_receive_buffer[LIBSPDM_RECEIVER_BUFFER_SIZE];
+    pci_doe_statistics_t statistics;
+};
+
+static pthread_mutex_t m_doe_mailboxes_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static bool wait_doe_status_poll(pci_doe_context_t *doe_context, uint32_t mask, uint32_t expected, uint64_t timeout_us);
+static bool wait_doe_status_irq(pci_doe_context_t *doe_context, uint32_t mask, uint32_t expected, uint64_t timeout_us);
+
+// Per-device wait strategies. They are kept across open/close of the device so the learned latency is reused.
+pci_doe_wait_strategy_t m_doe_wait_strategies[MAX_PCI_DOE_WAIT_STRATEGY_NUM];
+pthread_mutex_t m_doe_wait_strategies_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 // The must supported pci_doe_data_object_type for TEEIO-Validator
 uint8_t m_pci_doe_data_object_type[] = {
@@ -42,10 +160,6 @@ uint8_t m_pci_doe_data_object_type[] = {
 };
 
 
-bool m_send_receive_buffer_acquired = false;
-uint8_t m_send_receive_buffer[LIBSPDM_RECEIVER_BUFFER_SIZE];
-size_t m_send_receive_buffer_size;
-
 #define TEEIO_DOE_DEBUG(expression) \
     do {                            \
         if(g_doe_log) {             \
@@ -59,44 +173,50 @@ void check_pcie_advance_error()
     return;
 }
 
-uint32_t device_pci_doe_control_read_32 ()
+static uint32_t device_pci_doe_control_read_32 (pci_doe_context_t *doe_context)
 {
-    TEEIO_ASSERT(g_doe_extended_offset != 0);
-    return device_pci_read_32 (g_doe_extended_offset + PCI_EXPRESS_REG_DOE_CONTROL_OFFSET, m_dev_fp);
+    TEEIO_ASSERT(doe_context->doe_offset != 0);
+    return device_pci_read_32 (doe_context->doe_offset + PCI_EXPRESS_REG_DOE_CONTROL_OFFSET, doe_context->fd);
 }
 
-void device_pci_doe_control_write_32 (uint32_t data)
+static void device_pci_doe_control_write_32 (pci_doe_context_t *doe_context, uint32_t data)
 {
-    TEEIO_ASSERT(g_doe_extended_offset != 0);
-    device_pci_write_32 (g_doe_extended_offset + PCI_EXPRESS_REG_DOE_CONTROL_OFFSET, data, m_dev_fp);
+    TEEIO_ASSERT(doe_context->doe_offset != 0);
+    device_pci_write_32 (doe_context->doe_offset + PCI_EXPRESS_REG_DOE_CONTROL_OFFSET, data, doe_context->fd);
 }
 
-uint32_t device_pci_doe_status_read_32 ()
+static uint32_t device_pci_doe_status_read_32 (pci_doe_context_t *doe_context)
 {
-    TEEIO_ASSERT(g_doe_extended_offset != 0);
-    return device_pci_read_32 (g_doe_extended_offset + PCI_EXPRESS_REG_DOE_STATUS_OFFSET, m_dev_fp);
+    TEEIO_ASSERT(doe_context->doe_offset != 0);
+    return device_pci_read_32 (doe_context->doe_offset + PCI_EXPRESS_REG_DOE_STATUS_OFFSET, doe_context->fd);
 }
 
-void device_pci_doe_write_mailbox_write_32 (uint32_t data)
+static void device_pci_doe_status_write_32 (pci_doe_context_t *doe_context, uint32_t data)
 {
-    TEEIO_ASSERT(g_doe_extended_offset != 0);
-    device_pci_write_32 (g_doe_extended_offset + PCI_EXPRESS_REG_DOE_WRITE_DATA_MAILBOX_OFFSET, data, m_dev_fp);
+    TEEIO_ASSERT(doe_context->doe_offset != 0);
+    device_pci_write_32 (doe_context->doe_offset + PCI_EXPRESS_REG_DOE_STATUS_OFFSET, data, doe_context->fd);
 }
 
-uint32_t device_pci_doe_read_mailbox_read_32 ()
+static void device_pci_doe_write_mailbox_write_32 (pci_doe_context_t *doe_context, uint32_t data)
 {
-    TEEIO_ASSERT(g_doe_extended_offset != 0);
-    return device_pci_read_32 (g_doe_extended_offset + PCI_EXPRESS_REG_DOE_READ_DATA_MAILBOX_OFFSET, m_dev_fp);
+    TEEIO_ASSERT(doe_context->doe_offset != 0);
+    device_pci_write_32 (doe_context->doe_offset + PCI_EXPRESS_REG_DOE_WRITE_DATA_MAILBOX_OFFSET, data, doe_context->fd);
 }
 
-void device_pci_doe_read_mailbox_write_32 (uint32_t data)
+static uint32_t device_pci_doe_read_mailbox_read_32 (pci_doe_context_t *doe_context)
 {
-    TEEIO_ASSERT(g_doe_extended_offset != 0);
-    device_pci_write_32 (g_doe_extended_offset + PCI_EXPRESS_REG_DOE_READ_DATA_MAILBOX_OFFSET, data, m_dev_fp);
+    TEEIO_ASSERT(doe_context->doe_offset != 0);
+    return device_pci_read_32 (doe_context->doe_offset + PCI_EXPRESS_REG_DOE_READ_DATA_MAILBOX_OFFSET, doe_context->fd);
 }
 
-bool is_doe_error_asserted(){
-    uint32_t doe_status = device_pci_doe_status_read_32 ();
+static void device_pci_doe_read_mailbox_write_32 (pci_doe_context_t *doe_context, uint32_t data)
+{
+    TEEIO_ASSERT(doe_context->doe_offset != 0);
+    device_pci_write_32 (doe_context->doe_offset + PCI_EXPRESS_REG_DOE_READ_DATA_MAILBOX_OFFSET, data, doe_context->fd);
+}
+
+bool is_doe_error_asserted(void *doe_context){
+    uint32_t doe_status = device_pci_doe_status_read_32 (doe_context);
     if ((doe_status & PCI_EXPRESS_REG_DOE_STATUS_DOE_ERROR) != 0){
         return true;
     }else{
@@ -104,49 +224,631 @@ bool is_doe_error_asserted(){
     }
 }
 
-bool is_doe_busy_asserted(){
-    uint32_t doe_status = device_pci_doe_status_read_32 ();
-    if ((doe_status & PCI_EXPRESS_REG_DOE_STATUS_DOE_BUSY) != 0){
-        return true;
-    }else{
+void trigger_doe_abort(void *doe_context){
+    uint32_t doe_control = device_pci_doe_control_read_32 (doe_context);
+    doe_control |= PCI_EXPRESS_REG_DOE_CONTROL_DOE_ABORT;
+    doe_control &= ~PCI_EXPRESS_REG_DOE_CONTROL_DOE_GO;
+    device_pci_doe_control_write_32 (doe_context, doe_control);
+    ((pci_doe_context_t *)doe_context)->statistics.aborts++;
+}
+
+static void trigger_doe_go(pci_doe_context_t *doe_context){
+    uint32_t doe_control = device_pci_doe_control_read_32 (doe_context);
+    doe_control &= ~PCI_EXPRESS_REG_DOE_CONTROL_DOE_ABORT;
+    doe_control |= PCI_EXPRESS_REG_DOE_CONTROL_DOE_GO;
+    device_pci_doe_control_write_32 (doe_context, doe_control);
+}
+
+/**
+ * Get the DOE context bound to spdm_context by spdm_client_init/spdm_bind_doe_context.
+ */
+static pci_doe_context_t *get_spdm_doe_context(void *spdm_context)
+{
+    void *doe_context = NULL;
+    size_t data_size = sizeof(doe_context);
+    libspdm_return_t status;
+
+    status = libspdm_get_data(spdm_context, LIBSPDM_DATA_APP_CONTEXT_DATA, NULL, &doe_context, &data_size);
+    if (LIBSPDM_STATUS_IS_ERROR(status)) {
+        return NULL;
+    }
+    TEEIO_ASSERT(doe_context == NULL || ((pci_doe_context_t *)doe_context)->signature == PCI_DOE_CONTEXT_SIGNATURE);
+    return (pci_doe_context_t *)doe_context;
+}
+
+static bool open_doe_irq_uio(pci_doe_wait_strategy_t *strategy, const char *bdf)
+{
+    char path[MAX_FILE_NAME];
+    DIR *dir;
+    struct dirent *entry;
+    int fd = -1;
+
+    // uio_pci_generic exposes the device as /sys/bus/pci/devices/<bdf>/uio/uioX
+    snprintf(path, sizeof(path), "/sys/bus/pci/devices/%s/uio", bdf);
+    dir = opendir(path);
+    if (dir == NULL) {
         return false;
     }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "uio", 3) == 0) {
+            snprintf(path, sizeof(path), "/dev/%s", entry->d_name);
+            fd = open(path, O_RDWR);
+            break;
+        }
+    }
+    closedir(dir);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    strategy->irq_fd = fd;
+    return true;
 }
 
-bool is_doe_data_object_ready_asserted(){
-    uint32_t doe_status = device_pci_doe_status_read_32 ();
-    if ((doe_status & PCI_EXPRESS_REG_DOE_STATUS_DOE_READY) != 0){
-        return true;
-    }else{
+static void unmask_doe_irq(pci_doe_wait_strategy_t *strategy)
+{
+    int32_t irq_on = 1;
+    if (write(strategy->irq_fd, &irq_on, sizeof(irq_on)) != sizeof(irq_on)) {
+        TEEIO_DEBUG ((TEEIO_DEBUG_WARN, "Failed to unmask DOE interrupt.\n"));
+    }
+}
+
+/**
+ * Select the DOE wait strategy of the device. spin_max_us and backoff_max_us
+ * are the ceilings of the busy-spin window and the polling interval. 0 means default.
+ */
+static void init_wait_strategy(pci_doe_wait_strategy_t *strategy, uint32_t spin_max_us, uint32_t backoff_max_us)
+{
+    strategy->wait = wait_doe_status_poll;
+    strategy->irq_fd = -1;
+    strategy->irq_ref_cnt = 0;
+    strategy->spin_max_us = spin_max_us == 0 ? PCI_DOE_SPIN_MAX_DEFAULT_US : spin_max_us;
+    strategy->backoff_max_us = backoff_max_us == 0 ? PCI_DOE_POLL_BACKOFF_MAX_DEFAULT_US : backoff_max_us;
+}
+
+/**
+ * The strategy of a device is shared by its DOE contexts. It is initialized when
+ * the device is opened the first time, so opening it again keeps the wait mode.
+ */
+static void pci_doe_set_wait_strategy(pci_doe_context_t *doe_context, uint32_t spin_max_us, uint32_t backoff_max_us)
+{
+    pci_doe_wait_strategy_t *strategy = NULL;
+    const char *bdf = doe_context->bdf;
+    int i;
+
+    pthread_mutex_lock(&m_doe_wait_strategies_mutex);
+    for (i = 0; i < MAX_PCI_DOE_WAIT_STRATEGY_NUM; i++) {
+        if (strcmp(m_doe_wait_strategies[i].bdf, bdf) == 0) {
+            strategy = &m_doe_wait_strategies[i];
+            break;
+        }
+        if (strategy == NULL && m_doe_wait_strategies[i].bdf[0] == 0) {
+            strategy = &m_doe_wait_strategies[i];
+        }
+    }
+
+    if (strategy != NULL && strategy->bdf[0] == 0) {
+        strncpy(strategy->bdf, bdf, BDF_LENGTH - 1);
+        init_wait_strategy(strategy, spin_max_us, backoff_max_us);
+    }
+    pthread_mutex_unlock(&m_doe_wait_strategies_mutex);
+
+    if (strategy == NULL) {
+        TEEIO_DEBUG ((TEEIO_DEBUG_WARN, "No free DOE wait strategy for %s. The learned latency is not kept.\n", bdf));
+        strategy = (pci_doe_wait_strategy_t *)calloc(1, sizeof(pci_doe_wait_strategy_t));
+        TEEIO_ASSERT(strategy != NULL);
+        init_wait_strategy(strategy, spin_max_us, backoff_max_us);
+        doe_context->mailboxes->private_wait_strategy = strategy;
+    }
+
+    doe_context->wait_strategy = strategy;
+
+    TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "DOE wait strategy of %s: spin_max=%dus, backoff_max=%dus, %d latency samples\n",
+                      bdf, strategy->spin_max_us, strategy->backoff_max_us, strategy->latency_samples));
+}
+
+/**
+ * Allocate the DOE context of the device opened as fd.
+ * The DOE mailboxes are discovered with pcie_doe_init_request.
+ */
+void *pci_doe_context_open(const char *bdf, int fd, uint32_t spin_max_us, uint32_t backoff_max_us)
+{
+    pci_doe_context_t *doe_context;
+
+    TEEIO_ASSERT(bdf != NULL);
+
+    doe_context = (pci_doe_context_t *)calloc(1, sizeof(pci_doe_context_t));
+    if (doe_context == NULL) {
+        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "Failed to allocate DOE context of %s.\n", bdf));
+        return NULL;
+    }
+    doe_context->mailboxes = (pci_doe_mailboxes_t *)calloc(1, sizeof(pci_doe_mailboxes_t));
+    if (doe_context->mailboxes == NULL) {
+        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "Failed to allocate DOE mailboxes of %s.\n", bdf));
+        free(doe_context);
+        return NULL;
+    }
+    doe_context->mailboxes->ref_cnt = 1;
+
+    doe_context->signature = PCI_DOE_CONTEXT_SIGNATURE;
+    strncpy(doe_context->bdf, bdf, BDF_LENGTH - 1);
+    doe_context->fd = fd;
+    pci_doe_set_wait_strategy(doe_context, spin_max_us, backoff_max_us);
+
+    return doe_context;
+}
+
+static bool is_doe_mailbox_supported(const pci_doe_mailbox_t *mailbox, uint16_t vendor_id, uint8_t data_object_type)
+{
+    for (uint32_t i = 0; i < mailbox->protocol_cnt; i++) {
+        if (mailbox->protocols[i].vendor_id == vendor_id &&
+            mailbox->protocols[i].data_object_type == data_object_type) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * SPDM and Secured SPDM of a connection go to the same mailbox, because the
+ * device binds the session to the DOE instance which sets it up.
+ */
+static bool is_spdm_doe_route(const pci_doe_route_t *route)
+{
+    return route->vendor_id == PCI_DOE_VENDOR_ID_PCISIG &&
+           (route->data_object_type == PCI_DOE_DATA_OBJECT_TYPE_SPDM ||
+            route->data_object_type == PCI_DOE_DATA_OBJECT_TYPE_SECURED_SPDM);
+}
+
+static bool is_spdm_doe_mailbox(const pci_doe_mailbox_t *mailbox)
+{
+    return is_doe_mailbox_supported(mailbox, PCI_DOE_VENDOR_ID_PCISIG, PCI_DOE_DATA_OBJECT_TYPE_SPDM) &&
+           is_doe_mailbox_supported(mailbox, PCI_DOE_VENDOR_ID_PCISIG, PCI_DOE_DATA_OBJECT_TYPE_SECURED_SPDM);
+}
+
+/**
+ * Route SPDM and Secured SPDM to the mailbox at mailbox_index.
+ */
+static void set_spdm_doe_routes(pci_doe_context_t *context, uint8_t mailbox_index)
+{
+    for (uint32_t i = 0; i < context->route_cnt; i++) {
+        if (is_spdm_doe_route(context->routes + i)) {
+            context->routes[i].mailbox = mailbox_index;
+        }
+    }
+}
+
+/**
+ * Allocate a DOE context which shares the discovered mailboxes of doe_context.
+ * The forked context has its own buffer, so it can be bound to another spdm_context
+ * and used by another thread. Where the device has several mailboxes for a protocol,
+ * the forked context prefers a mailbox other than the one doe_context uses, so that
+ * their requests go out in parallel. Otherwise they take turns on the mailbox.
+ * SPDM and Secured SPDM move together, and they stay on their mailbox if doe_context
+ * has a live SPDM session, which the device knows on that mailbox only.
+ */
+void *pci_doe_context_fork(void *doe_context)
+{
+    pci_doe_context_t *parent = (pci_doe_context_t *)doe_context;
+    pci_doe_context_t *context;
+    pci_doe_mailboxes_t *mailboxes;
+    uint32_t i, j;
+
+    TEEIO_ASSERT(parent != NULL && parent->signature == PCI_DOE_CONTEXT_SIGNATURE);
+
+    context = (pci_doe_context_t *)calloc(1, sizeof(pci_doe_context_t));
+    if (context == NULL) {
+        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "Failed to allocate DOE context of %s.\n", parent->bdf));
+        return NULL;
+    }
+
+    mailboxes = parent->mailboxes;
+    pthread_mutex_lock(&m_doe_mailboxes_mutex);
+    mailboxes->ref_cnt++;
+    pthread_mutex_unlock(&m_doe_mailboxes_mutex);
+
+    context->signature = PCI_DOE_CONTEXT_SIGNATURE;
+    strncpy(context->bdf, parent->bdf, BDF_LENGTH - 1);
+    context->fd = parent->fd;
+    context->doe_offset = parent->doe_offset;
+    context->mailboxes = mailboxes;
+    context->wait_strategy = parent->wait_strategy;
+    if (parent->irq_enabled) {
+        pthread_mutex_lock(&m_doe_wait_strategies_mutex);
+        context->wait_strategy->irq_ref_cnt++;
+        pthread_mutex_unlock(&m_doe_wait_strategies_mutex);
+        context->irq_enabled = true;
+    }
+    context->route_cnt = parent->route_cnt;
+    memcpy(context->routes, parent->routes, sizeof(context->routes));
+
+    for (i = 0; i < context->route_cnt; i++) {
+        pci_doe_route_t *route = context->routes + i;
+        if (is_spdm_doe_route(route)) {
+            continue;
+        }
+        for (j = 0; j < mailboxes->mailbox_cnt; j++) {
+            if (j != route->mailbox &&
+                is_doe_mailbox_supported(mailboxes->mailboxes + j, route->vendor_id, route->data_object_type)) {
+                route->mailbox = (uint8_t)j;
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < context->route_cnt; i++) {
+        if (is_spdm_doe_route(context->routes + i)) {
+            break;
+        }
+    }
+    if (i < context->route_cnt && parent->session_cnt == 0) {
+        for (j = 0; j < mailboxes->mailbox_cnt; j++) {
+            if (j != context->routes[i].mailbox && is_spdm_doe_mailbox(mailboxes->mailboxes + j)) {
+                set_spdm_doe_routes(context, (uint8_t)j);
+                break;
+            }
+        }
+    }
+
+    return context;
+}
+
+/**
+ * Free the DOE context. The DOE interrupt is disabled with the last context which uses it.
+ */
+void pci_doe_context_close(void *doe_context)
+{
+    pci_doe_context_t *context = (pci_doe_context_t *)doe_context;
+    bool last;
+
+    if (context == NULL) {
+        return;
+    }
+    TEEIO_ASSERT(context->signature == PCI_DOE_CONTEXT_SIGNATURE);
+
+    pci_doe_disable_interrupt(context);
+
+    pthread_mutex_lock(&m_doe_mailboxes_mutex);
+    last = --context->mailboxes->ref_cnt == 0;
+    pthread_mutex_unlock(&m_doe_mailboxes_mutex);
+
+    TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "DOE(%s@0x%04x): %llu requests (%llu bytes), %llu responses (%llu bytes), %llu errors, %llu timeouts, %llu aborts\n",
+                      context->bdf, context->doe_offset,
+                      (unsigned long long)context->statistics.requests, (unsigned long long)context->statistics.request_bytes,
+                      (unsigned long long)context->statistics.responses, (unsigned long long)context->statistics.response_bytes,
+                      (unsigned long long)context->statistics.errors, (unsigned long long)context->statistics.timeouts,
+                      (unsigned long long)context->statistics.aborts));
+
+    if (last) {
+        for (uint32_t i = 0; i < context->mailboxes->mailbox_cnt; i++) {
+            pthread_mutex_destroy(&context->mailboxes->mailboxes[i].lock);
+        }
+        if (context->mailboxes->private_wait_strategy != NULL) {
+            free(context->mailboxes->private_wait_strategy);
+        }
+        free(context->mailboxes);
+    }
+    context->signature = 0;
+    free(context);
+}
+
+/**
+ * Get the transfer statistics of the DOE context.
+ */
+void pci_doe_context_get_statistics(void *doe_context, pci_doe_statistics_t *statistics)
+{
+    pci_doe_context_t *context = (pci_doe_context_t *)doe_context;
+
+    TEEIO_ASSERT(context != NULL && context->signature == PCI_DOE_CONTEXT_SIGNATURE);
+    memcpy(statistics, &context->statistics, sizeof(pci_doe_statistics_t));
+}
+
+/**
+ * Select the DOE mailbox at doe_offset in the configuration space.
+ * It is used by the requests which are not routed.
+ */
+void pci_doe_context_set_mailbox(void *doe_context, uint32_t doe_offset)
+{
+    pci_doe_context_t *context = (pci_doe_context_t *)doe_context;
+
+    TEEIO_ASSERT(context != NULL && context->signature == PCI_DOE_CONTEXT_SIGNATURE);
+    context->doe_offset = doe_offset;
+}
+
+/**
+ * Get the offset of the DOE mailbox which the requests of data_object_type go to.
+ * 0 if the protocol is not supported by the device.
+ */
+uint32_t pci_doe_context_get_mailbox(void *doe_context, uint16_t vendor_id, uint8_t data_object_type)
+{
+    pci_doe_context_t *context = (pci_doe_context_t *)doe_context;
+
+    TEEIO_ASSERT(context != NULL && context->signature == PCI_DOE_CONTEXT_SIGNATURE);
+    for (uint32_t i = 0; i < context->route_cnt; i++) {
+        if (context->routes[i].vendor_id == vendor_id && context->routes[i].data_object_type == data_object_type) {
+            return context->mailboxes->mailboxes[context->routes[i].mailbox].offset;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Offsets of the DOE mailboxes in use. The mailbox at doe_offset if none is discovered.
+ */
+static uint32_t get_doe_mailbox_offsets(pci_doe_context_t *context, uint32_t *offsets)
+{
+    uint32_t cnt = context->mailboxes->mailbox_cnt;
+
+    if (cnt == 0) {
+        offsets[0] = context->doe_offset;
+        return context->doe_offset == 0 ? 0 : 1;
+    }
+    for (uint32_t i = 0; i < cnt; i++) {
+        offsets[i] = context->mailboxes->mailboxes[i].offset;
+    }
+    return cnt;
+}
+
+/**
+ * Enable the DOE interrupt of the DOE instances if g_doe_irq is set,
+ * DOE_INT_SUPPORT is advertised by all of them and the device is bound to uio_pci_generic.
+ * Otherwise DOE Status is polled. The interrupt is shared by the DOE contexts
+ * of the device and stays enabled until all of them disable it.
+ */
+bool pci_doe_enable_interrupt(void *doe_context)
+{
+    uint32_t doe_caps;
+    pci_doe_context_t *context = (pci_doe_context_t *)doe_context;
+    pci_doe_wait_strategy_t *strategy;
+    uint32_t offsets[MAX_PCI_DOE_MAILBOX_NUM];
+    uint32_t offset_cnt;
+    const char *bdf;
+    uint32_t i;
+
+    bool ret = false;
+
+    if (!g_doe_irq || context == NULL) {
         return false;
     }
+    if (context->irq_enabled) {
+        return true;
+    }
+
+    strategy = context->wait_strategy;
+    bdf = context->bdf;
+
+    pthread_mutex_lock(&m_doe_wait_strategies_mutex);
+    // enabled by another context of the device
+    if (strategy->irq_fd >= 0) {
+        strategy->irq_ref_cnt++;
+        context->irq_enabled = true;
+        ret = true;
+        goto Done;
+    }
+
+    offset_cnt = get_doe_mailbox_offsets(context, offsets);
+    TEEIO_ASSERT(offset_cnt != 0);
+
+    // The DOE instances share the interrupt vector of the device, so an interrupt
+    // cannot be told apart and acknowledged per mailbox.
+    if (offset_cnt > 1) {
+        TEEIO_DEBUG ((TEEIO_DEBUG_INFO, "%d DOE instances share the interrupt of %s. Poll DOE Status instead.\n", offset_cnt, bdf));
+        goto Done;
+    }
+    for (i = 0; i < offset_cnt; i++) {
+        doe_caps = device_pci_read_32(offsets[i] + PCI_EXPRESS_REG_DOE_CAPABILITIES_OFFSET, context->fd);
+        if ((doe_caps & PCI_EXPRESS_REG_DOE_CAPABILITIES_DOE_INT_SUPPORT) == 0) {
+            TEEIO_DEBUG ((TEEIO_DEBUG_INFO, "DOE interrupt is not supported by %s@0x%04x. Poll DOE Status instead.\n", bdf, offsets[i]));
+            goto Done;
+        }
+    }
+
+    if (!open_doe_irq_uio(strategy, bdf)) {
+        TEEIO_DEBUG ((TEEIO_DEBUG_INFO, "%s is not bound to uio_pci_generic. Poll DOE Status instead.\n", bdf));
+        goto Done;
+    }
+
+    for (i = 0; i < offset_cnt; i++) {
+        // clear stale DOE Interrupt Status (RW1C) before enabling it
+        device_pci_write_32(offsets[i] + PCI_EXPRESS_REG_DOE_STATUS_OFFSET,
+                            PCI_EXPRESS_REG_DOE_STATUS_DOE_INT_STS, context->fd);
+        uint32_t doe_control = device_pci_read_32(offsets[i] + PCI_EXPRESS_REG_DOE_CONTROL_OFFSET, context->fd);
+        doe_control &= ~(PCI_EXPRESS_REG_DOE_CONTROL_DOE_ABORT | PCI_EXPRESS_REG_DOE_CONTROL_DOE_GO);
+        doe_control |= PCI_EXPRESS_REG_DOE_CONTROL_DOE_INT_EN;
+        device_pci_write_32(offsets[i] + PCI_EXPRESS_REG_DOE_CONTROL_OFFSET, doe_control, context->fd);
+    }
+    unmask_doe_irq(strategy);
+    strategy->wait = wait_doe_status_irq;
+    strategy->irq_ref_cnt = 1;
+    context->irq_enabled = true;
+    ret = true;
+
+    TEEIO_DEBUG ((TEEIO_DEBUG_INFO, "DOE interrupt is enabled on %s.\n", bdf));
+
+Done:
+    pthread_mutex_unlock(&m_doe_wait_strategies_mutex);
+    return ret;
 }
 
-void trigger_doe_abort(){
-    uint32_t doe_control = device_pci_doe_control_read_32 ();
-    doe_control |= PCI_EXPRESS_REG_DOE_CONTROL_DOE_ABORT;
-    doe_control &= ~PCI_EXPRESS_REG_DOE_CONTROL_DOE_GO;
-    device_pci_doe_control_write_32 (doe_control);
+/**
+ * Drop the reference of the DOE interrupt. The last context which uses it
+ * disables the interrupt and the device falls back to polling mode.
+ */
+void pci_doe_disable_interrupt(void *doe_context)
+{
+    pci_doe_context_t *context = (pci_doe_context_t *)doe_context;
+    pci_doe_wait_strategy_t *strategy;
+    uint32_t offsets[MAX_PCI_DOE_MAILBOX_NUM];
+    uint32_t offset_cnt;
+
+    if (context == NULL || !context->irq_enabled) {
+        return;
+    }
+    context->irq_enabled = false;
+
+    strategy = context->wait_strategy;
+    pthread_mutex_lock(&m_doe_wait_strategies_mutex);
+    if (--strategy->irq_ref_cnt != 0) {
+        pthread_mutex_unlock(&m_doe_wait_strategies_mutex);
+        return;
+    }
+
+    offset_cnt = get_doe_mailbox_offsets(context, offsets);
+    for (uint32_t i = 0; i < offset_cnt; i++) {
+        uint32_t doe_control = device_pci_read_32(offsets[i] + PCI_EXPRESS_REG_DOE_CONTROL_OFFSET, context->fd);
+        doe_control &= ~(PCI_EXPRESS_REG_DOE_CONTROL_DOE_ABORT |
+                         PCI_EXPRESS_REG_DOE_CONTROL_DOE_GO |
+                         PCI_EXPRESS_REG_DOE_CONTROL_DOE_INT_EN);
+        device_pci_write_32(offsets[i] + PCI_EXPRESS_REG_DOE_CONTROL_OFFSET, doe_control, context->fd);
+    }
+
+    strategy->wait = wait_doe_status_poll;
+    close(strategy->irq_fd);
+    strategy->irq_fd = -1;
+    pthread_mutex_unlock(&m_doe_wait_strategies_mutex);
 }
 
-void trigger_doe_go(){
-    uint32_t doe_control = device_pci_doe_control_read_32 ();
-    doe_control &= ~PCI_EXPRESS_REG_DOE_CONTROL_DOE_ABORT;
-    doe_control |= PCI_EXPRESS_REG_DOE_CONTROL_DOE_GO;
-    device_pci_doe_control_write_32 (doe_control);
+static void record_doe_latency(pci_doe_wait_strategy_t *strategy, uint64_t latency_us)
+{
+    int bucket = 0;
+    int i;
+
+    while (latency_us > 1 && bucket < PCI_DOE_LATENCY_BUCKETS - 1) {
+        latency_us >>= 1;
+        bucket++;
+    }
+
+    // the strategy of a device is shared by the lanes using it
+    pthread_mutex_lock(&m_doe_wait_strategies_mutex);
+    strategy->latency_histogram[bucket]++;
+    strategy->latency_samples++;
+
+    if (strategy->latency_samples >= PCI_DOE_LATENCY_MAX_SAMPLES) {
+        strategy->latency_samples = 0;
+        for (i = 0; i < PCI_DOE_LATENCY_BUCKETS; i++) {
+            strategy->latency_histogram[i] >>= 1;
+            strategy->latency_samples += strategy->latency_histogram[i];
+        }
+    }
+    pthread_mutex_unlock(&m_doe_wait_strategies_mutex);
 }
 
-libspdm_return_t device_doe_send_message(
-    void *spdm_context,
+// Busy-spin window which covers PCI_DOE_LATENCY_PERCENTILE of the observed responses.
+static uint32_t get_doe_spin_window(pci_doe_wait_strategy_t *strategy)
+{
+    uint32_t window = PCI_DOE_SPIN_DEFAULT_US;
+    uint32_t threshold;
+    uint32_t count = 0;
+    int i;
+
+    pthread_mutex_lock(&m_doe_wait_strategies_mutex);
+    if (strategy->latency_samples >= PCI_DOE_LATENCY_MIN_SAMPLES) {
+        threshold = strategy->latency_samples * PCI_DOE_LATENCY_PERCENTILE / 100;
+        for (i = 0; i < PCI_DOE_LATENCY_BUCKETS; i++) {
+            count += strategy->latency_histogram[i];
+            if (count >= threshold) {
+                window = 1u << (i + 1);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_doe_wait_strategies_mutex);
+
+    return window > strategy->spin_max_us ? strategy->spin_max_us : window;
+}
+
+/**
+ * Busy-poll DOE Status for the learned spin window, then poll with an
+ * exponential backoff capped at backoff_max_us.
+ */
+static bool wait_doe_status_poll(pci_doe_context_t *doe_context, uint32_t mask, uint32_t expected, uint64_t timeout_us)
+{
+    pci_doe_wait_strategy_t *strategy = doe_context->wait_strategy;
+    uint64_t start = get_monotonic_time_ns();
+    uint64_t elapsed_us;
+    uint64_t backoff_us = PCI_DOE_POLL_BACKOFF_MIN_US;
+    uint32_t spin_us = get_doe_spin_window(strategy);
+    uint32_t doe_status;
+
+    while (true) {
+        doe_status = device_pci_doe_status_read_32 (doe_context);
+        if ((doe_status & PCI_EXPRESS_REG_DOE_STATUS_DOE_ERROR) != 0) {
+            return false;
+        }
+        if ((doe_status & mask) == expected) {
+            return true;
+        }
+
+        elapsed_us = (get_monotonic_time_ns() - start) / 1000;
+        if (elapsed_us >= timeout_us) {
+            return false;
+        }
+        if (elapsed_us < spin_us) {
+            continue;
+        }
+
+        libspdm_sleep (backoff_us);
+        backoff_us *= 2;
+        if (backoff_us > strategy->backoff_max_us) {
+            backoff_us = strategy->backoff_max_us;
+        }
+    }
+}
+
+/**
+ * Sleep on the DOE interrupt and check DOE Status when it is signaled.
+ */
+static bool wait_doe_status_irq(pci_doe_context_t *doe_context, uint32_t mask, uint32_t expected, uint64_t timeout_us)
+{
+    pci_doe_wait_strategy_t *strategy = doe_context->wait_strategy;
+    uint64_t start = get_monotonic_time_ns();
+    uint64_t elapsed_us;
+    uint64_t remaining_ms;
+    uint32_t doe_status;
+    uint32_t irq_count;
+    struct pollfd pfd = {.fd = strategy->irq_fd, .events = POLLIN};
+
+    while (true) {
+        doe_status = device_pci_doe_status_read_32 (doe_context);
+        if ((doe_status & PCI_EXPRESS_REG_DOE_STATUS_DOE_ERROR) != 0) {
+            return false;
+        }
+        if ((doe_status & mask) == expected) {
+            return true;
+        }
+
+        elapsed_us = (get_monotonic_time_ns() - start) / 1000;
+        if (elapsed_us >= timeout_us) {
+            return false;
+        }
+
+        remaining_ms = (timeout_us - elapsed_us) / 1000 + 1;
+        if (poll(&pfd, 1, remaining_ms < PCI_DOE_IRQ_WAIT_SLICE_MS ? (int)remaining_ms : PCI_DOE_IRQ_WAIT_SLICE_MS) <= 0) {
+            continue;
+        }
+        if (read(strategy->irq_fd, &irq_count, sizeof(irq_count)) != sizeof(irq_count)) {
+            continue;
+        }
+
+        // clear DOE Interrupt Status (RW1C) and re-arm the interrupt
+        device_pci_doe_status_write_32 (doe_context, PCI_EXPRESS_REG_DOE_STATUS_DOE_INT_STS);
+        unmask_doe_irq(strategy);
+    }
+}
+
+static libspdm_return_t pci_doe_send_message(
+    pci_doe_context_t *doe_context,
     size_t request_size,
     const void *request,
     uint64_t timeout)
 {
     libspdm_return_t status;
     uint32_t index;
-    uint64_t delay;
     uint32_t data_object_count;
     uint32_t *data_object_buffer;
+    pci_doe_wait_strategy_t *strategy = doe_context->wait_strategy;
 
     check_pcie_advance_error();
 
@@ -167,76 +869,71 @@ libspdm_return_t device_doe_send_message(
 
     TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_send_message] Start ... \n"));
 
+    // timeout from libspdm is in us as the wait strategy takes. 0 means the default.
     if (timeout == 0) {
-      timeout = PCI_EXPRESS_DOE_MAILBOX_TIMEOUT;
+        timeout = PCI_EXPRESS_DOE_MAILBOX_TIMEOUT;
     }
 
-    delay = timeout / 30 + 1;
-
-    if (is_doe_error_asserted()) {
+    if (is_doe_error_asserted(doe_context)) {
         TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_send_message] 'DOE Error' bit is set before sending message. Clear error bit and wait 1 second.\n"));
         /* Write 1b to the DOE Abort bit and wait 1 second. */
-        trigger_doe_abort();
+        trigger_doe_abort(doe_context);
         libspdm_sleep(1000*1000);
     }
 
-    do {
-        /* Check the DOE Busy bit is Clear to ensure that the DOE instance is ready to receive a DOE request. */
-        if (!is_doe_busy_asserted()) {
-            /* Write the entire data object a DWORD at a time via the DOE Write Data Mailbox register. */
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_send_message] 'DOE Busy' bit is cleared. Start writing Mailbox ...\n"));
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_VERBOSE, "Requester: \n"));
-            for (index = 0; index < data_object_count; index++) { 
-                device_pci_doe_write_mailbox_write_32 (data_object_buffer[index]);
-                TEEIO_DOE_DEBUG((TEEIO_DEBUG_VERBOSE, "mailbox: 0x%08x\n", data_object_buffer[index]));
-                TEEIO_DOE_DEBUG ((TEEIO_DEBUG_VERBOSE,"%02x %02x %02x %02x \n", *((uint8_t*)(data_object_buffer + index) + 0),
-                                                            *((uint8_t*)(data_object_buffer + index) + 1),
-                                                            *((uint8_t*)(data_object_buffer + index) + 2),
-                                                            *((uint8_t*)(data_object_buffer + index) + 3)));
-            }
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_VERBOSE,"\n"));
-
-            /* Write 1b to the DOE Go bit. */
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_send_message] Set 'DOE Go' bit, the instance start consuming the data object.\n"));
-            trigger_doe_go();
-
-            break;
-        } else {
-            /* Stall for 30 microseconds. */
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_send_message] 'DOE Busy' bit is not cleared! Waiting ...\n"));
-            if(is_doe_error_asserted()){
-                TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_send_message] DOE error is found. Exiting!\n"));
-                break;
-            }
-            libspdm_sleep (30 * 1000);
-            delay--;
+    /* Wait for the DOE Busy bit is Clear to ensure that the DOE instance is ready to receive a DOE request. */
+    if (!strategy->wait(doe_context, PCI_EXPRESS_REG_DOE_STATUS_DOE_BUSY, 0, timeout)) {
+        if (!is_doe_error_asserted(doe_context)) {
+            TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_send_message] 'DOE Busy' bit is not cleared before timeout.\n"));
+            doe_context->statistics.timeouts++;
+            status = LIBSPDM_STATUS_SEND_FAIL;
+            goto SendDone;
         }
-    } while (delay != 0);
+        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_send_message] DOE error is found. Exiting!\n"));
+    } else {
+        /* Write the entire data object a DWORD at a time via the DOE Write Data Mailbox register. */
+        TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_send_message] 'DOE Busy' bit is cleared. Start writing Mailbox ...\n"));
+        TEEIO_DOE_DEBUG ((TEEIO_DEBUG_VERBOSE, "Requester: \n"));
+        for (index = 0; index < data_object_count; index++) { 
+            device_pci_doe_write_mailbox_write_32 (doe_context, data_object_buffer[index]);
+            TEEIO_DOE_DEBUG((TEEIO_DEBUG_VERBOSE, "mailbox: 0x%08x\n", data_object_buffer[index]));
+            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_VERBOSE,"%02x %02x %02x %02x \n", *((uint8_t*)(data_object_buffer + index) + 0),
+                                                        *((uint8_t*)(data_object_buffer + index) + 1),
+                                                        *((uint8_t*)(data_object_buffer + index) + 2),
+                                                        *((uint8_t*)(data_object_buffer + index) + 3)));
+        }
+        TEEIO_DOE_DEBUG ((TEEIO_DEBUG_VERBOSE,"\n"));
+
+        /* Write 1b to the DOE Go bit. */
+        TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_send_message] Set 'DOE Go' bit, the instance start consuming the data object.\n"));
+        trigger_doe_go(doe_context);
+        doe_context->go_time_ns = get_monotonic_time_ns();
+    }
 
-    if (delay == 0) {
+    /* check ERROR bit again */
+    if (is_doe_error_asserted(doe_context)) {
         status = LIBSPDM_STATUS_SEND_FAIL;
+        doe_context->statistics.errors++;
+        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_send_message] 'DOE Error' bit is set. Send failedl. Clear error bit and wait 1 second.\n"));
+        /* Write 1b to the DOE Abort bit and wait 1 second. */
+        trigger_doe_abort(doe_context);
+        libspdm_sleep(1000*1000);
     } else {
-        /* check ERROR bit again */
-        if (is_doe_error_asserted()) {
-            status = LIBSPDM_STATUS_SEND_FAIL;
-            TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_send_message] 'DOE Error' bit is set. Send failedl. Clear error bit and wait 1 second.\n"));
-            /* Write 1b to the DOE Abort bit and wait 1 second. */
-            trigger_doe_abort();
-            libspdm_sleep(1000*1000);
-        } else {
-            append_pcap_packet_data(NULL, 0, (const void *)request, request_size);
-            status = LIBSPDM_STATUS_SUCCESS;
-        }
+        append_pcap_packet_data_ex(doe_context->bdf, PCAP_PACKET_DIRECTION_OUTBOUND, NULL, 0, (const void *)request, request_size);
+        doe_context->statistics.requests++;
+        doe_context->statistics.request_bytes += request_size;
+        status = LIBSPDM_STATUS_SUCCESS;
     }
 
+SendDone:
     check_pcie_advance_error();
 
     return status;
 }
 
 
-libspdm_return_t device_doe_receive_message(
-    void *spdm_context,
+static libspdm_return_t pci_doe_receive_message(
+    pci_doe_context_t *doe_context,
     size_t *response_size,
     void **response,
     uint64_t timeout)
@@ -246,7 +943,7 @@ libspdm_return_t device_doe_receive_message(
     uint32_t *data_object_buffer;
     uint32_t index;
     pci_doe_data_object_header_t *data_object_header;
-    uint64_t delay;
+    pci_doe_wait_strategy_t *strategy = doe_context->wait_strategy;
 
     check_pcie_advance_error();
 
@@ -261,13 +958,11 @@ libspdm_return_t device_doe_receive_message(
         return LIBSPDM_STATUS_INVALID_PARAMETER;
     }
 
+    // timeout from libspdm is in us. 0 means the default, which gives a debug device enough time to write to mailbox
     if (timeout == 0) {
         timeout = PCI_EXPRESS_DOE_MAILBOX_TIMEOUT;
     }
 
-    //delay = timeout / 30 + 1;
-    delay = 0x1000000 / 30 + 1; //make sure debug device have enough time to write to mailbox
-
     data_object_buffer = (uint32_t *)*response;
     data_object_header = (pci_doe_data_object_header_t *)*response;
     if (*response_size < sizeof (pci_doe_data_object_header_t)) {
@@ -276,134 +971,279 @@ libspdm_return_t device_doe_receive_message(
     }
 
     /* check error bit */
-    if (is_doe_error_asserted()) {
+    if (is_doe_error_asserted(doe_context)) {
         TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_receive_message] 'DOE Error' bit is set before receiving. Clear error bit and wait 1 second.\n"));
         /* Write 1b to the DOE Abort bit and wait 1 second. */
-        trigger_doe_abort();
+        trigger_doe_abort(doe_context);
         libspdm_sleep(1000*1000);
     }
 
-    do {
-        /* Poll the Data Object Ready bit. */
-        if (is_doe_data_object_ready_asserted()) {
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_receive_message] 'Data Object Ready' bit is set. Start reading Mailbox ...\n"));
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO,"Responder: \n"));
-            /* Get DataObjectHeader1. */
-            data_object_buffer[0] = device_pci_doe_read_mailbox_read_32 ();
-            /* Write to the DOE Read Data Mailbox to indicate a successful read. */
-            device_pci_doe_read_mailbox_write_32 (data_object_buffer[0]);
-            /* Get DataObjectHeader2. */
-            data_object_buffer[1] = device_pci_doe_read_mailbox_read_32 ();
-            /* Write to the DOE Read Data Mailbox to indicate a successful read. */
-            device_pci_doe_read_mailbox_write_32 (data_object_buffer[1]);
-            data_object_count = data_object_header->length;
-            if (data_object_count == 0) {
-                data_object_count = 0x40000;
-            }
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_receive_message] data_object_count = 0x%x\n", data_object_count));
-
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO,"%02x %02x %02x %02x \n", *((uint8_t*)(data_object_buffer + 0) + 0),
-                                                            *((uint8_t*)(data_object_buffer + 0) + 1),
-                                                            *((uint8_t*)(data_object_buffer + 0) + 2),
-                                                            *((uint8_t*)(data_object_buffer + 0) + 3)));
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO,"%02x %02x %02x %02x \n", *((uint8_t*)(data_object_buffer + 1) + 0),
-                                                            *((uint8_t*)(data_object_buffer + 1) + 1),
-                                                            *((uint8_t*)(data_object_buffer + 1) + 2),
-                                                            *((uint8_t*)(data_object_buffer + 1) + 3)));
-
-            if (data_object_count * sizeof(uint32_t) > *response_size) {
-                *response_size = data_object_count * sizeof(uint32_t);  
-                return LIBSPDM_STATUS_BUFFER_TOO_SMALL;
-            }
-            *response_size = data_object_count * sizeof(uint32_t);
-
-            for (index = sizeof (pci_doe_data_object_header_t) / sizeof(uint32_t); index < data_object_count; index++) {
-                /* Read data from the DOE Read Data Mailbox and save it. */
-                data_object_buffer[index] = device_pci_doe_read_mailbox_read_32 ();
-                /* Write to the DOE Read Data Mailbox to indicate a successful read. */
-                device_pci_doe_read_mailbox_write_32 (data_object_buffer[index]);
-                TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO,"%02x %02x %02x %02x \n", *((uint8_t*)(data_object_buffer + index) + 0),
-                                                            *((uint8_t*)(data_object_buffer + index) + 1),
-                                                            *((uint8_t*)(data_object_buffer + index) + 2),
-                                                            *((uint8_t*)(data_object_buffer + index) + 3)));
-            }
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO,"\n"));
+    /* Wait for the Data Object Ready bit. */
+    if (!strategy->wait(doe_context, PCI_EXPRESS_REG_DOE_STATUS_DOE_READY, PCI_EXPRESS_REG_DOE_STATUS_DOE_READY, timeout)) {
+        if (!is_doe_error_asserted(doe_context)) {
+            TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_receive_message] 'Data Object Ready' bit is not set before timeout.\n"));
+            doe_context->statistics.timeouts++;
+            status = LIBSPDM_STATUS_RECEIVE_FAIL;
+            goto ReceiveDone;
+        }
+        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_receive_message] 'DOE Error' bit is set. Quit the reading loop\n"));
+    } else {
+        if (doe_context->go_time_ns != 0) {
+            record_doe_latency(strategy, (get_monotonic_time_ns() - doe_context->go_time_ns) / 1000);
+            doe_context->go_time_ns = 0;
+        }
+        TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_receive_message] 'Data Object Ready' bit is set. Start reading Mailbox ...\n"));
+        TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO,"Responder: \n"));
+        /* Get DataObjectHeader1. */
+        data_object_buffer[0] = device_pci_doe_read_mailbox_read_32 (doe_context);
+        /* Write to the DOE Read Data Mailbox to indicate a successful read. */
+        device_pci_doe_read_mailbox_write_32 (doe_context, data_object_buffer[0]);
+        /* Get DataObjectHeader2. */
+        data_object_buffer[1] = device_pci_doe_read_mailbox_read_32 (doe_context);
+        /* Write to the DOE Read Data Mailbox to indicate a successful read. */
+        device_pci_doe_read_mailbox_write_32 (doe_context, data_object_buffer[1]);
+        data_object_count = data_object_header->length;
+        if (data_object_count == 0) {
+            data_object_count = 0x40000;
+        }
+        TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_receive_message] data_object_count = 0x%x\n", data_object_count));
+
+        TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO,"%02x %02x %02x %02x \n", *((uint8_t*)(data_object_buffer + 0) + 0),
+                                                        *((uint8_t*)(data_object_buffer + 0) + 1),
+                                                        *((uint8_t*)(data_object_buffer + 0) + 2),
+                                                        *((uint8_t*)(data_object_buffer + 0) + 3)));
+        TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO,"%02x %02x %02x %02x \n", *((uint8_t*)(data_object_buffer + 1) + 0),
+                                                        *((uint8_t*)(data_object_buffer + 1) + 1),
+                                                        *((uint8_t*)(data_object_buffer + 1) + 2),
+                                                        *((uint8_t*)(data_object_buffer + 1) + 3)));
+
+        if (data_object_count * sizeof(uint32_t) > *response_size) {
+            *response_size = data_object_count * sizeof(uint32_t);  
+            return LIBSPDM_STATUS_BUFFER_TOO_SMALL;
+        }
+        *response_size = data_object_count * sizeof(uint32_t);
 
-            break;
-        } else {
-            /* Stall for 30 microseconds.. */
-            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO, "[device_doe_receive_message] 'Data Object Ready' bit is not set! Waiting ...\n"));
-            if(is_doe_error_asserted()){
-                TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_receive_message] 'DOE Error' bit is set. Quit the reading loop\n"));
-                break;
-            }
-            libspdm_sleep (30 * 1000);
-            delay--;
+        for (index = sizeof (pci_doe_data_object_header_t) / sizeof(uint32_t); index < data_object_count; index++) {
+            /* Read data from the DOE Read Data Mailbox and save it. */
+            data_object_buffer[index] = device_pci_doe_read_mailbox_read_32 (doe_context);
+            /* Write to the DOE Read Data Mailbox to indicate a successful read. */
+            device_pci_doe_read_mailbox_write_32 (doe_context, data_object_buffer[index]);
+            TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO,"%02x %02x %02x %02x \n", *((uint8_t*)(data_object_buffer + index) + 0),
+                                                        *((uint8_t*)(data_object_buffer + index) + 1),
+                                                        *((uint8_t*)(data_object_buffer + index) + 2),
+                                                        *((uint8_t*)(data_object_buffer + index) + 3)));
         }
-    } while (delay != 0);
+        TEEIO_DOE_DEBUG ((TEEIO_DEBUG_INFO,"\n"));
+    }
 
-    if (delay == 0) {
+    /* check ERROR bit again */
+    if (is_doe_error_asserted(doe_context)) {
         status = LIBSPDM_STATUS_RECEIVE_FAIL;
+        doe_context->statistics.errors++;
+        TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_receive_message] 'DOE Error' bit is set. Receive failed. Clear error bit and wait 1 second.\n"));
+        /* Write 1b to the DOE Abort bit and wait 1 second. */
+        trigger_doe_abort(doe_context);
+        libspdm_sleep(1000*1000);
     } else {
-        /* check ERROR bit again */
-        if (is_doe_error_asserted()) {
-            status = LIBSPDM_STATUS_RECEIVE_FAIL;
-            TEEIO_DEBUG ((TEEIO_DEBUG_ERROR, "[device_doe_receive_message] 'DOE Error' bit is set. Receive failed. Clear error bit and wait 1 second.\n"));
-            /* Write 1b to the DOE Abort bit and wait 1 second. */
-            trigger_doe_abort();
-            libspdm_sleep(1000*1000);
-        } else {
-            append_pcap_packet_data(NULL, 0, (const void *)*response, *response_size);
-            status = LIBSPDM_STATUS_SUCCESS;
-        }
+        append_pcap_packet_data_ex(doe_context->bdf, PCAP_PACKET_DIRECTION_INBOUND, NULL, 0, (const void *)*response, *response_size);
+        doe_context->statistics.responses++;
+        doe_context->statistics.response_bytes += *response_size;
+        status = LIBSPDM_STATUS_SUCCESS;
     }
 
+ReceiveDone:
     check_pcie_advance_error();
 
     return status;
 }
 
-libspdm_return_t spdm_device_acquire_sender_buffer (
+static void release_doe_mailbox(pci_doe_context_t *doe_context)
+{
+    if (doe_context->active_mailbox != NULL) {
+        doe_context->doe_offset = doe_context->default_doe_offset;
+        pthread_mutex_unlock(&doe_context->active_mailbox->lock);
+        doe_context->active_mailbox = NULL;
+    }
+}
+
+/**
+ * Select the mailbox of the request by its data object protocol and lock it
+ * until the response is received. The requests which are not routed, e.g. DOE
+ * discovery, go to the mailbox at doe_offset and lock it as well.
+ */
+static void acquire_doe_mailbox(pci_doe_context_t *doe_context, size_t request_size, const void *request)
+{
+    const pci_doe_data_object_header_t *header = (const pci_doe_data_object_header_t *)request;
+    pci_doe_mailbox_t *mailbox = NULL;
+
+    // the response of the previous request was never read
+    release_doe_mailbox(doe_context);
+
+    if (request == NULL || request_size < sizeof(pci_doe_data_object_header_t)) {
+        return;
+    }
+    // DOE discovery is about the mailbox at doe_offset itself
+    if (header->vendor_id != PCI_DOE_VENDOR_ID_PCISIG ||
+        header->data_object_type != PCI_DOE_DATA_OBJECT_TYPE_DOE_DISCOVERY) {
+        for (uint32_t i = 0; i < doe_context->route_cnt; i++) {
+            if (doe_context->routes[i].vendor_id == header->vendor_id &&
+                doe_context->routes[i].data_object_type == header->data_object_type) {
+                mailbox = doe_context->mailboxes->mailboxes + doe_context->routes[i].mailbox;
+                break;
+            }
+        }
+    }
+    for (uint32_t i = 0; mailbox == NULL && i < doe_context->mailboxes->mailbox_cnt; i++) {
+        if (doe_context->mailboxes->mailboxes[i].offset == doe_context->doe_offset) {
+            mailbox = doe_context->mailboxes->mailboxes + i;
+        }
+    }
+    if (mailbox == NULL) {
+        // the mailbox is being discovered and is not shared with other DOE contexts yet
+        return;
+    }
+
+    pthread_mutex_lock(&mailbox->lock);
+    doe_context->active_mailbox = mailbox;
+    doe_context->default_doe_offset = doe_context->doe_offset;
+    doe_context->doe_offset = mailbox->offset;
+}
+
+libspdm_return_t device_doe_send_message(
+    void *spdm_context,
+    size_t request_size,
+    const void *request,
+    uint64_t timeout)
+{
+    pci_doe_context_t *doe_context = get_spdm_doe_context(spdm_context);
+    libspdm_return_t status;
+
+    if (doe_context == NULL) {
+        return LIBSPDM_STATUS_SEND_FAIL;
+    }
+
+    acquire_doe_mailbox(doe_context, request_size, request);
+    status = pci_doe_send_message(doe_context, request_size, request, timeout);
+    if (LIBSPDM_STATUS_IS_ERROR(status)) {
+        release_doe_mailbox(doe_context);
+    }
+    return status;
+}
+
+libspdm_return_t device_doe_receive_message(
+    void *spdm_context,
+    size_t *response_size,
+    void **response,
+    uint64_t timeout)
+{
+    pci_doe_context_t *doe_context = get_spdm_doe_context(spdm_context);
+
+    libspdm_return_t status;
+
+    if (doe_context == NULL) {
+        return LIBSPDM_STATUS_RECEIVE_FAIL;
+    }
+
+    status = pci_doe_receive_message(doe_context, response_size, response, timeout);
+    release_doe_mailbox(doe_context);
+    return status;
+}
+
+static libspdm_return_t acquire_doe_send_receive_buffer (
     void *context, void **msg_buf_ptr)
 {
-    TEEIO_ASSERT (!m_send_receive_buffer_acquired);
-    *msg_buf_ptr = m_send_receive_buffer;
-    libspdm_zero_mem (m_send_receive_buffer, sizeof(m_send_receive_buffer));
-    m_send_receive_buffer_acquired = true;
+    pci_doe_context_t *doe_context = get_spdm_doe_context(context);
+
+    TEEIO_ASSERT (doe_context != NULL);
+    TEEIO_ASSERT (!doe_context->send_receive_buffer_acquired);
+    *msg_buf_ptr = doe_context->send_receive_buffer;
+    libspdm_zero_mem (doe_context->send_receive_buffer, sizeof(doe_context->send_receive_buffer));
+    doe_context->send_receive_buffer_acquired = true;
     return LIBSPDM_STATUS_SUCCESS;
 }
 
+static void release_doe_send_receive_buffer (
+    void *context, const void *msg_buf_ptr)
+{
+    pci_doe_context_t *doe_context = get_spdm_doe_context(context);
+
+    TEEIO_ASSERT (doe_context != NULL);
+    TEEIO_ASSERT (doe_context->send_receive_buffer_acquired);
+    TEEIO_ASSERT (msg_buf_ptr == doe_context->send_receive_buffer);
+    doe_context->send_receive_buffer_acquired = false;
+}
+
+libspdm_return_t spdm_device_acquire_sender_buffer (
+    void *context, void **msg_buf_ptr)
+{
+    return acquire_doe_send_receive_buffer (context, msg_buf_ptr);
+}
+
 void spdm_device_release_sender_buffer (
     void *context, const void *msg_buf_ptr)
 {
-    TEEIO_ASSERT (m_send_receive_buffer_acquired);
-    TEEIO_ASSERT (msg_buf_ptr == m_send_receive_buffer);
-    m_send_receive_buffer_acquired = false;
-    return;
+    release_doe_send_receive_buffer (context, msg_buf_ptr);
 }
 
 libspdm_return_t spdm_device_acquire_receiver_buffer (
     void *context, void **msg_buf_ptr)
 {
-    TEEIO_ASSERT (!m_send_receive_buffer_acquired);
-    *msg_buf_ptr = m_send_receive_buffer;
-    libspdm_zero_mem (m_send_receive_buffer, sizeof(m_send_receive_buffer));
-    m_send_receive_buffer_acquired = true;
-    return LIBSPDM_STATUS_SUCCESS;
+    return acquire_doe_send_receive_buffer (context, msg_buf_ptr);
 }
 
 void spdm_device_release_receiver_buffer (
     void *context, const void *msg_buf_ptr)
 {
-    TEEIO_ASSERT (m_send_receive_buffer_acquired);
-    TEEIO_ASSERT (msg_buf_ptr == m_send_receive_buffer);
-    m_send_receive_buffer_acquired = false;
-    return;
+    release_doe_send_receive_buffer (context, msg_buf_ptr);
+}
+
+/**
+ * Bind the DOE context to spdm_context. The device io and buffer functions
+ * registered to libspdm send and receive through this DOE mailbox.
+ */
+bool spdm_bind_doe_context(void *spdm_context, void *doe_context)
+{
+    libspdm_return_t status;
+
+    if (doe_context == NULL) {
+        return false;
+    }
+    TEEIO_ASSERT(((pci_doe_context_t *)doe_context)->signature == PCI_DOE_CONTEXT_SIGNATURE);
+    status = libspdm_set_data(spdm_context, LIBSPDM_DATA_APP_CONTEXT_DATA, NULL, &doe_context, sizeof(doe_context));
+    return !LIBSPDM_STATUS_IS_ERROR(status);
+}
+
+/**
+ * Count the SPDM session set up (live) or stopped through the DOE context bound to spdm_context.
+ */
+void spdm_track_doe_session(void *spdm_context, bool live)
+{
+    pci_doe_context_t *doe_context = get_spdm_doe_context(spdm_context);
+
+    if (doe_context == NULL) {
+        return;
+    }
+    if (live) {
+        doe_context->session_cnt++;
+    } else if (doe_context->session_cnt > 0) {
+        doe_context->session_cnt--;
+    }
+}
+
+/**
+ * Get the bdf of the device which spdm_context talks to. NULL if no DOE context is bound.
+ */
+const char *spdm_get_bdf(void *spdm_context)
+{
+    pci_doe_context_t *doe_context = get_spdm_doe_context(spdm_context);
+
+    return doe_context != NULL ? doe_context->bdf : NULL;
 }
 
 /**
  * Send and receive an DOE message
  *
+ * @param pci_doe_context               the DOE context returned by pci_doe_context_open.
  * @param request                       the PCI DOE request message, start from pci_doe_data_object_header_t.
  * @param request_size                  size in bytes of request.
  * @param response                      the PCI DOE response message, start from pci_doe_data_object_header_t.
@@ -417,50 +1257,170 @@ libspdm_return_t pci_doe_send_receive_data(const void *pci_doe_context,
                                         size_t *response_size, void *response)
 {
     libspdm_return_t status;
+    pci_doe_context_t *doe_context = (pci_doe_context_t *)(uintptr_t)pci_doe_context;
 
-    status = device_doe_send_message (NULL, request_size, request, 0);
-    if (LIBSPDM_STATUS_IS_ERROR(status)) {
-        return status;
+    TEEIO_ASSERT(doe_context != NULL && doe_context->signature == PCI_DOE_CONTEXT_SIGNATURE);
+
+    acquire_doe_mailbox (doe_context, request_size, request);
+    status = pci_doe_send_message (doe_context, request_size, request, 0);
+    if (!LIBSPDM_STATUS_IS_ERROR(status)) {
+        status = pci_doe_receive_message (doe_context, response_size, &response, 0);
     }
-    status = device_doe_receive_message (NULL, response_size, &response, 0);
-    if (LIBSPDM_STATUS_IS_ERROR(status)) {
-        return status;
+    release_doe_mailbox (doe_context);
+
+    return status;
+}
+
+/**
+ * Route the requests of the protocol to the mailbox. A mailbox which supports
+ * fewer protocols is preferred, so that dedicated mailboxes carry their own traffic.
+ */
+static void add_doe_route(pci_doe_context_t *doe_context, const pci_doe_data_object_protocol_t *protocol, uint8_t mailbox_index)
+{
+    pci_doe_mailboxes_t *mailboxes = doe_context->mailboxes;
+    pci_doe_route_t *route;
+    uint32_t i;
+
+    if (protocol->vendor_id == PCI_DOE_VENDOR_ID_PCISIG &&
+        protocol->data_object_type == PCI_DOE_DATA_OBJECT_TYPE_DOE_DISCOVERY) {
+        return;
     }
-    return LIBSPDM_STATUS_SUCCESS;
+
+    for (i = 0; i < doe_context->route_cnt; i++) {
+        route = doe_context->routes + i;
+        if (route->vendor_id == protocol->vendor_id && route->data_object_type == protocol->data_object_type) {
+            if (mailboxes->mailboxes[mailbox_index].protocol_cnt < mailboxes->mailboxes[route->mailbox].protocol_cnt) {
+                route->mailbox = mailbox_index;
+            }
+            return;
+        }
+    }
+
+    if (doe_context->route_cnt == MAX_PCI_DOE_ROUTE_NUM) {
+        TEEIO_DEBUG((TEEIO_DEBUG_WARN, "Too many DOE protocols. VendorId-0x%04x, DataObjectType-0x%02x is not routed.\n",
+                     protocol->vendor_id, protocol->data_object_type));
+        return;
+    }
+
+    route = doe_context->routes + doe_context->route_cnt++;
+    route->vendor_id = protocol->vendor_id;
+    route->data_object_type = protocol->data_object_type;
+    route->mailbox = mailbox_index;
+}
+
+/**
+ * Move SPDM and Secured SPDM to one mailbox if add_doe_route has split them.
+ * The mailbox which supports both with the fewest protocols is taken.
+ */
+static void pin_spdm_doe_routes(pci_doe_context_t *doe_context)
+{
+    pci_doe_mailboxes_t *mailboxes = doe_context->mailboxes;
+    int32_t spdm_mailbox = -1;
+    int32_t pinned = -1;
+    bool split = false;
+
+    for (uint32_t i = 0; i < doe_context->route_cnt; i++) {
+        if (!is_spdm_doe_route(doe_context->routes + i)) {
+            continue;
+        }
+        if (spdm_mailbox != -1 && spdm_mailbox != doe_context->routes[i].mailbox) {
+            split = true;
+        }
+        spdm_mailbox = doe_context->routes[i].mailbox;
+    }
+    if (!split) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < mailboxes->mailbox_cnt; i++) {
+        if (is_spdm_doe_mailbox(mailboxes->mailboxes + i) &&
+            (pinned == -1 || mailboxes->mailboxes[i].protocol_cnt < mailboxes->mailboxes[pinned].protocol_cnt)) {
+            pinned = (int32_t)i;
+        }
+    }
+    if (pinned == -1) {
+        // not known yet if a mailbox discovered later supports both
+        TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "No DOE mailbox supports both SPDM and Secured SPDM yet.\n"));
+        return;
+    }
+    set_spdm_doe_routes(doe_context, (uint8_t)pinned);
 }
 
-bool pcie_doe_init_request(uint8_t doe_discovery_version)
+/**
+ * Discover the data object protocols of the DOE mailbox at doe_offset
+ * and add the mailbox to the routes of doe_context.
+ */
+bool pcie_doe_init_request(void *doe_context, uint8_t doe_discovery_version)
 {
-    pci_doe_data_object_protocol_t data_object_protocol[6];
+    pci_doe_context_t *context = (pci_doe_context_t *)doe_context;
+    pci_doe_mailboxes_t *mailboxes = context->mailboxes;
+    pci_doe_mailbox_t *mailbox;
     size_t data_object_protocol_size;
     libspdm_return_t status;
     uint32_t index;
 
-    data_object_protocol_size = sizeof(data_object_protocol);
+    TEEIO_ASSERT(context->signature == PCI_DOE_CONTEXT_SIGNATURE);
+    if (mailboxes->mailbox_cnt == MAX_PCI_DOE_MAILBOX_NUM) {
+        TEEIO_DEBUG((TEEIO_DEBUG_WARN, "Too many DOE mailboxes. 0x%04x is not used.\n", context->doe_offset));
+        return false;
+    }
+
+    mailbox = mailboxes->mailboxes + mailboxes->mailbox_cnt;
+    data_object_protocol_size = sizeof(mailbox->protocols);
     status =
-        pci_doe_discovery (m_pci_doe_context, data_object_protocol, &data_object_protocol_size, doe_discovery_version);
+        pci_doe_discovery (doe_context, mailbox->protocols, &data_object_protocol_size, doe_discovery_version);
     if (LIBSPDM_STATUS_IS_ERROR(status)) {
         return false;
     }
 
-    for (index = 0; index < data_object_protocol_size/sizeof(pci_doe_data_object_protocol_t); index++) {
-        TEEIO_DOE_DEBUG((TEEIO_DEBUG_INFO, "DOE(0x%x) VendorId-0x%04x, DataObjectType-0x%02x\n",
-                        index, data_object_protocol[index].vendor_id,
-                        data_object_protocol[index].data_object_type));
+    mailbox->offset = context->doe_offset;
+    mailbox->protocol_cnt = (uint32_t)(data_object_protocol_size / sizeof(pci_doe_data_object_protocol_t));
+    pthread_mutex_init(&mailbox->lock, NULL);
+
+    for (index = 0; index < mailbox->protocol_cnt; index++) {
+        TEEIO_DOE_DEBUG((TEEIO_DEBUG_INFO, "DOE@0x%04x(0x%x) VendorId-0x%04x, DataObjectType-0x%02x\n",
+                        mailbox->offset, index, mailbox->protocols[index].vendor_id,
+                        mailbox->protocols[index].data_object_type));
+        add_doe_route(context, mailbox->protocols + index, (uint8_t)mailboxes->mailbox_cnt);
+    }
+    mailboxes->mailbox_cnt++;
+    pin_spdm_doe_routes(context);
+
+    return true;
+}
+
+/**
+ * Check the data object protocols required by teeio-validator are routed.
+ */
+bool pci_doe_check_protocols(void *doe_context)
+{
+    pci_doe_context_t *context = (pci_doe_context_t *)doe_context;
+    bool found = true;
+
+    TEEIO_ASSERT(context->signature == PCI_DOE_CONTEXT_SIGNATURE);
+    if (context->mailboxes->mailbox_cnt == 0) {
+        TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "PCI DOE DataObjectType(0x%02x) is not found.\n", PCI_DOE_DATA_OBJECT_TYPE_DOE_DISCOVERY));
+        return false;
     }
 
-    bool found = false;
     for(int i = 0; i < sizeof(m_pci_doe_data_object_type); i++) {
-        found = false;
-        for (index = 0; index < data_object_protocol_size/sizeof(pci_doe_data_object_protocol_t); index++) {
-            if(data_object_protocol[index].data_object_type == m_pci_doe_data_object_type[i]) {
-                found = true; break;
-            }
+        if (m_pci_doe_data_object_type[i] == PCI_DOE_DATA_OBJECT_TYPE_DOE_DISCOVERY) {
+            continue;
         }
-        if(!found) {
+        uint32_t offset = pci_doe_context_get_mailbox(doe_context, PCI_DOE_VENDOR_ID_PCISIG, m_pci_doe_data_object_type[i]);
+        if (offset == 0) {
             TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "PCI DOE DataObjectType(0x%02x) is not found.\n", m_pci_doe_data_object_type[i]));
-            break;
+            found = false;
+            continue;
         }
+        TEEIO_DEBUG((TEEIO_DEBUG_INFO, "PCI DOE DataObjectType(0x%02x) is routed to doe_offset=0x%04x\n",
+                     m_pci_doe_data_object_type[i], offset));
+    }
+
+    if (found && pci_doe_context_get_mailbox(doe_context, PCI_DOE_VENDOR_ID_PCISIG, PCI_DOE_DATA_OBJECT_TYPE_SPDM) !=
+                 pci_doe_context_get_mailbox(doe_context, PCI_DOE_VENDOR_ID_PCISIG, PCI_DOE_DATA_OBJECT_TYPE_SECURED_SPDM)) {
+        TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "No PCI DOE mailbox supports both SPDM and Secured SPDM.\n"));
+        found = false;
     }
 
     return found;
@@ -4,11 +4,62 @@
  *  License: BSD 3-Clause License.
  **/
 
+#include <pthread.h>
 #include "teeio_validator.h"
 #include "teeio_spdmlib.h"
+#include "library/spdm_crypt_lib.h"
 
-void *m_spdm_context;
-void *m_scratch_buffer;
+TEEIO_THREAD_LOCAL void *m_spdm_context;
+TEEIO_THREAD_LOCAL void *m_scratch_buffer;
+
+extern bool g_spdm_fresh_session;
+
+// SPDM sessions are pooled by endpoint bdf and reused across test groups.
+#define MAX_SPDM_SESSION_POOL_SIZE 16
+
+typedef struct {
+    char bdf[BDF_LENGTH];
+    void *spdm_context;
+    void *scratch_buffer;
+    uint32_t session_id;
+    // the session is handed out again without a probe, so it may be stale
+    bool reused;
+} spdm_session_pool_entry_t;
+
+spdm_session_pool_entry_t m_spdm_session_pool[MAX_SPDM_SESSION_POOL_SIZE] = {0};
+pthread_mutex_t m_spdm_session_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+extern bool g_spdm_probe_empty_slots;
+extern uint32_t g_parallel_topology;
+
+// Cert chains and measurement of the devices, keyed by the digest of slot 0 cert chain.
+// They are revalidated with GET_DIGESTS in spdm_connect.
+#define MAX_SPDM_DEVICE_CACHE_SIZE 8
+
+typedef struct {
+    size_t size;
+    uint8_t *data;
+    uint32_t version;   // 0 means the blob is not cached
+    uint8_t digest[LIBSPDM_MAX_HASH_SIZE];
+} spdm_cached_blob_t;
+
+typedef struct {
+    uint8_t identity[LIBSPDM_MAX_HASH_SIZE];
+    uint32_t hash_size;
+    uint32_t last_used;
+    bool in_use;
+    spdm_cached_blob_t cert_chain[SPDM_MAX_SLOT_COUNT];
+    spdm_cached_blob_t measurement;
+} spdm_device_cache_t;
+
+spdm_device_cache_t m_spdm_device_cache[MAX_SPDM_DEVICE_CACHE_SIZE] = {0};
+uint32_t m_spdm_device_cache_clock = 0;
+uint32_t m_spdm_cached_blob_version = 0;
+// version of the cached blob written in device_cert_chain_N.bin and device_measurement.bin.
+// The files are named per endpoint bdf if the topologies are tested in parallel, and are not tracked then.
+uint32_t m_cert_chain_file_version[SPDM_MAX_SLOT_COUNT] = {0};
+uint32_t m_measurement_file_version = 0;
+pthread_mutex_t m_spdm_device_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 bool libspdm_write_output_file(const char *file_name, const void *file_data,
                                size_t file_size);
@@ -44,7 +95,22 @@ void spdm_device_release_receiver_buffer (
 
 libspdm_return_t pci_doe_process_session_test(void *spdm_context, uint32_t session_id);
 
-void *spdm_client_init(void)
+/**
+ * Free the spdm_context and scratch buffer created by spdm_client_init in this thread.
+ */
+static void spdm_client_deinit()
+{
+    if (m_spdm_context != NULL) {
+        free(m_spdm_context);
+        m_spdm_context = NULL;
+    }
+    if (m_scratch_buffer != NULL) {
+        free(m_scratch_buffer);
+        m_scratch_buffer = NULL;
+    }
+}
+
+void *spdm_client_init(void *doe_context)
 {
     void *spdm_context;
     libspdm_return_t status;
@@ -56,12 +122,18 @@ void *spdm_client_init(void)
 
     TEEIO_DEBUG((TEEIO_DEBUG_INFO, "spdm_client_init\n"));
 
+    m_scratch_buffer = NULL;
     m_spdm_context = (void *)malloc(libspdm_get_context_size());
     if (m_spdm_context == NULL) {
         return NULL;
     }
     spdm_context = m_spdm_context;
     libspdm_init_context(spdm_context);
+    if (!spdm_bind_doe_context(spdm_context, doe_context)) {
+        TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to bind doe context to spdm context.\n"));
+        spdm_client_deinit();
+        return NULL;
+    }
 
     libspdm_register_device_io_func(spdm_context, device_doe_send_message,
                                     device_doe_receive_message);
@@ -82,8 +154,7 @@ void *spdm_client_init(void)
     scratch_buffer_size = libspdm_get_sizeof_required_scratch_buffer(m_spdm_context);
     m_scratch_buffer = (void *)malloc(scratch_buffer_size);
     if (m_scratch_buffer == NULL) {
-        free(m_spdm_context);
-        m_spdm_context = NULL;
+        spdm_client_deinit();
         return NULL;
     }
     libspdm_set_scratch_buffer (spdm_context, m_scratch_buffer, scratch_buffer_size);
@@ -146,8 +217,7 @@ void *spdm_client_init(void)
     status = libspdm_init_connection(spdm_context, false);
     if (LIBSPDM_STATUS_IS_ERROR(status)) {
         TEEIO_DEBUG((TEEIO_DEBUG_INFO, "libspdm_init_connection failed with 0x%x\n", (uint32_t)status));
-        free(m_spdm_context);
-        m_spdm_context = NULL;
+        spdm_client_deinit();
         return NULL;
     }
 
@@ -249,7 +319,175 @@ libspdm_return_t spdm_send_receive_get_measurement(void *spdm_context,
     return LIBSPDM_STATUS_SUCCESS;
 }
 
-bool spdm_connect (void *spdm_context, uint32_t *session_id)
+/**
+ * Store data into the cached blob. The version of the blob is bumped only if data is changed.
+ */
+static void update_spdm_cached_blob(spdm_cached_blob_t *blob, const uint8_t *data, size_t size, const uint8_t *digest, uint32_t hash_size)
+{
+    if (digest != NULL) {
+        libspdm_copy_mem(blob->digest, sizeof(blob->digest), digest, hash_size);
+    }
+
+    if (blob->version != 0 && blob->size == size &&
+        (size == 0 || memcmp(blob->data, data, size) == 0)) {
+        return;
+    }
+
+    free(blob->data);
+    blob->data = NULL;
+    if (size != 0) {
+        blob->data = (uint8_t *)malloc(size);
+        TEEIO_ASSERT(blob->data != NULL);
+        libspdm_copy_mem(blob->data, size, data, size);
+    }
+    blob->size = size;
+    blob->version = __atomic_add_fetch(&m_spdm_cached_blob_version, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Write the cached blob to file unless the same version is already written.
+ */
+static void write_spdm_cached_blob(const char *file_name, const spdm_cached_blob_t *blob, uint32_t *written_version)
+{
+    pthread_mutex_lock(&m_spdm_device_cache_mutex);
+    if (*written_version == blob->version) {
+        TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "%s is not changed.\n", file_name));
+    } else {
+        TEEIO_DEBUG((TEEIO_DEBUG_INFO, "write file - %s\n", file_name));
+        libspdm_write_output_file (file_name, blob->data, blob->size);
+        *written_version = blob->version;
+    }
+    pthread_mutex_unlock(&m_spdm_device_cache_mutex);
+}
+
+/**
+ * Lanes test different endpoints at the same time if g_parallel_topology > 1, so the
+ * output files are suffixed with the endpoint bdf then, e.g. device_cert_chain_0_0000:1a:00.0.bin.
+ * slot_id is -1 for a file which is not per slot.
+ */
+static void get_spdm_output_file_name(void *spdm_context, const char *prefix, int slot_id, char *name, size_t size)
+{
+    const char *bdf = g_parallel_topology > 1 ? spdm_get_bdf(spdm_context) : NULL;
+    char slot[8] = "";
+
+    if (slot_id >= 0) {
+        snprintf(slot, sizeof(slot), "_%d", slot_id);
+    }
+    if (bdf != NULL && bdf[0] != 0) {
+        snprintf(name, size, "%s%s_%s.bin", prefix, slot, bdf);
+    } else {
+        snprintf(name, size, "%s%s.bin", prefix, slot);
+    }
+}
+
+/**
+ * The written version of a shared output file, or of a per bdf file which is always written.
+ */
+static uint32_t *get_spdm_output_file_version(uint32_t *shared_version, uint32_t *local_version)
+{
+    if (g_parallel_topology > 1) {
+        *local_version = 0;
+        return local_version;
+    }
+    return shared_version;
+}
+
+/**
+ * Find the cache of the device identified by the digest of its slot 0 cert chain.
+ * The least recently connected cache is recycled if there is no free one.
+ * The cache is owned by the caller until put_spdm_device_cache.
+ */
+static spdm_device_cache_t *get_spdm_device_cache(const uint8_t *identity, uint32_t hash_size)
+{
+    spdm_device_cache_t *cache = NULL;
+
+    pthread_mutex_lock(&m_spdm_device_cache_mutex);
+    for (int i = 0; i < MAX_SPDM_DEVICE_CACHE_SIZE; i++) {
+        spdm_device_cache_t *walker = m_spdm_device_cache + i;
+        if (walker->in_use) {
+            continue;
+        }
+        if (walker->hash_size == hash_size && memcmp(walker->identity, identity, hash_size) == 0) {
+            cache = walker;
+            break;
+        }
+        if (cache == NULL || walker->last_used < cache->last_used) {
+            cache = walker;
+        }
+    }
+
+    if (cache == NULL) {
+        pthread_mutex_unlock(&m_spdm_device_cache_mutex);
+        return NULL;
+    }
+
+    if (cache->hash_size != hash_size || memcmp(cache->identity, identity, hash_size) != 0) {
+        for (int slot_id = 0; slot_id < SPDM_MAX_SLOT_COUNT; slot_id++) {
+            free(cache->cert_chain[slot_id].data);
+        }
+        free(cache->measurement.data);
+        libspdm_zero_mem(cache, sizeof(spdm_device_cache_t));
+        libspdm_copy_mem(cache->identity, sizeof(cache->identity), identity, hash_size);
+        cache->hash_size = hash_size;
+    }
+
+    cache->last_used = ++m_spdm_device_cache_clock;
+    cache->in_use = true;
+    pthread_mutex_unlock(&m_spdm_device_cache_mutex);
+    return cache;
+}
+
+static void put_spdm_device_cache(spdm_device_cache_t *cache)
+{
+    pthread_mutex_lock(&m_spdm_device_cache_mutex);
+    cache->in_use = false;
+    pthread_mutex_unlock(&m_spdm_device_cache_mutex);
+}
+
+/**
+ * Get the digests of the populated slots with GET_DIGESTS.
+ * digests[slot_id] is valid if bit slot_id of slot_mask is set.
+ */
+static bool spdm_get_slot_digests(void *spdm_context, uint8_t *slot_mask, uint8_t digests[SPDM_MAX_SLOT_COUNT][LIBSPDM_MAX_HASH_SIZE], uint32_t *hash_size)
+{
+    libspdm_return_t status;
+    libspdm_data_parameter_t parameter;
+    uint32_t base_hash_algo = 0;
+    size_t data_size = sizeof(base_hash_algo);
+    uint8_t total_digest_buffer[LIBSPDM_MAX_HASH_SIZE * SPDM_MAX_SLOT_COUNT];
+    uint32_t index = 0;
+
+    libspdm_zero_mem(&parameter, sizeof(parameter));
+    parameter.location = LIBSPDM_DATA_LOCATION_CONNECTION;
+    status = libspdm_get_data(spdm_context, LIBSPDM_DATA_BASE_HASH_ALGO, &parameter, &base_hash_algo, &data_size);
+    if (LIBSPDM_STATUS_IS_ERROR(status)) {
+        return false;
+    }
+    *hash_size = libspdm_get_hash_size(base_hash_algo);
+    if (*hash_size == 0 || *hash_size > LIBSPDM_MAX_HASH_SIZE) {
+        return false;
+    }
+
+    *slot_mask = 0;
+    libspdm_zero_mem(total_digest_buffer, sizeof(total_digest_buffer));
+    status = libspdm_get_digest(spdm_context, NULL, slot_mask, total_digest_buffer);
+    if (LIBSPDM_STATUS_IS_ERROR(status)) {
+        TEEIO_DEBUG((TEEIO_DEBUG_INFO, "libspdm_get_digest - %x\n", (uint32_t)status));
+        return false;
+    }
+
+    // digests are packed in the order of the slots set in slot_mask
+    for (int slot_id = 0; slot_id < SPDM_MAX_SLOT_COUNT; slot_id++) {
+        if ((*slot_mask & (1 << slot_id)) != 0) {
+            libspdm_copy_mem(digests[slot_id], LIBSPDM_MAX_HASH_SIZE, total_digest_buffer + index * (*hash_size), *hash_size);
+            index++;
+        }
+    }
+
+    return (*slot_mask & 1) != 0;
+}
+
+static bool do_spdm_connect (void *spdm_context, uint32_t *session_id, spdm_device_cache_t **device_cache)
 {
     libspdm_return_t status;
     uint32_t measurement_record_length;
@@ -260,12 +498,47 @@ bool spdm_connect (void *spdm_context, uint32_t *session_id)
     uint32_t data32;
     size_t data_size;
     libspdm_data_parameter_t parameter;
-    char cert_chain_name[] = "device_cert_chain_0.bin";
-    char measurement_name[] = "device_measurement.bin";
+    char cert_chain_name[MAX_FILE_NAME];
+    char measurement_name[MAX_FILE_NAME];
+    uint32_t file_version;
+    uint8_t slot_mask = 0;
+    uint8_t digests[SPDM_MAX_SLOT_COUNT][LIBSPDM_MAX_HASH_SIZE];
+    uint32_t hash_size = 0;
+    spdm_device_cache_t *cache = NULL;
+    spdm_cached_blob_t uncached_blob = {0};
+    spdm_cached_blob_t *blob;
+    bool digests_unchanged = true;
+    bool ret = false;
 
     TEEIO_DEBUG((TEEIO_DEBUG_INFO, "spdm_connect\n"));
 
-    /* get cert_chain 0 */
+    /* GET_DIGESTS identifies the device and tells which cert chains are changed.
+     * If it fails, all the cert chains are fetched without cache. */
+    if (spdm_get_slot_digests(spdm_context, &slot_mask, digests, &hash_size)) {
+        cache = get_spdm_device_cache(digests[0], hash_size);
+        *device_cache = cache;
+    }
+
+    if (cache != NULL) {
+        for (slot_id = 0; slot_id < SPDM_MAX_SLOT_COUNT; slot_id++) {
+            bool populated = (slot_mask & (1 << slot_id)) != 0;
+            blob = &cache->cert_chain[slot_id];
+            if (blob->version == 0 ||
+                (populated && memcmp(blob->digest, digests[slot_id], hash_size) != 0) ||
+                (!populated && blob->size != 0)) {
+                digests_unchanged = false;
+            }
+        }
+    } else {
+        slot_mask = 0xFF;
+        // the files written before cannot be trusted to match
+        pthread_mutex_lock(&m_spdm_device_cache_mutex);
+        libspdm_zero_mem(m_cert_chain_file_version, sizeof(m_cert_chain_file_version));
+        m_measurement_file_version = 0;
+        pthread_mutex_unlock(&m_spdm_device_cache_mutex);
+    }
+
+    /* get cert_chain 0. libspdm needs it to verify the KEY_EXCHANGE_RSP. */
     slot_id = 0;
     cert_chain.cert_chain_size = sizeof(cert_chain.cert_chain);
     libspdm_zero_mem (cert_chain.cert_chain, sizeof(cert_chain.cert_chain));
@@ -274,13 +547,20 @@ bool spdm_connect (void *spdm_context, uint32_t *session_id)
                                       cert_chain.cert_chain);
     if (LIBSPDM_STATUS_IS_ERROR(status)) {
         TEEIO_DEBUG((TEEIO_DEBUG_INFO, "libspdm_get_certificate (slot=%d) - %x\n", slot_id, (uint32_t)status));
-        return false;
+        goto Done;
+    }
+    get_spdm_output_file_name(spdm_context, "device_cert_chain", slot_id, cert_chain_name, sizeof(cert_chain_name));
+    if (cache != NULL) {
+        blob = &cache->cert_chain[slot_id];
+        update_spdm_cached_blob(blob, cert_chain.cert_chain, cert_chain.cert_chain_size, digests[slot_id], hash_size);
+        write_spdm_cached_blob(cert_chain_name, blob,
+                               get_spdm_output_file_version(&m_cert_chain_file_version[slot_id], &file_version));
+    } else {
+        TEEIO_DEBUG((TEEIO_DEBUG_INFO, "write file - %s\n", cert_chain_name));
+        libspdm_write_output_file (cert_chain_name,
+                                   cert_chain.cert_chain,
+                                   cert_chain.cert_chain_size);
     }
-    cert_chain_name[18] = slot_id + '0';
-    TEEIO_DEBUG((TEEIO_DEBUG_INFO, "write file - %s\n", cert_chain_name));
-    libspdm_write_output_file (cert_chain_name,
-                               cert_chain.cert_chain,
-                               cert_chain.cert_chain_size);
 
     /* setup session based on slot 0 */
     status = libspdm_start_session(
@@ -293,8 +573,9 @@ bool spdm_connect (void *spdm_context, uint32_t *session_id)
                 NULL, NULL);
     if (LIBSPDM_STATUS_IS_ERROR(status)) {
         TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "libspdm_start_session - %x\n", (uint32_t)status));
-        return false;
+        goto Done;
     }
+    spdm_track_doe_session(spdm_context, true);
 
     /* get measurement */
     libspdm_zero_mem(&parameter, sizeof(parameter));
@@ -304,24 +585,50 @@ bool spdm_connect (void *spdm_context, uint32_t *session_id)
     status = libspdm_get_data(spdm_context, LIBSPDM_DATA_CAPABILITY_FLAGS, &parameter, &data32, &data_size);
     TEEIO_ASSERT(!LIBSPDM_STATUS_IS_ERROR(status));
     if(data32 & SPDM_GET_CAPABILITIES_RESPONSE_FLAGS_MEAS_CAP) {
-        measurement_record_length = sizeof(measurement_record);
-        status = spdm_send_receive_get_measurement (spdm_context, session_id, 0,
-                                                    measurement_record,
-                                                    &measurement_record_length);
-        if (LIBSPDM_STATUS_IS_ERROR(status)) {
-            TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "spdm_send_receive_get_measurement - %x\n", (uint32_t)status));
-            return false;
+        if (cache != NULL && digests_unchanged && cache->measurement.version != 0) {
+            // the device is not changed since its measurement is cached
+            TEEIO_DEBUG((TEEIO_DEBUG_INFO, "use cached spdm measurement.\n"));
+            blob = &cache->measurement;
+        } else {
+            measurement_record_length = sizeof(measurement_record);
+            status = spdm_send_receive_get_measurement (spdm_context, session_id, 0,
+                                                        measurement_record,
+                                                        &measurement_record_length);
+            if (LIBSPDM_STATUS_IS_ERROR(status)) {
+                TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "spdm_send_receive_get_measurement - %x\n", (uint32_t)status));
+                goto Done;
+            }
+            blob = cache != NULL ? &cache->measurement : &uncached_blob;
+            update_spdm_cached_blob(blob, measurement_record, measurement_record_length, NULL, 0);
         }
-
-        TEEIO_DEBUG((TEEIO_DEBUG_INFO, "write file - %s\n", measurement_name));
-        libspdm_write_output_file (measurement_name,
-                                measurement_record, measurement_record_length);
+        get_spdm_output_file_name(spdm_context, "device_measurement", -1, measurement_name, sizeof(measurement_name));
+        write_spdm_cached_blob(measurement_name, blob,
+                               get_spdm_output_file_version(&m_measurement_file_version, &file_version));
     } else {
         TEEIO_DEBUG((TEEIO_DEBUG_INFO, "spdm measurement is not supported.\n"));
     }
 
     /* get cert_chain 1 ~ 7 */
     for (slot_id = 1; slot_id < SPDM_MAX_SLOT_COUNT; slot_id++) {
+        get_spdm_output_file_name(spdm_context, "device_cert_chain", slot_id, cert_chain_name, sizeof(cert_chain_name));
+        blob = cache != NULL ? &cache->cert_chain[slot_id] : &uncached_blob;
+
+        if ((slot_mask & (1 << slot_id)) == 0 && !g_spdm_probe_empty_slots) {
+            // empty slot reported by GET_DIGESTS
+            update_spdm_cached_blob(blob, NULL, 0, NULL, 0);
+            write_spdm_cached_blob(cert_chain_name, blob,
+                                   get_spdm_output_file_version(&m_cert_chain_file_version[slot_id], &file_version));
+            continue;
+        }
+
+        if (cache != NULL && (slot_mask & (1 << slot_id)) != 0 && blob->version != 0 &&
+            memcmp(blob->digest, digests[slot_id], hash_size) == 0) {
+            // digest is not changed. use the cached cert chain.
+            write_spdm_cached_blob(cert_chain_name, blob,
+                                   get_spdm_output_file_version(&m_cert_chain_file_version[slot_id], &file_version));
+            continue;
+        }
+
         cert_chain.cert_chain_size = sizeof(cert_chain.cert_chain);
         libspdm_zero_mem (cert_chain.cert_chain, sizeof(cert_chain.cert_chain));
         status = libspdm_get_certificate(
@@ -332,20 +639,37 @@ bool spdm_connect (void *spdm_context, uint32_t *session_id)
             TEEIO_DEBUG((TEEIO_DEBUG_INFO, "libspdm_get_certificate (slot=%d) - %x\n", slot_id, (uint32_t)status));
             cert_chain.cert_chain_size = 0;
         }
-        cert_chain_name[18] = slot_id + '0';
-        TEEIO_DEBUG((TEEIO_DEBUG_INFO, "write file - %s\n", cert_chain_name));
-        libspdm_write_output_file (cert_chain_name,
-                                   cert_chain.cert_chain,
-                                   cert_chain.cert_chain_size);
+        update_spdm_cached_blob(blob, cert_chain.cert_chain, cert_chain.cert_chain_size,
+                                (slot_mask & (1 << slot_id)) != 0 ? digests[slot_id] : NULL, hash_size);
+        write_spdm_cached_blob(cert_chain_name, blob,
+                               get_spdm_output_file_version(&m_cert_chain_file_version[slot_id], &file_version));
     }
 
-    return true;
+    ret = true;
+
+Done:
+    free(uncached_blob.data);
+
+    return ret;
+}
+
+bool spdm_connect (void *spdm_context, uint32_t *session_id)
+{
+    spdm_device_cache_t *cache = NULL;
+    bool ret = do_spdm_connect(spdm_context, session_id, &cache);
+
+    if (cache != NULL) {
+        put_spdm_device_cache(cache);
+    }
+
+    return ret;
 }
 
 bool spdm_stop(void *spdm_context, uint32_t session_id)
 {
     /* stop session */
     libspdm_return_t status = libspdm_stop_session(spdm_context, session_id, 0);
+    spdm_track_doe_session(spdm_context, false);
     if (LIBSPDM_STATUS_IS_ERROR(status)) {
         TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "libspdm_stop_session - %x\n", (uint32_t)status));
         return false;
@@ -353,3 +677,221 @@ bool spdm_stop(void *spdm_context, uint32_t session_id)
 
     return true;
 }
+
+static spdm_session_pool_entry_t *find_spdm_session_pool_entry(const char *bdf, void *spdm_context)
+{
+    for (int i = 0; i < MAX_SPDM_SESSION_POOL_SIZE; i++) {
+        spdm_session_pool_entry_t *entry = m_spdm_session_pool + i;
+        if (entry->spdm_context == NULL) {
+            continue;
+        }
+        if ((bdf != NULL && strcmp(entry->bdf, bdf) == 0) ||
+            (spdm_context != NULL && entry->spdm_context == spdm_context)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void free_spdm_session_pool_entry(spdm_session_pool_entry_t *entry, bool stop)
+{
+    if (stop) {
+        spdm_stop(entry->spdm_context, entry->session_id);
+    }
+    free(entry->spdm_context);
+    free(entry->scratch_buffer);
+
+    pthread_mutex_lock(&m_spdm_session_pool_mutex);
+    memset(entry, 0, sizeof(spdm_session_pool_entry_t));
+    pthread_mutex_unlock(&m_spdm_session_pool_mutex);
+}
+
+/**
+ * Check if the pooled session is still alive.
+ * HEARTBEAT does not change the session state, so it is used as the probe if the
+ * responder supports it. Otherwise the session is trusted, and it is set up again
+ * by spdm_session_reacquire if the first request in it fails.
+ */
+static bool is_spdm_session_alive(void *spdm_context, uint32_t session_id, bool *probed)
+{
+    libspdm_return_t status;
+    libspdm_data_parameter_t parameter;
+    uint32_t data32 = 0;
+    size_t data_size = sizeof(data32);
+
+    libspdm_zero_mem(&parameter, sizeof(parameter));
+    parameter.location = LIBSPDM_DATA_LOCATION_CONNECTION;
+    status = libspdm_get_data(spdm_context, LIBSPDM_DATA_CAPABILITY_FLAGS, &parameter, &data32, &data_size);
+    if (LIBSPDM_STATUS_IS_ERROR(status)) {
+        return false;
+    }
+
+    *probed = (data32 & SPDM_GET_CAPABILITIES_RESPONSE_FLAGS_HBEAT_CAP) != 0;
+    if (!*probed) {
+        return true;
+    }
+
+    status = libspdm_heartbeat(spdm_context, session_id);
+    if (LIBSPDM_STATUS_IS_ERROR(status)) {
+        TEEIO_DEBUG((TEEIO_DEBUG_WARN, "libspdm_heartbeat on pooled session - %x\n", (uint32_t)status));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Acquire a connected spdm_context and secure session to the endpoint of bdf.
+ * The session kept in the pool is reused unless g_spdm_fresh_session is set.
+ * The device's DOE mailbox shall be initialized before it is called.
+ */
+bool spdm_session_acquire(const char *bdf, void *doe_context, void **spdm_context, uint32_t *session_id)
+{
+    spdm_session_pool_entry_t *entry;
+    bool probed = false;
+
+    TEEIO_ASSERT(bdf != NULL && spdm_context != NULL && session_id != NULL);
+
+    // the pool entry of a bdf is only used by the thread which tests the device
+    pthread_mutex_lock(&m_spdm_session_pool_mutex);
+    entry = find_spdm_session_pool_entry(bdf, NULL);
+    pthread_mutex_unlock(&m_spdm_session_pool_mutex);
+    if (entry != NULL) {
+        // the device is reopened for every test group, so the pooled session is rebound to its new doe context
+        if (!g_spdm_fresh_session && spdm_bind_doe_context(entry->spdm_context, doe_context) &&
+            is_spdm_session_alive(entry->spdm_context, entry->session_id, &probed)) {
+            TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Reuse spdm session 0x%08x of %s\n", entry->session_id, bdf));
+            spdm_track_doe_session(entry->spdm_context, true);
+            entry->reused = !probed;
+            *spdm_context = entry->spdm_context;
+            *session_id = entry->session_id;
+            return true;
+        }
+        // the session shall not be reused. The device forgets it once a new connection is set up.
+        free_spdm_session_pool_entry(entry, false);
+    }
+
+    // reserve the pool slot before the connection is set up, so that a full pool costs no handshake
+    pthread_mutex_lock(&m_spdm_session_pool_mutex);
+    entry = NULL;
+    for (int i = 0; entry == NULL && i < MAX_SPDM_SESSION_POOL_SIZE; i++) {
+        if (m_spdm_session_pool[i].spdm_context == NULL && m_spdm_session_pool[i].bdf[0] == 0) {
+            entry = m_spdm_session_pool + i;
+            strncpy(entry->bdf, bdf, BDF_LENGTH - 1);
+        }
+    }
+    pthread_mutex_unlock(&m_spdm_session_pool_mutex);
+    if (entry == NULL) {
+        TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "spdm session pool is full.\n"));
+        *spdm_context = NULL;
+        return false;
+    }
+
+    *spdm_context = spdm_client_init(doe_context);
+    if (*spdm_context == NULL) {
+        free_spdm_session_pool_entry(entry, false);
+        return false;
+    }
+
+    // the pool owns the spdm_context and scratch buffer from now on
+    entry->spdm_context = *spdm_context;
+    entry->scratch_buffer = m_scratch_buffer;
+    m_spdm_context = NULL;
+    m_scratch_buffer = NULL;
+
+    if (!spdm_connect(*spdm_context, session_id)) {
+        free_spdm_session_pool_entry(entry, false);
+        *spdm_context = NULL;
+        return false;
+    }
+    entry->session_id = *session_id;
+
+    return true;
+}
+
+/**
+ * Release the spdm_context acquired by spdm_session_acquire.
+ * The session is kept in the pool for the next test group unless g_spdm_fresh_session is set.
+ */
+void spdm_session_release(void *spdm_context, uint32_t session_id)
+{
+    spdm_session_pool_entry_t *entry;
+
+    pthread_mutex_lock(&m_spdm_session_pool_mutex);
+    entry = find_spdm_session_pool_entry(NULL, spdm_context);
+    pthread_mutex_unlock(&m_spdm_session_pool_mutex);
+
+    if (entry == NULL) {
+        spdm_stop(spdm_context, session_id);
+        // it is not pooled, so it is the spdm_context created by spdm_client_init in this thread
+        if (spdm_context == m_spdm_context) {
+            spdm_client_deinit();
+        } else {
+            TEEIO_DEBUG((TEEIO_DEBUG_WARN, "spdm_context %p is not created in this thread. It is not freed.\n", spdm_context));
+        }
+        return;
+    }
+
+    if (g_spdm_fresh_session) {
+        free_spdm_session_pool_entry(entry, true);
+    }
+}
+
+/**
+ * Set up the session again if the first request in a reused session failed, i.e. the
+ * device has dropped it. False if the session was set up or probed in this acquisition,
+ * so the failure is not caused by a stale session, or the new session cannot be set up.
+ */
+bool spdm_session_reacquire(const char *bdf, void *doe_context, void **spdm_context, uint32_t *session_id)
+{
+    spdm_session_pool_entry_t *entry;
+
+    pthread_mutex_lock(&m_spdm_session_pool_mutex);
+    entry = find_spdm_session_pool_entry(bdf, NULL);
+    pthread_mutex_unlock(&m_spdm_session_pool_mutex);
+
+    if (entry == NULL || entry->spdm_context != *spdm_context || !entry->reused) {
+        return false;
+    }
+
+    TEEIO_DEBUG((TEEIO_DEBUG_WARN, "Pooled spdm session 0x%08x of %s is stale. Set it up again.\n", entry->session_id, bdf));
+    // the device does not know the session any more, so END_SESSION is not sent
+    free_spdm_session_pool_entry(entry, false);
+    *spdm_context = NULL;
+    *session_id = 0;
+
+    return spdm_session_acquire(bdf, doe_context, spdm_context, session_id);
+}
+
+/**
+ * Drop the pooled session of bdf, i.e. the device is to be tested with a new connection.
+ * END_SESSION is sent through doe_context if it is not NULL.
+ */
+void spdm_session_pool_evict(const char *bdf, void *doe_context)
+{
+    spdm_session_pool_entry_t *entry;
+
+    pthread_mutex_lock(&m_spdm_session_pool_mutex);
+    entry = find_spdm_session_pool_entry(bdf, NULL);
+    pthread_mutex_unlock(&m_spdm_session_pool_mutex);
+
+    if (entry != NULL) {
+        TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Evict spdm session 0x%08x of %s\n", entry->session_id, bdf));
+        // the doe context bound to the pooled session is freed with the device
+        bool stop = doe_context != NULL && spdm_bind_doe_context(entry->spdm_context, doe_context);
+        free_spdm_session_pool_entry(entry, stop);
+    }
+}
+
+/**
+ * Free all the pooled sessions. The devices are not opened any more so END_SESSION is not sent.
+ */
+void spdm_session_pool_close()
+{
+    for (int i = 0; i < MAX_SPDM_SESSION_POOL_SIZE; i++) {
+        if (m_spdm_session_pool[i].spdm_context != NULL) {
+            free_spdm_session_pool_entry(m_spdm_session_pool + i, false);
+        }
+    }
+}
@@ -18,6 +18,10 @@
 #define TDISP_REQUEST_STOP_INTERFACE                87
 #define TDISP_MMIO_REPORTING_OFFSET					0xD0000000
 
+// The largest portion of DEVICE_INTERFACE_REPORT requested in one message.
+// The actual portion length is derived from the negotiated DataTransferSize.
+#define TDISP_TEST_REPORT_PORTION_MAX_LEN			0x1000
+
 #pragma pack(1)
 typedef struct {
 	pci_tdisp_header_t header;
@@ -31,7 +35,7 @@ typedef struct {
 	pci_tdisp_header_t header;
 	uint16_t portion_length;
 	uint16_t remainder_length;
-	uint8_t report[LIBTDISP_INTERFACE_REPORT_PORTION_LEN];
+	uint8_t report[TDISP_TEST_REPORT_PORTION_MAX_LEN];
 } pci_tdisp_device_interface_report_response_mine_t;
 #pragma pack()
 
@@ -79,3 +83,16 @@ bool tdisp_test_stop_interface (void *test_context, uint32_t function_id,
 
 bool tdisp_test_get_interface_report (void *test_context, uint32_t function_id,
 	uint8_t *interface_report, uint32_t *interface_report_size);
+
+/**
+ * Get the DEVICE_INTERFACE_REPORT of the interface locked by tdisp_test_lock_interface.
+ * The report fetched by tdisp_test_get_interface_report is returned if the interface
+ * is locked with the same parameters since. Otherwise the report is fetched.
+ */
+bool tdisp_test_get_cached_interface_report (void *test_context, uint32_t function_id,
+	uint8_t *interface_report, uint32_t *interface_report_size);
+
+/**
+ * Drop the cached DEVICE_INTERFACE_REPORT and the lock state of the current thread.
+ */
+void tdisp_test_invalidate_interface_report_cache ();
@@ -46,14 +46,14 @@ ide_test_case_name_t m_tdisp_test_case_names[] = {
 ide_test_case_funcs_t m_tdisp_test_version_cases[MAX_TDISP_VERSION_CASE_ID] = {
 	{
 		tdisp_test_version_1_setup, tdisp_test_version_1_run,
-		tdisp_test_version_1_teardown, true
+		tdisp_test_version_1_teardown, true, true
 	}
 };
 
 ide_test_case_funcs_t m_tdisp_test_capabilities_cases[MAX_TDISP_CAPABILITIES_CASE_ID] = {
 	{
 		tdisp_test_capabilities_1_setup, tdisp_test_capabilities_1_run,
-		tdisp_test_capabilities_1_teardown, true
+		tdisp_test_capabilities_1_teardown, true, true
 	}
 };
 
@@ -4,6 +4,7 @@
  *  License: BSD 3-Clause License.
  **/
 
+#include <string.h>
 #include "ide_test.h"
 #include "tdisp_test_internal.h"
 #include "teeio_debug.h"
@@ -14,6 +15,37 @@
 #include "library/pci_tdisp_requester_lib.h"
 /* *INDENT-ON* */
 
+// SPDM VENDOR_DEFINED_RESPONSE header, StandardID, Len, VendorID, ReqLength,
+// protocol ID and the DEVICE_INTERFACE_REPORT header before the report portion.
+#define TDISP_TEST_REPORT_MESSAGE_OVERHEAD \
+	(sizeof (spdm_message_header_t) + 2 + 1 + 2 + 2 + 1 + \
+	 sizeof (pci_tdisp_device_interface_report_response_t))
+
+// DEVICE_INTERFACE_REPORT of the interface fetched in the current thread.
+// It is valid until the interface is locked with different parameters, the
+// SPDM session changes or the test group is torn down.
+typedef struct {
+	bool valid;
+	uint32_t session_id;
+	char bdf[BDF_LENGTH];
+	uint32_t function_id;
+	pci_tdisp_lock_interface_param_t lock_interface_param;
+	uint32_t report_size;
+	uint8_t report[LIBTDISP_INTERFACE_REPORT_MAX_SIZE];
+} tdisp_test_interface_report_cache_t;
+
+// parameters of the last successful LOCK_INTERFACE_REQUEST
+typedef struct {
+	bool valid;
+	uint32_t session_id;
+	char bdf[BDF_LENGTH];
+	uint32_t function_id;
+	pci_tdisp_lock_interface_param_t lock_interface_param;
+} tdisp_test_locked_interface_t;
+
+TEEIO_THREAD_LOCAL tdisp_test_interface_report_cache_t m_interface_report_cache = {0};
+TEEIO_THREAD_LOCAL tdisp_test_locked_interface_t m_locked_interface = {0};
+
 void assert_context (void *test_context)
 {
 	ide_common_test_case_context_t *case_context =
@@ -142,7 +174,33 @@ bool tdisp_test_lock_interface (void *test_context, uint32_t function_id,
 	libspdm_return_t status = pci_tdisp_send_receive_data (group_context->spdm_doe.spdm_context,
 		&group_context->spdm_doe.session_id, &request, request_size, response, response_size);
 
-	return LIBSPDM_STATUS_IS_ERROR (status) == false;
+	if (LIBSPDM_STATUS_IS_ERROR (status)) {
+		return false;
+	}
+	if (*response_size < sizeof (pci_tdisp_header_t) ||
+		((pci_tdisp_header_t *) response)->message_type != PCI_TDISP_LOCK_INTERFACE_RSP) {
+		// the caller checks the error response
+		return true;
+	}
+
+	// The report is fixed by the lock parameters. Relocking the interface with
+	// different parameters or in another session makes the cached report stale.
+	const char *bdf = group_context->common.lower_port.port->bdf;
+	if (m_interface_report_cache.valid &&
+		(m_interface_report_cache.session_id != group_context->spdm_doe.session_id ||
+		 strcmp (m_interface_report_cache.bdf, bdf) != 0 ||
+		 m_interface_report_cache.function_id != function_id ||
+		 memcmp (&m_interface_report_cache.lock_interface_param, &lock_interface_param,
+			sizeof (lock_interface_param)) != 0)) {
+		tdisp_test_invalidate_interface_report_cache ();
+	}
+	m_locked_interface.valid = true;
+	m_locked_interface.session_id = group_context->spdm_doe.session_id;
+	strncpy (m_locked_interface.bdf, bdf, sizeof (m_locked_interface.bdf) - 1);
+	m_locked_interface.function_id = function_id;
+	m_locked_interface.lock_interface_param = lock_interface_param;
+
+	return true;
 }
 
 bool tdisp_test_start_interface (void *test_context, uint32_t function_id,
@@ -196,6 +254,9 @@ bool tdisp_test_stop_interface (void *test_context, uint32_t function_id,
 	libspdm_return_t status = pci_tdisp_send_receive_data (group_context->spdm_doe.spdm_context,
 		&group_context->spdm_doe.session_id, &request, request_size, response, response_size);
 
+	// the interface is unlocked. The cached report is kept for the next lock.
+	m_locked_interface.valid = false;
+
 	return LIBSPDM_STATUS_IS_ERROR (status) == false;
 }
 
@@ -209,6 +270,97 @@ static const char *mAssertion[] = {
 };
 
 
+void tdisp_test_invalidate_interface_report_cache ()
+{
+	m_interface_report_cache.valid = false;
+	m_interface_report_cache.report_size = 0;
+	m_locked_interface.valid = false;
+}
+
+/**
+ * Derive the portion length of GET_DEVICE_INTERFACE_REPORT from the DataTransferSize
+ * of the device so that a portion is fetched in one message.
+ */
+static uint16_t tdisp_test_get_report_portion_length (void *spdm_context)
+{
+	libspdm_data_parameter_t parameter;
+	uint32_t data_transfer_size;
+	uint32_t local_data_transfer_size;
+	uint32_t portion_length;
+	size_t data_size;
+
+	libspdm_zero_mem (&parameter, sizeof (parameter));
+	parameter.location = LIBSPDM_DATA_LOCATION_CONNECTION;
+	data_size = sizeof (data_transfer_size);
+	data_transfer_size = 0;
+	if (LIBSPDM_STATUS_IS_ERROR (libspdm_get_data (spdm_context,
+		LIBSPDM_DATA_CAPABILITY_DATA_TRANSFER_SIZE, &parameter, &data_transfer_size, &data_size)) ||
+		data_transfer_size == 0) {
+		// DataTransferSize is not reported before SPDM 1.2
+		return LIBTDISP_INTERFACE_REPORT_PORTION_LEN;
+	}
+
+	parameter.location = LIBSPDM_DATA_LOCATION_LOCAL;
+	data_size = sizeof (local_data_transfer_size);
+	local_data_transfer_size = 0;
+	if (!LIBSPDM_STATUS_IS_ERROR (libspdm_get_data (spdm_context,
+		LIBSPDM_DATA_CAPABILITY_DATA_TRANSFER_SIZE, &parameter, &local_data_transfer_size, &data_size)) &&
+		local_data_transfer_size != 0) {
+		data_transfer_size = LIBSPDM_MIN (data_transfer_size, local_data_transfer_size);
+	}
+
+	if (data_transfer_size <= TDISP_TEST_REPORT_MESSAGE_OVERHEAD + LIBTDISP_INTERFACE_REPORT_PORTION_LEN) {
+		return LIBTDISP_INTERFACE_REPORT_PORTION_LEN;
+	}
+
+	portion_length = data_transfer_size - TDISP_TEST_REPORT_MESSAGE_OVERHEAD;
+	portion_length = LIBSPDM_MIN (portion_length, TDISP_TEST_REPORT_PORTION_MAX_LEN);
+
+	return (uint16_t) portion_length;
+}
+
+bool tdisp_test_get_cached_interface_report (void *test_context, uint32_t function_id,
+	uint8_t *interface_report, uint32_t *interface_report_size)
+{
+	assert_context (test_context);
+
+	ide_common_test_case_context_t *case_context =
+		(ide_common_test_case_context_t*) test_context;
+	pcie_ide_test_group_context_t *group_context =
+		case_context->group_context;
+	const char *bdf = group_context->common.lower_port.port->bdf;
+	uint32_t session_id = group_context->spdm_doe.session_id;
+
+	if (m_interface_report_cache.valid &&
+		(m_interface_report_cache.session_id != session_id ||
+		 (m_locked_interface.valid && m_locked_interface.session_id != session_id))) {
+		tdisp_test_invalidate_interface_report_cache ();
+	}
+
+	if (m_interface_report_cache.valid && m_locked_interface.valid &&
+		strcmp (m_interface_report_cache.bdf, bdf) == 0 &&
+		m_interface_report_cache.function_id == function_id &&
+		strcmp (m_locked_interface.bdf, bdf) == 0 &&
+		m_locked_interface.function_id == function_id &&
+		memcmp (&m_interface_report_cache.lock_interface_param, &m_locked_interface.lock_interface_param,
+			sizeof (pci_tdisp_lock_interface_param_t)) == 0) {
+		if (m_interface_report_cache.report_size > *interface_report_size) {
+			*interface_report_size = m_interface_report_cache.report_size;
+			return false;
+		}
+
+		TEEIO_DEBUG ((TEEIO_DEBUG_INFO, "use cached interface report of %s function %d (0x%x bytes).\n",
+			bdf, function_id, m_interface_report_cache.report_size));
+		libspdm_copy_mem (interface_report, *interface_report_size,
+			m_interface_report_cache.report, m_interface_report_cache.report_size);
+		*interface_report_size = m_interface_report_cache.report_size;
+
+		return true;
+	}
+
+	return tdisp_test_get_interface_report (test_context, function_id, interface_report, interface_report_size);
+}
+
 bool tdisp_test_get_interface_report (void *test_context, uint32_t function_id,
 	uint8_t *interface_report, uint32_t *interface_report_size)
 {
@@ -235,8 +387,12 @@ bool tdisp_test_get_interface_report (void *test_context, uint32_t function_id,
 	uint16_t offset;
 	uint16_t remainder_length;
 	uint32_t total_report_length;
+	uint16_t portion_length;
 	bool res;
 
+	portion_length = tdisp_test_get_report_portion_length (group_context->spdm_doe.spdm_context);
+	TEEIO_DEBUG ((TEEIO_DEBUG_VERBOSE, "interface report portion length: 0x%x\n", portion_length));
+
 	offset = 0;
 	remainder_length = 0;
 	total_report_length = 0;
@@ -246,9 +402,9 @@ bool tdisp_test_get_interface_report (void *test_context, uint32_t function_id,
 		request.header.message_type = PCI_TDISP_GET_DEVICE_INTERFACE_REPORT;
 		request.header.interface_id.function_id = function_id;
 		request.offset = offset;
-		request.length = LIBTDISP_INTERFACE_REPORT_PORTION_LEN;
+		request.length = portion_length;
 		if (request.offset != 0) {
-			request.length = LIBSPDM_MIN (remainder_length, LIBTDISP_INTERFACE_REPORT_PORTION_LEN);
+			request.length = LIBSPDM_MIN (remainder_length, portion_length);
 		}
 
 		request_size = sizeof (request);
@@ -324,5 +480,20 @@ bool tdisp_test_get_interface_report (void *test_context, uint32_t function_id,
 
 	*interface_report_size = total_report_length;
 
+	const char *bdf = group_context->common.lower_port.port->bdf;
+	if (m_locked_interface.valid && m_locked_interface.session_id == group_context->spdm_doe.session_id &&
+		strcmp (m_locked_interface.bdf, bdf) == 0 &&
+		m_locked_interface.function_id == function_id &&
+		total_report_length <= sizeof (m_interface_report_cache.report)) {
+		libspdm_copy_mem (m_interface_report_cache.report, sizeof (m_interface_report_cache.report),
+			interface_report, total_report_length);
+		m_interface_report_cache.report_size = total_report_length;
+		m_interface_report_cache.session_id = m_locked_interface.session_id;
+		strncpy (m_interface_report_cache.bdf, bdf, sizeof (m_interface_report_cache.bdf) - 1);
+		m_interface_report_cache.function_id = function_id;
+		m_interface_report_cache.lock_interface_param = m_locked_interface.lock_interface_param;
+		m_interface_report_cache.valid = true;
+	}
+
 	return true;
 }
@@ -15,7 +15,7 @@ extern pci_tdisp_interface_id_t g_tdisp_interface_id;
 static const char *mAssertion[] = {
 	"TdispMessage.TDI_STATE = 0x%x"
 };
-static bool setup_success = false;
+static TEEIO_THREAD_LOCAL bool setup_success = false;
 
 
 bool tdisp_test_interface_report_2_setup (void *test_context)
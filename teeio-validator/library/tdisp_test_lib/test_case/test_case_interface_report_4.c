@@ -27,7 +27,7 @@ static const char *mAssertion[] = {
 	"TdispMessage.ERROR_CODE = 0x%x",
 	"TdispMessage.TDI_STATE = 0x%x"
 };
-static bool setup_success = false;
+static TEEIO_THREAD_LOCAL bool setup_success = false;
 
 
 bool tdisp_test_interface_report_4_setup (void *test_context)
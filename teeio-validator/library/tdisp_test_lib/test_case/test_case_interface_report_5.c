@@ -17,7 +17,7 @@ static const char *mAssertion[] = {
 	"(REPORT_BYTES.INTERFACE_INFO & 0xFFE0) = 0x%x",
 	"(REPORT_BYTES.MMIO_RANGE[i].RangeAttributes & 0xFFF0) = 0x%x"
 };
-static bool setup_success = false;
+static TEEIO_THREAD_LOCAL bool setup_success = false;
 
 
 bool tdisp_test_interface_report_5_setup (void *test_context)
@@ -106,7 +106,7 @@ void tdisp_test_interface_report_5_run (void *test_context)
 	uint8_t interface_report_buffer[LIBTDISP_INTERFACE_REPORT_MAX_SIZE];
 	uint32_t buffer_size = sizeof (interface_report_buffer);
 
-	if (!tdisp_test_get_interface_report (test_context, g_tdisp_interface_id.function_id,
+	if (!tdisp_test_get_cached_interface_report (test_context, g_tdisp_interface_id.function_id,
 		interface_report_buffer, &buffer_size)) {
 		return;
 	}
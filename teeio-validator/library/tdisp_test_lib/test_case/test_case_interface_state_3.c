@@ -19,7 +19,7 @@ static const char *mAssertion[] = {
 	"TdispMessage.INTERFACE_ID = 0x%x",
 	"TdispMessage.TDI_STATE = 0x%x"
 };
-static bool setup_success = false;
+static TEEIO_THREAD_LOCAL bool setup_success = false;
 
 
 bool tdisp_test_interface_state_3_setup (void *test_context)
@@ -20,8 +20,8 @@ static const char *mAssertion[] = {
 	"TdispMessage.ERROR_CODE = 0x%x",
 	"TdispMessage.TDI_STATE = 0x%x"
 };
-static pci_tdisp_responder_capabilities_t rsp_caps = {0};
-static bool setup_success = false;
+static TEEIO_THREAD_LOCAL pci_tdisp_responder_capabilities_t rsp_caps = {0};
+static TEEIO_THREAD_LOCAL bool setup_success = false;
 
 
 bool tdisp_test_lock_interface_2_setup (void *test_context)
@@ -21,8 +21,8 @@ static const char *mAssertion[] = {
 	"TdispMessage.ERROR_CODE = 0x%x",
 	"TdispMessage.TDI_STATE = 0x%x"
 };
-static pci_tdisp_lock_interface_response_t lock_interface_response = {0};
-static bool setup_success = false;
+static TEEIO_THREAD_LOCAL pci_tdisp_lock_interface_response_t lock_interface_response = {0};
+static TEEIO_THREAD_LOCAL bool setup_success = false;
 
 
 bool tdisp_test_start_interface_3_setup (void *test_context)
@@ -10,11 +10,15 @@
 bool scan_devices (void *context);
 bool init_dev_port (void *context);
 bool init_root_port (void *context);
-void* spdm_client_init ();
+void* spdm_client_init (void *doe_context);
 bool spdm_connect (void *spdm_context, uint32_t *session_id);
 bool spdm_stop (void *spdm_context, uint32_t session_id);
-void close_dev_port (ide_common_test_port_context_t *port, IDE_TEST_TOPOLOGY_TYPE type);
-void close_root_port (void *context);
+bool spdm_session_acquire (const char *bdf, void *doe_context, void **spdm_context, uint32_t *session_id);
+void spdm_session_release (void *spdm_context, uint32_t session_id);
+bool pcie_ide_borrow_topology (void *context);
+void pcie_ide_keep_topology (void *context);
+void pcie_ide_reset_topology (void *context);
+void tdisp_test_invalidate_interface_report_cache ();
 
 /**
  * This function works to setup selective_ide and link_ide
@@ -32,46 +36,49 @@ static bool common_test_group_setup (void *test_context)
 
 	TEEIO_ASSERT (context->common.signature == GROUP_CONTEXT_SIGNATURE);
 
-	// first scan devices
-	if (!scan_devices (test_context)) {
-		return false;
+	// the ports are opened once per suite
+	if (!pcie_ide_borrow_topology (test_context)) {
+		// first scan devices
+		if (!scan_devices (test_context)) {
+			return false;
+		}
+
+		// initialize lower_port
+		ret = init_dev_port (context);
+		if (!ret) {
+			return false;
+		}
+
+		IDE_TEST_TOPOLOGY *top = context->common.top;
+
+		if ((top->connection == IDE_TEST_CONNECT_DIRECT) ||
+			(top->connection == IDE_TEST_CONNECT_SWITCH)) {
+			ret = init_root_port (context);
+		}
+		else if (top->connection == IDE_TEST_CONNECT_P2P) {
+			NOT_IMPLEMENTED ("Open both root_port and upper_port for peer2peer connection.");
+		}
+		else {
+			ret = false;
+		}
+
+		if (!ret) {
+			return false;
+		}
+
+		pcie_ide_keep_topology (test_context);
 	}
 
-	// initialize lower_port
-	ret = init_dev_port (context);
-	if (!ret) {
-		return false;
-	}
-
-	IDE_TEST_TOPOLOGY *top = context->common.top;
-
-	if ((top->connection == IDE_TEST_CONNECT_DIRECT) ||
-		(top->connection == IDE_TEST_CONNECT_SWITCH)) {
-		ret = init_root_port (context);
-	}
-	else if (top->connection == IDE_TEST_CONNECT_P2P) {
-		NOT_IMPLEMENTED ("Open both root_port and upper_port for peer2peer connection.");
-	}
-	else {
-		ret = false;
-	}
-
-	if (!ret) {
-		return false;
-	}
-
-	// init spdm_context
-	void *spdm_context = spdm_client_init ();
-
-	TEEIO_ASSERT (spdm_context != NULL);
-
+	// acquire spdm_context and spdm_session
+	void *spdm_context = NULL;
 	uint32_t session_id = 0;
 
-	ret = spdm_connect (spdm_context, &session_id);
+	ret = spdm_session_acquire (context->common.lower_port.port->bdf, context->common.lower_port.doe_context, &spdm_context, &session_id);
 	TEEIO_ASSERT (ret);
 
 	context->spdm_doe.spdm_context = spdm_context;
 	context->spdm_doe.session_id = session_id;
+	context->spdm_doe.doe_context = context->common.lower_port.doe_context;
 
 	return true;
 }
@@ -82,28 +89,26 @@ static bool common_test_group_teardown (void *test_context)
 
 	TEEIO_ASSERT (context->common.signature == GROUP_CONTEXT_SIGNATURE);
 
-	// close spdm_session and free spdm_context
+	// the interface report and the lock state belong to the session released below
+	tdisp_test_invalidate_interface_report_cache ();
+
+	// release spdm_session and spdm_context
 	if (context->spdm_doe.spdm_context != NULL) {
-		spdm_stop (context->spdm_doe.spdm_context, context->spdm_doe.session_id);
-		free (context->spdm_doe.spdm_context);
+		spdm_session_release (context->spdm_doe.spdm_context, context->spdm_doe.session_id);
 		context->spdm_doe.spdm_context = NULL;
 		context->spdm_doe.session_id = 0;
 	}
 
 	IDE_TEST_TOPOLOGY *top = context->common.top;
 
-	// close ports
-	close_dev_port (&context->common.lower_port, top->type);
-
-	if ((top->connection == IDE_TEST_CONNECT_DIRECT) ||
-		(top->connection == IDE_TEST_CONNECT_SWITCH)) {
-		close_root_port (context);
-	}
-	else if (top->connection == IDE_TEST_CONNECT_P2P) {
+	if (top->connection == IDE_TEST_CONNECT_P2P) {
 		// close both root_port and upper_port
 		NOT_IMPLEMENTED ("Close both root_port and upper_port for peer2peer connection.");
 	}
 
+	// the ports are closed when the suite is done
+	pcie_ide_reset_topology (test_context);
+
 	return true;
 }
 
@@ -41,6 +41,7 @@ extern bool g_run_test_suite;
 extern bool g_teeio_fixed_key;
 extern int g_test_interval;
 extern int g_test_rounds;
+extern int g_keyrefresh_interval_us;
 
 void print_usage()
 {
@@ -60,6 +61,7 @@ void print_usage()
   TEEIO_PRINT(("  -b <scan_bus>       : Bus number in hex format. For example 0x1a\n"));
   TEEIO_PRINT(("  -e <test_interval>  : test interval of 2 rounds.\n"));
   TEEIO_PRINT(("  -n <test_rounds>    : test rounds of a case.\n"));
+  TEEIO_PRINT(("  -r <interval_us>    : benchmark KeyRefresh. -n rounds are run every <interval_us> microseconds. 0 means back-to-back.\n"));
   TEEIO_PRINT(("  -k                  : Use fixed IDE Key for debug purpose.\n"));
   TEEIO_PRINT(("  -h                  : Display this usage\n"));
 }
@@ -93,7 +95,7 @@ bool parse_cmdline_option(int argc, char *argv[], char* file_name, IDE_TEST_CONF
   }
   TEEIO_PRINT(("%s\n", buf));
 
-  while ((opt = getopt(argc, argv, "f:t:c:s:l:g:b:n:e:kh")) != -1) {
+  while ((opt = getopt(argc, argv, "f:t:c:s:l:g:b:n:e:r:kh")) != -1) {
       switch (opt) {
           case 'f':
               if(!validate_file_name(optarg)) {
@@ -168,6 +170,15 @@ bool parse_cmdline_option(int argc, char *argv[], char* file_name, IDE_TEST_CONF
             g_test_interval = v;
             break;
 
+        case 'r':
+            v = atoi(optarg);
+            if(v < 0 || !IsValidDigital((uint8_t *)optarg, strlen(optarg), false)) {
+              TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Invalid -r parameter %s\n", optarg));
+              return false;
+            }
+            g_keyrefresh_interval_us = v;
+            break;
+
         case 'k':
             g_teeio_fixed_key = true;
             break;
@@ -181,5 +192,10 @@ bool parse_cmdline_option(int argc, char *argv[], char* file_name, IDE_TEST_CONF
       }  
   }
 
+  if(g_keyrefresh_interval_us >= 0 && g_test_rounds == 0) {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "-r shall be used with -n.\n"));
+    return false;
+  }
+
   return true;
 }
@@ -8,8 +8,10 @@
 
 #include <stdlib.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "helperlib.h"
 #include "ide_test.h"
+#include "pcie_ide_lib.h"
 #include "pcie_ide_test_lib.h"
 #include "cxl_ide_test_lib.h"
 #include "cxl_tsp_test_lib.h"
@@ -38,11 +40,20 @@ const char* m_config_item_operation_str[] = {
   "support", "enable", "disable", "check"
 };
 
-ide_run_test_config_result_t* g_current_config_result = NULL;
-ide_run_test_group_result_t* g_current_group_result = NULL;
-ide_run_test_case_result_t* g_current_case_result = NULL;
+// names of teeio_test_case_phase_t and the total
+const char* m_test_case_phase_str[] = {
+  "support", "enable", "setup", "run", "check", "teardown", "disable", "total"
+};
+
+TEEIO_THREAD_LOCAL ide_run_test_config_result_t* g_current_config_result = NULL;
+TEEIO_THREAD_LOCAL ide_run_test_group_result_t* g_current_group_result = NULL;
+TEEIO_THREAD_LOCAL ide_run_test_case_result_t* g_current_case_result = NULL;
+TEEIO_THREAD_LOCAL teeio_result_store_t* g_current_result_store = NULL;
 
 extern const char *TEEIO_TEST_CATEGORY_NAMES[];
+extern bool g_pci_log;
+extern uint32_t g_parallel_topology;
+void spdm_session_pool_close();
 teeio_test_funcs_t m_teeio_test_funcs[TEEIO_TEST_CATEGORY_MAX] = {
   // PCIE-IDE
   { 0 },
@@ -68,6 +79,7 @@ void teeio_init_test_funcs()
 void teeio_clean_test_libs()
 {
   spdm_test_lib_clean();
+  spdm_session_pool_close();
 }
 
 void append_config_item(ide_run_test_config_item_t **head, ide_run_test_config_item_t* new)
@@ -476,6 +488,7 @@ bool alloc_run_test_case(TEEIO_TEST_CATEGORY test_category, ide_run_test_group_t
   run_test_case->setup_func = case_funcs->setup;
   run_test_case->teardown_func = case_funcs->teardown;
   run_test_case->config_check_required = case_funcs->config_check_required;
+  run_test_case->config_readonly = case_funcs->config_readonly;
 
   ide_common_test_case_context_t* context = (ide_common_test_case_context_t *)malloc(sizeof(ide_common_test_case_context_t));
   TEEIO_ASSERT(context);
@@ -554,6 +567,7 @@ ide_run_test_suite_t *prepare_tests_data(IDE_TEST_CONFIG *test_config)
 
     run_test_suite = alloc_run_test_suite(suite, test_config);
     TEEIO_ASSERT(run_test_suite);
+    run_test_suite->topology = top;
 
     bool ret = alloc_run_test_config(run_test_suite, test_config, suite->topology_id, suite->configuration_id);
     TEEIO_ASSERT(ret);
@@ -580,27 +594,28 @@ ide_run_test_suite_t *prepare_tests_data(IDE_TEST_CONFIG *test_config)
   return run_test_suite_header;
 }
 
-ide_run_test_case_result_t *alloc_run_test_case_result(ide_run_test_group_result_t* group_result, ide_run_test_case_t *test_case)
+static void init_run_test_case_result(ide_run_test_case_result_t *case_result, ide_run_test_case_t *test_case)
 {
-  ide_run_test_case_result_t *case_result = (ide_run_test_case_result_t *)malloc(sizeof(ide_run_test_case_result_t));
-  TEEIO_ASSERT(case_result);
-  memset(case_result, 0, sizeof(ide_run_test_case_result_t));
-
   strncpy(case_result->name, test_case->name, MAX_NAME_LENGTH);
   strncpy(case_result->class, test_case->class, MAX_NAME_LENGTH);
 
   case_result->case_id = test_case->case_id;
   case_result->class_id = test_case->class_id;
+}
+
+ide_run_test_case_result_t *alloc_run_test_case_result(ide_run_test_group_result_t* group_result, ide_run_test_case_t *test_case)
+{
+  ide_run_test_case_result_t *case_result = (ide_run_test_case_result_t *)teeio_result_store_alloc(g_current_result_store, sizeof(ide_run_test_case_result_t));
+  TEEIO_ASSERT(case_result);
+
+  init_run_test_case_result(case_result, test_case);
 
-  ide_run_test_case_result_t* itr = group_result->case_result;
-  if(itr == NULL) {
+  if(group_result->case_result_tail == NULL) {
     group_result->case_result = case_result;
   } else {
-    while(itr->next) {
-      itr = itr->next;
-    }
-    itr->next = case_result;
+    group_result->case_result_tail->next = case_result;
   }
+  group_result->case_result_tail = case_result;
 
   return case_result;
 }
@@ -665,11 +680,35 @@ static bool do_run_test_config_check(ide_run_test_config_t *run_test_config, IDE
   return ret;
 }
 
-bool do_run_test_case(ide_run_test_case_t *test_case, ide_run_test_config_t *run_test_config, TEEIO_TEST_CATEGORY test_category, IDE_TEST_TOPOLOGY_TYPE top_type)
+// state of the config shared by the test cases of a test group
+typedef struct {
+  // support is evaluated once per config per group
+  bool support_checked;
+  bool supported;
+  // the config is enabled and kept for the next case
+  bool enabled;
+} ide_run_test_config_state_t;
+
+// add the time since *phase_start_ns to the phase and start the next phase
+static void record_test_case_phase(ide_run_test_case_result_t *case_result, teeio_test_case_phase_t phase, uint64_t *phase_start_ns)
+{
+  uint64_t now_ns = get_monotonic_time_ns();
+
+  if(case_result != NULL) {
+    case_result->phase_ns[phase] += now_ns - *phase_start_ns;
+  }
+  *phase_start_ns = now_ns;
+}
+
+bool do_run_test_case(ide_run_test_case_t *test_case, ide_run_test_config_t *run_test_config, ide_run_test_case_result_t *case_result, TEEIO_TEST_CATEGORY test_category, IDE_TEST_TOPOLOGY_TYPE top_type, ide_run_test_config_state_t *config_state)
 {
   ide_common_test_case_context_t *case_context = (ide_common_test_case_context_t *)test_case->test_context;
   TEEIO_ASSERT(case_context->signature == CASE_CONTEXT_SIGNATURE);
   teeio_spdm_test_context_t m_spdm_test_context = {0};
+  uint64_t start_ns = get_monotonic_time_ns();
+  uint64_t phase_start_ns = start_ns;
+  bool ret;
+  bool keep_config = false;
 
   void *context = case_context;
   if(test_category == TEEIO_TEST_CATEGORY_SPDM) {
@@ -685,20 +724,34 @@ bool do_run_test_case(ide_run_test_case_t *test_case, ide_run_test_config_t *run
     return true;
   }
 
-  // check if the test_config is supported.
-  if(!do_run_test_config_support(run_test_config, top_type, test_category)) {
+  // check if the test_config is supported. It is checked once in a group.
+  if(!config_state->support_checked) {
+    config_state->supported = do_run_test_config_support(run_test_config, top_type, test_category);
+    config_state->support_checked = true;
+    record_test_case_phase(case_result, TEEIO_TEST_CASE_PHASE_CONFIG_SUPPORT, &phase_start_ns);
+  }
+  if(!config_state->supported) {
     TEEIO_DEBUG((TEEIO_DEBUG_INFO, "%s is not supported.\n", run_test_config->name));
-    return true;
+    goto CaseDone;
   }
 
-  // call test_config's enable function
-  if(!do_run_test_config_enable(run_test_config, top_type, test_category)) {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "run_test_config_enable failed. %s skipped.\n", test_case->name));
-    return true;
+  // call test_config's enable function unless the previous case kept it enabled
+  if(!config_state->enabled) {
+    ret = do_run_test_config_enable(run_test_config, top_type, test_category);
+    record_test_case_phase(case_result, TEEIO_TEST_CASE_PHASE_CONFIG_ENABLE, &phase_start_ns);
+    if(!ret) {
+      TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "run_test_config_enable failed. %s skipped.\n", test_case->name));
+      goto CaseDone;
+    }
+    config_state->enabled = true;
+  } else {
+    TEEIO_DEBUG((TEEIO_DEBUG_INFO, "%s is kept enabled for %s.\n", run_test_config->name, test_case->name));
   }
 
   if(test_case->setup_func != NULL) {
-    if(!test_case->setup_func(context)) {
+    ret = test_case->setup_func(context);
+    record_test_case_phase(case_result, TEEIO_TEST_CASE_PHASE_SETUP, &phase_start_ns);
+    if(!ret) {
       TEEIO_DEBUG((TEEIO_DEBUG_INFO, "%s setup failed. So skipped.\n", test_case->name));
       case_context->action = IDE_COMMON_TEST_ACTION_SKIP;
       goto TestCaseDone;
@@ -715,20 +768,43 @@ bool do_run_test_case(ide_run_test_case_t *test_case, ide_run_test_config_t *run
 
   if(test_case->run_func != NULL) {
     test_case->run_func(context);
+    record_test_case_phase(case_result, TEEIO_TEST_CASE_PHASE_RUN, &phase_start_ns);
   }
 
+  // A readonly case which got here passed its setup, so it keeps the config enabled for
+  // the next case unless its check fails. The check is only run if the case requires it.
+  keep_config = test_case->config_readonly;
   if(test_case->config_check_required) {
     // check config
-    do_run_test_config_check(run_test_config, top_type, test_category);
+    ret = do_run_test_config_check(run_test_config, top_type, test_category);
+    record_test_case_phase(case_result, TEEIO_TEST_CASE_PHASE_CONFIG_CHECK, &phase_start_ns);
+    keep_config = keep_config && ret;
   }
 
 TestCaseDone:
 
+  phase_start_ns = get_monotonic_time_ns();
   if(test_case->teardown_func != NULL) {
     test_case->teardown_func(context);
+    record_test_case_phase(case_result, TEEIO_TEST_CASE_PHASE_TEARDOWN, &phase_start_ns);
+  }
+
+  if(!keep_config) {
+    do_run_test_config_disable(run_test_config, top_type, test_category);
+    record_test_case_phase(case_result, TEEIO_TEST_CASE_PHASE_CONFIG_DISABLE, &phase_start_ns);
+    config_state->enabled = false;
   }
 
-  do_run_test_config_disable(run_test_config, top_type, test_category);
+CaseDone:
+  if(case_result != NULL) {
+    case_result->total_ns = get_monotonic_time_ns() - start_ns;
+  }
+  if(case_result != NULL && g_current_config_result != NULL) {
+    g_current_config_result->func_ns[TEEIO_TEST_CONFIG_FUNC_SUPPORT] += case_result->phase_ns[TEEIO_TEST_CASE_PHASE_CONFIG_SUPPORT];
+    g_current_config_result->func_ns[TEEIO_TEST_CONFIG_FUNC_ENABLE] += case_result->phase_ns[TEEIO_TEST_CASE_PHASE_CONFIG_ENABLE];
+    g_current_config_result->func_ns[TEEIO_TEST_CONFIG_FUNC_DISABLE] += case_result->phase_ns[TEEIO_TEST_CASE_PHASE_CONFIG_DISABLE];
+    g_current_config_result->func_ns[TEEIO_TEST_CONFIG_FUNC_CHECK] += case_result->phase_ns[TEEIO_TEST_CASE_PHASE_CONFIG_CHECK];
+  }
 
   return true;
 }
@@ -755,6 +831,12 @@ bool do_run_test_group(ide_run_test_group_t *run_test_group, ide_run_test_config
 
   TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Run TestGroup (%s %s %s)\n", run_test_group->name, run_test_config->name, run_test_group->test_case->class));
 
+  uint64_t start_ns = get_monotonic_time_ns();
+  uint64_t func_start_ns;
+  ide_run_test_config_state_t config_state = {0};
+  const teeio_result_sink_t *result_sink = get_result_sink();
+  ide_run_test_case_result_t streamed_case_result;
+
   // call run_test_group's setup function
   bool group_setup_result = true;
   TEEIO_ASSERT(run_test_group->setup_func);
@@ -762,16 +844,28 @@ bool do_run_test_group(ide_run_test_group_t *run_test_group, ide_run_test_config
     TEEIO_DEBUG((TEEIO_DEBUG_INFO, "%s failed at test_group->setup().\n", run_test_config->name));
     group_setup_result = false;
   }
+  group_result->func_results[TEEIO_TEST_GROUP_FUNC_SETUP].elapsed_ns = get_monotonic_time_ns() - start_ns;
 
   ide_run_test_case_t *test_case = run_test_group->test_case;
   while (test_case != NULL)
   {
-    // alloc case_result
-    g_current_case_result = alloc_run_test_case_result(group_result, test_case);
+    if(result_sink != NULL) {
+      // the case result is streamed to the sink and not kept
+      memset(&streamed_case_result, 0, sizeof(streamed_case_result));
+      init_run_test_case_result(&streamed_case_result, test_case);
+      g_current_case_result = &streamed_case_result;
+    } else {
+      // alloc case_result
+      g_current_case_result = alloc_run_test_case_result(group_result, test_case);
+    }
 
     // run the test_case
     if(group_setup_result) {
-      do_run_test_case(test_case, run_test_config, test_category, top_type);
+      do_run_test_case(test_case, run_test_config, g_current_case_result, test_category, top_type, &config_state);
+    }
+
+    if(result_sink != NULL) {
+      result_sink->record_case(g_current_config_result, group_result, g_current_case_result);
     }
 
     // next case
@@ -779,9 +873,27 @@ bool do_run_test_group(ide_run_test_group_t *run_test_group, ide_run_test_config
     g_current_case_result = NULL;
   }
 
+  // disable the config kept enabled by the last case
+  if(config_state.enabled) {
+    func_start_ns = get_monotonic_time_ns();
+    do_run_test_config_disable(run_test_config, top_type, test_category);
+    if(g_current_config_result != NULL) {
+      g_current_config_result->func_ns[TEEIO_TEST_CONFIG_FUNC_DISABLE] += get_monotonic_time_ns() - func_start_ns;
+    }
+    config_state.enabled = false;
+  }
+
   // call run_test_group's teardown function
   if(group_setup_result) {
+    func_start_ns = get_monotonic_time_ns();
     run_test_group->teardown_func(group_context);
+    group_result->func_results[TEEIO_TEST_GROUP_FUNC_TEARDOWN].elapsed_ns = get_monotonic_time_ns() - func_start_ns;
+  }
+  group_result->total_ns = get_monotonic_time_ns() - start_ns;
+
+  // render the pci register trace recorded in this test group
+  if(g_pci_log) {
+    pci_trace_dump();
   }
 
   // config_context is reused between different run_group_test
@@ -793,20 +905,16 @@ bool do_run_test_group(ide_run_test_group_t *run_test_group, ide_run_test_config
 
 ide_run_test_group_result_t* alloc_run_test_group_result(ide_run_test_group_t *run_test_group, ide_run_test_config_result_t* config_result)
 {
-  ide_run_test_group_result_t* group_result = (ide_run_test_group_result_t *)malloc(sizeof(ide_run_test_group_result_t));
+  ide_run_test_group_result_t* group_result = (ide_run_test_group_result_t *)teeio_result_store_alloc(g_current_result_store, sizeof(ide_run_test_group_result_t));
   TEEIO_ASSERT(group_result);
-  memset(group_result, 0, sizeof(ide_run_test_group_result_t));
   strncpy(group_result->name, run_test_group->name, MAX_NAME_LENGTH);
 
-  ide_run_test_group_result_t* itr = config_result->group_result;
-  if(itr == NULL) {
+  if(config_result->group_result_tail == NULL) {
     config_result->group_result = group_result;
   } else {
-    while(itr->next) {
-      itr = itr->next;
-    }
-    itr->next = group_result;
+    config_result->group_result_tail->next = group_result;
   }
+  config_result->group_result_tail = group_result;
 
   return group_result;
 }
@@ -817,27 +925,23 @@ bool append_config_result(ide_run_test_suite_t* run_test_suite, ide_run_test_con
   ide_common_test_suite_context_t* suite_context = (ide_common_test_suite_context_t*)run_test_suite->test_context;
   TEEIO_ASSERT(suite_context->signature == SUITE_CONTEXT_SIGNATURE);
 
-  if(suite_context->result == NULL) {
+  if(suite_context->result_tail == NULL) {
     suite_context->result = config_result;
-    return true;
-  }
-
-  ide_run_test_config_result_t* itr = suite_context->result;
-  while(itr->next) {
-    itr = itr->next;
+  } else {
+    suite_context->result_tail->next = config_result;
   }
-  itr->next = config_result;
+  suite_context->result_tail = config_result;
 
   return true;
 }
 
 ide_run_test_config_result_t* alloc_run_test_config_result(ide_run_test_suite_t* run_test_suite, ide_run_test_config_t* run_test_config)
 {
-  ide_run_test_config_result_t* config_result = (ide_run_test_config_result_t*)malloc(sizeof(ide_run_test_config_result_t));
+  ide_run_test_config_result_t* config_result = (ide_run_test_config_result_t*)teeio_result_store_alloc(g_current_result_store, sizeof(ide_run_test_config_result_t));
   TEEIO_ASSERT(config_result);
-  memset(config_result, 0, sizeof(ide_run_test_config_result_t));
 
   config_result->config_id = run_test_config->config_id;
+  config_result->suite_name = run_test_suite->name;
   strncpy(config_result->name, run_test_config->name, MAX_NAME_LENGTH);
 
   append_config_result(run_test_suite, config_result);
@@ -858,25 +962,50 @@ bool do_run_test_suite(ide_run_test_suite_t *run_test_suite)
 
     TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Run %s\n", run_test_suite->name));
 
+    if(suite_context->result_store == NULL) {
+      suite_context->result_store = teeio_result_store_create();
+      TEEIO_ASSERT(suite_context->result_store);
+    }
+    g_current_result_store = suite_context->result_store;
+
+    // With a result sink only the config results are kept. The groups and cases are streamed.
+    ide_run_test_group_result_t streamed_group_result;
+    bool streamed = get_result_sink() != NULL;
+
     while(run_test_config != NULL) {
       TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Run Configuration_%d\n", run_test_config->config_id));
       g_current_config_result = alloc_run_test_config_result(run_test_suite, run_test_config);
+      uint64_t config_start_ns = get_monotonic_time_ns();
 
       while (run_test_group != NULL)
       {
-        // alloc group_result
-        g_current_group_result = alloc_run_test_group_result(run_test_group, g_current_config_result);
-        TEEIO_ASSERT(g_current_group_result);
+        if(streamed) {
+          memset(&streamed_group_result, 0, sizeof(streamed_group_result));
+          strncpy(streamed_group_result.name, run_test_group->name, MAX_NAME_LENGTH);
+          g_current_group_result = &streamed_group_result;
+        } else {
+          // alloc group_result
+          g_current_group_result = alloc_run_test_group_result(run_test_group, g_current_config_result);
+          TEEIO_ASSERT(g_current_group_result);
+        }
 
         do_run_test_group(run_test_group, run_test_config, g_current_group_result, suite_context->test_category);
 
         run_test_group = run_test_group->next;
         g_current_group_result = NULL;
       }
+      g_current_config_result->total_ns = get_monotonic_time_ns() - config_start_ns;
 
       run_test_config = run_test_config->next;
       g_current_config_result = NULL;
     }
+    g_current_result_store = NULL;
+
+    // close the ports shared by the test groups of the suite
+    if(suite_context->topology.close_func != NULL) {
+      suite_context->topology.close_func(suite_context->topology.group_context);
+    }
+    memset(&suite_context->topology, 0, sizeof(suite_context->topology));
 
     TEEIO_PRINT(("\n"));
 
@@ -905,16 +1034,19 @@ bool test_suite_cases_statics(ide_run_test_suite_t *run_test_suite, int *passed,
 
 bool print_test_case_assertion_result(ide_run_test_case_assertion_result_t* assertion_result)
 {
+  char message[MAX_LINE_LENGTH];
+
   while(assertion_result) {
+    teeio_render_assertion_message(assertion_result, message, sizeof(message));
     if(assertion_result->type == IDE_COMMON_TEST_CASE_ASSERTION_TYPE_TEST) {
       TEEIO_PRINT(("           Assertion%d.%d.%d: - %s %s\n", 
         assertion_result->class_id + 1,
         assertion_result->case_id,
         assertion_result->assertion_id,
         m_assertion_result_str[assertion_result->result],
-        assertion_result->extra_data));
+        message));
     } else if(assertion_result->type == IDE_COMMON_TEST_CASE_ASSERTION_TYPE_SEPARATOR) {
-      TEEIO_PRINT(("       %s\n", assertion_result->extra_data));
+      TEEIO_PRINT(("       %s\n", message));
     }
 
     assertion_result = assertion_result->next;
@@ -960,6 +1092,114 @@ bool print_test_config_item_result(TEEIO_TEST_CATEGORY test_category, ide_run_te
   return true;
 }
 
+void print_test_case_timing(ide_run_test_case_result_t *case_result)
+{
+  char buffer[MAX_LINE_LENGTH] = {0};
+  int pos = 0;
+
+  for(int i = 0; i < TEEIO_TEST_CASE_PHASE_MAX; i++) {
+    if(case_result->phase_ns[i] == 0) {
+      continue;
+    }
+    pos += snprintf(buffer + pos, sizeof(buffer) - pos, "%s %llu, ", m_test_case_phase_str[i],
+                    (unsigned long long)(case_result->phase_ns[i] / 1000));
+  }
+  TEEIO_PRINT(("           Timing(us): %stotal %llu\n", buffer, (unsigned long long)(case_result->total_ns / 1000)));
+}
+
+// timing samples of the test cases of a case class. The last phase is the total.
+typedef struct {
+  const char *class;
+  int cnt[TEEIO_TEST_CASE_PHASE_MAX + 1];
+  int capacity[TEEIO_TEST_CASE_PHASE_MAX + 1];
+  uint64_t *samples[TEEIO_TEST_CASE_PHASE_MAX + 1];
+} teeio_case_class_timing_t;
+
+#define MAX_CASE_CLASS_TIMING_NUM 64
+
+static void add_timing_sample(teeio_case_class_timing_t *timing, int phase, uint64_t sample)
+{
+  if(timing->cnt[phase] == timing->capacity[phase]) {
+    int capacity = timing->capacity[phase] == 0 ? 16 : timing->capacity[phase] * 2;
+    uint64_t *samples = (uint64_t *)realloc(timing->samples[phase], capacity * sizeof(uint64_t));
+    if(samples == NULL) {
+      return;
+    }
+    timing->samples[phase] = samples;
+    timing->capacity[phase] = capacity;
+  }
+  timing->samples[phase][timing->cnt[phase]++] = sample;
+}
+
+/**
+ * Print p50/p95/max of each phase per case class, aggregated over all the test suites.
+ */
+void print_test_case_class_timing(ide_run_test_suite_t *run_test_suite)
+{
+  teeio_case_class_timing_t timings[MAX_CASE_CLASS_TIMING_NUM];
+  int timing_cnt = 0;
+  int i, phase;
+
+  memset(timings, 0, sizeof(timings));
+
+  for(ide_run_test_suite_t *test_suite = run_test_suite; test_suite != NULL; test_suite = test_suite->next) {
+    ide_common_test_suite_context_t *suite_context = (ide_common_test_suite_context_t *)test_suite->test_context;
+    for(ide_run_test_config_result_t *config_result = suite_context->result; config_result != NULL; config_result = config_result->next) {
+      for(ide_run_test_group_result_t *group_result = config_result->group_result; group_result != NULL; group_result = group_result->next) {
+        for(ide_run_test_case_result_t *case_result = group_result->case_result; case_result != NULL; case_result = case_result->next) {
+          if(case_result->total_ns == 0) {
+            continue;
+          }
+
+          for(i = 0; i < timing_cnt; i++) {
+            if(strcmp(timings[i].class, case_result->class) == 0) {
+              break;
+            }
+          }
+          if(i == timing_cnt) {
+            if(timing_cnt == MAX_CASE_CLASS_TIMING_NUM) {
+              continue;
+            }
+            timings[timing_cnt++].class = case_result->class;
+          }
+
+          for(phase = 0; phase < TEEIO_TEST_CASE_PHASE_MAX; phase++) {
+            if(case_result->phase_ns[phase] != 0) {
+              add_timing_sample(timings + i, phase, case_result->phase_ns[phase]);
+            }
+          }
+          add_timing_sample(timings + i, TEEIO_TEST_CASE_PHASE_MAX, case_result->total_ns);
+        }
+      }
+    }
+  }
+
+  if(timing_cnt == 0) {
+    return;
+  }
+
+  TEEIO_PRINT((" Timing per case class (us, p50/p95/max).\n"));
+  for(i = 0; i < timing_cnt; i++) {
+    TEEIO_PRINT(("   %s (%d cases)\n", timings[i].class, timings[i].cnt[TEEIO_TEST_CASE_PHASE_MAX]));
+    for(phase = 0; phase <= TEEIO_TEST_CASE_PHASE_MAX; phase++) {
+      int cnt = timings[i].cnt[phase];
+      uint64_t *samples = timings[i].samples[phase];
+      if(cnt == 0) {
+        continue;
+      }
+      sort_uint64_array(samples, cnt);
+      TEEIO_PRINT(("     %-10s %10llu %10llu %10llu\n", m_test_case_phase_str[phase],
+                  (unsigned long long)(get_percentile_of_sorted_uint64_array(samples, cnt, 50) / 1000),
+                  (unsigned long long)(get_percentile_of_sorted_uint64_array(samples, cnt, 95) / 1000),
+                  (unsigned long long)(samples[cnt - 1] / 1000)));
+    }
+    for(phase = 0; phase <= TEEIO_TEST_CASE_PHASE_MAX; phase++) {
+      free(timings[i].samples[phase]);
+    }
+  }
+  TEEIO_PRINT(("\n"));
+}
+
 bool print_test_results(ide_run_test_suite_t *run_test_suite, bool detail)
 {
   ide_run_test_suite_t* test_suite = run_test_suite;
@@ -969,6 +1209,9 @@ bool print_test_results(ide_run_test_suite_t *run_test_suite, bool detail)
   } else {
     TEEIO_PRINT((" Print summary results.\n"));
   }
+  if(get_result_sink() != NULL) {
+    TEEIO_PRINT((" The test groups and cases are streamed to the result sink (%s). Only the configurations are printed.\n", get_result_sink()->name));
+  }
 
   int passed, failed;
   teeio_test_result_t test_result = TEEIO_TEST_RESULT_NOT_TESTED;
@@ -990,6 +1233,14 @@ bool print_test_results(ide_run_test_suite_t *run_test_suite, bool detail)
     while(run_test_config_result) {
 
       TEEIO_PRINT(("   Configuration_%d (%s)\n", run_test_config_result->config_id, run_test_config_result->name));
+      if(detail) {
+        TEEIO_PRINT(("   Timing(us): %s %llu, %s %llu, %s %llu, %s %llu, total %llu\n",
+                    m_config_item_operation_str[TEEIO_TEST_CONFIG_FUNC_SUPPORT], (unsigned long long)(run_test_config_result->func_ns[TEEIO_TEST_CONFIG_FUNC_SUPPORT] / 1000),
+                    m_config_item_operation_str[TEEIO_TEST_CONFIG_FUNC_ENABLE], (unsigned long long)(run_test_config_result->func_ns[TEEIO_TEST_CONFIG_FUNC_ENABLE] / 1000),
+                    m_config_item_operation_str[TEEIO_TEST_CONFIG_FUNC_DISABLE], (unsigned long long)(run_test_config_result->func_ns[TEEIO_TEST_CONFIG_FUNC_DISABLE] / 1000),
+                    m_config_item_operation_str[TEEIO_TEST_CONFIG_FUNC_CHECK], (unsigned long long)(run_test_config_result->func_ns[TEEIO_TEST_CONFIG_FUNC_CHECK] / 1000),
+                    (unsigned long long)(run_test_config_result->total_ns / 1000)));
+      }
 
       ide_run_test_group_result_t * group_result = run_test_config_result->group_result;
       while(group_result) {
@@ -998,9 +1249,10 @@ bool print_test_results(ide_run_test_suite_t *run_test_suite, bool detail)
         const char* case_class = case_result->class;
 
         if(detail) {
-          TEEIO_PRINT(("     TestGroup (%s) - setup %s %s\n", 
+          TEEIO_PRINT(("     TestGroup (%s) - setup %s (%lluus) %s\n", 
                       case_class,
                       m_test_case_result_str[group_result->func_results[TEEIO_TEST_GROUP_FUNC_SETUP].result],
+                      (unsigned long long)(group_result->func_results[TEEIO_TEST_GROUP_FUNC_SETUP].elapsed_ns / 1000),
                       group_result->func_results[TEEIO_TEST_GROUP_FUNC_SETUP].extra_data));
         } else {
           TEEIO_PRINT(("     TestGroup (%s) - pass: %d, fail: %d\n",
@@ -1020,6 +1272,7 @@ bool print_test_results(ide_run_test_suite_t *run_test_suite, bool detail)
           if(detail) {
             TEEIO_PRINT(("       TestCase %s: %s\n", case_result->name, m_test_case_result_str[test_result]));
             print_test_case_assertion_result(case_result->assertion_result);
+            print_test_case_timing(case_result);
             TEEIO_PRINT(("\n"));
           } else {
             TEEIO_PRINT(("       TestCase %s: %s (pass: %d, fail: %d)\n", case_result->name, m_test_case_result_str[test_result], case_result->total_passed, case_result->total_failed));
@@ -1028,8 +1281,10 @@ bool print_test_results(ide_run_test_suite_t *run_test_suite, bool detail)
         }
   
         if(detail) {
-          TEEIO_PRINT(("     TestGroup (%s) - teardown %s\n",
-                    case_class, m_test_case_result_str[group_result->func_results[TEEIO_TEST_GROUP_FUNC_TEARDOWN].result]));
+          TEEIO_PRINT(("     TestGroup (%s) - teardown %s (%lluus), total %lluus\n",
+                    case_class, m_test_case_result_str[group_result->func_results[TEEIO_TEST_GROUP_FUNC_TEARDOWN].result],
+                    (unsigned long long)(group_result->func_results[TEEIO_TEST_GROUP_FUNC_TEARDOWN].elapsed_ns / 1000),
+                    (unsigned long long)(group_result->total_ns / 1000)));
         }
 
         group_result = group_result->next;
@@ -1043,6 +1298,10 @@ bool print_test_results(ide_run_test_suite_t *run_test_suite, bool detail)
     test_suite = test_suite->next;
   }
 
+  if(!detail) {
+    print_test_case_class_timing(run_test_suite);
+  }
+
   return true;
 }
 
@@ -1086,65 +1345,6 @@ bool clean_test_groups(ide_run_test_group_t *group)
   return true;
 }
 
-bool clean_test_case_assertion_result(ide_run_test_case_assertion_result_t *result)
-{
-  ide_run_test_case_assertion_result_t *ptr = NULL;
-  while(result) {
-    ptr = result;
-    result = result->next;
-    free(ptr);
-  }
-
-  return true;
-}
-
-bool clean_test_config_item_result(ide_run_test_config_item_result_t *result)
-{
-  ide_run_test_config_item_result_t *ptr = NULL;
-  while(result) {
-    ptr = result;
-    result = result->next;
-    free(ptr);
-  }
-
-  return true;
-}
-
-bool clean_test_case_result(ide_run_test_case_result_t *case_result)
-{
-  ide_run_test_case_result_t *ptr = NULL;
-  while (case_result)
-  {
-    clean_test_case_assertion_result(case_result->assertion_result);
-    clean_test_config_item_result(case_result->config_item_result);
-
-    ptr = case_result;
-    case_result = case_result->next;
-    free(ptr);
-  }  
-
-  return true;
-}
-
-bool clean_test_group_results(ide_run_test_group_result_t *group_result)
-{
-  if(group_result == NULL) {
-    return true;
-  }
-  ide_run_test_group_result_t *ptr = NULL;
-
-  while (group_result)
-  {
-    clean_test_case_result(group_result->case_result);
-
-    ptr = group_result;
-    group_result = group_result->next;
-    free(ptr);
-  }
-  
-  return true;
-}
-
 bool clean_test_config_items(ide_run_test_config_item_t *config_item)
 {
   if(config_item == NULL) {
@@ -1190,17 +1390,8 @@ bool clean_suite_context(void *context)
   ide_common_test_suite_context_t* suite_context = (ide_common_test_suite_context_t*)context;
   TEEIO_ASSERT(suite_context->signature == SUITE_CONTEXT_SIGNATURE);
 
-  ide_run_test_config_result_t* ptr = NULL;
-  ide_run_test_config_result_t* config_result = suite_context->result;
-
-  while(config_result) {
-
-    clean_test_group_results(config_result->group_result);
-
-    ptr = config_result->next;
-    free(config_result);
-    config_result = ptr;
-  }
+  // all the results are in the result store
+  teeio_result_store_free(suite_context->result_store);
 
   free(context);
   return true;
@@ -1228,6 +1419,219 @@ bool clean_tests_data(ide_run_test_suite_t* test_suite)
   return true;
 }
 
+typedef enum {
+  TOPOLOGY_RESOURCE_ROOTPORT = 0,
+  TOPOLOGY_RESOURCE_ENDPOINT,
+  TOPOLOGY_RESOURCE_SWITCH,
+  // key configuration unit, i.e. the KCBAR shared by the root ports of a root complex
+  TOPOLOGY_RESOURCE_KCU
+} TOPOLOGY_RESOURCE_TYPE;
+
+typedef struct {
+  TOPOLOGY_RESOURCE_TYPE type;
+  uint64_t id;
+} ide_test_topology_resource_t;
+
+typedef struct {
+  int cnt;
+  ide_test_topology_resource_t res[MAX_TOPOLOGY_RESOURCE_NUM];
+} ide_test_topology_resources_t;
+
+static void add_topology_resource(ide_test_topology_resources_t *resources, TOPOLOGY_RESOURCE_TYPE type, uint64_t id)
+{
+  if(resources->cnt < MAX_TOPOLOGY_RESOURCE_NUM) {
+    resources->res[resources->cnt].type = type;
+    resources->res[resources->cnt].id = id;
+    resources->cnt++;
+  }
+}
+
+/**
+ * Collect the ports, switches and KCBARs a topology touches.
+ * Ports, switches and KCBARs are tagged with their type so that their ids never collide.
+ */
+static void get_topology_resources(IDE_TEST_CONFIG *test_config, IDE_TEST_TOPOLOGY *top, ide_test_topology_resources_t *resources)
+{
+  IDE_SWITCH_INTERNAL_CONNECTION *conns[2] = {top->sw_conn1, top->sw_conn2};
+  INTEL_KEYP_PROTOCOL_TYPE protocols[2] = {INTEL_KEYP_PROTOCOL_TYPE_PCIE_CXLIO, INTEL_KEYP_PROTOCOL_TYPE_CXL_MEMCACHE};
+
+  resources->cnt = 0;
+
+  // upper_port is an endpoint in a P2P topology, otherwise it is the root port
+  if(top->root_port != 0) {
+    add_topology_resource(resources, TOPOLOGY_RESOURCE_ROOTPORT, top->root_port);
+  }
+  if(top->upper_port != 0) {
+    add_topology_resource(resources, top->connection == IDE_TEST_CONNECT_P2P ? TOPOLOGY_RESOURCE_ENDPOINT : TOPOLOGY_RESOURCE_ROOTPORT,
+                          top->upper_port);
+  }
+  if(top->lower_port != 0) {
+    add_topology_resource(resources, TOPOLOGY_RESOURCE_ENDPOINT, top->lower_port);
+  }
+
+  for(int i = 0; i < 2; i++) {
+    for(IDE_SWITCH_INTERNAL_CONNECTION *conn = conns[i]; conn != NULL; conn = conn->next) {
+      add_topology_resource(resources, TOPOLOGY_RESOURCE_SWITCH, conn->switch_id);
+    }
+  }
+
+  // The stream and key/iv slots of a root port are allocated in the KCBAR, which is shared
+  // by the root ports of the same key configuration unit.
+  IDE_PORT *root_port = get_port_by_id(test_config, top->root_port);
+  if(root_port == NULL) {
+    return;
+  }
+  for(int i = 0; i < 2; i++) {
+    uint64_t kcbar_addr = find_keyp_kcbar_addr(top->segment, top->bus, root_port->device, root_port->function, protocols[i]);
+    if(kcbar_addr != 0) {
+      add_topology_resource(resources, TOPOLOGY_RESOURCE_KCU, kcbar_addr);
+    }
+  }
+}
+
+static bool is_topology_conflicted(IDE_TEST_TOPOLOGY *top1, ide_test_topology_resources_t *res1,
+                                   IDE_TEST_TOPOLOGY *top2, ide_test_topology_resources_t *res2)
+{
+  if(top1 == top2 || top1->id == top2->id) {
+    return true;
+  }
+
+  for(int i = 0; i < res1->cnt; i++) {
+    for(int j = 0; j < res2->cnt; j++) {
+      if(res1->res[i].type == res2->res[j].type && res1->res[i].id == res2->res[j].id) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Partition the test suites into lanes. Suites which share a topology, a port, a switch
+ * or a KCBAR (directly or through other suites) are put into the same lane.
+ * Return the number of lanes.
+ */
+static int assign_test_suite_lanes(IDE_TEST_CONFIG *test_config, ide_run_test_suite_t *run_test_suite)
+{
+  int lanes = 0;
+  ide_test_topology_resources_t *resources = (ide_test_topology_resources_t *)calloc(MAX_TEST_SUITE_NUM, sizeof(ide_test_topology_resources_t));
+
+  if(resources == NULL) {
+    TEEIO_DEBUG((TEEIO_DEBUG_WARN, "Failed to allocate topology resources. Run the test suites in one lane.\n"));
+    for(ide_run_test_suite_t *itr = run_test_suite; itr != NULL; itr = itr->next) {
+      itr->lane = 0;
+    }
+    return run_test_suite == NULL ? 0 : 1;
+  }
+
+  // the lane is the index of the suite until the lanes are merged
+  for(ide_run_test_suite_t *itr = run_test_suite; itr != NULL; itr = itr->next) {
+    TEEIO_ASSERT(lanes < MAX_TEST_SUITE_NUM);
+    get_topology_resources(test_config, itr->topology, resources + lanes);
+    itr->lane = lanes++;
+  }
+
+  // merge the lanes of conflicted suites until nothing changes. lane of a suite is the smallest lane it is connected to.
+  bool changed = true;
+  while(changed) {
+    changed = false;
+    int i = 0;
+    for(ide_run_test_suite_t *s1 = run_test_suite; s1 != NULL; s1 = s1->next, i++) {
+      int j = i + 1;
+      for(ide_run_test_suite_t *s2 = s1->next; s2 != NULL; s2 = s2->next, j++) {
+        if(s1->lane != s2->lane && is_topology_conflicted(s1->topology, resources + i, s2->topology, resources + j)) {
+          int lane = s1->lane < s2->lane ? s1->lane : s2->lane;
+          s1->lane = s2->lane = lane;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // renumber the lanes to be contiguous
+  int lane_map[MAX_TEST_SUITE_NUM];
+  int lanes_cnt = 0;
+  for(int i = 0; i < MAX_TEST_SUITE_NUM; i++) {
+    lane_map[i] = -1;
+  }
+  for(ide_run_test_suite_t *itr = run_test_suite; itr != NULL; itr = itr->next) {
+    if(lane_map[itr->lane] == -1) {
+      lane_map[itr->lane] = lanes_cnt++;
+    }
+    itr->lane = lane_map[itr->lane];
+  }
+
+  free(resources);
+
+  return lanes_cnt;
+}
+
+typedef struct {
+  ide_run_test_suite_t *run_test_suite;
+  int lanes_cnt;
+  int next_lane;
+} ide_run_test_lanes_t;
+
+static void *run_test_lanes_worker(void *arg)
+{
+  ide_run_test_lanes_t *lanes = (ide_run_test_lanes_t *)arg;
+  char tag[MAX_CASE_NAME_LENGTH];
+  int lane;
+
+  while((lane = __atomic_fetch_add(&lanes->next_lane, 1, __ATOMIC_RELAXED)) < lanes->lanes_cnt) {
+    // the lanes share the log, so their lines are tagged
+    snprintf(tag, sizeof(tag), "lane %d", lane);
+    teeio_log_set_tag(tag);
+    for(ide_run_test_suite_t *itr = lanes->run_test_suite; itr != NULL; itr = itr->next) {
+      if(itr->lane == lane) {
+        do_run_test_suite(itr);
+      }
+    }
+  }
+  teeio_log_set_tag(NULL);
+
+  return NULL;
+}
+
+/**
+ * Run the test suites with up to g_parallel_topology threads.
+ * Each thread picks a lane and runs its suites in the original order.
+ */
+static bool run_test_suites_parallel(IDE_TEST_CONFIG *test_config, ide_run_test_suite_t *run_test_suite)
+{
+  pthread_t workers[MAX_PARALLEL_TOPOLOGY_NUM];
+  int workers_cnt = 0;
+  ide_run_test_lanes_t lanes = {0};
+
+  lanes.run_test_suite = run_test_suite;
+  lanes.lanes_cnt = assign_test_suite_lanes(test_config, run_test_suite);
+  lanes.next_lane = 0;
+
+  int threads = g_parallel_topology > MAX_PARALLEL_TOPOLOGY_NUM ? MAX_PARALLEL_TOPOLOGY_NUM : (int)g_parallel_topology;
+  if(threads > lanes.lanes_cnt) {
+    threads = lanes.lanes_cnt;
+  }
+  TEEIO_DEBUG((TEEIO_DEBUG_INFO, "Run %d lanes of test suites with %d threads.\n", lanes.lanes_cnt, threads));
+
+  for(int i = 1; i < threads; i++) {
+    if(pthread_create(&workers[workers_cnt], NULL, run_test_lanes_worker, &lanes) != 0) {
+      TEEIO_DEBUG((TEEIO_DEBUG_WARN, "Failed to create test thread. Continue with %d threads.\n", workers_cnt + 1));
+      break;
+    }
+    workers_cnt++;
+  }
+
+  // the main thread is a worker too
+  run_test_lanes_worker(&lanes);
+
+  for(int i = 0; i < workers_cnt; i++) {
+    pthread_join(workers[i], NULL);
+  }
+
+  return true;
+}
+
 /**
  * Run tests based on test_config
 */
@@ -1236,9 +1640,14 @@ bool run(IDE_TEST_CONFIG *test_config)
   ide_run_test_suite_t *run_test_suite = prepare_tests_data(test_config);
   ide_run_test_suite_t *itr = run_test_suite;
 
-  while(itr != NULL) {
-    do_run_test_suite(itr);
-    itr = itr->next;
+  if(g_parallel_topology > 1) {
+    // each suite owns its result tree so the results are printed in suite order as in the sequential run
+    run_test_suites_parallel(test_config, run_test_suite);
+  } else {
+    while(itr != NULL) {
+      do_run_test_suite(itr);
+      itr = itr->next;
+    }
   }
 
   print_test_results(run_test_suite, true);
@@ -29,6 +29,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/mman.h>
 #include "hal/base.h"
 #include "hal/library/debuglib.h"
 
@@ -85,27 +86,36 @@ const char *TEEIO_TEST_CATEGORY_NAMES[] = {
 uint8_t valid_chars[] = {
     '_', ':', ',', '.', '-'};
 
-typedef struct _INI_SECTIOIN_ITME SECTION_ITEM;
-struct _INI_SECTIOIN_ITME
+// An entry of the INI file.
+// Entries are indexed in a hash table by the section name and the entry name.
+// A section which has entries is also indexed with PtrEntry set to NULL.
+typedef struct _INI_ENTRY_ITEM ENTRY_ITEM;
+struct _INI_ENTRY_ITEM
 {
   uint8_t *PtrSection;
-  uint32_t SecNameLen;
   uint8_t *PtrEntry;
   uint8_t *PtrValue;
-  SECTION_ITEM *PtrNext;
-};
-
-typedef struct _INI_COMMENT_LINE COMMENT_LINE;
-struct _INI_COMMENT_LINE
-{
-  uint8_t *PtrComment;
-  COMMENT_LINE *PtrNext;
+  uint32_t Hash;
+  ENTRY_ITEM *PtrHashNext;
+  // next entry in the order of the file
+  ENTRY_ITEM *PtrNext;
 };
 
+// The context, the hash buckets, the entries and the strings are allocated
+// from one arena which is sized from the INI file and freed in one step.
 typedef struct
 {
-  SECTION_ITEM *SectionHead;
-  COMMENT_LINE *CommentHead;
+  ENTRY_ITEM **Buckets;
+  uint32_t BucketMask;
+  ENTRY_ITEM *EntryHead;
+  ENTRY_ITEM *EntryTail;
+
+  ENTRY_ITEM *Items;
+  uint32_t ItemsUsed;
+  uint32_t ItemsMax;
+  uint8_t *Strings;
+  size_t StringsUsed;
+  size_t StringsMax;
 } INI_PARSING_LIB_CONTEXT;
 
 // /**
@@ -412,205 +422,238 @@ bool IsValidValue(
   return false;
 }
 
-bool IsValidSection(
-  void *Context,
-  uint8_t *SectionName
-)
+/**
+  Hash a section name and an entry name (FNV-1a).
+
+  @param[in] SectionName     Section name.
+  @param[in] SectionNameLen  Length of section name.
+  @param[in] EntryName       Entry name. NULL for the section itself.
+  @param[in] EntryNameLen    Length of entry name.
+
+  @return The hash value.
+**/
+uint32_t IniHash(
+    const uint8_t *SectionName,
+    uint32_t SectionNameLen,
+    const uint8_t *EntryName,
+    uint32_t EntryNameLen)
 {
-  SECTION_ITEM *Section = NULL;
-  INI_PARSING_LIB_CONTEXT *IniContext;
+  uint32_t Hash = 2166136261u;
+  uint32_t Index;
 
-  if(Context == NULL || SectionName == NULL) {
-    return false;
+  for (Index = 0; Index < SectionNameLen; Index++)
+  {
+    Hash = (Hash ^ SectionName[Index]) * 16777619u;
   }
 
-  IniContext = Context;
-  Section = IniContext->SectionHead;
+  // separate the section name from the entry name
+  Hash = (Hash ^ '[') * 16777619u;
 
-  while (Section != NULL)
+  for (Index = 0; Index < EntryNameLen; Index++)
   {
-    if (strcmp((const char *)Section->PtrSection, (const char *)SectionName) == 0)
-    {
-      if (Section->PtrEntry != NULL)
-      {
-        return true;
-      }
-    }
-
-    Section = Section->PtrNext;
+    Hash = (Hash ^ EntryName[Index]) * 16777619u;
   }
 
-  return false;
+  return Hash;
 }
 
 /**
-  Dump an INI config file context.
+  Find an entry in the hash index.
 
-  @param[in] Context         INI Config file context.
+  @param[in] IniContext      INI Config file context.
+  @param[in] SectionName     Section name.
+  @param[in] EntryName       Entry name. NULL to find the section.
+
+  @return The entry or NULL if it is not found.
 **/
-void DumpIniSection(
-    void *Context)
+ENTRY_ITEM *IniFindEntry(
+    INI_PARSING_LIB_CONTEXT *IniContext,
+    const uint8_t *SectionName,
+    const uint8_t *EntryName)
 {
-  INI_PARSING_LIB_CONTEXT *IniContext;
-  SECTION_ITEM *PtrSection;
-  SECTION_ITEM *Section;
+  ENTRY_ITEM *Item;
+  uint32_t Hash;
 
-  if (Context == NULL)
-  {
-    return;
-  }
+  Hash = IniHash(SectionName, strlen((const char *)SectionName),
+                 EntryName, EntryName == NULL ? 0 : strlen((const char *)EntryName));
 
-  IniContext = Context;
-  Section = IniContext->SectionHead;
-
-  while (Section != NULL)
+  for (Item = IniContext->Buckets[Hash & IniContext->BucketMask]; Item != NULL; Item = Item->PtrHashNext)
   {
-    PtrSection = Section;
-    Section = Section->PtrNext;
-    if (PtrSection->PtrSection != NULL)
+    if (Item->Hash != Hash || strcmp((const char *)Item->PtrSection, (const char *)SectionName) != 0)
     {
-      TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "Section - %s\n", PtrSection->PtrSection));
+      continue;
     }
 
-    if (PtrSection->PtrEntry != NULL)
+    if (EntryName == NULL && Item->PtrEntry == NULL)
     {
-      TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  Entry - %s\n", PtrSection->PtrEntry));
+      return Item;
     }
 
-    if (PtrSection->PtrValue != NULL)
+    if (EntryName != NULL && Item->PtrEntry != NULL &&
+        strcmp((const char *)Item->PtrEntry, (const char *)EntryName) == 0)
     {
-      TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  Value - %s\n", PtrSection->PtrValue));
+      return Item;
     }
   }
+
+  return NULL;
 }
 
 /**
-  Copy one line data from buffer data to the line buffer.
-
-  @param[in]      Buffer          Buffer data.
-  @param[in]      BufferSize      Buffer Size.
-  @param[in, out] LineBuffer      Line buffer to store the found line data.
-  @param[in, out] LineSize        On input, size of the input line buffer.
-                                  On output, size of the actual line buffer.
-
-  @retval EFI_BUFFER_TOO_SMALL  The size of input line buffer is not enough.
-  @retval EFI_SUCCESS           Copy line data into the line buffer.
+  Copy a string into the arena and add a trailing '\0'.
 
+  @return The copied string.
 **/
-libspdm_return_t
-ProfileGetLine(
-    uint8_t *Buffer,
-    uint32_t BufferSize,
-    uint8_t *LineBuffer,
-    uint32_t *LineSize)
+uint8_t *IniArenaCopyString(
+    INI_PARSING_LIB_CONTEXT *IniContext,
+    const uint8_t *Buffer,
+    uint32_t Length)
 {
-  uint32_t Length;
-  uint8_t *PtrBuf;
-  uint8_t *PtrEnd;
+  uint8_t *String;
 
-  PtrBuf = Buffer;
-  PtrEnd = Buffer + BufferSize;
+  // The arena is sized so that every string of the file fits.
+  TEEIO_ASSERT(IniContext->StringsUsed + Length + 1 <= IniContext->StringsMax);
 
-  //
-  // 0x0D indicates a line break. Otherwise there is no line break
-  //
-  while (PtrBuf < PtrEnd)
-  {
-    if ((*PtrBuf == 0x0D) || (*PtrBuf == 0x0A))
-    {
-      break;
-    }
+  String = IniContext->Strings + IniContext->StringsUsed;
+  memcpy(String, Buffer, Length);
+  String[Length] = '\0';
+  IniContext->StringsUsed += Length + 1;
 
-    PtrBuf++;
-  }
+  return String;
+}
 
-  if (PtrBuf >= PtrEnd - 1)
+/**
+  Add an entry into the hash index.
+  An entry defined again overrides the previous value.
+
+  @param[in] IniContext      INI Config file context.
+  @param[in] SectionName     Section name in the arena.
+  @param[in] EntryName       Entry name in the arena. NULL to add the section.
+  @param[in] Value           Entry value in the arena.
+**/
+void IniAddEntry(
+    INI_PARSING_LIB_CONTEXT *IniContext,
+    uint8_t *SectionName,
+    uint8_t *EntryName,
+    uint8_t *Value)
+{
+  ENTRY_ITEM *Item;
+  uint32_t Hash;
+
+  Item = IniFindEntry(IniContext, SectionName, EntryName);
+  if (Item != NULL)
   {
-    //
-    // The buffer ends without any line break
-    // or it is the last character of the buffer
-    //
-    Length = BufferSize;
+    Item->PtrValue = Value;
+    return;
   }
-  else if (*(PtrBuf + 1) == 0x0A)
+
+  TEEIO_ASSERT(IniContext->ItemsUsed < IniContext->ItemsMax);
+
+  Hash = IniHash(SectionName, strlen((const char *)SectionName),
+                 EntryName, EntryName == NULL ? 0 : strlen((const char *)EntryName));
+
+  Item = IniContext->Items + IniContext->ItemsUsed;
+  IniContext->ItemsUsed++;
+
+  Item->PtrSection = SectionName;
+  Item->PtrEntry = EntryName;
+  Item->PtrValue = Value;
+  Item->Hash = Hash;
+  Item->PtrHashNext = IniContext->Buckets[Hash & IniContext->BucketMask];
+  IniContext->Buckets[Hash & IniContext->BucketMask] = Item;
+
+  Item->PtrNext = NULL;
+  if (IniContext->EntryTail == NULL)
   {
-    //
-    // Further check if a 0x0A follows. If yes, count 0xA
-    //
-    Length = PtrBuf - Buffer + 2;
+    IniContext->EntryHead = Item;
   }
   else
   {
-    Length = PtrBuf - Buffer + 1;
+    IniContext->EntryTail->PtrNext = Item;
+  }
+  IniContext->EntryTail = Item;
+}
+
+bool IsValidSection(
+  void *Context,
+  uint8_t *SectionName
+)
+{
+  if(Context == NULL || SectionName == NULL) {
+    return false;
   }
 
-  if (Length > (*LineSize))
+  return IniFindEntry((INI_PARSING_LIB_CONTEXT *)Context, SectionName, NULL) != NULL;
+}
+
+/**
+  Dump an INI config file context.
+
+  @param[in] Context         INI Config file context.
+**/
+void DumpIniSection(
+    void *Context)
+{
+  INI_PARSING_LIB_CONTEXT *IniContext;
+  ENTRY_ITEM *Item;
+
+  if (Context == NULL)
   {
-    *LineSize = Length;
-    return LIBSPDM_STATUS_BUFFER_TOO_SMALL;
+    return;
   }
 
-  memset(LineBuffer, 0, *LineSize);
-  *LineSize = Length;
-  memcpy(LineBuffer, Buffer, Length);
+  IniContext = Context;
 
-  return LIBSPDM_STATUS_SUCCESS;
+  for (Item = IniContext->EntryHead; Item != NULL; Item = Item->PtrNext)
+  {
+    if (Item->PtrEntry == NULL)
+    {
+      TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "Section - %s\n", Item->PtrSection));
+      continue;
+    }
+
+    TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  Entry - %s\n", Item->PtrEntry));
+    TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  Value - %s\n", Item->PtrValue));
+  }
 }
 
 /**
-  Trim Buffer by removing all CR, LF, TAB, and SPACE chars in its head and tail.
+  Trim Buffer by skipping all CR, LF, TAB, and SPACE chars in its head and tail.
+  The buffer is not modified so that it can be a read-only mapping of the file.
 
   @param[in, out] Buffer          On input,  buffer data to be trimmed.
-                                  On output, the trimmed buffer.
+                                  On output, start of the trimmed buffer.
   @param[in, out] BufferSize      On input,  size of original buffer data.
                                   On output, size of the trimmed buffer.
 
 **/
 void ProfileTrim(
-    uint8_t *Buffer,
+    uint8_t **Buffer,
     uint32_t *BufferSize)
 {
-  uint32_t Length;
   uint8_t *PtrBuf;
   uint8_t *PtrEnd;
 
-  if (*BufferSize == 0)
-  {
-    return;
-  }
+  PtrBuf = *Buffer;
+  PtrEnd = *Buffer + *BufferSize;
 
   //
   // Trim the tail first, include CR, LF, TAB, and SPACE.
   //
-  Length = *BufferSize;
-  PtrBuf = Buffer + Length - 1;
-  while (PtrBuf >= Buffer)
+  while (PtrEnd > PtrBuf)
   {
-    if ((*PtrBuf != 0x0D) && (*PtrBuf != 0x0A) && (*PtrBuf != 0x20) && (*PtrBuf != 0x09))
+    if ((*(PtrEnd - 1) != 0x0D) && (*(PtrEnd - 1) != 0x0A) && (*(PtrEnd - 1) != 0x20) && (*(PtrEnd - 1) != 0x09))
     {
       break;
     }
 
-    PtrBuf--;
+    PtrEnd--;
   }
 
-  //
-  // all spaces, a blank line, return directly;
-  //
-  if (PtrBuf < Buffer)
-  {
-    *BufferSize = 0;
-    return;
-  }
-
-  Length = PtrBuf - Buffer + 1;
-  PtrEnd = PtrBuf;
-  PtrBuf = Buffer;
-
   //
   // Now skip the heading CR, LF, TAB and SPACE
   //
-  while (PtrBuf <= PtrEnd)
+  while (PtrBuf < PtrEnd)
   {
     if ((*PtrBuf != 0x0D) && (*PtrBuf != 0x0A) && (*PtrBuf != 0x20) && (*PtrBuf != 0x09))
     {
@@ -620,94 +663,29 @@ void ProfileTrim(
     PtrBuf++;
   }
 
-  //
-  // If no heading CR, LF, TAB or SPACE, directly return
-  //
-  if (PtrBuf == Buffer)
-  {
-    *BufferSize = Length;
-    return;
-  }
-
-  *BufferSize = PtrEnd - PtrBuf + 1;
-
-  //
-  // The first Buffer..PtrBuf characters are CR, LF, TAB or SPACE.
-  // Now move out all these characters.
-  //
-  while (PtrBuf <= PtrEnd)
-  {
-    *Buffer = *PtrBuf;
-    Buffer++;
-    PtrBuf++;
-  }
-
-  return;
-}
-
-/**
-  Insert new comment item into comment head.
-
-  @param[in]      Buffer          Comment buffer to be added.
-  @param[in]      BufferSize      Size of comment buffer.
-  @param[in, out] CommentHead     Comment Item head entry.
-
-  @retval EFI_OUT_OF_RESOURCES   No enough memory is allocated.
-  @retval EFI_SUCCESS            New comment item is inserted.
-
-**/
-bool ProfileGetComments(
-    uint8_t *Buffer,
-    uint32_t BufferSize,
-    COMMENT_LINE **CommentHead)
-{
-  COMMENT_LINE *CommentItem;
-
-  CommentItem = NULL;
-  CommentItem = malloc(sizeof(COMMENT_LINE));
-  if (CommentItem == NULL)
-  {
-    TEEIO_ASSERT(false);
-    return false;
-  }
-
-  CommentItem->PtrNext = *CommentHead;
-  *CommentHead = CommentItem;
-
-  //
-  // Add a trailing '\0'
-  //
-  CommentItem->PtrComment = malloc(BufferSize + 1);
-  if (CommentItem->PtrComment == NULL)
-  {
-    free(CommentItem);
-    TEEIO_ASSERT(false);
-    return false;
-  }
-
-  memcpy(CommentItem->PtrComment, Buffer, BufferSize);
-  *(CommentItem->PtrComment + BufferSize) = '\0';
-
-  return true;
+  *Buffer = PtrBuf;
+  *BufferSize = PtrEnd - PtrBuf;
 }
 
 /**
-  Add new section item into Section head.
+  Parse a section line.
 
-  @param[in]      Buffer          Section item data buffer.
-  @param[in]      BufferSize      Size of section item.
-  @param[in, out] SectionHead     Section item head entry.
+  @param[in]      IniContext      INI Config file context.
+  @param[in]      Buffer          Section line. The first character is '['.
+  @param[in]      BufferSize      Size of section line.
+  @param[in, out] SectionName     The name of the current section.
+                                  It is not changed if the line is invalid.
 
-  @retval EFI_OUT_OF_RESOURCES   No enough memory is allocated.
-  @retval EFI_SUCCESS            Section item is NULL or Section item is added.
+  @retval true   The section is parsed.
+  @retval false  The section line is invalid.
 
 **/
 bool ProfileGetSection(
+    INI_PARSING_LIB_CONTEXT *IniContext,
     uint8_t *Buffer,
     uint32_t BufferSize,
-    SECTION_ITEM **SectionHead)
+    uint8_t **SectionName)
 {
-  SECTION_ITEM *SectionItem;
   uint32_t Length;
   uint8_t *PtrBuf;
   uint8_t *PtrEnd;
@@ -736,19 +714,12 @@ bool ProfileGetSection(
     return false;
   }
 
-  if (PtrBuf <= Buffer + 1)
-  {
-    // Empty name
-    return false;
-  }
-
   //
   // excluding the heading '[' and tailing ']'
   //
   Length = PtrBuf - Buffer - 1;
-  ProfileTrim(
-      Buffer + 1,
-      &Length);
+  PtrBuf = Buffer + 1;
+  ProfileTrim(&PtrBuf, &Length);
 
   //
   // Invalid line if the section name is null
@@ -758,67 +729,41 @@ bool ProfileGetSection(
     return false;
   }
 
-  if (!IsValidName((uint8_t *)Buffer + 1, Length))
-  {
-    return false;
-  }
-
-  SectionItem = malloc(sizeof(SECTION_ITEM));
-  if (SectionItem == NULL)
-  {
-    TEEIO_ASSERT(false);
-    return false;
-  }
-
-  SectionItem->PtrSection = NULL;
-  SectionItem->SecNameLen = Length;
-  SectionItem->PtrEntry = NULL;
-  SectionItem->PtrValue = NULL;
-  SectionItem->PtrNext = *SectionHead;
-  *SectionHead = SectionItem;
-
-  //
-  // Add a trailing '\0'
-  //
-  SectionItem->PtrSection = malloc(Length + 1);
-  if (SectionItem->PtrSection == NULL)
+  if (!IsValidName(PtrBuf, Length))
   {
-    TEEIO_ASSERT(false);
     return false;
   }
 
-  //
-  // excluding the heading '['
-  //
-  memcpy(SectionItem->PtrSection, Buffer + 1, Length);
-  *(SectionItem->PtrSection + Length) = '\0';
+  *SectionName = IniArenaCopyString(IniContext, PtrBuf, Length);
 
   return true;
 }
 
 /**
-  Add new section entry and entry value into Section head.
+  Parse an entry line and add the entry into the hash index.
 
-  @param[in]      Buffer          Section entry data buffer.
-  @param[in]      BufferSize      Size of section entry.
-  @param[in, out] SectionHead     Section item head entry.
+  @param[in]      IniContext      INI Config file context.
+  @param[in]      Buffer          Entry line.
+  @param[in]      BufferSize      Size of entry line.
+  @param[in]      SectionName     The name of the current section.
 
-  @retval EFI_OUT_OF_RESOURCES   No enough memory is allocated.
-  @retval EFI_SUCCESS            Section entry is added.
-  @retval EFI_NOT_FOUND          Section entry is not found.
-  @retval EFI_INVALID_PARAMETER  Section entry is invalid.
+  @retval true   The entry is added, or omitted because it is out of any section.
+  @retval false  The entry line is invalid.
 
 **/
 bool ProfileGetEntry(
+    INI_PARSING_LIB_CONTEXT *IniContext,
     uint8_t *Buffer,
     uint32_t BufferSize,
-    SECTION_ITEM **SectionHead)
+    uint8_t *SectionName)
 {
-  SECTION_ITEM *SectionItem;
-  SECTION_ITEM *PtrSection;
+  uint8_t *EntryName;
+  uint8_t *Value;
   uint32_t Length;
   uint8_t *PtrBuf;
   uint8_t *PtrEnd;
+  uint8_t *PtrName;
+  uint32_t EntryNameLength;
 
   PtrBuf = Buffer;
   PtrEnd = Buffer + BufferSize - 1;
@@ -844,19 +789,12 @@ bool ProfileGetEntry(
     return false;
   }
 
-  if (PtrBuf <= Buffer)
-  {
-    // Empty name
-    return false;
-  }
-
   //
   // excluding the tailing '='
   //
   Length = PtrBuf - Buffer;
-  ProfileTrim(
-      Buffer,
-      &Length);
+  PtrName = Buffer;
+  ProfileTrim(&PtrName, &Length);
 
   //
   // Invalid line if the entry name is null
@@ -866,7 +804,7 @@ bool ProfileGetEntry(
     return false;
   }
 
-  if (!IsValidName((uint8_t *)Buffer, Length))
+  if (!IsValidName(PtrName, Length))
   {
     return false;
   }
@@ -874,52 +812,13 @@ bool ProfileGetEntry(
   //
   // Omit this line if no section header has been found before
   //
-  if (*SectionHead == NULL)
+  if (SectionName == NULL)
   {
     return true;
   }
 
-  PtrSection = *SectionHead;
-
-  SectionItem = malloc(sizeof(SECTION_ITEM));
-  if (SectionItem == NULL)
-  {
-    TEEIO_ASSERT(false);
-    return false;
-  }
-
-  SectionItem->PtrSection = NULL;
-  SectionItem->PtrEntry = NULL;
-  SectionItem->PtrValue = NULL;
-  SectionItem->SecNameLen = PtrSection->SecNameLen;
-  SectionItem->PtrNext = *SectionHead;
-  *SectionHead = SectionItem;
-
-  //
-  // SectionName, add a trailing '\0'
-  //
-  SectionItem->PtrSection = malloc(PtrSection->SecNameLen + 1);
-  if (SectionItem->PtrSection == NULL)
-  {
-    TEEIO_ASSERT(false);
-    return false;
-  }
-
-  memcpy(SectionItem->PtrSection, PtrSection->PtrSection, PtrSection->SecNameLen + 1);
-
-  //
-  // EntryName, add a trailing '\0'
-  //
-  SectionItem->PtrEntry = malloc(Length + 1);
-  if (SectionItem->PtrEntry == NULL)
-  {
-    free(SectionItem->PtrSection);
-    TEEIO_ASSERT(false);
-    return false;
-  }
-
-  memcpy(SectionItem->PtrEntry, Buffer, Length);
-  *(SectionItem->PtrEntry + Length) = '\0';
+  EntryName = PtrName;
+  EntryNameLength = Length;
 
   //
   // Next search for '#' or ';'
@@ -936,343 +835,145 @@ bool ProfileGetEntry(
     PtrBuf++;
   }
 
-  if (PtrBuf <= Buffer)
-  {
-    // Empty name
-    free(SectionItem->PtrEntry);
-    free(SectionItem->PtrSection);
-    return false;
-  }
-
   Length = PtrBuf - Buffer;
-  ProfileTrim(
-      Buffer,
-      &Length);
+  ProfileTrim(&Buffer, &Length);
 
   //
   // Invalid line if the entry value is null
   //
   if (Length == 0)
   {
-    free(SectionItem->PtrEntry);
-    free(SectionItem->PtrSection);
     return false;
   }
 
-  if (!IsValidValue((uint8_t *)Buffer, Length))
+  if (!IsValidValue(Buffer, Length))
   {
-    free(SectionItem->PtrEntry);
-    free(SectionItem->PtrSection);
     return false;
   }
 
-  //
-  // EntryValue, add a trailing '\0'
-  //
-  SectionItem->PtrValue = malloc(Length + 1);
-  if (SectionItem->PtrValue == NULL)
+  EntryName = IniArenaCopyString(IniContext, EntryName, EntryNameLength);
+  Value = IniArenaCopyString(IniContext, Buffer, Length);
+
+  // index the section when its first entry is added
+  if (IniFindEntry(IniContext, SectionName, NULL) == NULL)
   {
-    free(SectionItem->PtrEntry);
-    free(SectionItem->PtrSection);
-    TEEIO_ASSERT(false);
-    return false;
+    IniAddEntry(IniContext, SectionName, NULL, NULL);
   }
-
-  memcpy(SectionItem->PtrValue, Buffer, Length);
-  *(SectionItem->PtrValue + Length) = '\0';
+  IniAddEntry(IniContext, SectionName, EntryName, Value);
 
   return true;
 }
 
 /**
-  Free all comment entry and section entry.
+  Open an INI config file and return a context.
+
+  The data buffer is parsed in one pass. Comments and invalid lines are skipped.
+  The data buffer is not modified and may be a read-only mapping of the file.
+  The context does not refer to the data buffer after it is returned.
 
-  @param[in] Section         Section entry list.
-  @param[in] Comment         Comment entry list.
+  @param[in] DataBuffer      Config raw file buffer.
+  @param[in] BufferSize      Size of raw buffer.
 
+  @return       Config data buffer is opened and context is returned.
+  @retval NULL  No enough memory is allocated.
+  @retval NULL  Config data buffer is invalid.
 **/
-void FreeAllList(
-    SECTION_ITEM *Section,
-    COMMENT_LINE *Comment)
+void *
+OpenIniFile(
+    uint8_t *DataBuffer,
+    uint32_t BufferSize)
 {
-  SECTION_ITEM *PtrSection;
-  COMMENT_LINE *PtrComment;
+  INI_PARSING_LIB_CONTEXT *IniContext;
+  uint8_t *Arena;
+  size_t ArenaSize;
+  uint32_t ItemsMax;
+  uint32_t BucketNum;
+  uint8_t *CurrentPtr;
+  uint8_t *BufferEnd;
+  uint8_t *PtrLine;
+  uint32_t LineLength;
+  uint8_t *SectionName;
 
-  while (Section != NULL)
+  if ((DataBuffer == NULL) || (BufferSize == 0))
   {
-    PtrSection = Section;
-    Section = Section->PtrNext;
-    if (PtrSection->PtrEntry != NULL)
-    {
-      free(PtrSection->PtrEntry);
-    }
-
-    if (PtrSection->PtrSection != NULL)
-    {
-      free(PtrSection->PtrSection);
-    }
-
-    if (PtrSection->PtrValue != NULL)
-    {
-      free(PtrSection->PtrValue);
-    }
-
-    free(PtrSection);
+    return NULL;
   }
 
-  while (Comment != NULL)
+  //
+  // A section or an entry takes at least 3 chars and a line break, e.g. "a=b\n".
+  // Every section and entry has at most 2 strings copied from its line.
+  //
+  ItemsMax = BufferSize / 3 + 2;
+  BucketNum = 64;
+  while (BucketNum < ItemsMax)
   {
-    PtrComment = Comment;
-    Comment = Comment->PtrNext;
-    if (PtrComment->PtrComment != NULL)
-    {
-      free(PtrComment->PtrComment);
-    }
-
-    free(PtrComment);
+    BucketNum <<= 1;
   }
 
-  return;
-}
-
-/**
-  Get section entry value.
-
-  @param[in]  Section         Section entry list.
-  @param[in]  SectionName     Section name.
-  @param[in]  EntryName       Section entry name.
-  @param[out] EntryValue      Point to the got entry value.
-
-  @retval EFI_NOT_FOUND  Section is not found.
-  @retval EFI_SUCCESS    Section entry value is got.
-
-**/
-bool UpdateGetProfileString(
-    SECTION_ITEM *Section,
-    uint8_t *SectionName,
-    uint8_t *EntryName,
-    uint8_t **EntryValue)
-{
-  *EntryValue = NULL;
-
-  while (Section != NULL)
-  {
-    if (strcmp((const char *)Section->PtrSection, (const char *)SectionName) == 0)
-    {
-      if (Section->PtrEntry != NULL)
-      {
-        if (strcmp((const char *)Section->PtrEntry, (const char *)EntryName) == 0)
-        {
-          break;
-        }
-      }
-    }
-
-    Section = Section->PtrNext;
-  }
+  ArenaSize = sizeof(INI_PARSING_LIB_CONTEXT) +
+              BucketNum * sizeof(ENTRY_ITEM *) +
+              (size_t)ItemsMax * sizeof(ENTRY_ITEM) +
+              (size_t)BufferSize + (size_t)ItemsMax * 2;
 
-  if (Section == NULL)
+  // calloc so that the pages which are not used are not touched.
+  Arena = calloc(1, ArenaSize);
+  if (Arena == NULL)
   {
-    return false;
+    TEEIO_ASSERT(false);
+    return NULL;
   }
 
-  *EntryValue = Section->PtrValue;
-
-  return true;
-}
-
-/**
-  Pre process config data buffer into Section entry list and Comment entry list.
-
-  @param[in]      DataBuffer      Config raw file buffer.
-  @param[in]      BufferSize      Size of raw buffer.
-  @param[in, out] SectionHead     Pointer to the section entry list.
-  @param[in, out] CommentHead     Pointer to the comment entry list.
-
-  @retval EFI_OUT_OF_RESOURCES  No enough memory is allocated.
-  @retval EFI_SUCCESS           Config data buffer is preprocessed.
-  @retval EFI_NOT_FOUND         Config data buffer is invalid, because Section or Entry is not found.
-  @retval EFI_INVALID_PARAMETER Config data buffer is invalid, because Section or Entry is invalid.
-
-**/
-bool PreProcessDataFile(
-    uint8_t *DataBuffer,
-    uint32_t BufferSize,
-    SECTION_ITEM **SectionHead,
-    COMMENT_LINE **CommentHead)
-{
-  uint8_t *Source;
-  uint8_t *CurrentPtr;
-  uint8_t *BufferEnd;
-  uint8_t *PtrLine;
-  uint32_t LineLength;
-  uint32_t SourceLength;
-  uint32_t MaxLineLength;
-  libspdm_return_t Status;
+  IniContext = (INI_PARSING_LIB_CONTEXT *)Arena;
+  IniContext->Buckets = (ENTRY_ITEM **)(Arena + sizeof(INI_PARSING_LIB_CONTEXT));
+  IniContext->BucketMask = BucketNum - 1;
+  IniContext->Items = (ENTRY_ITEM *)(IniContext->Buckets + BucketNum);
+  IniContext->ItemsMax = ItemsMax;
+  IniContext->Strings = (uint8_t *)(IniContext->Items + ItemsMax);
+  IniContext->StringsMax = (size_t)BufferSize + (size_t)ItemsMax * 2;
 
-  *SectionHead = NULL;
-  *CommentHead = NULL;
+  SectionName = NULL;
   BufferEnd = DataBuffer + BufferSize;
   CurrentPtr = DataBuffer;
-  MaxLineLength = MAX_LINE_LENGTH;
-  Status = LIBSPDM_STATUS_SUCCESS;
-
-  PtrLine = malloc(MaxLineLength);
-  if (PtrLine == NULL)
-  {
-    TEEIO_ASSERT(false);
-    return false;
-  }
 
   while (CurrentPtr < BufferEnd)
   {
-    Source = CurrentPtr;
-    SourceLength = BufferEnd - CurrentPtr;
-    LineLength = MaxLineLength;
     //
-    // With the assumption that line length is less than 512
-    // characters. Otherwise BUFFER_TOO_SMALL will be returned.
+    // 0x0D or 0x0A indicates a line break.
     //
-    Status = ProfileGetLine(
-        Source,
-        SourceLength,
-        PtrLine,
-        &LineLength);
-    if (LIBSPDM_STATUS_IS_ERROR(Status))
+    PtrLine = CurrentPtr;
+    while (CurrentPtr < BufferEnd && *CurrentPtr != 0x0D && *CurrentPtr != 0x0A)
     {
-      if (Status == LIBSPDM_STATUS_BUFFER_TOO_SMALL)
-      {
-        //
-        // If buffer too small, re-allocate the buffer according
-        // to the returned LineLength and try again.
-        //
-        free(PtrLine);
-        PtrLine = NULL;
-        PtrLine = malloc(LineLength);
-        if (PtrLine == NULL)
-        {
-          TEEIO_ASSERT(false);
-          return false;
-        }
-
-        SourceLength = LineLength;
-        Status = ProfileGetLine(
-            (uint8_t *)Source,
-            SourceLength,
-            (uint8_t *)PtrLine,
-            &LineLength);
-        if (LIBSPDM_STATUS_IS_ERROR(Status))
-        {
-          break;
-        }
-
-        MaxLineLength = LineLength;
-      }
-      else
-      {
-        break;
-      }
+      CurrentPtr++;
+    }
+    LineLength = CurrentPtr - PtrLine;
+    while (CurrentPtr < BufferEnd && (*CurrentPtr == 0x0D || *CurrentPtr == 0x0A))
+    {
+      CurrentPtr++;
     }
-
-    CurrentPtr = CurrentPtr + LineLength;
 
     //
     // Line got. Trim the line before processing it.
     //
-    ProfileTrim(
-        (uint8_t *)PtrLine,
-        &LineLength);
+    ProfileTrim(&PtrLine, &LineLength);
 
     //
-    // Blank line
+    // Blank line or comment
     //
-    if (LineLength == 0)
+    if ((LineLength == 0) || (PtrLine[0] == '#') || (PtrLine[0] == ';'))
     {
       continue;
     }
 
-    if ((PtrLine[0] == '#') || (PtrLine[0] == ';'))
+    if (PtrLine[0] == '[')
     {
-      Status = ProfileGetComments(
-          (uint8_t *)PtrLine,
-          LineLength,
-          CommentHead);
-    }
-    else if (PtrLine[0] == '[')
-    {
-      Status = ProfileGetSection(
-          (uint8_t *)PtrLine,
-          LineLength,
-          SectionHead);
+      ProfileGetSection(IniContext, PtrLine, LineLength, &SectionName);
     }
     else
     {
-      Status = ProfileGetEntry(
-          (uint8_t *)PtrLine,
-          LineLength,
-          SectionHead);
-    }
-
-    if (LIBSPDM_STATUS_IS_ERROR(Status))
-    {
-      break;
+      ProfileGetEntry(IniContext, PtrLine, LineLength, SectionName);
     }
   }
 
-  //
-  // Free buffer
-  //
-  free(PtrLine);
-
-  return Status;
-}
-
-/**
-  Open an INI config file and return a context.
-
-  @param[in] DataBuffer      Config raw file buffer.
-  @param[in] BufferSize      Size of raw buffer.
-
-  @return       Config data buffer is opened and context is returned.
-  @retval NULL  No enough memory is allocated.
-  @retval NULL  Config data buffer is invalid.
-**/
-void *
-OpenIniFile(
-    uint8_t *DataBuffer,
-    uint32_t BufferSize)
-{
-  libspdm_return_t Status;
-  INI_PARSING_LIB_CONTEXT *IniContext;
-
-  if ((DataBuffer == NULL) || (BufferSize == 0))
-  {
-    return NULL;
-  }
-
-  IniContext = malloc(sizeof(INI_PARSING_LIB_CONTEXT));
-  if (IniContext == NULL)
-  {
-    TEEIO_ASSERT(false);
-    return NULL;
-  }
-
-  memset(IniContext, 0, sizeof(INI_PARSING_LIB_CONTEXT));
-
-  //
-  // First process the data buffer and get all sections and entries
-  //
-  Status = PreProcessDataFile(
-      DataBuffer,
-      BufferSize,
-      &IniContext->SectionHead,
-      &IniContext->CommentHead);
-  if (LIBSPDM_STATUS_IS_ERROR(Status))
-  {
-    free(IniContext);
-    return NULL;
-  }
-
   // DumpIniSection(IniContext);
 
   return IniContext;
@@ -1295,21 +996,23 @@ bool GetStringFromDataFile(
     uint8_t *EntryName,
     uint8_t **EntryValue)
 {
-  INI_PARSING_LIB_CONTEXT *IniContext;
+  ENTRY_ITEM *Item;
 
   if ((Context == NULL) || (SectionName == NULL) || (EntryName == NULL) || (EntryValue == NULL))
   {
     return false;
   }
 
-  IniContext = Context;
-
   *EntryValue = NULL;
-  return UpdateGetProfileString(
-      IniContext->SectionHead,
-      SectionName,
-      EntryName,
-      EntryValue);
+  Item = IniFindEntry((INI_PARSING_LIB_CONTEXT *)Context, SectionName, EntryName);
+  if (Item == NULL)
+  {
+    return false;
+  }
+
+  *EntryValue = Item->PtrValue;
+
+  return true;
 }
 
 /**
@@ -1499,17 +1202,8 @@ bool GetUint32ArrayLengthFromDataFile(
 void CloseIniFile(
     void *Context)
 {
-  INI_PARSING_LIB_CONTEXT *IniContext;
-
-  if (Context == NULL)
-  {
-    return;
-  }
-
-  IniContext = Context;
-  FreeAllList(IniContext->SectionHead, IniContext->CommentHead);
-
-  return;
+  // the context is the head of the arena
+  free(Context);
 }
 
 bool ParseTestSuiteCaseEntry(void *context, uint8_t *section_name, uint8_t *entry_name, uint32_t *cases_id, uint32_t *cases_cnt, uint32_t max_case_id)
@@ -2256,6 +1950,74 @@ void ParseMainSection(void *context, IDE_TEST_CONFIG *test_config)
   {
     test_config->main_config.pcap_enable = data32 == 1;
   }
+
+  sprintf(entry_name, "pcap_format");
+  if (GetStringFromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &entry_value))
+  {
+    if (strcmp((const char*)entry_value, "pcap") == 0) {
+      test_config->main_config.pcap_format = PCAP_FILE_FORMAT_PCAP;
+    } else if (strcmp((const char*)entry_value, "pcapng") == 0) {
+      test_config->main_config.pcap_format = PCAP_FILE_FORMAT_PCAPNG;
+    } else {
+      TEEIO_DEBUG((TEEIO_DEBUG_WARN, "Unknown pcap_format %s. pcapng is used.\n", entry_value));
+      test_config->main_config.pcap_format = PCAP_FILE_FORMAT_PCAPNG;
+    }
+  }
+
+  sprintf(entry_name, "doe_irq");
+  if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32))
+  {
+    test_config->main_config.doe_irq = data32 == 1;
+  }
+
+  sprintf(entry_name, "spdm_fresh_session");
+  if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32))
+  {
+    test_config->main_config.spdm_fresh_session = data32 == 1;
+  }
+
+  sprintf(entry_name, "spdm_probe_empty_slots");
+  if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32))
+  {
+    test_config->main_config.spdm_probe_empty_slots = data32 == 1;
+  }
+
+  sprintf(entry_name, "parallel_topology");
+  if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32))
+  {
+    test_config->main_config.parallel_topology = data32;
+  }
+
+  sprintf(entry_name, "emulator");
+  if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32))
+  {
+    test_config->main_config.emulator = data32 == 1;
+  }
+
+  sprintf(entry_name, "emulator_latency");
+  if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32))
+  {
+    test_config->main_config.emulator_latency_us = data32;
+  }
+
+  sprintf(entry_name, "kcbar_verify");
+  if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32))
+  {
+    test_config->main_config.kcbar_verify = data32 == 1;
+  }
+
+  sprintf(entry_name, "result_stream");
+  if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32))
+  {
+    test_config->main_config.result_stream = data32 == 1;
+  }
+
+  test_config->main_config.result_checkpoint = RESULT_STREAM_DEFAULT_CHECKPOINT;
+  sprintf(entry_name, "result_checkpoint");
+  if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32))
+  {
+    test_config->main_config.result_checkpoint = data32;
+  }
 }
 
 void ParsePortsSection(void *context, IDE_TEST_CONFIG *test_config, IDE_PORT_TYPE port_type)
@@ -2263,6 +2025,7 @@ void ParsePortsSection(void *context, IDE_TEST_CONFIG *test_config, IDE_PORT_TYP
   char entry_name[MAX_ENTRY_NAME_LENGTH] = {0};
   char section_name[MAX_SECTION_NAME_LENGTH] = {0};
   uint8_t *entry_value = NULL;
+  uint32_t data32 = 0;
   int index = 1;
   IDE_PORT *port = NULL;
 
@@ -2290,6 +2053,18 @@ void ParsePortsSection(void *context, IDE_TEST_CONFIG *test_config, IDE_PORT_TYP
     test_config->ports_config.cnt += 1;
     port->id = test_config->ports_config.cnt;
 
+    // DOE wait strategy of endpoint
+    if(port_type == IDE_PORT_TYPE_ENDPOINT) {
+      sprintf(entry_name, "%s_%d_doe_spin", IDE_PORT_TYPE_NAMES[port_type], index);
+      if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32)) {
+        port->doe_spin_max_us = data32;
+      }
+      sprintf(entry_name, "%s_%d_doe_backoff_max", IDE_PORT_TYPE_NAMES[port_type], index);
+      if (GetDecimalUint32FromDataFile(context, (uint8_t *)section_name, (uint8_t *)entry_name, &data32)) {
+        port->doe_backoff_max_us = data32;
+      }
+    }
+
     index++;
   }
 }
@@ -2369,6 +2144,16 @@ void dump_test_config(IDE_TEST_CONFIG *test_config)
   TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  libspdm_log=%s\n", main_config->libspdm_log == 0 ? "false":"true"));
   TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  doe_log=%s\n", main_config->doe_log == 0 ? "false":"true"));
   TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  pcap_enable=%s\n", main_config->pcap_enable == 0 ? "false":"true"));
+  TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  pcap_format=%s\n", main_config->pcap_format == PCAP_FILE_FORMAT_PCAP ? "pcap":"pcapng"));
+  TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  doe_irq=%s\n", main_config->doe_irq == 0 ? "false":"true"));
+  TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  spdm_fresh_session=%s\n", main_config->spdm_fresh_session == 0 ? "false":"true"));
+  TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  spdm_probe_empty_slots=%s\n", main_config->spdm_probe_empty_slots == 0 ? "false":"true"));
+  TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  parallel_topology=%d\n", main_config->parallel_topology));
+  TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  emulator=%s\n", main_config->emulator == 0 ? "false":"true"));
+  TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  emulator_latency=%d\n", main_config->emulator_latency_us));
+  TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  kcbar_verify=%s\n", main_config->kcbar_verify == 0 ? "false":"true"));
+  TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  result_stream=%s\n", main_config->result_stream == 0 ? "false":"true"));
+  TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  result_checkpoint=%d\n", main_config->result_checkpoint));
   TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "\n"));
 
   IDE_TEST_PORTS_CONFIG *ports = &test_config->ports_config;
@@ -2378,6 +2163,10 @@ void dump_test_config(IDE_TEST_CONFIG *test_config)
     TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  id      = %d\n", port->id));
     TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  enabled = %d\n", port->enabled));
     TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  bdf     = %s\n", port->bdf));
+    if(port->port_type == IDE_PORT_TYPE_ENDPOINT) {
+      TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  doe_spin        = %d\n", port->doe_spin_max_us));
+      TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  doe_backoff_max = %d\n", port->doe_backoff_max_us));
+    }
     TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  name    = %s\n", port->port_name));
     TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "  type    = %s\n", IDE_PORT_TYPE_NAMES[port->port_type]));
     TEEIO_DEBUG((TEEIO_DEBUG_VERBOSE, "\n"));
@@ -2556,18 +2345,25 @@ bool parse_ide_test_init(IDE_TEST_CONFIG *test_config, const char *ide_test_ini)
   }
 
   off_t size = lseek(fp, 0x0, SEEK_END);
-  raw_data = (uint8_t *)malloc(size);
-  if (raw_data == NULL)
+  if (size <= 0 || size > UINT32_MAX)
   {
-    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to allocate memory to parse ini file.\n"));
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Invalid size of ide_test_ini file. (%s)\n", ide_test_ini));
+    close(fp);
     return false;
   }
 
-  lseek(fp, 0, SEEK_SET);
-  size_t bytes_read = read(fp, raw_data, size);
-  TEEIO_ASSERT(bytes_read == size);
+  // OpenIniFile parses the mapped file in place and does not keep it.
+  raw_data = (uint8_t *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fp, 0);
+  if (raw_data == MAP_FAILED)
+  {
+    TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to map ide_test_ini file. (%s)\n", ide_test_ini));
+    close(fp);
+    return false;
+  }
 
-  context = OpenIniFile(raw_data, bytes_read);
+  context = OpenIniFile(raw_data, (uint32_t)size);
+  munmap(raw_data, size);
+  raw_data = NULL;
   if (context == NULL)
   {
     TEEIO_ASSERT(false);
@@ -2636,11 +2432,6 @@ ParseDone:
     CloseIniFile(context);
   }
 
-  if (raw_data != NULL)
-  {
-    free(raw_data);
-  }
-
   close(fp);
 
   return ret;
@@ -10,6 +10,7 @@
 #include <ctype.h>
 #include "ide_test.h"
 #include "command.h"
+#include "device_emu.h"
 
 char g_bdf[] = {'2','a',':','0','0','.','0','\0'};
 char g_rp_bdf[] = {'2','9',':','0','2','.','0','\0'};
@@ -28,17 +29,24 @@ bool g_teeio_fixed_key = false;
 pci_tdisp_interface_id_t g_tdisp_interface_id = {0};
 int g_test_interval = 0;
 int g_test_rounds = 0;
+// -1 means KeyRefresh is driven by the tester
+int g_keyrefresh_interval_us = -1;
 
 TEEIO_DEBUG_LEVEL g_debug_level = TEEIO_DEBUG_WARN;
 bool g_libspdm_log = false;
 bool g_doe_log = false;
+bool g_doe_irq = false;
+bool g_spdm_fresh_session = false;
+bool g_spdm_probe_empty_slots = false;
+bool g_kcbar_verify = false;
+uint32_t g_parallel_topology = 0;
 uint16_t g_scan_segment = INVALID_SCAN_SEGMENT;
 uint8_t g_scan_bus = INVALID_SCAN_BUS;
 
 FILE* m_logfile = NULL;
 
 bool log_file_init(const char* filepath);
-bool pcap_file_init(const char* filepath, uint32_t transport_layer);
+bool pcap_file_init(const char* filepath, uint32_t transport_layer, PCAP_FILE_FORMAT format);
 void log_file_close();
 void pcap_file_close();
 void teeio_init_test_funcs();
@@ -66,6 +74,30 @@ static TEEIO_TEST_CATEGORY get_test_category_from_configuration(IDE_TEST_CONFIG*
   return TEEIO_TEST_CATEGORY_MAX;
 }
 
+// Emulate the ports of all the topologies and install the emulator as the device backend
+static bool init_device_emulator(IDE_TEST_CONFIG* test_config)
+{
+  if (!device_emu_init(test_config->main_config.emulator_latency_us)) {
+    return false;
+  }
+
+  for (int i = 0; i < MAX_TOPOLOGY_NUM; i++) {
+    IDE_TEST_TOPOLOGY *top = test_config->topologies.topologies + i;
+    if (!top->enabled) {
+      continue;
+    }
+    if (!device_emu_add_topology(test_config, top)) {
+      TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to emulate topology_%d.\n", top->id));
+      return false;
+    }
+  }
+
+  set_device_backend(device_emu_get_backend());
+  TEEIO_PRINT(("Run against the device emulator.\n"));
+
+  return true;
+}
+
 int main(int argc, char *argv[])
 {
     char ide_test_ini_file[MAX_FILE_NAME] = {0};
@@ -78,6 +110,10 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    if (!teeio_log_init()) {
+        TEEIO_PRINT(("Failed to start the log writer. Log synchronously.\n"));
+    }
+
     TEEIO_PRINT(("%s version %s\n", TEEIO_VALIDATOR_NAME, TEEIO_VALIDATOR_VERSION));
 
     teeio_init_test_funcs();
@@ -112,11 +148,27 @@ int main(int argc, char *argv[])
     g_pci_log = ide_test_config.main_config.pci_log;
     g_libspdm_log = ide_test_config.main_config.libspdm_log;
     g_doe_log = ide_test_config.main_config.doe_log;
+    g_doe_irq = ide_test_config.main_config.doe_irq;
+    g_spdm_fresh_session = ide_test_config.main_config.spdm_fresh_session;
+    g_spdm_probe_empty_slots = ide_test_config.main_config.spdm_probe_empty_slots;
+    g_parallel_topology = ide_test_config.main_config.parallel_topology;
+    g_kcbar_verify = ide_test_config.main_config.kcbar_verify;
 
     if(debug_level == TEEIO_DEBUG_NUM) {
         g_debug_level = ide_test_config.main_config.debug_level;
     }
 
+    // classic pcap has one interface, so the DOE messages of the lanes cannot be told apart in the shared file
+    if(g_parallel_topology > 1 && ide_test_config.main_config.pcap_enable &&
+       ide_test_config.main_config.pcap_format == PCAP_FILE_FORMAT_PCAP) {
+        TEEIO_PRINT(("parallel_topology=%d is not supported with pcap_format=pcap. Use pcapng.\n", g_parallel_topology));
+        goto MainDone;
+    }
+
+    if(g_pci_log && !pci_trace_init(PCI_TRACE_DEFAULT_CAPACITY)) {
+        goto MainDone;
+    }
+
     // tester wants to run a specific test case instead of run test suite
     if(!g_run_test_suite) {
       // g_top_id and g_config_id shall be set in command line
@@ -150,14 +202,28 @@ int main(int argc, char *argv[])
       }
     }
 
+    if(ide_test_config.main_config.emulator && !init_device_emulator(&ide_test_config)) {
+        goto MainDone;
+    }
+
     // Open pcap file
     if (ide_test_config.main_config.pcap_enable) {
-       if (!pcap_file_init(PCAPFILE, SOCKET_TRANSPORT_TYPE_PCI_DOE)) {
+       if (!pcap_file_init(PCAPFILE, SOCKET_TRANSPORT_TYPE_PCI_DOE, ide_test_config.main_config.pcap_format)) {
            TEEIO_PRINT(("Failed to open pcap file!\n"));
            goto MainDone;
        }
     }
 
+    // Open result file
+    if (ide_test_config.main_config.result_stream) {
+       const teeio_result_sink_t *result_sink = jsonl_result_sink_open(RESULTFILE, ide_test_config.main_config.result_checkpoint);
+       if (result_sink == NULL) {
+           TEEIO_PRINT(("Failed to open result file!\n"));
+           goto MainDone;
+       }
+       set_result_sink(result_sink);
+    }
+
     srand((unsigned int)time(NULL));
 
     run(&ide_test_config);
@@ -170,6 +236,14 @@ int main(int argc, char *argv[])
     }
 
 MainDone:
+    if (get_result_sink() != NULL) {
+       get_result_sink()->close();
+       set_result_sink(NULL);
+    }
+    pci_trace_dump();
+    pci_trace_close();
+    device_emu_close();
+    teeio_log_close();
     log_file_close();
     teeio_clean_test_libs();
 
@@ -0,0 +1,461 @@
+/**
+ *  Copyright Notice:
+ *  Copyright 2024 Intel. All rights reserved.
+ *  License: BSD 3-Clause License.
+ **/
+
+#include <ctype.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "teeio_validator.h"
+#include "teeio_spdmlib.h"
+#include "ide_tools.h"
+#include "pcie_ide_lib.h"
+#include <industry_standard/pci_tdisp.h>
+
+#define DOE_BENCH_DEFAULT_LOOPS 1000
+// histogram[i] counts the round trips which take [2^i, 2^(i+1)) us.
+#define DOE_BENCH_HISTOGRAM_BUCKETS 24
+#define DOE_BENCH_HISTOGRAM_BAR_LENGTH 50
+#define DOE_BENCH_TDISP_RESPONSE_SIZE 64
+
+bool g_pci_log = false;
+TEEIO_DEBUG_LEVEL g_debug_level = TEEIO_DEBUG_WARN;
+bool g_libspdm_log = false;
+bool g_doe_log = false;
+bool g_doe_irq = false;
+bool g_spdm_fresh_session = false;
+bool g_spdm_probe_empty_slots = false;
+bool g_kcbar_verify = false;
+uint32_t g_parallel_topology = 0;
+FILE* m_logfile = NULL;
+
+char m_bdf[BDF_LENGTH] = {0};
+int m_loops = DOE_BENCH_DEFAULT_LOOPS;
+uint8_t m_port_index = 0;
+
+typedef struct {
+    void *doe_context;
+    void *spdm_context;
+    uint32_t session_id;
+    uint8_t doe_discovery_version;
+    uint8_t port_index;
+    uint32_t tdisp_function_id;
+} doe_bench_context_t;
+
+typedef bool (*doe_bench_func_t)(doe_bench_context_t *context);
+
+typedef struct {
+    const char *name;
+    const char *description;
+    doe_bench_func_t func;
+    // the request is sent in a secure spdm session
+    bool in_session;
+    bool enabled;
+} doe_bench_t;
+
+#pragma pack(1)
+typedef struct {
+    pci_doe_data_object_header_t header;
+    uint8_t index;
+    uint8_t version;
+    uint16_t reserved;
+} doe_bench_discovery_request_mine_t;
+
+typedef struct {
+    pci_doe_data_object_header_t header;
+    uint16_t vendor_id;
+    uint8_t data_object_type;
+    uint8_t next_index;
+} doe_bench_discovery_response_mine_t;
+#pragma pack()
+
+// One DOE Discovery round trip for index 0. pci_doe_discovery walks all the indexes,
+// i.e. one round trip per data object protocol.
+static bool doe_bench_discovery(doe_bench_context_t *context)
+{
+    doe_bench_discovery_request_mine_t request;
+    doe_bench_discovery_response_mine_t response;
+    size_t response_size = sizeof(response);
+
+    libspdm_zero_mem(&request, sizeof(request));
+    request.header.vendor_id = PCI_DOE_VENDOR_ID_PCISIG;
+    request.header.data_object_type = PCI_DOE_DATA_OBJECT_TYPE_DOE_DISCOVERY;
+    request.header.length = sizeof(request) / sizeof(uint32_t);
+    request.index = 0;
+    request.version = context->doe_discovery_version;
+
+    libspdm_return_t status = pci_doe_send_receive_data(context->doe_context, sizeof(request), &request,
+                                                        &response_size, &response);
+    if (LIBSPDM_STATUS_IS_ERROR(status) || response_size != sizeof(response))
+    {
+        return false;
+    }
+
+    return response.header.vendor_id == PCI_DOE_VENDOR_ID_PCISIG &&
+           response.header.data_object_type == PCI_DOE_DATA_OBJECT_TYPE_DOE_DISCOVERY;
+}
+
+static bool doe_bench_spdm_get_version(doe_bench_context_t *context)
+{
+    libspdm_return_t status = libspdm_init_connection(context->spdm_context, true);
+    return !LIBSPDM_STATUS_IS_ERROR(status);
+}
+
+static bool doe_bench_ide_km_query(doe_bench_context_t *context)
+{
+    uint8_t dev_func = 0;
+    uint8_t bus = 0;
+    uint8_t segment = 0;
+    uint8_t max_port_index = 0;
+    uint32_t ide_reg_block[PCI_IDE_KM_IDE_REG_BLOCK_SUPPORTED_COUNT] = {0};
+    uint32_t ide_reg_block_count = PCI_IDE_KM_IDE_REG_BLOCK_SUPPORTED_COUNT;
+
+    libspdm_return_t status = pci_ide_km_query(context->doe_context, context->spdm_context, &context->session_id,
+                                               context->port_index, &dev_func, &bus, &segment, &max_port_index,
+                                               ide_reg_block, &ide_reg_block_count);
+    return !LIBSPDM_STATUS_IS_ERROR(status);
+}
+
+static bool doe_bench_tdisp_get_version(doe_bench_context_t *context)
+{
+    pci_tdisp_get_version_request_t request;
+    uint8_t response[DOE_BENCH_TDISP_RESPONSE_SIZE];
+    size_t response_size = sizeof(response);
+
+    libspdm_zero_mem(&request, sizeof(request));
+    request.header.version = PCI_TDISP_MESSAGE_VERSION_10;
+    request.header.message_type = PCI_TDISP_GET_VERSION;
+    request.header.interface_id.function_id = context->tdisp_function_id;
+
+    libspdm_return_t status = pci_tdisp_send_receive_data(context->spdm_context, &context->session_id,
+                                                          &request, sizeof(request), response, &response_size);
+    return !LIBSPDM_STATUS_IS_ERROR(status);
+}
+
+doe_bench_t m_doe_benches[] = {
+    {"discovery", "DOE Discovery", doe_bench_discovery, false, true},
+    {"version", "SPDM GET_VERSION", doe_bench_spdm_get_version, false, true},
+    {"idekm", "IDE_KM QUERY", doe_bench_ide_km_query, true, true},
+    {"tdisp", "TDISP GET_VERSION", doe_bench_tdisp_get_version, true, true}
+};
+
+#define DOE_BENCH_NUM (sizeof(m_doe_benches) / sizeof(doe_bench_t))
+
+void print_usage()
+{
+    TEEIO_PRINT(( "\n"));
+    TEEIO_PRINT(( "Usage:\n"));
+    TEEIO_PRINT(( "  doebench -d <bdf> [-n <loops>] [-s <benchmarks>]\n"));
+
+    TEEIO_PRINT(( "\n"));
+    TEEIO_PRINT(( "Options:\n"));
+    TEEIO_PRINT(( "  -d <bdf>            : bdf of the endpoint. For example 0000:da:00.0\n"));
+    TEEIO_PRINT(( "  -n <loops>          : round trips of each benchmark. Default is %d\n", DOE_BENCH_DEFAULT_LOOPS));
+    TEEIO_PRINT(( "  -s <benchmarks>     : benchmarks to be run. discovery,version,idekm,tdisp. Default is all of them\n"));
+    TEEIO_PRINT(( "  -p <port_index>     : port_index of IDE_KM QUERY. Default is 0\n"));
+    TEEIO_PRINT(( "  -l <debug_level>    : Set debug level. error/warn/info/verbose\n"));
+    TEEIO_PRINT(( "  -h                  : Display this usage\n"));
+}
+
+static bool enable_benches_from_string(char *str)
+{
+    char *name;
+    size_t i;
+
+    for (i = 0; i < DOE_BENCH_NUM; i++)
+    {
+        m_doe_benches[i].enabled = false;
+    }
+
+    for (name = strtok(str, ","); name != NULL; name = strtok(NULL, ","))
+    {
+        for (i = 0; i < DOE_BENCH_NUM; i++)
+        {
+            if (strcmp(name, m_doe_benches[i].name) == 0)
+            {
+                m_doe_benches[i].enabled = true;
+                break;
+            }
+        }
+        if (i == DOE_BENCH_NUM)
+        {
+            TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Unknown benchmark %s\n", name));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * parse the command line option
+ */
+bool parse_cmdline_option(int argc, char *argv[], bool *print_usage)
+{
+    int opt, v;
+
+    TEEIO_ASSERT(argc > 0);
+    TEEIO_ASSERT(argv != NULL);
+    TEEIO_ASSERT(print_usage != NULL);
+
+    while ((opt = getopt(argc, argv, "d:n:s:p:l:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            if (strlen(optarg) >= BDF_LENGTH)
+            {
+                TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Invalid -d parameter. %s\n", optarg));
+                return false;
+            }
+            strncpy(m_bdf, optarg, BDF_LENGTH - 1);
+            break;
+
+        case 'n':
+            v = atoi(optarg);
+            if (v <= 0)
+            {
+                TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Invalid -n parameter. %s\n", optarg));
+                return false;
+            }
+            m_loops = v;
+            break;
+
+        case 's':
+            if (!enable_benches_from_string(optarg))
+            {
+                TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Invalid -s parameter.\n"));
+                return false;
+            }
+            break;
+
+        case 'p':
+            v = atoi(optarg);
+            if (v < 0 || v > 0xff)
+            {
+                TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Invalid -p parameter. %s\n", optarg));
+                return false;
+            }
+            m_port_index = (uint8_t)v;
+            break;
+
+        case 'l':
+            g_debug_level = get_ide_log_level_from_string(optarg);
+            break;
+
+        case 'h':
+            *print_usage = true;
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void print_bench_result(const doe_bench_t *bench, uint64_t *samples, int cnt, int failures, uint64_t elapsed_ns,
+                               const pci_doe_statistics_t *before, const pci_doe_statistics_t *after)
+{
+    uint32_t histogram[DOE_BENCH_HISTOGRAM_BUCKETS] = {0};
+    uint32_t max_bucket_cnt = 0;
+    uint64_t request_dwords = (after->request_bytes - before->request_bytes) / sizeof(uint32_t);
+    uint64_t response_dwords = (after->response_bytes - before->response_bytes) / sizeof(uint32_t);
+    uint64_t latency_us;
+    int bucket;
+    int i;
+
+    TEEIO_PRINT(("\n"));
+    TEEIO_PRINT(("%s: %d round trips in %llums, %d failures\n", bench->description, cnt,
+                 (unsigned long long)(elapsed_ns / 1000000), failures));
+    if (cnt == 0)
+    {
+        return;
+    }
+
+    sort_uint64_array(samples, cnt);
+    TEEIO_PRINT(("  round trip (us): min %llu, p50 %llu, p95 %llu, p99 %llu, max %llu\n",
+                 (unsigned long long)(samples[0] / 1000),
+                 (unsigned long long)(get_percentile_of_sorted_uint64_array(samples, cnt, 50) / 1000),
+                 (unsigned long long)(get_percentile_of_sorted_uint64_array(samples, cnt, 95) / 1000),
+                 (unsigned long long)(get_percentile_of_sorted_uint64_array(samples, cnt, 99) / 1000),
+                 (unsigned long long)(samples[cnt - 1] / 1000)));
+    TEEIO_PRINT(("  mailbox: %llu dwords/s (%llu request dwords, %llu response dwords)\n",
+                 elapsed_ns == 0 ? 0ULL : (unsigned long long)((request_dwords + response_dwords) * 1000000000ULL / elapsed_ns),
+                 (unsigned long long)request_dwords, (unsigned long long)response_dwords));
+    TEEIO_PRINT(("  doe: %llu errors, %llu timeouts, %llu aborts\n",
+                 (unsigned long long)(after->errors - before->errors),
+                 (unsigned long long)(after->timeouts - before->timeouts),
+                 (unsigned long long)(after->aborts - before->aborts)));
+
+    for (i = 0; i < cnt; i++)
+    {
+        latency_us = samples[i] / 1000;
+        bucket = 0;
+        while (latency_us > 1 && bucket < DOE_BENCH_HISTOGRAM_BUCKETS - 1)
+        {
+            latency_us >>= 1;
+            bucket++;
+        }
+        histogram[bucket]++;
+        if (histogram[bucket] > max_bucket_cnt)
+        {
+            max_bucket_cnt = histogram[bucket];
+        }
+    }
+
+    TEEIO_PRINT(("  histogram (us):\n"));
+    for (i = 0; i < DOE_BENCH_HISTOGRAM_BUCKETS; i++)
+    {
+        char bar[DOE_BENCH_HISTOGRAM_BAR_LENGTH + 1] = {0};
+        if (histogram[i] == 0)
+        {
+            continue;
+        }
+        memset(bar, '#', (size_t)histogram[i] * DOE_BENCH_HISTOGRAM_BAR_LENGTH / max_bucket_cnt);
+        TEEIO_PRINT(("    [%8llu, %8llu) %8u %s\n", i == 0 ? 0ULL : 1ULL << i, 1ULL << (i + 1), histogram[i], bar));
+    }
+}
+
+static bool run_bench(doe_bench_context_t *context, const doe_bench_t *bench, int loops)
+{
+    pci_doe_statistics_t before;
+    pci_doe_statistics_t after;
+    uint64_t start_ns;
+    uint64_t sample_start_ns;
+    int failures = 0;
+    int i;
+
+    uint64_t *samples = (uint64_t *)calloc(loops, sizeof(uint64_t));
+    if (samples == NULL)
+    {
+        TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to allocate %d samples.\n", loops));
+        return false;
+    }
+
+    pci_doe_context_get_statistics(context->doe_context, &before);
+    start_ns = get_monotonic_time_ns();
+    for (i = 0; i < loops; i++)
+    {
+        sample_start_ns = get_monotonic_time_ns();
+        if (!bench->func(context))
+        {
+            failures++;
+        }
+        samples[i] = get_monotonic_time_ns() - sample_start_ns;
+    }
+    pci_doe_context_get_statistics(context->doe_context, &after);
+
+    print_bench_result(bench, samples, loops, failures, get_monotonic_time_ns() - start_ns, &before, &after);
+    free(samples);
+
+    return failures == 0;
+}
+
+// tdisp function_id of the endpoint. Its bits 15:0 are the Requester ID of the function.
+static uint32_t get_tdisp_function_id(const char *bdf)
+{
+    uint32_t segment, bus, device, function;
+
+    if (sscanf(bdf, "%x:%x:%x.%x", &segment, &bus, &device, &function) != 4)
+    {
+        return 0;
+    }
+
+    return ((bus & 0xff) << 8) | ((device & 0x1f) << 3) | (function & 0x7);
+}
+
+int main(int argc, char *argv[])
+{
+    TEEIO_PRINT(( "%s version %s\n", DOE_BENCH_NAME, DOE_BENCH_VERSION));
+
+    bool to_print_usage = false;
+    bool ret = true;
+    IDE_PORT port = {0};
+    ide_common_test_port_context_t port_context = {0};
+    doe_bench_context_t context = {0};
+    PCIE_CAP_ID ecap_id = {.raw = 0};
+
+    // parse command line optioins
+    if (!parse_cmdline_option(argc, argv, &to_print_usage))
+    {
+        print_usage();
+        return -1;
+    }
+
+    if (to_print_usage || m_bdf[0] == 0)
+    {
+        print_usage();
+        return 0;
+    }
+
+    strncpy(port.bdf, m_bdf, BDF_LENGTH - 1);
+    port.port_type = IDE_PORT_TYPE_ENDPOINT;
+    port_context.port = &port;
+
+    int fd = open_configuration_space(port.bdf);
+    if (fd == -1)
+    {
+        return -1;
+    }
+    port_context.cfg_space_fd = fd;
+
+    if (!init_pci_doe(&port_context))
+    {
+        close_configuration_space(fd);
+        return -1;
+    }
+
+    ecap_id.raw = device_pci_read_32(port_context.doe_offset, fd);
+    context.doe_context = port_context.doe_context;
+    context.doe_discovery_version = ecap_id.version >= PCIE_DOE_ECAP_VERSION2 ? PCIE_DOE_DISCOVERY_VERSION2 : 0;
+    context.port_index = m_port_index;
+    context.tdisp_function_id = get_tdisp_function_id(port.bdf);
+
+    for (size_t i = 0; i < DOE_BENCH_NUM; i++)
+    {
+        doe_bench_t *bench = m_doe_benches + i;
+        if (!bench->enabled)
+        {
+            continue;
+        }
+
+        if (bench->func != doe_bench_discovery && context.spdm_context == NULL)
+        {
+            if (!spdm_session_acquire(port.bdf, context.doe_context, &context.spdm_context, &context.session_id))
+            {
+                TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Failed to setup spdm session with %s\n", port.bdf));
+                ret = false;
+                break;
+            }
+        }
+
+        if (!run_bench(&context, bench, m_loops))
+        {
+            ret = false;
+        }
+
+        if (bench->func == doe_bench_spdm_get_version)
+        {
+            // GET_VERSION resets the connection. The session is gone.
+            spdm_session_pool_evict(port.bdf, NULL);
+            context.spdm_context = NULL;
+        }
+    }
+
+    if (context.spdm_context != NULL)
+    {
+        spdm_session_pool_evict(port.bdf, context.doe_context);
+    }
+
+    close_pci_doe(&port_context);
+    close_configuration_space(fd);
+
+    return ret ? 0 : -1;
+}
@@ -197,7 +197,7 @@ bool read_ide_cap_ctrl_register(IDE_PORT* port, uint32_t *ide_cap, uint32_t *ide
     ret = true;
 
 ReadIdeCapCtrlFailed:
-    close(fd);
+    close_configuration_space(fd);
 
     return ret;
 }
@@ -207,20 +207,60 @@ ide_test_case_name_t *get_test_case_from_string(const char *test_case_name, int
     return NULL;
 }
 
-bool pcie_doe_init_request(uint8_t doe_discovery_version)
+// the tools do not talk DOE. The DOE context is a placeholder.
+static int m_doe_context_stub;
+
+void *pci_doe_context_open(const char *bdf, int fd, uint32_t spin_max_us, uint32_t backoff_max_us)
+{
+    return &m_doe_context_stub;
+}
+
+void pci_doe_context_close(void *doe_context)
+{
+}
+
+void pci_doe_context_set_mailbox(void *doe_context, uint32_t doe_offset)
+{
+}
+
+void *pci_doe_context_fork(void *doe_context)
+{
+    return doe_context;
+}
+
+bool pcie_doe_init_request(void *doe_context, uint8_t doe_discovery_version)
 {
     return true;
 }
 
-void trigger_doe_abort()
+bool pci_doe_check_protocols(void *doe_context)
 {
+    return true;
 }
 
-bool is_doe_error_asserted()
+uint32_t pci_doe_context_get_mailbox(void *doe_context, uint16_t vendor_id, uint8_t data_object_type)
+{
+    return 0;
+}
+
+void trigger_doe_abort(void *doe_context)
+{
+}
+
+bool is_doe_error_asserted(void *doe_context)
 {
     return false;
 }
 
+bool pci_doe_enable_interrupt(void *doe_context)
+{
+    return false;
+}
+
+void pci_doe_disable_interrupt(void *doe_context)
+{
+}
+
 void libspdm_sleep(uint64_t microseconds)
 {
 }
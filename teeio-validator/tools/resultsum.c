@@ -0,0 +1,629 @@
+/**
+ *  Copyright Notice:
+ *  Copyright 2024 Intel. All rights reserved.
+ *  License: BSD 3-Clause License.
+ **/
+
+#include <ctype.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "teeio_validator.h"
+#include "ide_tools.h"
+
+// resultsum rebuilds the pass/fail tree of a run from its result stream
+// (see result_sink.c). The stream may end in a partial line if the run crashed.
+
+#define RESULT_SUM_MAX_RECORD_LENGTH (MAX_LINE_LENGTH * 16)
+
+// setup and teardown of a test group
+#define RESULT_SUM_GROUP_FUNC_NUM 2
+static const char *m_group_func_str[RESULT_SUM_GROUP_FUNC_NUM] = {
+    "setup", "teardown"
+};
+
+// support, enable, disable and check of a configuration item
+#define RESULT_SUM_CONFIG_FUNC_NUM 4
+static const char *m_config_func_str[RESULT_SUM_CONFIG_FUNC_NUM] = {
+    "support", "enable", "disable", "check"
+};
+#define RESULT_SUM_RESULT_LENGTH 16
+
+TEEIO_DEBUG_LEVEL g_debug_level = TEEIO_DEBUG_WARN;
+FILE* m_logfile = NULL;
+
+char m_result_file[MAX_FILE_NAME] = {0};
+bool m_print_failed_assertions = false;
+
+// result of the config item records of a case, empty if the func is not seen
+typedef struct _result_sum_config_item_t result_sum_config_item_t;
+struct _result_sum_config_item_t {
+    result_sum_config_item_t *next;
+    int id;
+    char results[RESULT_SUM_CONFIG_FUNC_NUM][RESULT_SUM_RESULT_LENGTH];
+};
+
+// suite -> configuration -> group -> case
+typedef struct _result_sum_node_t result_sum_node_t;
+struct _result_sum_node_t {
+    result_sum_node_t *next;
+    result_sum_node_t *child;
+    result_sum_node_t *child_tail;
+    char name[MAX_NAME_LENGTH];
+    int id;
+
+    int passed;
+    int failed;
+    // case: the case record is seen, so passed/failed are final
+    bool done;
+    unsigned long long total_us;
+    // group: result of the setup/teardown record, empty if it is not seen
+    char func_results[RESULT_SUM_GROUP_FUNC_NUM][MAX_NAME_LENGTH];
+    char func_messages[RESULT_SUM_GROUP_FUNC_NUM][MAX_LINE_LENGTH];
+    // case: the config items in the order they are first seen
+    result_sum_config_item_t *config_item;
+    result_sum_config_item_t *config_item_tail;
+};
+
+typedef struct {
+    result_sum_node_t root;
+    unsigned long long records;
+    unsigned long long checkpoint_records;
+    int partial_lines;
+    int invalid_lines;
+} result_sum_t;
+
+void print_usage()
+{
+    TEEIO_PRINT(( "\n"));
+    TEEIO_PRINT(( "Usage:\n"));
+    TEEIO_PRINT(( "  resultsum -f <result_file> [-a]\n"));
+
+    TEEIO_PRINT(( "\n"));
+    TEEIO_PRINT(( "Options:\n"));
+    TEEIO_PRINT(( "  -f <result_file>    : result stream written by teeio_validator with result_stream=1\n"));
+    TEEIO_PRINT(( "  -a                  : print the failed assertions\n"));
+    TEEIO_PRINT(( "  -h                  : Display this usage\n"));
+}
+
+bool parse_cmdline_option(int argc, char *argv[], bool *print_usage)
+{
+    int opt;
+
+    TEEIO_ASSERT(argc > 0);
+    TEEIO_ASSERT(argv != NULL);
+    TEEIO_ASSERT(print_usage != NULL);
+
+    while ((opt = getopt(argc, argv, "f:ah")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            if (strlen(optarg) >= MAX_FILE_NAME)
+            {
+                TEEIO_DEBUG((TEEIO_DEBUG_ERROR, "Invalid -f parameter. %s\n", optarg));
+                return false;
+            }
+            strncpy(m_result_file, optarg, MAX_FILE_NAME - 1);
+            break;
+
+        case 'a':
+            m_print_failed_assertions = true;
+            break;
+
+        case 'h':
+            *print_usage = true;
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Get the string value of "key" in the record and unescape it.
+ * The values are escaped by the writer, so an unescaped "key": only appears as a key.
+ */
+static bool get_string_field(const char *record, const char *key, char *value, size_t size)
+{
+    char pattern[MAX_NAME_LENGTH];
+    const char *p;
+    size_t pos = 0;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":\"", key);
+    p = strstr(record, pattern);
+    if (p == NULL)
+    {
+        return false;
+    }
+
+    for (p += strlen(pattern); *p && *p != '"'; p++)
+    {
+        char c = *p;
+        if (c == '\\')
+        {
+            p++;
+            if (*p == 'n')
+            {
+                c = '\n';
+            }
+            else if (*p == 'u')
+            {
+                unsigned int u = 0;
+                if (sscanf(p + 1, "%4x", &u) != 1)
+                {
+                    return false;
+                }
+                c = (char)u;
+                p += 4;
+            }
+            else if (*p == 0)
+            {
+                return false;
+            }
+            else
+            {
+                c = *p;
+            }
+        }
+        if (pos < size - 1)
+        {
+            value[pos++] = c;
+        }
+    }
+    value[pos] = 0;
+
+    return *p == '"';
+}
+
+static bool get_number_field(const char *record, const char *key, unsigned long long *value)
+{
+    char pattern[MAX_NAME_LENGTH];
+
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char *p = strstr(record, pattern);
+    if (p == NULL || !isdigit((unsigned char)p[strlen(pattern)]))
+    {
+        return false;
+    }
+
+    *value = strtoull(p + strlen(pattern), NULL, 10);
+    return true;
+}
+
+// find the child by name. The records of a node mostly follow each other, so the last child is checked first.
+static result_sum_node_t *get_child(result_sum_node_t *parent, const char *name, int id)
+{
+    result_sum_node_t *child = parent->child_tail;
+
+    if (child == NULL || child->id != id || strcmp(child->name, name) != 0)
+    {
+        for (child = parent->child; child != NULL; child = child->next)
+        {
+            if (child->id == id && strcmp(child->name, name) == 0)
+            {
+                break;
+            }
+        }
+    }
+
+    if (child == NULL)
+    {
+        child = (result_sum_node_t *)calloc(1, sizeof(result_sum_node_t));
+        TEEIO_ASSERT(child);
+        strncpy(child->name, name, MAX_NAME_LENGTH - 1);
+        child->id = id;
+
+        if (parent->child_tail == NULL)
+        {
+            parent->child = child;
+        }
+        else
+        {
+            parent->child_tail->next = child;
+        }
+        parent->child_tail = child;
+    }
+
+    return child;
+}
+
+static result_sum_node_t *get_group_node(result_sum_t *sum, const char *record)
+{
+    char suite[MAX_NAME_LENGTH];
+    char config[MAX_NAME_LENGTH];
+    char group[MAX_NAME_LENGTH];
+    unsigned long long config_id;
+
+    if (!get_string_field(record, "suite", suite, sizeof(suite)) ||
+        !get_number_field(record, "config_id", &config_id) ||
+        !get_string_field(record, "config", config, sizeof(config)) ||
+        !get_string_field(record, "group", group, sizeof(group)))
+    {
+        return NULL;
+    }
+
+    result_sum_node_t *node = get_child(&sum->root, suite, 0);
+    node = get_child(node, config, (int)config_id);
+    return get_child(node, group, 0);
+}
+
+static result_sum_node_t *get_case_node(result_sum_t *sum, const char *record)
+{
+    char test_case[MAX_NAME_LENGTH];
+
+    if (!get_string_field(record, "case", test_case, sizeof(test_case)))
+    {
+        return NULL;
+    }
+
+    result_sum_node_t *node = get_group_node(sum, record);
+    if (node == NULL)
+    {
+        return NULL;
+    }
+    return get_child(node, test_case, 0);
+}
+
+static result_sum_config_item_t *get_config_item(result_sum_node_t *test_case, int id)
+{
+    result_sum_config_item_t *item = test_case->config_item_tail;
+
+    if (item == NULL || item->id != id)
+    {
+        for (item = test_case->config_item; item != NULL; item = item->next)
+        {
+            if (item->id == id)
+            {
+                break;
+            }
+        }
+    }
+
+    if (item == NULL)
+    {
+        item = (result_sum_config_item_t *)calloc(1, sizeof(result_sum_config_item_t));
+        TEEIO_ASSERT(item);
+        item->id = id;
+
+        if (test_case->config_item_tail == NULL)
+        {
+            test_case->config_item = item;
+        }
+        else
+        {
+            test_case->config_item_tail->next = item;
+        }
+        test_case->config_item_tail = item;
+    }
+
+    return item;
+}
+
+static bool add_record(result_sum_t *sum, const char *record)
+{
+    char type[MAX_NAME_LENGTH];
+    char result[MAX_NAME_LENGTH];
+    char kind[MAX_NAME_LENGTH];
+    unsigned long long v;
+    result_sum_node_t *node;
+
+    if (!get_string_field(record, "type", type, sizeof(type)))
+    {
+        return false;
+    }
+
+    if (strcmp(type, "checkpoint") == 0)
+    {
+        if (!get_number_field(record, "records", &sum->checkpoint_records))
+        {
+            return false;
+        }
+        return true;
+    }
+
+    sum->records++;
+
+    if (strcmp(type, "assertion") == 0)
+    {
+        node = get_case_node(sum, record);
+        if (node == NULL || !get_string_field(record, "result", result, sizeof(result)) ||
+            !get_string_field(record, "kind", kind, sizeof(kind)))
+        {
+            return false;
+        }
+        if (strcmp(kind, "test") != 0 || node->done)
+        {
+            return true;
+        }
+
+        if (strcmp(result, "pass") == 0)
+        {
+            node->passed++;
+        }
+        else if (strcmp(result, "fail") == 0)
+        {
+            node->failed++;
+            if (m_print_failed_assertions)
+            {
+                char id[MAX_NAME_LENGTH];
+                char message[MAX_LINE_LENGTH];
+                get_string_field(record, "id", id, sizeof(id));
+                get_string_field(record, "message", message, sizeof(message));
+                TEEIO_PRINT(("  %s Assertion%s: - fail %s\n", node->name, id, message));
+            }
+        }
+    }
+    else if (strcmp(type, "case") == 0)
+    {
+        node = get_case_node(sum, record);
+        if (node == NULL)
+        {
+            return false;
+        }
+        node->done = true;
+        if (get_number_field(record, "passed", &v))
+        {
+            node->passed = (int)v;
+        }
+        if (get_number_field(record, "failed", &v))
+        {
+            node->failed = (int)v;
+        }
+        get_number_field(record, "total_us", &node->total_us);
+    }
+    else if (strcmp(type, "group") == 0)
+    {
+        char func[MAX_NAME_LENGTH];
+        int i;
+
+        node = get_group_node(sum, record);
+        if (node == NULL || !get_string_field(record, "func", func, sizeof(func)) ||
+            !get_string_field(record, "result", result, sizeof(result)))
+        {
+            return false;
+        }
+        for (i = 0; i < RESULT_SUM_GROUP_FUNC_NUM; i++)
+        {
+            if (strcmp(func, m_group_func_str[i]) == 0)
+            {
+                break;
+            }
+        }
+        if (i == RESULT_SUM_GROUP_FUNC_NUM)
+        {
+            return false;
+        }
+        strncpy(node->func_results[i], result, MAX_NAME_LENGTH - 1);
+        node->func_messages[i][0] = 0;
+        get_string_field(record, "message", node->func_messages[i], sizeof(node->func_messages[i]));
+    }
+    else if (strcmp(type, "config_item") == 0)
+    {
+        char func[MAX_NAME_LENGTH];
+        int i;
+
+        node = get_case_node(sum, record);
+        if (node == NULL || !get_number_field(record, "item", &v) ||
+            !get_string_field(record, "func", func, sizeof(func)) ||
+            !get_string_field(record, "result", result, sizeof(result)))
+        {
+            return false;
+        }
+        for (i = 0; i < RESULT_SUM_CONFIG_FUNC_NUM; i++)
+        {
+            if (strcmp(func, m_config_func_str[i]) == 0)
+            {
+                break;
+            }
+        }
+        if (i == RESULT_SUM_CONFIG_FUNC_NUM)
+        {
+            return false;
+        }
+        result_sum_config_item_t *item = get_config_item(node, (int)v);
+        strncpy(item->results[i], result, RESULT_SUM_RESULT_LENGTH - 1);
+    }
+
+    return true;
+}
+
+// sum up the children into the node
+static void sum_up(result_sum_node_t *node)
+{
+    if (node->child == NULL)
+    {
+        return;
+    }
+
+    node->passed = 0;
+    node->failed = 0;
+    for (result_sum_node_t *child = node->child; child != NULL; child = child->next)
+    {
+        sum_up(child);
+        node->passed += child->passed;
+        node->failed += child->failed;
+    }
+}
+
+static const char *get_case_result_str(const result_sum_node_t *node)
+{
+    if (node->failed > 0)
+    {
+        return "fail";
+    }
+    return node->passed > 0 ? "pass" : "skipped";
+}
+
+static void print_group_func_result(const result_sum_node_t *group, int func)
+{
+    if (group->func_results[func][0] == 0)
+    {
+        return;
+    }
+    TEEIO_PRINT(("       %s: %s %s\n", m_group_func_str[func], group->func_results[func], group->func_messages[func]));
+}
+
+static void print_config_item_results(const result_sum_node_t *test_case)
+{
+    char buffer[MAX_LINE_LENGTH];
+    char func_result[MAX_NAME_LENGTH];
+    int pos;
+
+    for (result_sum_config_item_t *item = test_case->config_item; item != NULL; item = item->next)
+    {
+        pos = 0;
+        buffer[0] = 0;
+        for (int i = 0; i < RESULT_SUM_CONFIG_FUNC_NUM; i++)
+        {
+            if (item->results[i][0] == 0)
+            {
+                continue;
+            }
+            snprintf(func_result, sizeof(func_result), "%s: %s", m_config_func_str[i], item->results[i]);
+            pos += snprintf(buffer + pos, sizeof(buffer) - pos, "%-18s ", func_result);
+        }
+        TEEIO_PRINT(("         ConfigItem %d: - %s\n", item->id, buffer));
+    }
+}
+
+static void print_result_sum(result_sum_t *sum)
+{
+    sum_up(&sum->root);
+
+    TEEIO_PRINT(("\n"));
+    TEEIO_PRINT((" Summary of %s - pass: %d, fail: %d\n", m_result_file, sum->root.passed, sum->root.failed));
+    for (result_sum_node_t *suite = sum->root.child; suite != NULL; suite = suite->next)
+    {
+        TEEIO_PRINT((" %s - pass: %d, fail: %d\n", suite->name, suite->passed, suite->failed));
+        for (result_sum_node_t *config = suite->child; config != NULL; config = config->next)
+        {
+            TEEIO_PRINT(("   Configuration_%d (%s)\n", config->id, config->name));
+            for (result_sum_node_t *group = config->child; group != NULL; group = group->next)
+            {
+                TEEIO_PRINT(("     TestGroup (%s) - pass: %d, fail: %d\n", group->name, group->passed, group->failed));
+                print_group_func_result(group, 0);
+                for (result_sum_node_t *test_case = group->child; test_case != NULL; test_case = test_case->next)
+                {
+                    TEEIO_PRINT(("       TestCase %s: %s (pass: %d, fail: %d)%s\n", test_case->name,
+                                 get_case_result_str(test_case), test_case->passed, test_case->failed,
+                                 test_case->done ? "" : " incomplete"));
+                    print_config_item_results(test_case);
+                }
+                print_group_func_result(group, 1);
+            }
+        }
+    }
+
+    TEEIO_PRINT(("\n"));
+    TEEIO_PRINT((" %llu records, %llu of them before the last checkpoint.\n", sum->records, sum->checkpoint_records));
+    if (sum->partial_lines > 0 || sum->invalid_lines > 0)
+    {
+        TEEIO_PRINT((" %d partial and %d invalid lines are skipped.\n", sum->partial_lines, sum->invalid_lines));
+    }
+}
+
+static void free_node(result_sum_node_t *node)
+{
+    result_sum_node_t *child = node->child;
+    result_sum_config_item_t *item = node->config_item;
+
+    while (item != NULL)
+    {
+        result_sum_config_item_t *next = item->next;
+        free(item);
+        item = next;
+    }
+
+    while (child != NULL)
+    {
+        result_sum_node_t *next = child->next;
+        free_node(child);
+        free(child);
+        child = next;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool to_print_usage = false;
+    char *record = NULL;
+    result_sum_t sum = {0};
+    int ret = -1;
+
+    TEEIO_PRINT(( "%s version %s\n", RESULT_SUM_NAME, RESULT_SUM_VERSION));
+
+    // parse command line optioins
+    if (!parse_cmdline_option(argc, argv, &to_print_usage))
+    {
+        print_usage();
+        return -1;
+    }
+
+    if (to_print_usage)
+    {
+        print_usage();
+        return 0;
+    }
+
+    if (m_result_file[0] == 0)
+    {
+        TEEIO_PRINT(("-f parameter is missing.\n"));
+        print_usage();
+        return -1;
+    }
+
+    FILE *fp = fopen(m_result_file, "r");
+    if (fp == NULL)
+    {
+        TEEIO_PRINT(("Failed to open %s.\n", m_result_file));
+        return -1;
+    }
+
+    record = (char *)malloc(RESULT_SUM_MAX_RECORD_LENGTH);
+    if (record == NULL)
+    {
+        goto Done;
+    }
+
+    while (fgets(record, RESULT_SUM_MAX_RECORD_LENGTH, fp) != NULL)
+    {
+        size_t len = strlen(record);
+        // the last line of a crashed run may be cut
+        if (len == 0 || record[len - 1] != '\n')
+        {
+            sum.partial_lines++;
+            // skip the rest of a line which is longer than the buffer
+            while (len == RESULT_SUM_MAX_RECORD_LENGTH - 1 && fgets(record, RESULT_SUM_MAX_RECORD_LENGTH, fp) != NULL)
+            {
+                len = strlen(record);
+                if (record[len - 1] == '\n')
+                {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        if (!add_record(&sum, record))
+        {
+            sum.invalid_lines++;
+        }
+    }
+
+    print_result_sum(&sum);
+    ret = 0;
+
+Done:
+    free_node(&sum.root);
+    free(record);
+    fclose(fp);
+
+    return ret;
+}
@@ -31,6 +31,7 @@ pci_tdisp_interface_id_t g_tdisp_interface_id = {0};
 TEEIO_DEBUG_LEVEL g_debug_level = TEEIO_DEBUG_WARN;
 bool g_libspdm_log = false;
 bool g_doe_log = false;
+bool g_kcbar_verify = false;
 uint16_t g_scan_segment = INVALID_SCAN_SEGMENT;
 uint8_t g_scan_bus = INVALID_SCAN_BUS;
 FILE* m_logfile = NULL;
@@ -143,7 +144,7 @@ bool clear_ft_supported_in_ide_ctrl(IDE_PORT* port)
     ret = true;
 
 ClearFtSupportedFailed:
-    close(fd);
+    close_configuration_space(fd);
 
     return ret;
 }